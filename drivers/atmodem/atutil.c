@@ -31,6 +31,7 @@
 #define OFONO_API_SUBJECT_TO_CHANGE
 #include <ofono/log.h>
 #include <ofono/types.h>
+#include <ofono/modem.h>
 
 #include "atutil.h"
 #include "vendor.h"
@@ -614,3 +615,53 @@ void at_util_sim_state_query_free(struct at_util_sim_state_query *req)
 
 	g_free(req);
 }
+
+/*
+ * Reduces a command to its name so that all invocations of a command
+ * share a histogram: "AT+CGDCONT=1,..." becomes "AT+CGDCONT" and basic
+ * commands such as "ATD123;" become "ATD".
+ */
+static void latency_key(const char *cmd, char *key, size_t size)
+{
+	size_t len, i;
+
+	if (g_ascii_strncasecmp(cmd, "AT", 2) != 0) {
+		g_strlcpy(key, "other", size);
+		return;
+	}
+
+	len = 2;
+
+	if (cmd[2] != '\0' && strchr("+%^$*#&", cmd[2])) {
+		len += 1;
+
+		while (g_ascii_isalnum(cmd[len]))
+			len += 1;
+	} else if (g_ascii_isalpha(cmd[2]))
+		len += 1;
+
+	len = MIN(len, size - 1);
+
+	for (i = 0; i < len; i++)
+		key[i] = g_ascii_toupper(cmd[i]);
+
+	key[len] = '\0';
+}
+
+static void at_util_latency_cb(const char *cmd, gboolean ok, guint usec,
+				gpointer user_data)
+{
+	struct ofono_modem *modem = user_data;
+	char key[32];
+
+	latency_key(cmd, key, sizeof(key));
+
+	ofono_modem_record_latency(modem, key, usec,
+					ok ? OFONO_LATENCY_RESULT_OK :
+						OFONO_LATENCY_RESULT_ERROR);
+}
+
+void at_util_record_latency(GAtChat *chat, struct ofono_modem *modem)
+{
+	g_at_chat_set_latency_function(chat, at_util_latency_cb, modem);
+}
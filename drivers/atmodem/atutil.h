@@ -83,6 +83,10 @@ struct at_util_sim_state_query *at_util_sim_state_query_new(GAtChat *chat,
 						GDestroyNotify destroy);
 void at_util_sim_state_query_free(struct at_util_sim_state_query *req);
 
+struct ofono_modem;
+
+void at_util_record_latency(GAtChat *chat, struct ofono_modem *modem);
+
 struct cb_data {
 	void *cb;
 	void *data;
@@ -41,7 +41,7 @@ void g_mtk_request_dual_sim_mode_switch(GRil *gril,
 					int mode,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, mode);
 
@@ -52,7 +52,7 @@ void g_mtk_request_set_gprs_connect_type(GRil *gril,
 						int always,
 						struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, always);
 
@@ -63,7 +63,7 @@ void g_mtk_request_set_gprs_transfer_type(GRil *gril,
 						int callprefer,
 						struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, callprefer);
 
@@ -73,7 +73,7 @@ void g_mtk_request_set_gprs_transfer_type(GRil *gril,
 void g_mtk_request_set_call_indication(GRil *gril, int mode, int call_id,
 					int seq_number, struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 3);
 	/* What the parameters set is unknown */
 	parcel_w_int32(rilp, mode);
@@ -104,7 +104,7 @@ void g_mtk_request_set_fd_mode(GRil *gril, int mode, int param1,
 		return;
 	}
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, num_args);
 	parcel_w_int32(rilp, mode);
 
@@ -127,7 +127,7 @@ void g_mtk_request_set_3g_capability(GRil *gril, struct parcel *rilp)
 {
 	int mode = g_ril_get_slot(gril) + 1;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, mode);
 
@@ -136,7 +136,7 @@ void g_mtk_request_set_3g_capability(GRil *gril, struct parcel *rilp)
 
 void g_mtk_request_store_modem_type(GRil *gril, int mode, struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, mode);
 
@@ -145,7 +145,7 @@ void g_mtk_request_store_modem_type(GRil *gril, int mode, struct parcel *rilp)
 
 void g_mtk_request_set_trm(GRil *gril, int trm, struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, trm);
 
@@ -155,7 +155,7 @@ void g_mtk_request_set_trm(GRil *gril, int trm, struct parcel *rilp)
 void g_mtk_request_resume_registration(GRil *gril, int session_id,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, session_id);
 
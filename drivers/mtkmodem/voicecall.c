@@ -117,6 +117,10 @@ static int mtk_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 
 	ril_voicecall_start(driver_data, vc, vendor, vd);
 
+	/* Has to reach rild before the ANSWER for the incoming call */
+	g_ril_set_request_lane(vd->ril, MTK_RIL_REQUEST_SET_CALL_INDICATION,
+					G_RIL_LANE_CALL_CONTROL);
+
 	/*
 	 * Register events after ofono_voicecall_register() is called from
 	 * ril_delayed_register().
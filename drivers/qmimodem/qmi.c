@@ -26,6 +26,7 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -47,8 +48,11 @@ struct qmi_device {
 	guint read_watch;
 	guint write_watch;
 	GQueue *req_queue;
-	GQueue *control_queue;
-	GQueue *service_queue;
+	GHashTable *control_pending;
+	GHashTable *service_pending;
+	GList *discover_list;
+	uint8_t discover_tid;
+	GList *create_list;
 	uint8_t next_control_tid;
 	uint16_t next_service_tid;
 	qmi_debug_func_t debug_func;
@@ -72,6 +76,8 @@ struct qmi_service {
 	uint8_t client_id;
 	uint16_t next_notify_id;
 	GList *notify_list;
+	unsigned int in_flight;
+	unsigned int max_in_flight;
 };
 
 struct qmi_param {
@@ -85,15 +91,21 @@ struct qmi_result {
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	bool indexed;
+	uint32_t tlv_present[8];
+	uint16_t tlv_offset[256];
 };
 
 struct qmi_request {
 	uint16_t tid;
+	uint8_t service;
 	uint8_t client;
 	void *buf;
 	size_t len;
 	qmi_message_func_t callback;
 	void *user_data;
+	struct qmi_device *device;
+	guint timeout;
 };
 
 struct qmi_notify {
@@ -166,6 +178,7 @@ static struct qmi_request *__request_alloc(uint8_t service,
 		return NULL;
 	}
 
+	req->service = service;
 	req->client = client;
 
 	hdr = req->buf;
@@ -197,10 +210,18 @@ static void __request_free(gpointer data, gpointer user_data)
 {
 	struct qmi_request *req = data;
 
+	if (req->timeout > 0)
+		g_source_remove(req->timeout);
+
 	g_free(req->buf);
 	g_free(req);
 }
 
+static void __request_destroy(gpointer data)
+{
+	__request_free(data, NULL);
+}
+
 static gint __request_compare(gconstpointer a, gconstpointer b)
 {
 	const struct qmi_request *req = a;
@@ -590,40 +611,109 @@ static void __debug_device(struct qmi_device *device,
 	device->debug_func(strbuf, device->debug_data);
 }
 
+/* Seconds to wait for a response, long enough for a network scan */
+#define QMI_SERVICE_REQUEST_TIMEOUT 180
+
+static gboolean service_request_timeout(gpointer user_data);
+
+static struct qmi_service *service_lookup(struct qmi_device *device,
+						uint8_t type, uint8_t client)
+{
+	unsigned int hash_id = type | (client << 8);
+
+	return g_hash_table_lookup(device->service_list,
+					GUINT_TO_POINTER(hash_id));
+}
+
+/*
+ * Pick the oldest queued request whose client still has room for
+ * another request in flight.  Requests of a client that is at its
+ * limit are skipped as a whole, so per client ordering is kept.
+ */
+static struct qmi_request *next_request(struct qmi_device *device)
+{
+	struct qmi_request *req;
+	GList *list;
+
+	for (list = device->req_queue->head; list; list = list->next) {
+		struct qmi_service *service;
+
+		req = list->data;
+
+		if (req->service == QMI_SERVICE_CONTROL)
+			break;
+
+		service = service_lookup(device, req->service, req->client);
+		if (!service)
+			break;
+
+		if (!service->max_in_flight ||
+				service->in_flight < service->max_in_flight) {
+			service->in_flight++;
+			break;
+		}
+	}
+
+	if (!list)
+		return NULL;
+
+	req = list->data;
+
+	g_queue_delete_link(device->req_queue, list);
+
+	return req;
+}
+
+static void request_done(struct qmi_device *device, struct qmi_request *req)
+{
+	struct qmi_service *service;
+
+	if (req->service == QMI_SERVICE_CONTROL)
+		return;
+
+	service = service_lookup(device, req->service, req->client);
+	if (service && service->in_flight > 0)
+		service->in_flight--;
+}
+
 static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
 	struct qmi_device *device = user_data;
-	struct qmi_mux_hdr *hdr;
 	struct qmi_request *req;
 	ssize_t bytes_written;
 
-	req = g_queue_pop_head(device->req_queue);
-	if (!req)
-		return FALSE;
+	while ((req = next_request(device))) {
+		bytes_written = write(device->fd, req->buf, req->len);
+		if (bytes_written < 0) {
+			request_done(device, req);
+			g_queue_push_head(device->req_queue, req);
 
-	bytes_written = write(device->fd, req->buf, req->len);
-	if (bytes_written < 0)
-		return FALSE;
+			return errno == EAGAIN;
+		}
 
-	__hexdump('>', req->buf, bytes_written,
+		__hexdump('>', req->buf, bytes_written,
 				device->debug_func, device->debug_data);
 
-	__debug_msg(' ', req->buf, bytes_written,
+		__debug_msg(' ', req->buf, bytes_written,
 				device->debug_func, device->debug_data);
 
-	hdr = req->buf;
-
-	if (hdr->service == QMI_SERVICE_CONTROL)
-		g_queue_push_tail(device->control_queue, req);
-	else
-		g_queue_push_tail(device->service_queue, req);
+		if (req->service == QMI_SERVICE_CONTROL) {
+			g_hash_table_insert(device->control_pending,
+					GUINT_TO_POINTER(req->tid), req);
+		} else {
+			g_hash_table_insert(device->service_pending,
+					GUINT_TO_POINTER(req->tid), req);
 
-	g_free(req->buf);
-	req->buf = NULL;
+			req->device = device;
+			req->timeout = g_timeout_add_seconds(
+						QMI_SERVICE_REQUEST_TIMEOUT,
+						service_request_timeout, req);
+		}
 
-	if (g_queue_get_length(device->req_queue) > 0)
-		return TRUE;
+		g_free(req->buf);
+		req->buf = NULL;
+	}
 
 	return FALSE;
 }
@@ -655,6 +745,133 @@ static void __request_submit(struct qmi_device *device,
 	wakeup_writer(device);
 }
 
+static void request_finish(struct qmi_device *device, struct qmi_request *req)
+{
+	request_done(device, req);
+
+	if (g_queue_get_length(device->req_queue) > 0)
+		wakeup_writer(device);
+}
+
+/*
+ * Take a request out of the device, whether it is still queued for
+ * writing or already waiting for its response.
+ */
+static struct qmi_request *__request_remove(struct qmi_device *device,
+					GHashTable *pending, uint16_t tid)
+{
+	unsigned int key = tid;
+	struct qmi_request *req;
+	GList *list;
+
+	list = g_queue_find_custom(device->req_queue,
+				GUINT_TO_POINTER(key), __request_compare);
+	if (list) {
+		req = list->data;
+
+		g_queue_delete_link(device->req_queue, list);
+
+		return req;
+	}
+
+	req = g_hash_table_lookup(pending, GUINT_TO_POINTER(key));
+	if (!req)
+		return NULL;
+
+	g_hash_table_steal(pending, GUINT_TO_POINTER(key));
+
+	request_finish(device, req);
+
+	return req;
+}
+
+/*
+ * A response that never arrives would keep its slot of the client in
+ * flight forever, so the request is failed and its slot handed to the
+ * next queued request.  A late response finds no request anymore and is
+ * dropped.
+ */
+static gboolean service_request_timeout(gpointer user_data)
+{
+	struct qmi_request *req = user_data;
+	struct qmi_device *device = req->device;
+
+	req->timeout = 0;
+
+	__debug_device(device, "request %d timed out", req->tid);
+
+	__request_remove(device, device->service_pending, req->tid);
+
+	if (req->callback)
+		req->callback(0, 0, NULL, req->user_data);
+
+	__request_free(req, NULL);
+
+	return FALSE;
+}
+
+static void result_init(struct qmi_result *result, uint16_t message,
+					const void *data, uint16_t length)
+{
+	result->message = message;
+	result->result = 0;
+	result->error = 0;
+	result->data = data;
+	result->length = length;
+	result->indexed = false;
+}
+
+/*
+ * Walk the TLV list once and remember where each type starts, so that
+ * the qmi_result_get family does not rescan the message per lookup.
+ * Every TLV length is checked against the message size here; anything
+ * from the first truncated TLV onwards is ignored.  If a type repeats,
+ * the first occurrence wins like it did with a linear scan.
+ */
+static void result_index(struct qmi_result *result)
+{
+	uint16_t offset = 0;
+
+	memset(result->tlv_present, 0, sizeof(result->tlv_present));
+	result->indexed = true;
+
+	while (result->length - offset >= QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv = result->data + offset;
+		uint16_t tlv_length = GUINT16_FROM_LE(tlv->length);
+		uint32_t *word = &result->tlv_present[tlv->type / 32];
+		uint32_t bit = 1U << (tlv->type % 32);
+
+		if (tlv_length > result->length - offset - QMI_TLV_HDR_SIZE)
+			break;
+
+		if (!(*word & bit)) {
+			*word |= bit;
+			result->tlv_offset[tlv->type] = offset;
+		}
+
+		offset += QMI_TLV_HDR_SIZE + tlv_length;
+	}
+}
+
+static const void *result_tlv_get(struct qmi_result *result, uint8_t type,
+							uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+
+	if (!result->indexed)
+		result_index(result);
+
+	if (!(result->tlv_present[type / 32] & (1U << (type % 32))))
+		return NULL;
+
+	tlv = result->data + result->tlv_offset[type];
+
+	if (length)
+		*length = GUINT16_FROM_LE(tlv->length);
+
+	return tlv->value;
+}
+
 static void service_notify(gpointer key, gpointer value, gpointer user_data)
 {
 	struct qmi_service *service = value;
@@ -681,11 +898,7 @@ static void handle_indication(struct qmi_device *device,
 	if (service_type == QMI_SERVICE_CONTROL)
 		return;
 
-	result.result = 0;
-	result.error = 0;
-	result.message = message;
-	result.data = data;
-	result.length = length;
+	result_init(&result, message, data, length);
 
 	if (client_id == 0xff) {
 		g_hash_table_foreach(device->service_list,
@@ -714,7 +927,6 @@ static void handle_packet(struct qmi_device *device,
 		const struct qmi_control_hdr *control = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		/* Ignore control messages with client identifier */
 		if (hdr->client != 0x00)
@@ -735,19 +947,17 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->control_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = g_hash_table_lookup(device->control_pending,
+						GUINT_TO_POINTER(tid));
+		if (!req)
 			return;
 
-		req = list->data;
-
-		g_queue_delete_link(device->control_queue, list);
+		g_hash_table_steal(device->control_pending,
+						GUINT_TO_POINTER(tid));
 	} else {
 		const struct qmi_service_hdr *service = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		msg = buf + QMI_SERVICE_HDR_SIZE;
 
@@ -764,14 +974,15 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = g_hash_table_lookup(device->service_pending,
+						GUINT_TO_POINTER(tid));
+		if (!req)
 			return;
 
-		req = list->data;
+		g_hash_table_steal(device->service_pending,
+						GUINT_TO_POINTER(tid));
 
-		g_queue_delete_link(device->service_queue, list);
+		request_finish(device, req);
 	}
 
 	if (req->callback)
@@ -848,6 +1059,73 @@ static void service_destroy(gpointer data)
 	service->device = NULL;
 }
 
+struct discover_data {
+	struct qmi_device *device;
+	qmi_discover_func_t func;
+	void *user_data;
+	qmi_destroy_func_t destroy;
+	guint timeout;
+};
+
+static void discover_data_free(gpointer user_data)
+{
+	struct discover_data *data = user_data;
+
+	if (data->timeout > 0)
+		g_source_remove(data->timeout);
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	g_free(data);
+}
+
+struct service_create_shared_data {
+	struct qmi_service *service;
+	qmi_create_func_t func;
+	void *user_data;
+	qmi_destroy_func_t destroy;
+};
+
+struct service_create_data {
+	struct qmi_device *device;
+	bool shared;
+	uint8_t type;
+	uint16_t major;
+	uint16_t minor;
+	qmi_create_func_t func;
+	void *user_data;
+	qmi_destroy_func_t destroy;
+	guint timeout;
+	uint8_t tid;
+	GList *waiters;
+};
+
+static void service_create_waiter_free(gpointer user_data)
+{
+	struct service_create_shared_data *waiter = user_data;
+
+	if (waiter->destroy)
+		waiter->destroy(waiter->user_data);
+
+	g_free(waiter);
+}
+
+static void service_create_data_free(gpointer user_data)
+{
+	struct service_create_data *data = user_data;
+
+	if (data->timeout > 0)
+		g_source_remove(data->timeout);
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	g_list_free_full(data->waiters, service_create_waiter_free);
+
+	g_free(data);
+}
+
 struct qmi_device *qmi_device_new(int fd)
 {
 	struct qmi_device *device;
@@ -889,8 +1167,11 @@ struct qmi_device *qmi_device_new(int fd)
 	g_io_channel_unref(device->io);
 
 	device->req_queue = g_queue_new();
-	device->control_queue = g_queue_new();
-	device->service_queue = g_queue_new();
+
+	device->control_pending = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, __request_destroy);
+	device->service_pending = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, __request_destroy);
 
 	device->service_list = g_hash_table_new_full(g_direct_hash,
 					g_direct_equal, NULL, service_destroy);
@@ -918,11 +1199,11 @@ void qmi_device_unref(struct qmi_device *device)
 
 	__debug_device(device, "device %p free", device);
 
-	g_queue_foreach(device->control_queue, __request_free, NULL);
-	g_queue_free(device->control_queue);
+	g_list_free_full(device->discover_list, discover_data_free);
+	g_list_free_full(device->create_list, service_create_data_free);
 
-	g_queue_foreach(device->service_queue, __request_free, NULL);
-	g_queue_free(device->service_queue);
+	g_hash_table_destroy(device->control_pending);
+	g_hash_table_destroy(device->service_pending);
 
 	g_queue_foreach(device->req_queue, __request_free, NULL);
 	g_queue_free(device->req_queue);
@@ -972,6 +1253,9 @@ static const void *tlv_get(const void *data, uint16_t size,
 		const struct qmi_tlv_hdr *tlv = ptr;
 		uint16_t tlv_length = GUINT16_FROM_LE(tlv->length);
 
+		if (tlv_length > len - QMI_TLV_HDR_SIZE)
+			break;
+
 		if (tlv->type == type) {
 			if (length)
 				*length = tlv_length;
@@ -986,19 +1270,10 @@ static const void *tlv_get(const void *data, uint16_t size,
 	return NULL;
 }
 
-struct discover_data {
-	struct qmi_device *device;
-	qmi_discover_func_t func;
-	void *user_data;
-	qmi_destroy_func_t destroy;
-	guint timeout;
-};
-
 static void discover_callback(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data)
 {
-	struct discover_data *data = user_data;
-	struct qmi_device *device = data->device;
+	struct qmi_device *device = user_data;
 	const struct qmi_result_code *result_code;
 	const struct qmi_service_list *service_list;
 	const void *ptr;
@@ -1006,8 +1281,9 @@ static void discover_callback(uint16_t message, uint16_t length,
 	struct qmi_version *list;
 	uint8_t count;
 	unsigned int i;
+	GList *waiters, *l;
 
-	g_source_remove(data->timeout);
+	device->discover_tid = 0;
 
 	count = 0;
 	list = NULL;
@@ -1063,6 +1339,7 @@ static void discover_callback(uint16_t message, uint16_t length,
 	if (!ptr)
 		goto done;
 
+	g_free(device->version_str);
 	device->version_str = strndup(ptr + 1, *((uint8_t *) ptr));
 
 	service_list = ptr + *((uint8_t *) ptr) + 1;
@@ -1073,33 +1350,59 @@ static void discover_callback(uint16_t message, uint16_t length,
 	}
 
 done:
+	g_free(device->version_list);
 	device->version_list = list;
 	device->version_count = count;
 
-	if (data->func)
-		data->func(count, list, data->user_data);
+	/*
+	 * Everybody who asked while the request was outstanding shares
+	 * this one answer.  Callers may discover again from their
+	 * callback, so detach the list first.
+	 */
+	waiters = device->discover_list;
+	device->discover_list = NULL;
 
-	if (data->destroy)
-		data->destroy(data->user_data);
+	qmi_device_ref(device);
 
-	g_free(data);
+	for (l = waiters; l; l = l->next) {
+		struct discover_data *data = l->data;
+
+		if (data->func)
+			data->func(count, list, data->user_data);
+
+		discover_data_free(data);
+	}
+
+	g_list_free(waiters);
+
+	qmi_device_unref(device);
 }
 
 static gboolean discover_reply(gpointer user_data)
 {
 	struct discover_data *data = user_data;
 	struct qmi_device *device = data->device;
+	struct qmi_request *req;
 
 	data->timeout = 0;
 
+	device->discover_list = g_list_remove(device->discover_list, data);
+
+	/* Nobody waits for the answer anymore, let the next one retry */
+	if (!device->discover_list && device->discover_tid) {
+		req = __request_remove(device, device->control_pending,
+							device->discover_tid);
+		if (req)
+			__request_free(req, NULL);
+
+		device->discover_tid = 0;
+	}
+
 	if (data->func)
 		data->func(device->version_count,
 				device->version_list, data->user_data);
 
-	if (data->destroy)
-		data->destroy(data->user_data);
-
-	g_free(data);
+	discover_data_free(data);
 
 	return FALSE;
 }
@@ -1126,13 +1429,17 @@ bool qmi_device_discover(struct qmi_device *device, qmi_discover_func_t func,
 	data->destroy = destroy;
 
 	if (device->version_list) {
-		g_timeout_add_seconds(0, discover_reply, data);
-		return true;
+		data->timeout = g_timeout_add_seconds(0, discover_reply, data);
+		goto done;
 	}
 
+	/* Piggyback on a discovery that is already on its way */
+	if (device->discover_tid)
+		goto wait;
+
 	req = __request_alloc(QMI_SERVICE_CONTROL, 0x00,
 			QMI_CTL_GET_VERSION_INFO, QMI_CONTROL_HDR_SIZE,
-			NULL, 0, discover_callback, data, (void **) &hdr);
+			NULL, 0, discover_callback, device, (void **) &hdr);
 	if (!req) {
 		g_free(data);
 		return false;
@@ -1146,8 +1453,14 @@ bool qmi_device_discover(struct qmi_device *device, qmi_discover_func_t func,
 
 	__request_submit(device, req, hdr->transaction);
 
+	device->discover_tid = hdr->transaction;
+
+wait:
 	data->timeout = g_timeout_add_seconds(5, discover_reply, data);
 
+done:
+	device->discover_list = g_list_append(device->discover_list, data);
+
 	return true;
 }
 
@@ -1398,7 +1711,7 @@ const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -1409,7 +1722,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -1425,8 +1738,8 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
-	if (!ptr)
+	ptr = result_tlv_get(result, type, &len);
+	if (!ptr || len < 1)
 		return false;
 
 	if (value)
@@ -1444,8 +1757,8 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
-	if (!ptr)
+	ptr = result_tlv_get(result, type, &len);
+	if (!ptr || len < 2)
 		return false;
 
 	memcpy(&tmp, ptr, 2);
@@ -1466,8 +1779,8 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
-	if (!ptr)
+	ptr = result_tlv_get(result, type, &len);
+	if (!ptr || len < 4)
 		return false;
 
 	memcpy(&tmp, ptr, 4);
@@ -1488,8 +1801,8 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
-	if (!ptr)
+	ptr = result_tlv_get(result, type, &len);
+	if (!ptr || len < 8)
 		return false;
 
 	memcpy(&tmp, ptr, 8);
@@ -1500,28 +1813,44 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	return true;
 }
 
-struct service_create_data {
-	struct qmi_device *device;
-	bool shared;
-	uint8_t type;
-	uint16_t major;
-	uint16_t minor;
-	qmi_create_func_t func;
-	void *user_data;
-	qmi_destroy_func_t destroy;
-	guint timeout;
-};
+#define QMI_SERVICE_MAX_IN_FLIGHT 4
+
+static void service_create_finish(struct service_create_data *data,
+						struct qmi_service *service)
+{
+	struct qmi_device *device = data->device;
+	GList *list;
+
+	device->create_list = g_list_remove(device->create_list, data);
+
+	data->func(service, data->user_data);
+
+	for (list = data->waiters; list; list = list->next) {
+		struct service_create_shared_data *waiter = list->data;
+
+		waiter->func(service, waiter->user_data);
+	}
+
+	service_create_data_free(data);
+}
 
 static gboolean service_create_reply(gpointer user_data)
 {
 	struct service_create_data *data = user_data;
+	struct qmi_device *device = data->device;
+	struct qmi_request *req;
 
-	data->func(NULL, data->user_data);
+	data->timeout = 0;
 
-	if (data->destroy)
-		data->destroy(data->user_data);
+	/* Make sure a late client identifier does not find us anymore */
+	if (data->tid) {
+		req = __request_remove(device, device->control_pending,
+								data->tid);
+		if (req)
+			__request_free(req, NULL);
+	}
 
-	g_free(data);
+	service_create_finish(data, NULL);
 
 	return FALSE;
 }
@@ -1537,7 +1866,7 @@ static void service_create_callback(uint16_t message, uint16_t length,
 	uint16_t len;
 	unsigned int hash_id;
 
-	g_source_remove(data->timeout);
+	data->tid = 0;
 
 	result_code = tlv_get(buffer, length, 0x02, &len);
 	if (!result_code)
@@ -1570,6 +1899,8 @@ static void service_create_callback(uint16_t message, uint16_t length,
 
 	service->client_id = client_id->client;
 
+	service->max_in_flight = QMI_SERVICE_MAX_IN_FLIGHT;
+
 	__debug_device(device, "service created [client=%d,type=%d]",
 					service->client_id, service->type);
 
@@ -1579,14 +1910,9 @@ static void service_create_callback(uint16_t message, uint16_t length,
 				GUINT_TO_POINTER(hash_id), service);
 
 done:
-	data->func(service, data->user_data);
+	service_create_finish(data, service);
 
 	qmi_service_unref(service);
-
-	if (data->destroy)
-		data->destroy(data->user_data);
-
-	g_free(data);
 }
 
 static void service_create_discover(uint8_t count,
@@ -1617,7 +1943,8 @@ static void service_create_discover(uint8_t count,
 		if (data->timeout > 0)
 			g_source_remove(data->timeout);
 
-		g_timeout_add_seconds(0, service_create_reply, data);
+		data->timeout = g_timeout_add_seconds(0, service_create_reply,
+									data);
 		return;
 	}
 
@@ -1628,6 +1955,8 @@ static void service_create_discover(uint8_t count,
 	hdr->transaction = device->next_control_tid++;
 
 	__request_submit(device, req, hdr->transaction);
+
+	data->tid = hdr->transaction;
 }
 
 static bool service_create(struct qmi_device *device, bool shared,
@@ -1647,23 +1976,30 @@ static bool service_create(struct qmi_device *device, bool shared,
 	data->user_data = user_data;
 	data->destroy = destroy;
 
+	/*
+	 * Client identifiers are allocated in parallel: every create goes
+	 * out as soon as the version information is known, and creates
+	 * issued before that share a single discovery.
+	 */
+	device->create_list = g_list_append(device->create_list, data);
+
+	data->timeout = g_timeout_add_seconds(8, service_create_reply, data);
+
 	if (device->version_list) {
 		service_create_discover(device->version_count,
 						device->version_list, data);
-		goto done;
+		return true;
 	}
 
 	if (qmi_device_discover(device, service_create_discover, data, NULL))
-		goto done;
+		return true;
+
+	device->create_list = g_list_remove(device->create_list, data);
 
+	g_source_remove(data->timeout);
 	g_free(data);
 
 	return false;
-
-done:
-	data->timeout = g_timeout_add_seconds(8, service_create_reply, data);
-
-	return true;
 }
 
 bool qmi_service_create(struct qmi_device *device,
@@ -1679,12 +2015,16 @@ bool qmi_service_create(struct qmi_device *device,
 	return service_create(device, false, type, func, user_data, destroy);
 }
 
-struct service_create_shared_data {
-	struct qmi_service *service;
-	qmi_create_func_t func;
-	void *user_data;
-	qmi_destroy_func_t destroy;
-};
+static gint __create_compare_shared(gconstpointer a, gconstpointer b)
+{
+	const struct service_create_data *data = a;
+	uint8_t type = GPOINTER_TO_UINT(b);
+
+	if (data->shared && data->type == type)
+		return 0;
+
+	return 1;
+}
 
 static gboolean service_create_shared_reply(gpointer user_data)
 {
@@ -1708,6 +2048,7 @@ bool qmi_service_create_shared(struct qmi_device *device,
 {
 	struct qmi_service *service;
 	unsigned int type_val = type;
+	GList *list;
 
 	if (!device || !func)
 		return false;
@@ -1732,7 +2073,27 @@ bool qmi_service_create_shared(struct qmi_device *device,
 
 		g_timeout_add(0, service_create_shared_reply, data);
 
-		return 0;
+		return true;
+	}
+
+	/* Wait for a shared client that is being allocated already */
+	list = g_list_find_custom(device->create_list,
+			GUINT_TO_POINTER(type_val), __create_compare_shared);
+	if (list) {
+		struct service_create_data *create = list->data;
+		struct service_create_shared_data *waiter;
+
+		waiter = g_try_new0(struct service_create_shared_data, 1);
+		if (!waiter)
+			return false;
+
+		waiter->func = func;
+		waiter->user_data = user_data;
+		waiter->destroy = destroy;
+
+		create->waiters = g_list_append(create->waiters, waiter);
+
+		return true;
 	}
 
 	return service_create(device, true, type, func, user_data, destroy);
@@ -1811,6 +2172,21 @@ bool qmi_service_get_version(struct qmi_service *service,
 	return true;
 }
 
+bool qmi_service_set_max_in_flight(struct qmi_service *service,
+							unsigned int max)
+{
+	if (!service)
+		return false;
+
+	service->max_in_flight = max;
+
+	if (service->device &&
+			g_queue_get_length(service->device->req_queue) > 0)
+		wakeup_writer(service->device);
+
+	return true;
+}
+
 struct service_send_data {
 	struct qmi_service *service;
 	struct qmi_param *param;
@@ -1837,11 +2213,18 @@ static void service_send_callback(uint16_t message, uint16_t length,
 	uint16_t len;
 	struct qmi_result result;
 
-	result.message = message;
-	result.data = buffer;
-	result.length = length;
+	/* No response in time, report it like a missing result */
+	if (!buffer) {
+		if (data->func)
+			data->func(NULL, data->user_data);
 
-	result_code = tlv_get(buffer, length, 0x02, &len);
+		service_send_free(data);
+		return;
+	}
+
+	result_init(&result, message, buffer, length);
+
+	result_code = result_tlv_get(&result, 0x02, &len);
 	if (!result_code)
 		goto done;
 
@@ -1911,12 +2294,10 @@ uint16_t qmi_service_send(struct qmi_service *service,
 
 bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 {
-	unsigned int tid = id;
 	struct qmi_device *device;
 	struct qmi_request *req;
-	GList *list;
 
-	if (!service || !tid)
+	if (!service || !id)
 		return false;
 
 	if (!service->client_id)
@@ -1926,22 +2307,9 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	if (!device)
 		return false;
 
-	list = g_queue_find_custom(device->req_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-	if (list) {
-		req = list->data;
-
-		g_queue_delete_link(device->req_queue, list);
-	} else {
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
-			return false;
-
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
-	}
+	req = __request_remove(device, device->service_pending, id);
+	if (!req)
+		return false;
 
 	service_send_free(req->user_data);
 
@@ -1950,7 +2318,7 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	return true;
 }
 
-static GQueue *remove_client(GQueue *queue, uint8_t client)
+static GQueue *remove_client(GQueue *queue, uint8_t type, uint8_t client)
 {
 	GQueue *new_queue;
 	GList *list;
@@ -1966,7 +2334,7 @@ static GQueue *remove_client(GQueue *queue, uint8_t client)
 
 		req = list->data;
 
-		if (!req->client || req->client != client) {
+		if (req->service != type || req->client != client) {
 			g_queue_push_tail_link(new_queue, list);
 			continue;
 		}
@@ -1974,6 +2342,8 @@ static GQueue *remove_client(GQueue *queue, uint8_t client)
 		service_send_free(req->user_data);
 
 		__request_free(req, NULL);
+
+		g_list_free_1(list);
 	}
 
 	g_queue_free(queue);
@@ -1981,6 +2351,23 @@ static GQueue *remove_client(GQueue *queue, uint8_t client)
 	return new_queue;
 }
 
+static gboolean remove_pending_client(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	struct qmi_request *req = value;
+	struct qmi_service *service = user_data;
+
+	if (req->service != service->type ||
+				req->client != service->client_id)
+		return FALSE;
+
+	service_send_free(req->user_data);
+
+	__request_free(req, NULL);
+
+	return TRUE;
+}
+
 bool qmi_service_cancel_all(struct qmi_service *service)
 {
 	struct qmi_device *device;
@@ -1996,10 +2383,12 @@ bool qmi_service_cancel_all(struct qmi_service *service)
 		return false;
 
 	device->req_queue = remove_client(device->req_queue,
-						service->client_id);
+					service->type, service->client_id);
+
+	g_hash_table_foreach_steal(device->service_pending,
+					remove_pending_client, service);
 
-	device->service_queue = remove_client(device->service_queue,
-							service->client_id);
+	service->in_flight = 0;
 
 	return true;
 }
@@ -139,6 +139,8 @@ void qmi_service_unref(struct qmi_service *service);
 const char *qmi_service_get_identifier(struct qmi_service *service);
 bool qmi_service_get_version(struct qmi_service *service,
 					uint16_t *major, uint16_t *minor);
+bool qmi_service_set_max_in_flight(struct qmi_service *service,
+							unsigned int max);
 
 uint16_t qmi_service_send(struct qmi_service *service,
 				uint16_t message, struct qmi_param *param,
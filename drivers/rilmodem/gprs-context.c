@@ -97,18 +97,19 @@ static void disconnect_context(struct ofono_gprs_context *gc)
 	ril_gprs_context_deactivate_primary(gc, 0, NULL, NULL);
 }
 
+/* The call list is decoded once and shared by all contexts */
 static void ril_gprs_context_call_list_changed(struct ril_msg *message,
+						gconstpointer data,
 						gpointer user_data)
 {
 	struct ofono_gprs_context *gc = user_data;
 	struct gprs_context_data *gcd = ofono_gprs_context_get_data(gc);
+	const struct ril_data_call_list *call_list = data;
 	struct ril_data_call *call = NULL;
-	struct ril_data_call_list *call_list;
 	gboolean active_cid_found = FALSE;
 	gboolean disconnect = FALSE;
 	GSList *iterator = NULL;
 
-	call_list = g_ril_unsol_parse_data_call_list(gcd->ril, message);
 	if (call_list == NULL)
 		return;
 
@@ -140,8 +141,6 @@ static void ril_gprs_context_call_list_changed(struct ril_msg *message,
 		ofono_gprs_context_deactivated(gc, gcd->active_ctx_cid);
 		set_context_disconnected(gcd);
 	}
-
-	g_ril_unsol_free_data_call_list(call_list);
 }
 
 static void ril_setup_data_call_cb(struct ril_msg *message, gpointer user_data)
@@ -219,9 +218,11 @@ static void ril_setup_data_call_cb(struct ril_msg *message, gpointer user_data)
 
 	/* activate listener for data call changed events.... */
 	gcd->call_list_id =
-		g_ril_register(gcd->ril,
-				RIL_UNSOL_DATA_CALL_LIST_CHANGED,
-				ril_gprs_context_call_list_changed, gc);
+		g_ril_register_decoded(gcd->ril,
+			RIL_UNSOL_DATA_CALL_LIST_CHANGED,
+			(GRilUnsolDecodeFunc) g_ril_unsol_parse_data_call_list,
+			(GDestroyNotify) g_ril_unsol_free_data_call_list,
+			ril_gprs_context_call_list_changed, gc);
 
 	CALLBACK_WITH_SUCCESS(cb, cbd->data);
 	return;
@@ -176,7 +176,7 @@ static void send_allow_data(struct cb_data *cbd, GRil *ril, int attached)
 	struct parcel rilp;
 
 	/* ALLOW_DATA payload: int[] with attach value */
-	parcel_init(&rilp);
+	g_ril_init_request_parcel(ril, &rilp, 0);
 	parcel_w_int32(&rilp, 1);
 	parcel_w_int32(&rilp, attached);
 
@@ -47,6 +47,9 @@
 #include "grilrequest.h"
 #include "grilunsol.h"
 
+/* Milliseconds after which a network scan is given up */
+#define NETWORK_SCAN_TIMEOUT 180000
+
 struct netreg_data {
 	GRil *ril;
 	char mcc[OFONO_MAX_MCC_LENGTH + 1];
@@ -345,8 +348,10 @@ static void ril_list_operators(struct ofono_netreg *netreg,
 	struct netreg_data *nd = ofono_netreg_get_data(netreg);
 	struct cb_data *cbd = cb_data_new(cb, data, nd);
 
-	if (g_ril_send(nd->ril, RIL_REQUEST_QUERY_AVAILABLE_NETWORKS, NULL,
-			ril_cops_list_cb, cbd, g_free) == 0) {
+	if (g_ril_send_with_timeout(nd->ril,
+					RIL_REQUEST_QUERY_AVAILABLE_NETWORKS,
+					NULL, ril_cops_list_cb, cbd, g_free,
+					NETWORK_SCAN_TIMEOUT) == 0) {
 		g_free(cbd);
 		CALLBACK_WITH_FAILURE(cb, 0, NULL, data);
 	}
@@ -410,10 +415,14 @@ static void ril_strength_notify(struct ril_msg *message, gpointer user_data)
 {
 	struct ofono_netreg *netreg = user_data;
 	struct netreg_data *nd = ofono_netreg_get_data(netreg);
-	int strength = g_ril_unsol_parse_signal_strength(nd->ril, message,
-								nd->tech);
+	const struct unsol_signal_strength *ss;
+
+	ss = g_ril_decode_cached(nd->ril, message,
+			(GRilUnsolDecodeFunc) g_ril_unsol_decode_signal_strength,
+			g_free);
 
-	ofono_netreg_strength_notify(netreg, strength);
+	ofono_netreg_strength_notify(netreg,
+			g_ril_unsol_signal_strength_for_tech(ss, nd->tech));
 }
 
 static void ril_strength_cb(struct ril_msg *message, gpointer user_data)
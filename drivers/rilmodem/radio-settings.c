@@ -169,7 +169,7 @@ static gboolean send_set_radio_cap(struct radio_data *rd,
 	struct parcel rilp;
 	int version = 1;
 
-	parcel_init(&rilp);
+	g_ril_init_request_parcel(rd->ril, &rilp, 0);
 
 	parcel_w_int32(&rilp, version);
 	parcel_w_int32(&rilp, session);
@@ -59,6 +59,9 @@
 /* Number of passwords in EPINC response */
 #define MTK_EPINC_NUM_PASSWD 4
 
+/* Milliseconds after which a SIM_IO read or write is given up */
+#define SIM_IO_TIMEOUT 30000
+
 /*
  * Based on ../drivers/atmodem/sim.c.
  *
@@ -242,8 +245,9 @@ static void ril_sim_read_info(struct ofono_sim *sim, int fileid,
 				print_buf,
 				sd->aid_str);
 
-	ret = g_ril_send(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
-				ril_file_info_cb, cbd, g_free);
+	ret = g_ril_send_with_timeout(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
+					ril_file_info_cb, cbd, g_free,
+					SIM_IO_TIMEOUT);
 
 error:
 	if (ret == 0) {
@@ -376,8 +380,9 @@ static void ril_sim_read_binary(struct ofono_sim *sim, int fileid,
 				length,
 				sd->aid_str);
 
-	ret = g_ril_send(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
-				ril_file_io_cb, cbd, g_free);
+	ret = g_ril_send_with_timeout(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
+					ril_file_io_cb, cbd, g_free,
+					SIM_IO_TIMEOUT);
 error:
 	if (ret == 0) {
 		g_free(cbd);
@@ -422,8 +427,9 @@ static void ril_sim_read_record(struct ofono_sim *sim, int fileid,
 				length,
 				sd->aid_str);
 
-	ret = g_ril_send(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
-				ril_file_io_cb, cbd, g_free);
+	ret = g_ril_send_with_timeout(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
+					ril_file_io_cb, cbd, g_free,
+					SIM_IO_TIMEOUT);
 
 error:
 	if (ret == 0) {
@@ -461,8 +467,9 @@ static void ril_sim_update_binary(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	ret = g_ril_send(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
-				ril_file_write_cb, cbd, g_free);
+	ret = g_ril_send_with_timeout(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
+					ril_file_write_cb, cbd, g_free,
+					SIM_IO_TIMEOUT);
 
 error:
 	if (ret == 0) {
@@ -502,8 +509,9 @@ static void update_record(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	ret = g_ril_send(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
-				ril_file_write_cb, cbd, g_free);
+	ret = g_ril_send_with_timeout(sd->ril, RIL_REQUEST_SIM_IO, &rilp,
+					ril_file_write_cb, cbd, g_free,
+					SIM_IO_TIMEOUT);
 
 error:
 	if (ret == 0) {
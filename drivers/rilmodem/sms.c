@@ -149,10 +149,18 @@ static void ril_cmgs(struct ofono_sms *sms, const unsigned char *pdu,
 	struct cb_data *cbd = cb_data_new(cb, user_data, sd);
 	struct parcel rilp;
 	struct req_sms_cmgs req;
+	int request;
 
 	DBG("pdu_len: %d, tpdu_len: %d mms: %d", pdu_len, tpdu_len, mms);
 
-	/* TODO: if (mms) { ... } */
+	/*
+	 * SEND_SMS_EXPECT_MORE takes the same arguments as SEND_SMS, it
+	 * just asks the RIL to keep the link open (like AT+CMMS)
+	 */
+	if (mms)
+		request = RIL_REQUEST_SEND_SMS_EXPECT_MORE;
+	else
+		request = RIL_REQUEST_SEND_SMS;
 
 	req.pdu = pdu;
 	req.pdu_len = pdu_len;
@@ -160,7 +168,7 @@ static void ril_cmgs(struct ofono_sms *sms, const unsigned char *pdu,
 
 	g_ril_request_sms_cmgs(sd->ril, &req, &rilp);
 
-	if (g_ril_send(sd->ril, RIL_REQUEST_SEND_SMS, &rilp,
+	if (g_ril_send(sd->ril, request, &rilp,
 			ril_submit_sms_cb, cbd, g_free) == 0) {
 		g_free(cbd);
 		CALLBACK_WITH_FAILURE(cb, -1, user_data);
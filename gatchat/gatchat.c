@@ -56,6 +56,7 @@ struct at_command {
 	GAtNotifyFunc listing;
 	gpointer user_data;
 	GDestroyNotify notify;
+	gint64 sent_time;
 };
 
 struct at_notify_node {
@@ -90,6 +91,8 @@ struct at_chat {
 	gboolean suspended;			/* Are we suspended? */
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
+	GAtLatencyFunc latencyf;		/* command latency function */
+	gpointer latency_data;			/* Data to pass to latency func */
 	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
 	GSList *response_lines;			/* char * lines of the response */
 	char *wakeup;				/* command sent to wakeup modem */
@@ -444,6 +447,11 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 
 	p->cmd_bytes_written = 0;
 
+	if (p->latencyf && cmd->id != 0 && cmd->sent_time != 0)
+		p->latencyf(cmd->cmd, ok,
+				g_get_monotonic_time() - cmd->sent_time,
+				p->latency_data);
+
 	if (g_queue_peek_head(p->command_queue))
 		chat_wakeup_writer(p);
 
@@ -883,6 +891,9 @@ static gboolean can_write_data(gpointer data)
 
 	towrite = len - chat->cmd_bytes_written;
 
+	if (chat->cmd_bytes_written == 0)
+		cmd->sent_time = g_get_monotonic_time();
+
 	cr = strchr(cmd->cmd + chat->cmd_bytes_written, '\r');
 
 	if (cr)
@@ -1471,6 +1482,18 @@ gboolean g_at_chat_set_debug(GAtChat *chat,
 	return at_chat_set_debug(chat->parent, func, user_data);
 }
 
+gboolean g_at_chat_set_latency_function(GAtChat *chat,
+				GAtLatencyFunc func, gpointer user_data)
+{
+	if (chat == NULL || chat->group != 0)
+		return FALSE;
+
+	chat->parent->latencyf = func;
+	chat->parent->latency_data = user_data;
+
+	return TRUE;
+}
+
 void g_at_chat_add_terminator(GAtChat *chat, char *terminator,
 					int len, gboolean success)
 {
@@ -38,6 +38,8 @@ typedef struct _GAtChat GAtChat;
 typedef void (*GAtResultFunc)(gboolean success, GAtResult *result,
 				gpointer user_data);
 typedef void (*GAtNotifyFunc)(GAtResult *result, gpointer user_data);
+typedef void (*GAtLatencyFunc)(const char *cmd, gboolean ok, guint usec,
+				gpointer user_data);
 
 enum _GAtChatTerminator {
 	G_AT_CHAT_TERMINATOR_OK,
@@ -82,6 +84,14 @@ gboolean g_at_chat_set_disconnect_function(GAtChat *chat,
 gboolean g_at_chat_set_debug(GAtChat *chat,
 				GAtDebugFunc func, gpointer user_data);
 
+/*!
+ * If the function is not NULL, it is called whenever a command completes
+ * with the command string, whether it succeeded and the time in
+ * microseconds between writing the command out and its final response.
+ */
+gboolean g_at_chat_set_latency_function(GAtChat *chat,
+				GAtLatencyFunc func, gpointer user_data);
+
 /*!
  * Queue an AT command for execution.  The command contents are given
  * in cmd.  Once the command executes, the callback function given by
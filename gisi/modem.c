@@ -43,15 +43,23 @@
 	if ((m) != NULL && (m)->debug != NULL)		\
 		m->debug("gisi: "fmt, ##__VA_ARGS__);
 
+/* Request timeouts are in seconds, one slot per second */
+#define TIMER_WHEEL_SLOTS	64
+
 struct _GIsiServiceMux {
 	GIsiModem *modem;
-	GSList *pending;
+	GList *pending;
+	GHashTable *handlers;
+	GHashTable *transactions;
+	GSList *pings;
 	GIsiVersion version;
 	uint8_t resource;
 	uint8_t last_utid;
 	uint16_t object;
 	unsigned subscriptions;
 	unsigned registrations;
+	unsigned dispatching;
+	unsigned holes;
 	gboolean reachable;
 	gboolean version_pending;
 };
@@ -66,6 +74,14 @@ struct _GIsiModem {
 	int ind_fd;
 	guint req_watch;
 	guint ind_watch;
+	GIsiPhonetBatch *req_batch;
+	GIsiPhonetBatch *ind_batch;
+	GList *timers[TIMER_WHEEL_SLOTS];
+	unsigned timer_count;
+	guint64 timer_now;
+	guint timer_source;
+	unsigned dispatching;
+	gboolean destroyed;
 	GIsiDebugFunc debug;
 	GIsiNotifyFunc trace;
 	void *opaque;
@@ -76,7 +92,9 @@ struct _GIsiPending {
 	enum GIsiMessageType type;
 	GIsiServiceMux *service;
 	gpointer owner;
-	guint timeout;
+	GList *link;
+	GList *timer;
+	guint64 expires;
 	GIsiNotifyFunc notify;
 	GDestroyNotify destroy;
 	void *data;
@@ -100,6 +118,8 @@ static GIsiServiceMux *service_get(GIsiModem *modem, uint8_t resource)
 	g_hash_table_insert(modem->services, GINT_TO_POINTER(key), mux);
 
 	mux->modem = modem;
+	mux->handlers = g_hash_table_new(g_direct_hash, g_direct_equal);
+	mux->transactions = g_hash_table_new(g_direct_hash, g_direct_equal);
 	mux->resource = resource;
 	mux->version.major = -1;
 	mux->version.minor = -1;
@@ -109,12 +129,150 @@ static GIsiServiceMux *service_get(GIsiModem *modem, uint8_t resource)
 	return mux;
 }
 
-static gint utid_equal(gconstpointer a, gconstpointer b)
+static gboolean utid_in_use(GIsiServiceMux *mux, uint8_t utid)
 {
-	const GIsiPending *pa = a;
-	const GIsiPending *pb = b;
+	GSList *l;
+
+	if (g_hash_table_lookup(mux->transactions, GINT_TO_POINTER(utid)))
+		return TRUE;
+
+	for (l = mux->pings; l != NULL; l = l->next) {
+		GIsiPending *ping = l->data;
+
+		if (ping != NULL && ping->utid == utid)
+			return TRUE;
+	}
 
-	return pa->utid - pb->utid;
+	return FALSE;
+}
+
+/*
+ * Besides the list of everything pending on a service, RESPs are
+ * indexed by transaction ID and REQs, NTFs and INDs by message ID, so
+ * dispatching a message does not walk every subscription.
+ */
+static void pending_link(GIsiServiceMux *mux, GIsiPending *op)
+{
+	gpointer key;
+	GSList *list;
+
+	mux->pending = g_list_prepend(mux->pending, op);
+	op->link = mux->pending;
+
+	switch (op->type) {
+	case GISI_MESSAGE_TYPE_RESP:
+		g_hash_table_insert(mux->transactions,
+					GINT_TO_POINTER(op->utid), op);
+		break;
+
+	case GISI_MESSAGE_TYPE_COMMON:
+		mux->pings = g_slist_prepend(mux->pings, op);
+		break;
+
+	default:
+		key = GINT_TO_POINTER(op->msgid);
+		list = g_hash_table_lookup(mux->handlers, key);
+		list = g_slist_append(list, op);
+		g_hash_table_insert(mux->handlers, key, list);
+		break;
+	}
+}
+
+/*
+ * While a service is dispatching, an entry removed from the ping list
+ * or a handler list only leaves a hole, so that the dispatch loop never
+ * steps onto a freed link.  The holes are swept once the outermost
+ * dispatch is done.
+ */
+static GSList *service_list_remove(GIsiServiceMux *mux, GSList *list,
+					GIsiPending *op)
+{
+	GSList *l;
+
+	if (mux->dispatching == 0)
+		return g_slist_remove(list, op);
+
+	l = g_slist_find(list, op);
+	if (l != NULL) {
+		l->data = NULL;
+		mux->holes++;
+	}
+
+	return list;
+}
+
+static void service_sweep(GIsiServiceMux *mux)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GSList *keys = NULL;
+	GSList *l;
+
+	if (mux->dispatching > 0 || mux->holes == 0)
+		return;
+
+	mux->holes = 0;
+	mux->pings = g_slist_remove_all(mux->pings, NULL);
+
+	g_hash_table_iter_init(&iter, mux->handlers);
+
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		if (g_slist_find(value, NULL) != NULL)
+			keys = g_slist_prepend(keys, key);
+
+	for (l = keys; l != NULL; l = l->next) {
+		value = g_hash_table_lookup(mux->handlers, l->data);
+		value = g_slist_remove_all(value, NULL);
+
+		if (value == NULL)
+			g_hash_table_remove(mux->handlers, l->data);
+		else
+			g_hash_table_insert(mux->handlers, l->data, value);
+	}
+
+	g_slist_free(keys);
+}
+
+static void timer_disarm(GIsiPending *op);
+
+static void pending_unlink(GIsiPending *op)
+{
+	GIsiServiceMux *mux = op->service;
+	gpointer key;
+	GSList *list;
+
+	timer_disarm(op);
+
+	/* Synthesized ping replies are never linked */
+	if (op->link == NULL)
+		return;
+
+	mux->pending = g_list_delete_link(mux->pending, op->link);
+	op->link = NULL;
+
+	switch (op->type) {
+	case GISI_MESSAGE_TYPE_RESP:
+		key = GINT_TO_POINTER(op->utid);
+
+		if (g_hash_table_lookup(mux->transactions, key) == op)
+			g_hash_table_remove(mux->transactions, key);
+		break;
+
+	case GISI_MESSAGE_TYPE_COMMON:
+		mux->pings = service_list_remove(mux, mux->pings, op);
+		break;
+
+	default:
+		key = GINT_TO_POINTER(op->msgid);
+		list = g_hash_table_lookup(mux->handlers, key);
+		list = service_list_remove(mux, list, op);
+
+		if (list == NULL)
+			g_hash_table_remove(mux->handlers, key);
+		else
+			g_hash_table_insert(mux->handlers, key, list);
+		break;
+	}
 }
 
 static const char *pend_type_to_str(enum GIsiMessageType type)
@@ -155,7 +313,7 @@ static void pending_remove_and_dispatch(GIsiPending *op, GIsiMessage *msg)
 {
 	GIsiModem *modem;
 
-	op->service->pending = g_slist_remove(op->service->pending, op);
+	pending_unlink(op);
 
 	if (op->notify == NULL || msg == NULL)
 		goto destroy;
@@ -171,62 +329,90 @@ static void pending_remove_and_dispatch(GIsiPending *op, GIsiMessage *msg)
 	op->notify(msg, op->data);
 
 destroy:
-	if (op->timeout > 0)
-		g_source_remove(op->timeout);
-
 	if (op->destroy != NULL)
 		op->destroy(op->data);
 
 	g_free(op);
 }
 
-static void service_dispatch(GIsiServiceMux *mux, GIsiMessage *msg,
-				gboolean is_indication)
+/*
+ * Returns FALSE if a handler destroyed the modem, the service is gone
+ * then as well.
+ */
+static gboolean service_dispatch_handlers(GIsiServiceMux *mux,
+						GIsiMessage *msg,
+						gboolean is_indication)
 {
+	GIsiModem *modem = mux->modem;
 	uint8_t msgid = g_isi_msg_id(msg);
 	uint8_t utid = g_isi_msg_utid(msg);
+	GIsiPending *op;
+	GSList *l;
 
-	GSList *l = mux->pending;
+	/*
+	 * Version query responses are dispatched based on the pending
+	 * type and the message ID.  Some of these may be synthesized,
+	 * but nevertheless need to be removed.
+	 */
+	if (msgid == COMMON_MESSAGE) {
+		for (l = mux->pings; l != NULL; l = l->next) {
+			op = l->data;
 
-	while (l != NULL) {
-		GSList *next = l->next;
-		GIsiPending *pend = l->data;
+			if (op == NULL || op->msgid != COMM_ISI_VERSION_GET_REQ)
+				continue;
 
-		/*
-		 * REQs, NTFs and INDs are dispatched on message ID.  While
-		 * INDs have the unique transaction ID set to zero, NTFs
-		 * typically mirror the UTID of the request that set up the
-		 * session, and REQs can naturally have any transaction ID.
-		 *
-		 * RESPs are dispatched on unique transaction ID, explicitly
-		 * ignoring the msgid.  A RESP also completes a transaction,
-		 * so it needs to be removed after being notified of.
-		 *
-		 * Version query responses are dispatched in a similar fashion
-		 * as RESPs, but based on the pending type and the message ID.
-		 * Some of these may be synthesized, but nevertheless need to
-		 * be removed.
-		 */
-		if (pend->type < GISI_MESSAGE_TYPE_RESP
-				&& pend->msgid == msgid) {
+			pending_remove_and_dispatch(op, msg);
 
-			pending_dispatch(pend, msg);
+			if (modem->destroyed)
+				return FALSE;
+		}
+	}
 
-		} else if (pend->type == GISI_MESSAGE_TYPE_RESP &&
-				!is_indication && pend->utid == utid) {
+	/*
+	 * RESPs are dispatched on unique transaction ID, explicitly
+	 * ignoring the msgid.  A RESP also completes a transaction,
+	 * so it needs to be removed after being notified of.
+	 */
+	if (!is_indication) {
+		op = g_hash_table_lookup(mux->transactions,
+						GINT_TO_POINTER(utid));
+		if (op != NULL) {
+			pending_remove_and_dispatch(op, msg);
+			return !modem->destroyed;
+		}
+	}
 
-			pending_remove_and_dispatch(pend, msg);
-			break;
+	/*
+	 * REQs, NTFs and INDs are dispatched on message ID.  While
+	 * INDs have the unique transaction ID set to zero, NTFs
+	 * typically mirror the UTID of the request that set up the
+	 * session, and REQs can naturally have any transaction ID.
+	 */
+	l = g_hash_table_lookup(mux->handlers, GINT_TO_POINTER(msgid));
 
-		} else if (pend->type == GISI_MESSAGE_TYPE_COMMON &&
-				msgid == COMMON_MESSAGE &&
-				pend->msgid == COMM_ISI_VERSION_GET_REQ) {
+	for (; l != NULL; l = l->next) {
+		if (l->data == NULL)
+			continue;
 
-			pending_remove_and_dispatch(pend, msg);
-		}
+		pending_dispatch(l->data, msg);
 
-		l = next;
+		if (modem->destroyed)
+			return FALSE;
 	}
+
+	return TRUE;
+}
+
+static void service_dispatch(GIsiServiceMux *mux, GIsiMessage *msg,
+				gboolean is_indication)
+{
+	mux->dispatching++;
+
+	if (!service_dispatch_handlers(mux, msg, is_indication))
+		return;
+
+	mux->dispatching--;
+	service_sweep(mux);
 }
 
 static void common_message_decode(GIsiServiceMux *mux, GIsiMessage *msg)
@@ -277,63 +463,215 @@ static void firewall_notify_handle(GIsiModem *modem, GIsiMessage *msg)
 	ISIDBG(modem, "firewall blocked message 0x%02X", id);
 }
 
+static void isi_dispatch(GIsiModem *modem, GIsiMessage *msg,
+				gboolean is_indication)
+{
+	GIsiServiceMux *mux;
+	unsigned key;
+
+	if (modem->trace != NULL)
+		modem->trace(msg, NULL);
+
+	key = msg->addr->spn_resource;
+	mux = g_hash_table_lookup(modem->services, GINT_TO_POINTER(key));
+	if (mux == NULL) {
+		/*
+		 * Unfortunately, the FW report has the wrong
+		 * resource ID in the N900 modem.
+		 */
+		if (key == PN_FIREWALL)
+			firewall_notify_handle(modem, msg);
+
+		return;
+	}
+
+	msg->version = &mux->version;
+
+	if (g_isi_msg_id(msg) == COMMON_MESSAGE)
+		common_message_decode(mux, msg);
+
+	service_dispatch(mux, msg, is_indication);
+}
+
+static void modem_free(GIsiModem *modem)
+{
+	g_isi_phonet_batch_free(modem->req_batch);
+	g_isi_phonet_batch_free(modem->ind_batch);
+	g_free(modem);
+}
+
 static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
 	GIsiModem *modem = data;
-	int len;
-	int fd;
+	GIsiPhonetBatch *batch;
+	gboolean is_indication;
+	int count;
+	int i;
 
 	if (cond & (G_IO_NVAL|G_IO_HUP)) {
 		ISIDBG(modem, "Unexpected event on PhoNet channel %p", channel);
 		return FALSE;
 	}
 
-	fd = g_io_channel_unix_get_fd(channel);
-	len = g_isi_phonet_peek_length(channel);
+	is_indication = g_io_channel_unix_get_fd(channel) == modem->ind_fd;
+	batch = is_indication ? modem->ind_batch : modem->req_batch;
 
-	if (len > 0) {
-		struct sockaddr_pn addr;
-		uint32_t buf[(len + 3) / 4];
+	count = g_isi_phonet_batch_read(channel, batch);
+	if (count <= 0)
+		return TRUE;
 
-		GIsiServiceMux *mux;
+	/* A handler may destroy the modem, see g_isi_modem_destroy() */
+	modem->dispatching++;
+
+	for (i = 0; i < count && !modem->destroyed; i++) {
+		struct sockaddr_pn *addr;
 		GIsiMessage msg;
-		unsigned key;
+		size_t len;
+
+		msg.data = g_isi_phonet_batch_get(batch, i, &len, &addr);
+		if (msg.data == NULL) {
+			ISIDBG(modem, "Dropped truncated message");
+			continue;
+		}
 
-		len = g_isi_phonet_read(channel, buf, len, &addr);
 		if (len < 2)
-			return TRUE;
+			continue;
 
-		msg.addr = &addr;
+		msg.addr = addr;
 		msg.error = 0;
-		msg.data = buf;
 		msg.len = len;
 
-		if (modem->trace != NULL)
-			modem->trace(&msg, NULL);
+		isi_dispatch(modem, &msg, is_indication);
+	}
 
-		key = addr.spn_resource;
-		mux = g_hash_table_lookup(modem->services,
-						GINT_TO_POINTER(key));
-		if (mux == NULL) {
-			/*
-			 * Unfortunately, the FW report has the wrong
-			 * resource ID in the N900 modem.
-			 */
-			if (key == PN_FIREWALL)
-				firewall_notify_handle(modem, &msg);
+	modem->dispatching--;
 
-			return TRUE;
+	if (modem->destroyed && modem->dispatching == 0) {
+		modem_free(modem);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean timer_tick(gpointer data);
+
+static guint64 timer_seconds(void)
+{
+	return g_get_monotonic_time() / G_USEC_PER_SEC;
+}
+
+/*
+ * All request timeouts of a modem share one timer wheel driven by a
+ * single once a second tick, instead of a GSource per request.  The
+ * tick only runs while timeouts are armed.
+ */
+static void timer_arm(GIsiModem *modem, GIsiPending *op, unsigned timeout)
+{
+	unsigned slot;
+
+	if (modem->timer_count == 0 && modem->timer_source == 0)
+		modem->timer_now = timer_seconds();
+
+	/*
+	 * The clock is in whole seconds and the tick may come at any
+	 * point of a second, one more keeps it from firing early.
+	 */
+	op->expires = timer_seconds() + timeout + 1;
+	slot = op->expires % TIMER_WHEEL_SLOTS;
+
+	modem->timers[slot] = g_list_prepend(modem->timers[slot], op);
+	op->timer = modem->timers[slot];
+	modem->timer_count++;
+
+	if (modem->timer_source == 0)
+		modem->timer_source = g_timeout_add_seconds(1, timer_tick,
+								modem);
+}
+
+static void timer_disarm(GIsiPending *op)
+{
+	GIsiModem *modem;
+	unsigned slot;
+
+	if (op->timer == NULL)
+		return;
+
+	modem = op->service->modem;
+	slot = op->expires % TIMER_WHEEL_SLOTS;
+
+	modem->timers[slot] = g_list_delete_link(modem->timers[slot],
+							op->timer);
+	op->timer = NULL;
+	modem->timer_count--;
+}
+
+static GIsiPending *timer_expired(GIsiModem *modem, unsigned slot,
+					guint64 now)
+{
+	GList *l;
+
+	/* Entries more than a full turn away stay in place */
+	for (l = modem->timers[slot]; l != NULL; l = l->next) {
+		GIsiPending *op = l->data;
+
+		if (op->expires <= now)
+			return op;
+	}
+
+	return NULL;
+}
+
+static gboolean timer_tick(gpointer data)
+{
+	GIsiModem *modem = data;
+	GIsiMessage msg = {
+		.error = ETIMEDOUT,
+	};
+	guint64 now = timer_seconds();
+	guint64 last;
+	GIsiPending *op;
+
+	modem->dispatching++;
+
+	/*
+	 * Catch up on every second elapsed since the last tick.  One
+	 * turn of the wheel from where it stopped visits every slot,
+	 * in expiry order.
+	 */
+	last = MIN(now, modem->timer_now + TIMER_WHEEL_SLOTS - 1);
+
+	while (modem->timer_now <= last && !modem->destroyed) {
+		unsigned slot = modem->timer_now % TIMER_WHEEL_SLOTS;
+
+		/* A handler may cancel other entries, so rescan each time */
+		op = timer_expired(modem, slot, now);
+		if (op == NULL) {
+			modem->timer_now++;
+			continue;
 		}
 
-		msg.version = &mux->version;
+		pending_remove_and_dispatch(op, &msg);
+	}
+
+	if (modem->timer_now <= now)
+		modem->timer_now = now + 1;
+
+	modem->dispatching--;
 
-		if (g_isi_msg_id(&msg) == COMMON_MESSAGE)
-			common_message_decode(mux, &msg);
+	if (modem->destroyed) {
+		if (modem->dispatching == 0)
+			modem_free(modem);
 
-		service_dispatch(mux, &msg, fd == modem->ind_fd);
+		return FALSE;
 	}
-	return TRUE;
+
+	if (modem->timer_count > 0)
+		return TRUE;
+
+	modem->timer_source = 0;
+	return FALSE;
 }
 
 static gboolean modem_subs_update(gpointer data)
@@ -446,8 +784,7 @@ static void pending_destroy(gpointer value, gpointer user)
 	if (op == NULL)
 		return;
 
-	if (op->timeout > 0)
-		g_source_remove(op->timeout);
+	timer_disarm(op);
 
 	if (op->destroy != NULL)
 		op->destroy(op->data);
@@ -455,6 +792,11 @@ static void pending_destroy(gpointer value, gpointer user)
 	g_free(op);
 }
 
+static void handlers_free(gpointer key, gpointer value, gpointer user)
+{
+	g_slist_free(value);
+}
+
 static void service_finalize(gpointer value)
 {
 	GIsiServiceMux *mux = value;
@@ -466,8 +808,12 @@ static void service_finalize(gpointer value)
 	if (mux->registrations > 0)
 		service_name_deregister(mux);
 
-	g_slist_foreach(mux->pending, pending_destroy, NULL);
-	g_slist_free(mux->pending);
+	g_list_foreach(mux->pending, pending_destroy, NULL);
+	g_list_free(mux->pending);
+	g_slist_free(mux->pings);
+	g_hash_table_foreach(mux->handlers, handlers_free, NULL);
+	g_hash_table_unref(mux->handlers);
+	g_hash_table_unref(mux->transactions);
 	g_free(mux);
 }
 
@@ -496,6 +842,19 @@ GIsiModem *g_isi_modem_create(unsigned index)
 		return NULL;
 	}
 
+	modem->req_batch = g_isi_phonet_batch_new(g_isi_phonet_mtu(reqs,
+								index));
+	modem->ind_batch = g_isi_phonet_batch_new(g_isi_phonet_mtu(inds,
+								index));
+
+	if (modem->req_batch == NULL || modem->ind_batch == NULL) {
+		g_io_channel_unref(reqs);
+		g_io_channel_unref(inds);
+		modem_free(modem);
+		errno = ENOMEM;
+		return NULL;
+	}
+
 	modem->req_fd = g_io_channel_unix_get_fd(reqs);
 	modem->req_watch = g_io_add_watch(reqs,
 					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
@@ -648,7 +1007,16 @@ void g_isi_modem_destroy(GIsiModem *modem)
 	if (modem->req_watch > 0)
 		g_source_remove(modem->req_watch);
 
-	g_free(modem);
+	if (modem->timer_source > 0)
+		g_source_remove(modem->timer_source);
+
+	/* Called from a handler, the dispatcher frees it once done */
+	if (modem->dispatching > 0) {
+		modem->destroyed = TRUE;
+		return;
+	}
+
+	modem_free(modem);
 }
 
 unsigned g_isi_modem_index(GIsiModem *modem)
@@ -722,20 +1090,6 @@ static void vtrace(struct sockaddr_pn *dst,
 	trace(&msg, NULL);
 }
 
-static gboolean resp_timeout(gpointer data)
-{
-	GIsiPending *op = data;
-	GIsiMessage msg = {
-		.error = ETIMEDOUT,
-	};
-
-	op->timeout = 0;
-
-	pending_remove_and_dispatch(op, &msg);
-
-	return FALSE;
-}
-
 GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 					const struct iovec *__restrict iov,
 					size_t iovlen, unsigned timeout,
@@ -782,7 +1136,7 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	resp->destroy = destroy;
 	resp->data = data;
 
-	if (g_slist_find_custom(mux->pending, resp, utid_equal)) {
+	if (utid_in_use(mux, resp->utid)) {
 		/*
 		 * FIXME: perhaps retry with randomized access after
 		 * initial miss. Although if the rate at which
@@ -815,11 +1169,10 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 		goto error;
 	}
 
-	mux->pending = g_slist_prepend(mux->pending, resp);
+	pending_link(mux, resp);
 
 	if (timeout > 0)
-		resp->timeout = g_timeout_add_seconds(timeout, resp_timeout,
-							resp);
+		timer_arm(modem, resp, timeout);
 
 	mux->last_utid = resp->utid;
 	return resp;
@@ -854,8 +1207,7 @@ void g_isi_pending_remove(GIsiPending *op)
 		return;
 	}
 
-	op->service->pending = g_slist_remove(op->service->pending, op);
-
+	pending_unlink(op);
 	pending_destroy(op, NULL);
 }
 
@@ -890,10 +1242,11 @@ void g_isi_remove_pending_by_owner(GIsiModem *modem, uint8_t resource,
 					gpointer owner)
 {
 	GIsiServiceMux *mux;
-	GSList *l;
-	GSList *next;
+	GList *l;
+	GList *next;
 	GIsiPending *op;
 	GSList *owned = NULL;
+	GSList *o;
 
 	mux = service_get(modem, resource);
 	if (mux == NULL)
@@ -906,14 +1259,12 @@ void g_isi_remove_pending_by_owner(GIsiModem *modem, uint8_t resource,
 		if (op->owner != owner)
 			continue;
 
-		mux->pending = g_slist_remove_link(mux->pending, l);
-
-		l->next = owned;
-		owned = l;
+		pending_unlink(op);
+		owned = g_slist_prepend(owned, op);
 	}
 
-	for (l = owned; l != NULL; l = l->next) {
-		op = l->data;
+	for (o = owned; o != NULL; o = o->next) {
+		op = o->data;
 
 		foreach_destroy(op);
 	}
@@ -947,7 +1298,7 @@ GIsiPending *g_isi_ntf_subscribe(GIsiModem *modem, uint8_t resource,
 	ntf->destroy = destroy;
 	ntf->msgid = msgid;
 
-	mux->pending = g_slist_append(mux->pending, ntf);
+	pending_link(mux, ntf);
 
 	ISIDBG(modem, "Subscribed to %s (%p) [res=0x%02X, id=0x%02X]",
 		pend_type_to_str(ntf->type), ntf, resource, msgid);
@@ -981,7 +1332,7 @@ GIsiPending *g_isi_service_bind(GIsiModem *modem, uint8_t resource,
 	srv->destroy = destroy;
 	srv->msgid = msgid;
 
-	mux->pending = g_slist_append(mux->pending, srv);
+	pending_link(mux, srv);
 
 	ISIDBG(modem, "Bound service for %s (%p) [res=0x%02X, id=0x%02X]",
 		pend_type_to_str(srv->type), srv, resource, msgid);
@@ -1017,7 +1368,7 @@ GIsiPending *g_isi_ind_subscribe(GIsiModem *modem, uint8_t resource,
 	ind->destroy = destroy;
 	ind->msgid = msgid;
 
-	mux->pending = g_slist_append(mux->pending, ind);
+	pending_link(mux, ind);
 
 	ISIDBG(modem, "Subscribed for %s (%p) [res=0x%02X, id=0x%02X]",
 		pend_type_to_str(ind->type), ind, resource, msgid);
@@ -1165,7 +1516,7 @@ static int version_get_send(GIsiModem *modem, GIsiPending *ping)
 	};
 	ssize_t ret;
 
-	if (g_slist_find_custom(mux->pending, ping, utid_equal))
+	if (utid_in_use(mux, ping->utid))
 		return -EBUSY;
 
 	ret = sendto(modem->req_fd, msg, sizeof(msg), MSG_NOSIGNAL,
@@ -1245,9 +1596,8 @@ GIsiPending *g_isi_resource_ping(GIsiModem *modem, uint8_t resource,
 		mux->last_utid = ping->utid;
 	}
 
-	ping->timeout = g_timeout_add_seconds(COMMON_TIMEOUT, resp_timeout,
-						ping);
-	mux->pending = g_slist_prepend(mux->pending, ping);
+	pending_link(mux, ping);
+	timer_arm(modem, ping, COMMON_TIMEOUT);
 	mux->version_pending = TRUE;
 
 	ISIDBG(modem, "Ping sent %s (%p) [res=0x%02X]",
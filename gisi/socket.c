@@ -23,7 +23,10 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
+#include <errno.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -35,6 +38,18 @@
 #include "phonet.h"
 #include "socket.h"
 
+/* Upper bound on the memory kept for receiving, per channel */
+#define BATCH_BUDGET	65536
+
+struct _GIsiPhonetBatch {
+	unsigned int count;
+	size_t size;
+	struct mmsghdr hdr[GISI_PHONET_BATCH_MAX];
+	struct iovec iov[GISI_PHONET_BATCH_MAX];
+	struct sockaddr_pn addr[GISI_PHONET_BATCH_MAX];
+	uint32_t *bufs;
+};
+
 GIOChannel *g_isi_phonet_new(unsigned ifindex)
 {
 	GIOChannel *channel;
@@ -91,3 +106,125 @@ ssize_t g_isi_phonet_read(GIOChannel *channel, void *restrict buf, size_t len,
 
 	return ret;
 }
+
+size_t g_isi_phonet_mtu(GIOChannel *channel, unsigned ifindex)
+{
+	struct ifreq ifr;
+	int fd = g_io_channel_unix_get_fd(channel);
+
+	memset(&ifr, 0, sizeof(ifr));
+
+	if (ifindex == 0 || if_indextoname(ifindex, ifr.ifr_name) == NULL)
+		return GISI_PHONET_MAX_MTU;
+
+	if (ioctl(fd, SIOCGIFMTU, &ifr) < 0 || ifr.ifr_mtu <= 0 ||
+			ifr.ifr_mtu > GISI_PHONET_MAX_MTU)
+		return GISI_PHONET_MAX_MTU;
+
+	return ifr.ifr_mtu;
+}
+
+/*
+ * No datagram received over an interface is larger than its MTU, so
+ * slots of that size are never truncated.  As many slots as fit into
+ * the budget are allocated once and reused for every read.
+ */
+GIsiPhonetBatch *g_isi_phonet_batch_new(size_t mtu)
+{
+	GIsiPhonetBatch *batch;
+	size_t words = (mtu + 3) / 4;
+	unsigned int i;
+
+	batch = g_try_new0(GIsiPhonetBatch, 1);
+	if (batch == NULL)
+		return NULL;
+
+	batch->size = words * 4;
+	batch->count = MIN(GISI_PHONET_BATCH_MAX, BATCH_BUDGET / batch->size);
+
+	if (batch->count == 0)
+		batch->count = 1;
+
+	batch->bufs = g_try_new(uint32_t, words * batch->count);
+	if (batch->bufs == NULL) {
+		g_free(batch);
+		return NULL;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		batch->iov[i].iov_base = batch->bufs + words * i;
+		batch->iov[i].iov_len = batch->size;
+		batch->hdr[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return batch;
+}
+
+void g_isi_phonet_batch_free(GIsiPhonetBatch *batch)
+{
+	if (batch == NULL)
+		return;
+
+	g_free(batch->bufs);
+	g_free(batch);
+}
+
+static int batch_read_one(int fd, GIsiPhonetBatch *batch)
+{
+	socklen_t addrlen = sizeof(struct sockaddr_pn);
+	ssize_t ret;
+
+	ret = recvfrom(fd, batch->iov[0].iov_base, batch->size,
+			MSG_DONTWAIT | MSG_TRUNC, (void *)&batch->addr[0],
+			&addrlen);
+	if (ret == -1)
+		return -1;
+
+	batch->hdr[0].msg_len = ret;
+	batch->hdr[0].msg_hdr.msg_flags = ret > (ssize_t) batch->size ?
+								MSG_TRUNC : 0;
+
+	return 1;
+}
+
+/*
+ * Drains up to the batch size of queued datagrams in one system call,
+ * returns how many were read or -1 on error.
+ */
+int g_isi_phonet_batch_read(GIOChannel *channel, GIsiPhonetBatch *batch)
+{
+	int fd = g_io_channel_unix_get_fd(channel);
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < batch->count; i++) {
+		batch->hdr[i].msg_hdr.msg_name = &batch->addr[i];
+		batch->hdr[i].msg_hdr.msg_namelen = sizeof(batch->addr[i]);
+	}
+
+	ret = recvmmsg(fd, batch->hdr, batch->count, MSG_DONTWAIT, NULL);
+	if (ret == -1 && errno == ENOSYS)
+		return batch_read_one(fd, batch);
+
+	return ret;
+}
+
+/*
+ * The data stays valid until the next read into the batch.  Returns
+ * NULL for datagrams that did not fit into their slot.
+ */
+const void *g_isi_phonet_batch_get(GIsiPhonetBatch *batch, unsigned int i,
+					size_t *len, struct sockaddr_pn **addr)
+{
+	if (i >= batch->count)
+		return NULL;
+
+	if (batch->hdr[i].msg_hdr.msg_flags & MSG_TRUNC)
+		return NULL;
+
+	*len = batch->hdr[i].msg_len;
+	*addr = &batch->addr[i];
+
+	return batch->iov[i].iov_base;
+}
@@ -23,3 +23,17 @@ GIOChannel *g_isi_phonet_new(unsigned int ifindex);
 size_t g_isi_phonet_peek_length(GIOChannel *io);
 ssize_t g_isi_phonet_read(GIOChannel *io, void *restrict buf, size_t len,
 				struct sockaddr_pn *addr);
+
+/* Largest packet a Phonet interface can carry */
+#define GISI_PHONET_MAX_MTU	65541
+#define GISI_PHONET_BATCH_MAX	16
+
+struct _GIsiPhonetBatch;
+typedef struct _GIsiPhonetBatch GIsiPhonetBatch;
+
+size_t g_isi_phonet_mtu(GIOChannel *io, unsigned int ifindex);
+GIsiPhonetBatch *g_isi_phonet_batch_new(size_t mtu);
+void g_isi_phonet_batch_free(GIsiPhonetBatch *batch);
+int g_isi_phonet_batch_read(GIOChannel *io, GIsiPhonetBatch *batch);
+const void *g_isi_phonet_batch_get(GIsiPhonetBatch *batch, unsigned int i,
+					size_t *len, struct sockaddr_pn **addr);
@@ -63,16 +63,39 @@ struct ril_request {
 	GRilResponseFunc callback;
 	gpointer user_data;
 	GDestroyNotify notify;
+	gint64 queued_time;
+	gint64 sent_time;
+	GRilLane lane;
+	guint timeout_source;
+	gboolean timed_out;
+	struct ril_s *ril;
 };
 
 struct ril_notify_node {
 	guint id;
 	guint gid;
 	GRilNotifyFunc callback;
+	GRil *ril;				/* Only for decoded listeners */
+	GRilUnsolDecodeFunc decode;
+	GDestroyNotify decode_destroy;
+	GRilDecodedNotifyFunc decoded_callback;
 	gpointer user_data;
 	gboolean destroyed;
 };
 
+/* A decoded message, shared by its consumers until it is dispatched */
+struct ril_decoded {
+	const struct ril_msg *message;
+	GRilUnsolDecodeFunc decode;
+	GDestroyNotify destroy;
+	gpointer data;
+};
+
+struct ril_unsol_counters {
+	guint received;
+	guint decoded;
+};
+
 typedef gboolean (*node_remove_func)(struct ril_notify_node *node,
 					gpointer user_data);
 
@@ -80,19 +103,56 @@ struct ril_notify {
 	GSList *nodes;
 };
 
+/* Request parcel buffers kept for reuse, and the largest one kept */
+#define RIL_PARCEL_POOL_SIZE 4
+#define RIL_PARCEL_POOL_MAX_CAPACITY 4096
+
+#define RIL_NUM_LANES (G_RIL_LANE_INFO + 1)
+
+/*
+ * Requests waiting for a response per lane, 0 means no limit.  rild
+ * handles the requests of a socket one after the other, so anything
+ * written beyond what it is working on only waits in its queue where
+ * it can no longer be overtaken.  Two per lane keep rild busy, while a
+ * DIAL or HANGUP never waits behind more than two SIM reads or network
+ * scans.  Call control is never held back.
+ */
+static const guint lane_max_in_flight[RIL_NUM_LANES] = {
+	[G_RIL_LANE_CALL_CONTROL] = 0,
+	[G_RIL_LANE_DATA] = 2,
+	[G_RIL_LANE_SIM] = 2,
+	[G_RIL_LANE_INFO] = 2,
+};
+
+/*
+ * Seconds after writing that a request of a capped lane is given up if
+ * it has no deadline of its own, so that requests rild never answers,
+ * like unknown vendor ones or those lost in a rild restart, cannot hold
+ * the slots of their lane forever.
+ */
+#define RIL_LANE_TIMEOUT 180
+
+struct ril_lane {
+	GQueue *queue;				/* Unsent commands */
+	guint in_flight;			/* Sent, awaiting response */
+};
+
 struct ril_s {
 	gint ref_count;				/* Ref count */
 	gint next_cmd_id;			/* Next command id */
 	guint next_notify_id;			/* Next notify id */
 	guint next_gid;				/* Next group id */
 	GRilIO *io;				/* GRil IO */
-	GQueue *command_queue;			/* Command queue */
-	GQueue *out_queue;			/* Commands sent/been sent */
+	struct ril_lane lanes[RIL_NUM_LANES];	/* Unsent commands by lane */
+	GHashTable *request_lanes;		/* Lanes set by the drivers */
+	GHashTable *out_requests;		/* Sent commands by serial */
+	struct ril_request *writing;		/* Command being written */
 	guint req_bytes_written;		/* bytes written from req */
 	GHashTable *notify_list;		/* List of notification reg */
+	GHashTable *unsol_counters;		/* Counters by unsol id */
+	GSList *decode_cache;			/* Decoded current message */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
-	guint read_so_far;			/* Number of bytes processed */
 	gboolean suspended;			/* Are we suspended? */
 	gboolean debug;
 	gboolean trace;
@@ -104,7 +164,11 @@ struct ril_s {
 	int slot;
 	GRilMsgIdToStrFunc req_to_string;
 	GRilMsgIdToStrFunc unsol_to_string;
+	GRilLatencyFunc latencyf;
+	gpointer latency_data;
 	int version;
+	struct parcel parcel_pool[RIL_PARCEL_POOL_SIZE];
+	guint parcel_pool_len;
 };
 
 struct _GRil {
@@ -239,6 +303,76 @@ static gboolean ril_unregister_all(struct ril_s *ril,
 	return TRUE;
 }
 
+static GRilLane request_lane(struct ril_s *ril, int req)
+{
+	gpointer lane;
+
+	if (ril->request_lanes && g_hash_table_lookup_extended(
+					ril->request_lanes,
+					GINT_TO_POINTER(req), NULL, &lane))
+		return GPOINTER_TO_INT(lane);
+
+	switch (req) {
+	case RIL_REQUEST_GET_CURRENT_CALLS:
+	case RIL_REQUEST_DIAL:
+	case RIL_REQUEST_HANGUP:
+	case RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND:
+	case RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND:
+	case RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE:
+	case RIL_REQUEST_CONFERENCE:
+	case RIL_REQUEST_UDUB:
+	case RIL_REQUEST_LAST_CALL_FAIL_CAUSE:
+	case RIL_REQUEST_DTMF:
+	case RIL_REQUEST_ANSWER:
+	case RIL_REQUEST_DTMF_START:
+	case RIL_REQUEST_DTMF_STOP:
+	case RIL_REQUEST_SEPARATE_CONNECTION:
+	case RIL_REQUEST_SET_MUTE:
+	case RIL_REQUEST_GET_MUTE:
+	case RIL_REQUEST_EXPLICIT_CALL_TRANSFER:
+	case RIL_REQUEST_CDMA_FLASH:
+	case RIL_REQUEST_CDMA_BURST_DTMF:
+	case RIL_REQUEST_SET_SUPP_SVC_NOTIFICATION:
+		return G_RIL_LANE_CALL_CONTROL;
+	case RIL_REQUEST_SETUP_DATA_CALL:
+	case RIL_REQUEST_DEACTIVATE_DATA_CALL:
+	case RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE:
+	case RIL_REQUEST_DATA_CALL_LIST:
+	case RIL_REQUEST_SET_INITIAL_ATTACH_APN:
+	case RIL_REQUEST_ALLOW_DATA:
+		return G_RIL_LANE_DATA;
+	case RIL_REQUEST_GET_SIM_STATUS:
+	case RIL_REQUEST_ENTER_SIM_PIN:
+	case RIL_REQUEST_ENTER_SIM_PUK:
+	case RIL_REQUEST_ENTER_SIM_PIN2:
+	case RIL_REQUEST_ENTER_SIM_PUK2:
+	case RIL_REQUEST_CHANGE_SIM_PIN:
+	case RIL_REQUEST_CHANGE_SIM_PIN2:
+	case RIL_REQUEST_ENTER_NETWORK_DEPERSONALIZATION:
+	case RIL_REQUEST_GET_IMSI:
+	case RIL_REQUEST_SIM_IO:
+	case RIL_REQUEST_QUERY_FACILITY_LOCK:
+	case RIL_REQUEST_SET_FACILITY_LOCK:
+	case RIL_REQUEST_STK_GET_PROFILE:
+	case RIL_REQUEST_STK_SET_PROFILE:
+	case RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND:
+	case RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE:
+	case RIL_REQUEST_STK_HANDLE_CALL_SETUP_REQUESTED_FROM_SIM:
+	case RIL_REQUEST_REPORT_STK_SERVICE_IS_RUNNING:
+	case RIL_REQUEST_STK_SEND_ENVELOPE_WITH_STATUS:
+	case RIL_REQUEST_ISIM_AUTHENTICATION:
+	case RIL_REQUEST_SIM_TRANSMIT_APDU_BASIC:
+	case RIL_REQUEST_SIM_OPEN_CHANNEL:
+	case RIL_REQUEST_SIM_CLOSE_CHANNEL:
+	case RIL_REQUEST_SIM_TRANSMIT_APDU_CHANNEL:
+	case RIL_REQUEST_SIM_AUTHENTICATION:
+		return G_RIL_LANE_SIM;
+	}
+
+	/* Everything else, unless the driver set a lane for it */
+	return G_RIL_LANE_INFO;
+}
+
 /*
  * This function creates a RIL request.  For a good reference on
  * the layout of RIL requests, responses, and unsolicited requests
@@ -296,12 +430,27 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 	r->callback = func;
 	r->user_data = user_data;
 	r->notify = notify;
+	r->lane = request_lane(ril, req);
+	r->ril = ril;
 
 	return r;
 }
 
+static void ril_request_stop_timer(gpointer data, gpointer user_data)
+{
+	struct ril_request *req = data;
+
+	if (req->timeout_source == 0)
+		return;
+
+	g_source_remove(req->timeout_source);
+	req->timeout_source = 0;
+}
+
 static void ril_request_destroy(struct ril_request *req)
 {
+	ril_request_stop_timer(req, NULL);
+
 	if (req->notify)
 		req->notify(req->user_data);
 
@@ -309,18 +458,54 @@ static void ril_request_destroy(struct ril_request *req)
 	g_free(req);
 }
 
+static void ril_decoded_free(gpointer data, gpointer user_data)
+{
+	struct ril_decoded *d = data;
+
+	if (d->destroy && d->data)
+		d->destroy(d->data);
+
+	g_free(d);
+}
+
+static void decode_cache_flush(struct ril_s *p)
+{
+	g_slist_foreach(p->decode_cache, ril_decoded_free, NULL);
+	g_slist_free(p->decode_cache);
+	p->decode_cache = NULL;
+}
+
 static void ril_cleanup(struct ril_s *p)
 {
+	GHashTableIter iter;
+	gpointer value;
+	guint i;
+
 	/* Cleanup pending commands */
 
-	if (p->command_queue) {
-		g_queue_free(p->command_queue);
-		p->command_queue = NULL;
+	for (i = 0; i < RIL_NUM_LANES; i++) {
+		if (p->lanes[i].queue == NULL)
+			continue;
+
+		g_queue_foreach(p->lanes[i].queue,
+					ril_request_stop_timer, NULL);
+		g_queue_free(p->lanes[i].queue);
+		p->lanes[i].queue = NULL;
 	}
 
-	if (p->out_queue) {
-		g_queue_free(p->out_queue);
-		p->out_queue = NULL;
+	if (p->writing) {
+		ril_request_stop_timer(p->writing, NULL);
+		p->writing = NULL;
+	}
+
+	if (p->out_requests) {
+		g_hash_table_iter_init(&iter, p->out_requests);
+
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+			ril_request_stop_timer(value, NULL);
+
+		g_hash_table_destroy(p->out_requests);
+		p->out_requests = NULL;
 	}
 
 	/* Cleanup registered notifications */
@@ -329,10 +514,25 @@ static void ril_cleanup(struct ril_s *p)
 		p->notify_list = NULL;
 	}
 
+	if (p->unsol_counters) {
+		g_hash_table_destroy(p->unsol_counters);
+		p->unsol_counters = NULL;
+	}
+
+	if (p->request_lanes) {
+		g_hash_table_destroy(p->request_lanes);
+		p->request_lanes = NULL;
+	}
+
+	decode_cache_flush(p);
+
 	if (p->timeout_source) {
 		g_source_remove(p->timeout_source);
 		p->timeout_source = 0;
 	}
+
+	while (p->parcel_pool_len > 0)
+		parcel_free(&p->parcel_pool[--p->parcel_pool_len]);
 }
 
 void g_ril_set_disconnect_function(GRil *ril, GRilDisconnectFunc disconnect,
@@ -356,56 +556,71 @@ static void io_disconnect(gpointer user_data)
 		ril->user_disconnect(ril->user_disconnect_data);
 }
 
-static void handle_response(struct ril_s *p, struct ril_msg *message)
+/*
+ * Returns the request to write next: the oldest one of the highest
+ * priority lane that has not reached its in-flight limit.
+ */
+static struct ril_request *ril_next_request(struct ril_s *ril)
 {
-	guint count = g_queue_get_length(p->command_queue);
-	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
+	struct ril_lane *lane;
+	guint i;
 
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
+	for (i = 0; i < RIL_NUM_LANES; i++) {
+		lane = &ril->lanes[i];
+
+		if (lane->queue == NULL || g_queue_is_empty(lane->queue))
+			continue;
 
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
+		if (lane_max_in_flight[i] != 0 &&
+				lane->in_flight >= lane_max_in_flight[i])
+			continue;
 
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
+		return g_queue_peek_head(lane->queue);
+	}
 
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
+	return NULL;
+}
 
-			len = g_queue_get_length(p->out_queue);
+static void handle_response(struct ril_s *p, struct ril_msg *message)
+{
+	gpointer serial = GINT_TO_POINTER(message->serial_no);
+	struct ril_request *req;
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	req = g_hash_table_lookup(p->out_requests, serial);
+	if (req == NULL) {
+		ofono_error("No matching request for reply: %s serial_no: %d!",
+			request_id_to_string(p, message->req),
+			message->serial_no);
+		return;
+	}
 
-			ril_request_destroy(req);
+	g_hash_table_remove(p->out_requests, serial);
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	/* A timed out request already gave its lane slot back */
+	if (req->timed_out == FALSE)
+		p->lanes[req->lane].in_flight -= 1;
 
-			break;
-		}
-	}
+	message->req = req->req;
 
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+			p->slot, message->serial_no,
 			request_id_to_string(p, message->req),
-			message->serial_no);
+			ril_error_to_string(message->error));
 
+	if (p->latencyf && req->timed_out == FALSE)
+		p->latencyf(request_id_to_string(p, req->req),
+				message->error,
+				g_get_monotonic_time() - req->sent_time,
+				p->latency_data);
+
+	if (req->callback)
+		req->callback(message, req->user_data);
+
+	ril_request_destroy(req);
+
+	if (p->out_requests && ril_next_request(p))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -419,6 +634,56 @@ static gboolean node_check_destroyed(struct ril_notify_node *node,
 	return FALSE;
 }
 
+static struct ril_unsol_counters *unsol_counters(struct ril_s *p, int req)
+{
+	struct ril_unsol_counters *counters;
+
+	counters = g_hash_table_lookup(p->unsol_counters,
+					GINT_TO_POINTER(req));
+	if (counters != NULL)
+		return counters;
+
+	counters = g_new0(struct ril_unsol_counters, 1);
+	g_hash_table_insert(p->unsol_counters, GINT_TO_POINTER(req),
+				counters);
+
+	return counters;
+}
+
+/*
+ * Returns message as decoded by decode.  The cache is keyed by message
+ * and decoder, so the decoder only runs for the first consumer of a
+ * message; the result is dropped once the message has been dispatched.
+ */
+static gpointer decode_cached(struct ril_s *p, GRil *ril,
+				const struct ril_msg *message,
+				GRilUnsolDecodeFunc decode,
+				GDestroyNotify destroy)
+{
+	struct ril_decoded *d;
+	GSList *l;
+
+	for (l = p->decode_cache; l; l = l->next) {
+		d = l->data;
+
+		if (d->message == message && d->decode == decode)
+			return d->data;
+	}
+
+	d = g_new0(struct ril_decoded, 1);
+	d->message = message;
+	d->decode = decode;
+	d->destroy = destroy;
+	d->data = decode(ril, message);
+
+	if (message->unsolicited && p->unsol_counters)
+		unsol_counters(p, message->req)->decoded += 1;
+
+	p->decode_cache = g_slist_prepend(p->decode_cache, d);
+
+	return d->data;
+}
+
 static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 {
 	struct ril_notify *notify;
@@ -426,11 +691,14 @@ static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 	if (p->notify_list == NULL)
 		return;
 
+	unsol_counters(p, message->req)->received += 1;
+
 	p->in_notify = TRUE;
 
 	notify = g_hash_table_lookup(p->notify_list, &message->req);
 	if (notify != NULL) {
 		GSList *list_item;
+		gpointer data;
 
 		for (list_item = notify->nodes; list_item;
 				list_item = g_slist_next(list_item)) {
@@ -439,7 +707,15 @@ static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 			if (node->destroyed)
 				continue;
 
-			node->callback(message, node->user_data);
+			if (node->decode == NULL) {
+				node->callback(message, node->user_data);
+				continue;
+			}
+
+			data = decode_cached(p, node->ril, message,
+						node->decode,
+						node->decode_destroy);
+			node->decoded_callback(message, data, node->user_data);
 		}
 	} else {
 		/* Only log events not being listended for... */
@@ -457,93 +733,90 @@ static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 
 static void dispatch(struct ril_s *p, struct ril_msg *message)
 {
-	int32_t *unsolicited_field, *id_num_field;
-	gchar *bufp = message->buf;
-	gchar *datap;
-	gsize data_len;
-
-	/* This could be done with a struct/union... */
-	unsolicited_field = (int32_t *) (void *) bufp;
-	if (*unsolicited_field)
-		message->unsolicited = TRUE;
-	else
-		message->unsolicited = FALSE;
-
-	bufp += 4;
-
-	id_num_field = (int32_t *) (void *) bufp;
-	if (message->unsolicited) {
-		message->req = (int) *id_num_field;
-
-		/*
-		 * A RIL Unsolicited Event is two UINT32 fields ( unsolicited,
-		 * and req/ev ), so subtract the length of the header from the
-		 * overall length to calculate the length of the Event Data.
-		 */
-		data_len = message->buf_len - 8;
-	} else {
-		message->serial_no = (int) *id_num_field;
-
-		bufp += 4;
-		message->error = *((int32_t *) (void *) bufp);
-
-		/*
-		 * A RIL Solicited Response is three UINT32 fields ( unsolicied,
-		 * serial_no and error ), so subtract the length of the header
-		 * from the overall length to calculate the length of the Event
-		 * Data.
-		 */
-		data_len = message->buf_len - 12;
-	}
-
-	/* advance to start of data.. */
-	bufp += 4;
+	int32_t field;
+	gsize header_len;
 
 	/*
-	 * Now, use buffer for event data if present
+	 * A RIL Unsolicited Event starts with two UINT32 fields
+	 * ( unsolicited, and req/ev ), a RIL Solicited Response with
+	 * three ( unsolicited, serial_no and error ).
 	 */
-	if (data_len) {
-		datap = g_try_malloc(data_len);
-		if (datap == NULL)
-			goto error;
+	if (message->buf_len < 2 * sizeof(int32_t))
+		goto malformed;
 
-		/* Copy event bytes from message->buf into new buffer */
-		memcpy(datap, bufp, data_len);
+	memcpy(&field, message->buf, sizeof(field));
+	message->unsolicited = field ? TRUE : FALSE;
 
-		/* Free buffer that includes header */
-		g_free(message->buf);
+	memcpy(&field, message->buf + 4, sizeof(field));
 
-		/* ...and replace with new buffer */
-		message->buf = datap;
-		message->buf_len = data_len;
+	if (message->unsolicited) {
+		message->req = field;
+		header_len = 2 * sizeof(int32_t);
 	} else {
-		/* Free buffer that includes header */
-		g_free(message->buf);
+		if (message->buf_len < 3 * sizeof(int32_t))
+			goto malformed;
 
-		/* To know if there was no data when parsing */
-		message->buf = NULL;
-		message->buf_len = 0;
+		message->serial_no = field;
+		memcpy(&message->error, message->buf + 8, sizeof(int32_t));
+		header_len = 3 * sizeof(int32_t);
 	}
 
+	/*
+	 * Point the message at the event data, which stays in the read
+	 * buffer; a NULL buffer tells the parsers there was no data.
+	 */
+	message->buf_len -= header_len;
+	message->buf = message->buf_len ? message->buf + header_len : NULL;
+
 	if (message->unsolicited == TRUE)
 		handle_unsol_req(p, message);
 	else
 		handle_response(p, message);
 
-error:
-	g_free(message->buf);
-	g_free(message);
+	decode_cache_flush(p);
+
+	return;
+
+malformed:
+	ofono_error("%s: RIL record too short (%u bytes)", __func__,
+			(unsigned int) message->buf_len);
 }
 
-static struct ril_msg *read_fixed_record(struct ril_s *p,
-						const guchar *bytes, gsize *len)
+/* Copies len bytes starting at offset out of rbuf, across the wrap */
+static void ril_ring_copy(struct ring_buffer *rbuf, unsigned int offset,
+					void *dest, unsigned int len)
 {
-	struct ril_msg *message;
-	unsigned message_len, plen;
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned int first = 0;
+
+	if (offset < wrap)
+		first = MIN(len, wrap - offset);
+
+	memcpy(dest, ring_buffer_read_ptr(rbuf, offset), first);
+	memcpy((guchar *) dest + first,
+		ring_buffer_read_ptr(rbuf, offset + first), len - first);
+}
+
+/*
+ * Frames the next record in the read buffer.  A record that is
+ * contiguous is handed out in place; only one that wraps around the
+ * end of the buffer is copied into *linear, which the caller frees.
+ * Returns the number of bytes the record occupies, or 0 if it has not
+ * been received completely yet.
+ */
+static gsize read_fixed_record(struct ring_buffer *rbuf,
+				struct ril_msg *message, guchar **linear)
+{
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	uint32_t plen;
+
+	if (len < sizeof(plen))
+		return 0;
 
 	/* First four bytes are length in TCP byte order (Big Endian) */
-	plen = ntohl(*((uint32_t *) (void *) bytes));
-	bytes += 4;
+	ril_ring_copy(rbuf, 0, &plen, sizeof(plen));
+	plen = ntohl(plen);
 
 	/*
 	 * TODO: Verify that 8k is the max message size from rild.
@@ -563,74 +836,49 @@ static struct ril_msg *read_fixed_record(struct ril_s *p,
 
 	/*
 	 * If we don't have the whole fixed record in the ringbuffer
-	 * then return NULL & leave ringbuffer as is.
+	 * then leave ringbuffer as is.
 	 */
+	if (len - sizeof(plen) < plen)
+		return 0;
 
-	message_len = *len - 4;
-	if (message_len < plen)
-		return NULL;
-
-	message = g_malloc(sizeof(struct ril_msg));
-
-	/* allocate ril_msg->buffer */
 	message->buf_len = plen;
-	message->buf = g_malloc(plen);
 
-	/* Copy bytes into message buffer */
-	memmove(message->buf, (const void *) bytes, plen);
+	if (sizeof(plen) + plen <= wrap) {
+		message->buf = (gchar *) ring_buffer_read_ptr(rbuf,
+								sizeof(plen));
+	} else {
+		*linear = g_malloc(plen);
+		ril_ring_copy(rbuf, sizeof(plen), *linear, plen);
+		message->buf = (gchar *) *linear;
+	}
 
-	/* Indicate to caller size of record we extracted */
-	*len = plen + 4;
-	return message;
+	return sizeof(plen) + plen;
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
-	struct ril_msg *message;
 	struct ril_s *p = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	guchar *buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
+	struct ril_msg message;
+	guchar *linear;
+	gsize record_len;
 
 	p->in_read_handler = TRUE;
 
-	while (p->suspended == FALSE && (p->read_so_far < len)) {
-		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
+	while (p->suspended == FALSE) {
+		linear = NULL;
 
-		if (rbytes < 4) {
-			DBG("Not enough bytes for header length: len: %d", len);
-			return;
-		}
+		memset(&message, 0, sizeof(message));
 
-		/*
-		 * This function attempts to read the next full length
-		 * fixed message from the stream.  if not all bytes are
-		 * available, it returns NULL.  otherwise it allocates
-		 * and returns a ril_message with the copied bytes, and
-		 * drains those bytes from the ring_buffer
-		 */
-		message = read_fixed_record(p, buf, &rbytes);
+		record_len = read_fixed_record(rbuf, &message, &linear);
 
 		/* wait for the rest of the record... */
-		if (message == NULL)
+		if (record_len == 0)
 			break;
 
-		buf += rbytes;
-		p->read_so_far += rbytes;
+		dispatch(p, &message);
 
-		/* TODO: need to better understand how wrap works! */
-		if (p->read_so_far == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
-			wrap = len;
-		}
-
-		dispatch(p, message);
-
-		ring_buffer_drain(rbuf, p->read_so_far);
-
-		len -= p->read_so_far;
-		wrap -= p->read_so_far;
-		p->read_so_far = 0;
+		g_free(linear);
+		ring_buffer_drain(rbuf, record_len);
 	}
 
 	p->in_read_handler = FALSE;
@@ -639,6 +887,8 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		g_free(p);
 }
 
+static gboolean request_timeout(gpointer user_data);
+
 /*
  * This function is a GIOFunc and may be called directly or via an IO watch.
  * The return value controls whether the watch stays active ( TRUE ), or is
@@ -648,73 +898,31 @@ static gboolean can_write_data(gpointer data)
 {
 	struct ril_s *ril = data;
 	struct ril_request *req;
-	gsize bytes_written, towrite, len;
-	guint qlen, oqlen;
-	gint id;
-	gboolean written = TRUE;
-	guint i, j;
-
-	qlen = g_queue_get_length(ril->command_queue);
-	if (qlen < 1)
-		return FALSE;
-
-	/* if the whole request was not written */
-	if (ril->req_bytes_written != 0) {
-
-		for (i = 0; i < qlen; i++) {
-			req = g_queue_peek_nth(ril->command_queue, i);
-			if (req) {
-				id = GPOINTER_TO_INT(g_queue_peek_head(
-							ril->out_queue));
-				if (req->id == id)
-					goto out;
-			} else {
-				return FALSE;
-			}
-		}
-	}
-	/* if no requests already sent */
-	oqlen = g_queue_get_length(ril->out_queue);
-	if (oqlen < 1) {
-		req = g_queue_peek_head(ril->command_queue);
-		if (req == NULL)
-			return FALSE;
+	gsize bytes_written, towrite;
 
-		g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-		goto out;
-	}
-
-	for (i = 0; i < qlen; i++) {
-		req = g_queue_peek_nth(ril->command_queue, i);
+	/*
+	 * A request is taken off its lane when writing starts and has to
+	 * go out in full before the next one is picked.  Once it is out it
+	 * moves to out_requests, where the response looks it up by serial.
+	 */
+	req = ril->writing;
+	if (req == NULL) {
+		req = ril_next_request(ril);
 		if (req == NULL)
 			return FALSE;
 
-		for (j = 0; j < oqlen; j++) {
-			id = GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, j));
-			if (req->id == id) {
-				written = TRUE;
-				break;
-			} else {
-				written = FALSE;
-			}
-		}
+		g_queue_pop_head(ril->lanes[req->lane].queue);
+		ril->writing = req;
+		req->sent_time = g_get_monotonic_time();
 
-		if (written == FALSE)
-			break;
+		if (req->timeout_source == 0 &&
+				lane_max_in_flight[req->lane] != 0)
+			req->timeout_source = g_timeout_add_seconds(
+							RIL_LANE_TIMEOUT,
+							request_timeout, req);
 	}
 
-	/* watcher fired though requests already written */
-	if (written == TRUE)
-		return FALSE;
-
-	g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-out:
-	len = req->data_len;
-
-	towrite = len - ril->req_bytes_written;
+	towrite = req->data_len - ril->req_bytes_written;
 
 #ifdef WRITE_SCHEDULER_DEBUG
 	if (towrite > 5)
@@ -731,10 +939,16 @@ out:
 	ril->req_bytes_written += bytes_written;
 	if (bytes_written < towrite)
 		return TRUE;
-	else
-		ril->req_bytes_written = 0;
 
-	return FALSE;
+	ril->req_bytes_written = 0;
+	ril->writing = NULL;
+
+	if (req->timed_out == FALSE)
+		ril->lanes[req->lane].in_flight += 1;
+
+	g_hash_table_insert(ril->out_requests, GINT_TO_POINTER(req->id), req);
+
+	return ril_next_request(ril) != NULL;
 }
 
 static void ril_wakeup_writer(struct ril_s *ril)
@@ -813,6 +1027,7 @@ static struct ril_s *create_ril(const char *sock_path)
 	struct sockaddr_un addr;
 	int sk;
 	GIOChannel *io;
+	guint i;
 
 	ril = g_try_new0(struct ril_s, 1);
 	if (ril == NULL)
@@ -874,22 +1089,19 @@ static struct ril_s *create_ril(const char *sock_path)
 
 	g_ril_io_set_disconnect_function(ril->io, io_disconnect, ril);
 
-	ril->command_queue = g_queue_new();
-	if (ril->command_queue == NULL) {
-		ofono_error("create_ril: Couldn't create command_queue.");
-		goto error;
-	}
+	for (i = 0; i < RIL_NUM_LANES; i++)
+		ril->lanes[i].queue = g_queue_new();
 
-	ril->out_queue = g_queue_new();
-	if (ril->out_queue == NULL) {
-		ofono_error("create_ril: Couldn't create out_queue.");
-		goto error;
-	}
+	ril->out_requests = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
 							ril_notify_destroy);
 
+	ril->unsol_counters = g_hash_table_new_full(g_direct_hash,
+							g_direct_equal,
+							NULL, g_free);
+
 	g_ril_io_set_read_handler(ril->io, new_bytes, ril);
 
 	return ril;
@@ -923,54 +1135,55 @@ static struct ril_notify *ril_notify_create(struct ril_s *ril,
 
 static void ril_cancel_group(struct ril_s *ril, guint group)
 {
-	int n = 0;
-	guint len, i;
+	GHashTableIter iter;
+	gpointer value;
 	struct ril_request *req;
-	gboolean sent;
+	GQueue *queue;
+	GList *l, *next;
+	guint i;
 
-	if (ril->command_queue == NULL)
+	if (ril->out_requests == NULL)
 		return;
 
-	while ((req = g_queue_peek_nth(ril->command_queue, n)) != NULL) {
-		if (req->id == 0 || req->gid != group) {
-			n += 1;
-			continue;
+	for (i = 0; i < RIL_NUM_LANES; i++) {
+		queue = ril->lanes[i].queue;
+
+		for (l = queue->head; l; l = next) {
+			next = l->next;
+			req = l->data;
+
+			if (req->id == 0 || req->gid != group)
+				continue;
+
+			g_queue_delete_link(queue, l);
+			ril_request_destroy(req);
 		}
+	}
 
-		req->callback = NULL;
-		sent = FALSE;
-
-		len = g_queue_get_length(ril->out_queue);
-		for (i = 0; i < len; i++) {
-			if (GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, i))
-					== req->id) {
-				n += 1;
-				sent = TRUE;
-				break;
-			}
-		 }
+	/* A request being written has to go out in full */
+	if (ril->writing && ril->writing->gid == group)
+		ril->writing->callback = NULL;
 
-		if (sent)
-			continue;
+	/* Sent requests stay until their response arrives */
+	g_hash_table_iter_init(&iter, ril->out_requests);
 
-		g_queue_remove(ril->command_queue, req);
-		ril_request_destroy(req);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		req = value;
+
+		if (req->gid == group)
+			req->callback = NULL;
 	}
 }
 
-static guint ril_register(struct ril_s *ril, guint group,
-				const int req, GRilNotifyFunc func,
-				gpointer user_data)
+static struct ril_notify_node *ril_register(struct ril_s *ril, guint group,
+						const int req,
+						gpointer user_data)
 {
 	struct ril_notify *notify;
 	struct ril_notify_node *node;
 
 	if (ril->notify_list == NULL)
-		return 0;
-
-	if (func == NULL)
-		return 0;
+		return NULL;
 
 	notify = g_hash_table_lookup(ril->notify_list, &req);
 
@@ -978,20 +1191,19 @@ static guint ril_register(struct ril_s *ril, guint group,
 		notify = ril_notify_create(ril, req);
 
 	if (notify == NULL)
-		return 0;
+		return NULL;
 
 	node = g_try_new0(struct ril_notify_node, 1);
 	if (node == NULL)
-		return 0;
+		return NULL;
 
 	node->id = ril->next_notify_id++;
 	node->gid = group;
-	node->callback = func;
 	node->user_data = user_data;
 
 	notify->nodes = g_slist_prepend(notify->nodes, node);
 
-	return node->id;
+	return node;
 }
 
 static gboolean ril_unregister(struct ril_s *ril, gboolean mark_only,
@@ -1049,6 +1261,50 @@ void g_ril_init_parcel(const struct ril_msg *message, struct parcel *rilp)
 	rilp->malformed = 0;
 }
 
+void g_ril_init_request_parcel(GRil *ril, struct parcel *rilp, size_t size)
+{
+	struct ril_s *p;
+	guint i;
+
+	if (ril == NULL || ril->parent == NULL)
+		goto fresh;
+
+	p = ril->parent;
+
+	for (i = p->parcel_pool_len; i > 0; i--) {
+		if (p->parcel_pool[i - 1].capacity < size)
+			continue;
+
+		*rilp = p->parcel_pool[i - 1];
+		p->parcel_pool[i - 1] = p->parcel_pool[--p->parcel_pool_len];
+
+		rilp->size = 0;
+		rilp->offset = 0;
+		rilp->malformed = 0;
+		return;
+	}
+
+fresh:
+	parcel_init_sized(rilp, size);
+}
+
+static void ril_recycle_parcel(struct ril_s *p, struct parcel *rilp)
+{
+	if (p->out_requests == NULL ||
+			p->parcel_pool_len == RIL_PARCEL_POOL_SIZE ||
+			rilp->capacity > RIL_PARCEL_POOL_MAX_CAPACITY) {
+		parcel_free(rilp);
+		return;
+	}
+
+	p->parcel_pool[p->parcel_pool_len++] = *rilp;
+
+	rilp->data = NULL;
+	rilp->size = 0;
+	rilp->capacity = 0;
+	rilp->offset = 0;
+}
+
 GRil *g_ril_new(const char *sock_path, enum ofono_ril_vendor vendor)
 {
 	GRil *ril;
@@ -1118,16 +1374,81 @@ GRil *g_ril_ref(GRil *ril)
 	return ril;
 }
 
+/*
+ * Fails a request whose deadline passed.  A request still waiting in its
+ * lane is dropped; one that is being written or was sent stays where it
+ * is, without a callback, so that its late response is still consumed.
+ */
+static gboolean request_timeout(gpointer user_data)
+{
+	struct ril_request *req = user_data;
+	struct ril_s *p = req->ril;
+	GRilResponseFunc callback = req->callback;
+	gboolean queued = FALSE;
+	struct ril_msg message;
+	gint64 start;
+
+	req->timeout_source = 0;
+	req->timed_out = TRUE;
+	req->callback = NULL;
+
+	RIL_TRACE(p, "[%d,%04d]< %s timed out", p->slot, req->id,
+			request_id_to_string(p, req->req));
+
+	if (g_hash_table_lookup(p->out_requests,
+				GINT_TO_POINTER(req->id)) == req) {
+		p->lanes[req->lane].in_flight -= 1;
+
+		if (ril_next_request(p))
+			ril_wakeup_writer(p);
+	} else if (p->writing != req) {
+		g_queue_remove(p->lanes[req->lane].queue, req);
+		queued = TRUE;
+	}
+
+	start = req->sent_time != 0 ? req->sent_time : req->queued_time;
+
+	if (p->latencyf)
+		p->latencyf(request_id_to_string(p, req->req),
+				RIL_E_GRIL_TIMEOUT,
+				g_get_monotonic_time() - start,
+				p->latency_data);
+
+	/* The callback may drop the last reference, p is off limits now */
+	if (callback) {
+		memset(&message, 0, sizeof(message));
+		message.req = req->req;
+		message.serial_no = req->id;
+		message.error = RIL_E_GRIL_TIMEOUT;
+
+		callback(&message, req->user_data);
+	}
+
+	if (queued)
+		ril_request_destroy(req);
+
+	return FALSE;
+}
+
 gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 		GRilResponseFunc func, gpointer user_data,
 		GDestroyNotify notify)
+{
+	return g_ril_send_with_timeout(ril, reqid, rilp, func, user_data,
+					notify, 0);
+}
+
+gint g_ril_send_with_timeout(GRil *ril, const gint reqid,
+				struct parcel *rilp, GRilResponseFunc func,
+				gpointer user_data, GDestroyNotify notify,
+				guint timeout)
 {
 	struct ril_request *r;
 	struct ril_s *p;
 
 	if (ril == NULL
 		|| ril->parent == NULL
-		|| ril->parent->command_queue == NULL)
+		|| ril->parent->out_requests == NULL)
 			return 0;
 
 	p = ril->parent;
@@ -1136,14 +1457,19 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 				func, user_data, notify, FALSE);
 
 	if (rilp != NULL)
-		parcel_free(rilp);
+		ril_recycle_parcel(p, rilp);
 
 	if (r == NULL)
 		return 0;
 
 	p->next_cmd_id++;
 
-	g_queue_push_tail(p->command_queue, r);
+	r->queued_time = g_get_monotonic_time();
+
+	if (timeout > 0)
+		r->timeout_source = g_timeout_add(timeout, request_timeout, r);
+
+	g_queue_push_tail(p->lanes[r->lane].queue, r);
 
 	ril_wakeup_writer(p);
 
@@ -1250,14 +1576,109 @@ gboolean g_ril_set_vendor_print_msg_id_funcs(GRil *ril,
 	return TRUE;
 }
 
+gboolean g_ril_set_latency_function(GRil *ril, GRilLatencyFunc func,
+					gpointer user_data)
+{
+	if (ril == NULL || ril->parent == NULL)
+		return FALSE;
+
+	ril->parent->latencyf = func;
+	ril->parent->latency_data = user_data;
+
+	return TRUE;
+}
+
+gboolean g_ril_set_request_lane(GRil *ril, int req, GRilLane lane)
+{
+	struct ril_s *p;
+
+	if (ril == NULL || ril->parent == NULL || lane >= RIL_NUM_LANES)
+		return FALSE;
+
+	p = ril->parent;
+
+	if (p->request_lanes == NULL)
+		p->request_lanes = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+
+	g_hash_table_insert(p->request_lanes, GINT_TO_POINTER(req),
+				GINT_TO_POINTER(lane));
+
+	return TRUE;
+}
+
 guint g_ril_register(GRil *ril, const int req,
 			GRilNotifyFunc func, gpointer user_data)
 {
-	if (ril == NULL)
+	struct ril_notify_node *node;
+
+	if (ril == NULL || func == NULL)
 		return 0;
 
-	return ril_register(ril->parent, ril->group, req,
-				func, user_data);
+	node = ril_register(ril->parent, ril->group, req, user_data);
+	if (node == NULL)
+		return 0;
+
+	node->callback = func;
+
+	return node->id;
+}
+
+guint g_ril_register_decoded(GRil *ril, const int req,
+				GRilUnsolDecodeFunc decode,
+				GDestroyNotify destroy,
+				GRilDecodedNotifyFunc func,
+				gpointer user_data)
+{
+	struct ril_notify_node *node;
+
+	if (ril == NULL || decode == NULL || func == NULL)
+		return 0;
+
+	node = ril_register(ril->parent, ril->group, req, user_data);
+	if (node == NULL)
+		return 0;
+
+	/* Unregistered before ril goes away, see g_ril_unref */
+	node->ril = ril;
+	node->decode = decode;
+	node->decode_destroy = destroy;
+	node->decoded_callback = func;
+
+	return node->id;
+}
+
+gconstpointer g_ril_decode_cached(GRil *ril, const struct ril_msg *message,
+					GRilUnsolDecodeFunc decode,
+					GDestroyNotify destroy)
+{
+	if (ril == NULL || message == NULL || decode == NULL)
+		return NULL;
+
+	return decode_cached(ril->parent, ril, message, decode, destroy);
+}
+
+gboolean g_ril_get_unsol_counters(GRil *ril, int req,
+					guint *received, guint *decoded)
+{
+	struct ril_unsol_counters *counters;
+
+	if (ril == NULL || ril->parent == NULL)
+		return FALSE;
+
+	if (ril->parent->unsol_counters == NULL)
+		return FALSE;
+
+	counters = g_hash_table_lookup(ril->parent->unsol_counters,
+					GINT_TO_POINTER(req));
+
+	if (received)
+		*received = counters ? counters->received : 0;
+
+	if (decoded)
+		*decoded = counters ? counters->decoded : 0;
+
+	return TRUE;
 }
 
 gboolean g_ril_unregister(GRil *ril, guint id)
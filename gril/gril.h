@@ -57,8 +57,31 @@ typedef void (*GRilResponseFunc)(struct ril_msg *message, gpointer user_data);
 
 typedef void (*GRilNotifyFunc)(struct ril_msg *message, gpointer user_data);
 
+typedef gpointer (*GRilUnsolDecodeFunc)(GRil *ril,
+					const struct ril_msg *message);
+
+typedef void (*GRilDecodedNotifyFunc)(struct ril_msg *message,
+					gconstpointer data, gpointer user_data);
+
 typedef const char *(*GRilMsgIdToStrFunc)(int msg_id);
 
+typedef void (*GRilLatencyFunc)(const char *request, int error, guint usec,
+					gpointer user_data);
+
+/*
+ * Requests are written out by lane, highest priority first, and in the
+ * order they were queued within a lane.  Requests gril does not know
+ * about go into the info lane unless the driver sets another one.
+ */
+enum _GRilLane {
+	G_RIL_LANE_CALL_CONTROL = 0,
+	G_RIL_LANE_DATA,
+	G_RIL_LANE_SIM,
+	G_RIL_LANE_INFO,
+};
+
+typedef enum _GRilLane GRilLane;
+
 /**
  * TRACE:
  * @fmt: format string
@@ -110,6 +133,13 @@ extern char print_buf[];
 
 void g_ril_init_parcel(const struct ril_msg *message, struct parcel *rilp);
 
+/*
+ * Initializes a parcel for building a request of about size bytes.  The
+ * buffer is taken from a small per-channel pool that g_ril_send refills,
+ * so steady state request building does not allocate.  ril may be NULL.
+ */
+void g_ril_init_request_parcel(GRil *ril, struct parcel *rilp, size_t size);
+
 GRil *g_ril_new(const char *sock_path, enum ofono_ril_vendor vendor);
 
 GIOChannel *g_ril_get_channel(GRil *ril);
@@ -143,6 +173,23 @@ gboolean g_ril_set_vendor_print_msg_id_funcs(GRil *ril,
 					GRilMsgIdToStrFunc req_to_string,
 					GRilMsgIdToStrFunc unsol_to_string);
 
+/*!
+ * If the function is not NULL, it is called for every response with the
+ * request name, the RIL error code and the time in microseconds between
+ * writing the request out and receiving its response.
+ */
+gboolean g_ril_set_latency_function(GRil *ril, GRilLatencyFunc func,
+					gpointer user_data);
+
+/*!
+ * Puts a request, typically a vendor one, into the given lane.  Requests
+ * that have to stay in order with those of another lane, like a vendor
+ * call setting done before a DIAL, should be put into that lane.  At most
+ * two requests of the data, SIM and info lanes each wait for a response
+ * at any time, call control requests are never held back.
+ */
+gboolean g_ril_set_request_lane(GRil *ril, int req, GRilLane lane);
+
 
 /*!
  * Queue an RIL request for execution.  The request contents are given
@@ -157,9 +204,52 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 		GRilResponseFunc func, gpointer user_data,
 		GDestroyNotify notify);
 
+/*!
+ * Same as g_ril_send, but if no response arrived within timeout
+ * milliseconds of queueing the request, func is called with error
+ * RIL_E_GRIL_TIMEOUT and a late response is dropped.  With a timeout
+ * of 0, call control requests wait forever and requests of the other
+ * lanes are given up three minutes after they were written.
+ */
+gint g_ril_send_with_timeout(GRil *ril, const gint reqid,
+				struct parcel *rilp, GRilResponseFunc func,
+				gpointer user_data, GDestroyNotify notify,
+				guint timeout);
+
 guint g_ril_register(GRil *ril, const int req,
 			GRilNotifyFunc func, gpointer user_data);
 
+/*!
+ * Registers for an unsolicited message whose payload is decoded with
+ * decode before func is called.  All listeners of a channel that use the
+ * same decoder, on any clone, share a single decoded copy: it is
+ * produced once per message, must not be modified, and is freed with
+ * destroy after the last listener returns.  data is NULL if decoding
+ * failed.  Unregister with g_ril_unregister.
+ */
+guint g_ril_register_decoded(GRil *ril, const int req,
+				GRilUnsolDecodeFunc decode,
+				GDestroyNotify destroy,
+				GRilDecodedNotifyFunc func,
+				gpointer user_data);
+
+/*!
+ * Returns message decoded with decode, running the decoder only if no
+ * other consumer of the same message asked for it before.  For use from
+ * response and notification callbacks: the result is shared, must not be
+ * modified, and is freed with destroy once message has been dispatched.
+ */
+gconstpointer g_ril_decode_cached(GRil *ril, const struct ril_msg *message,
+					GRilUnsolDecodeFunc decode,
+					GDestroyNotify destroy);
+
+/*!
+ * Returns how many unsolicited messages of type req the channel received
+ * and how many times they were run through a decoder.
+ */
+gboolean g_ril_get_unsol_counters(GRil *ril, int req,
+					guint *received, guint *decoded);
+
 gboolean g_ril_unregister(GRil *ril, guint id);
 gboolean g_ril_unregister_all(GRil *ril);
 
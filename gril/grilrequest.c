@@ -183,7 +183,7 @@ gboolean g_ril_request_deactivate_data_call(GRil *gril,
 		goto error;
 	}
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, DEACTIVATE_DATA_CALL_NUM_PARAMS);
 
 	cid_str = g_strdup_printf("%d", req->cid);
@@ -215,7 +215,7 @@ void g_ril_request_power(GRil *gril,
 {
 	DBG("");
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, POWER_PARAMS);
 	parcel_w_int32(rilp, (int32_t) power);
 
@@ -228,7 +228,7 @@ void g_ril_request_set_net_select_manual(GRil *gril,
 {
 	DBG("");
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_string(rilp, mccmnc);
 
 	g_ril_append_print_buf(gril, "(%s)", mccmnc);
@@ -313,7 +313,7 @@ gboolean g_ril_request_setup_data_call(GRil *gril,
 		goto error;
 	}
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, num_param);
 
@@ -366,7 +366,7 @@ gboolean g_ril_request_sim_read_info(GRil *gril,
 {
 	enum ofono_ril_vendor vendor = g_ril_vendor(gril);
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, CMD_GET_RESPONSE);
 	parcel_w_int32(rilp, req->fileid);
@@ -421,7 +421,7 @@ gboolean g_ril_request_sim_read_binary(GRil *gril,
 				CMD_READ_BINARY,
 				req->fileid);
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, CMD_READ_BINARY);
 	parcel_w_int32(rilp, req->fileid);
 
@@ -452,7 +452,7 @@ gboolean g_ril_request_sim_read_record(GRil *gril,
 {
 	enum ofono_ril_vendor vendor = g_ril_vendor(gril);
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, CMD_READ_RECORD);
 	parcel_w_int32(rilp, req->fileid);
 
@@ -490,7 +490,7 @@ gboolean g_ril_request_sim_write_binary(GRil *gril,
 	char *hex_data;
 	int p1, p2;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, CMD_UPDATE_BINARY);
 	parcel_w_int32(rilp, req->fileid);
 
@@ -557,7 +557,7 @@ gboolean g_ril_request_sim_write_record(GRil *gril,
 	char *hex_data;
 	int p2;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, CMD_UPDATE_RECORD);
 	parcel_w_int32(rilp, req->fileid);
 
@@ -603,7 +603,7 @@ void g_ril_request_read_imsi(GRil *gril,
 				const gchar *aid_str,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, GET_IMSI_NUM_PARAMS);
 	parcel_w_string(rilp, aid_str);
 
@@ -615,7 +615,7 @@ void g_ril_request_pin_send(GRil *gril,
 				const gchar *aid_str,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, ENTER_SIM_PIN_PARAMS);
 	parcel_w_string(rilp, passwd);
@@ -675,7 +675,7 @@ gboolean g_ril_request_pin_change_state(GRil *gril,
 		goto error;
 	}
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, SET_FACILITY_LOCK_PARAMS);
 
 	parcel_w_string(rilp, lock_type);
@@ -710,7 +710,7 @@ void g_ril_request_pin_send_puk(GRil *gril,
 				const gchar *aid_str,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, ENTER_SIM_PUK_PARAMS);
 	parcel_w_string(rilp, puk);
@@ -727,7 +727,7 @@ void g_ril_request_change_passwd(GRil *gril,
 					const gchar *aid_str,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, CHANGE_SIM_PIN_PARAMS);
 	parcel_w_string(rilp, old_passwd);
@@ -745,7 +745,9 @@ void g_ril_request_sms_cmgs(GRil *gril,
 	int smsc_len;
 	char *tpdu;
 
-	parcel_init(rilp);
+	/* Count, NULL SMSC and the hex encoded TPDU */
+	g_ril_init_request_parcel(gril, rilp, 2 * sizeof(int32_t) +
+				PARCEL_STRING_SIZE(req->tpdu_len * 2));
 	parcel_w_int32(rilp, 2);	/* Number of strings */
 
 	/*
@@ -781,7 +783,7 @@ void g_ril_request_sms_cmgs(GRil *gril,
 void g_ril_request_sms_acknowledge(GRil *gril,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 2); /* Number of int32 values in array */
 	parcel_w_int32(rilp, 1); /* Successful receipt */
 	parcel_w_int32(rilp, 0); /* error code */
@@ -800,7 +802,7 @@ void g_ril_request_set_smsc_address(GRil *gril,
 	else
 		snprintf(number, sizeof(number), "\"%s\"", sca->number);
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_string(rilp, number);
 
 	g_ril_append_print_buf(gril, "(%s)", number);
@@ -811,7 +813,7 @@ void g_ril_request_dial(GRil *gril,
 			enum ofono_clir_option clir,
 			struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	/* Number to dial */
 	parcel_w_string(rilp, phone_number_to_string(ph));
@@ -831,7 +833,7 @@ void g_ril_request_hangup(GRil *gril,
 				unsigned call_id,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1); /* Always 1 - AT+CHLD=1x */
 	parcel_w_int32(rilp, call_id);
 
@@ -844,7 +846,7 @@ void g_ril_request_dtmf(GRil *gril,
 {
 	char ril_dtmf[2];
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	/* Ril wants just one character, but we need to send as string */
 	ril_dtmf[0] = dtmf_char;
 	ril_dtmf[1] = '\0';
@@ -857,7 +859,7 @@ void g_ril_request_separate_conn(GRil *gril,
 					int call_id,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	/* Payload is an array that holds just one element */
 	parcel_w_int32(rilp, 1);
@@ -869,7 +871,7 @@ void g_ril_request_separate_conn(GRil *gril,
 void g_ril_request_set_supp_svc_notif(GRil *gril,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1); /* size of array */
 	parcel_w_int32(rilp, 1); /* notifications enabled */
 
@@ -878,7 +880,7 @@ void g_ril_request_set_supp_svc_notif(GRil *gril,
 
 void g_ril_request_set_mute(GRil *gril, int muted, struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 1);
 	parcel_w_int32(rilp, muted);
@@ -890,7 +892,7 @@ void g_ril_request_send_ussd(GRil *gril,
 				const char *ussd,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_string(rilp, ussd);
 
 	g_ril_append_print_buf(gril, "(%s)", ussd);
@@ -900,7 +902,7 @@ void g_ril_request_set_call_waiting(GRil *gril,
 					int enabled, int serviceclass,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 2);	/* Number of params */
 	parcel_w_int32(rilp, enabled);	/* on/off */
@@ -925,7 +927,7 @@ void g_ril_request_query_call_waiting(GRil *gril,
 					int serviceclass,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 1);	/* Number of params */
 	/*
@@ -941,7 +943,7 @@ void g_ril_request_set_clir(GRil *gril,
 				int mode,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 1);	/* Number of params */
 	parcel_w_int32(rilp, mode);
@@ -953,7 +955,7 @@ void g_ril_request_screen_state(GRil *gril,
 				int state,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, 1);	/* Number of params */
 	parcel_w_int32(rilp, state);
 
@@ -963,7 +965,7 @@ void g_ril_request_screen_state(GRil *gril,
 void g_ril_request_call_fwd(GRil *gril,	const struct req_call_fwd *req,
 				struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, req->action);
 	parcel_w_int32(rilp, req->type);
@@ -1002,7 +1004,7 @@ void g_ril_request_call_fwd(GRil *gril,	const struct req_call_fwd *req,
 void g_ril_request_set_preferred_network_type(GRil *gril, int net_type,
 						struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 1);	/* Number of params */
 	parcel_w_int32(rilp, net_type);
@@ -1016,7 +1018,7 @@ void g_ril_request_query_facility_lock(GRil *gril, const char *facility,
 {
 	char svcs_str[4];
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 4);	/* # of strings */
 	parcel_w_string(rilp, facility);
@@ -1036,7 +1038,7 @@ void g_ril_request_set_facility_lock(GRil *gril, const char *facility,
 	char svcs_str[4];
 	const char *enable_str;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 5);	/* # of strings */
 	parcel_w_string(rilp, facility);
@@ -1059,7 +1061,7 @@ void g_ril_request_change_barring_password(GRil *gril, const char *facility,
 						const char *new_passwd,
 						struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, 3);	/* # of strings */
 	parcel_w_string(rilp, facility);
@@ -1075,7 +1077,7 @@ void g_ril_request_oem_hook_raw(GRil *gril, const void *payload, size_t length,
 {
 	char *hex_dump = NULL;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, sizeof(int32_t) + length);
 	parcel_w_raw(rilp, payload, length);
 
 	if (payload != NULL)
@@ -1090,7 +1092,7 @@ void g_ril_request_oem_hook_strings(GRil *gril, const char **strs, int num_str,
 {
 	int i;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 	parcel_w_int32(rilp, num_str);
 
 	g_ril_append_print_buf(gril, "(");
@@ -1118,7 +1120,7 @@ void g_ril_request_set_initial_attach_apn(GRil *gril, const char *apn,
 	const char *proto_str;
 	const int auth_type = RIL_AUTH_ANY;
 
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_string(rilp, apn);
 
@@ -1156,7 +1158,7 @@ void g_ril_request_set_uicc_subscription(GRil *gril, int slot_id,
 					int sub_status,
 					struct parcel *rilp)
 {
-	parcel_init(rilp);
+	g_ril_init_request_parcel(gril, rilp, 0);
 
 	parcel_w_int32(rilp, slot_id);
 	parcel_w_int32(rilp, app_index);
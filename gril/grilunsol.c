@@ -510,14 +510,13 @@ static int get_gsm_strength(int signal)
 		return -1;
 }
 
-int g_ril_unsol_parse_signal_strength(GRil *gril, const struct ril_msg *message,
-					int ril_tech)
+static void parse_signal_strength(GRil *gril, const struct ril_msg *message,
+					struct unsol_signal_strength *ss)
 {
 	struct parcel rilp;
 	int gw_sigstr, gw_signal, cdma_dbm, evdo_dbm;
 	int lte_sigstr = -1, lte_rsrp = -1, lte_rssnr = -1;
 	int lte_signal;
-	int signal;
 
 	g_ril_init_parcel(message, &rilp);
 
@@ -563,20 +562,46 @@ int g_ril_unsol_parse_signal_strength(GRil *gril, const struct ril_msg *message,
 	else
 		g_ril_print_response(gril, message);
 
+	ss->gw_signal = gw_signal;
+	ss->lte_signal = lte_signal;
+}
+
+struct unsol_signal_strength *g_ril_unsol_decode_signal_strength(GRil *gril,
+						const struct ril_msg *message)
+{
+	struct unsol_signal_strength *ss;
+
+	ss = g_new0(struct unsol_signal_strength, 1);
+	parse_signal_strength(gril, message, ss);
+
+	return ss;
+}
+
+int g_ril_unsol_signal_strength_for_tech(const struct unsol_signal_strength *ss,
+						int ril_tech)
+{
 	/* Return the first valid one */
-	if (gw_signal != -1 && lte_signal != -1)
+	if (ss->gw_signal != -1 && ss->lte_signal != -1)
 		if (ril_tech == RADIO_TECH_LTE)
-			signal = lte_signal;
+			return ss->lte_signal;
 		else
-			signal = gw_signal;
-	else if (gw_signal != -1)
-		signal = gw_signal;
-	else if (lte_signal != -1)
-		signal = lte_signal;
-	else
-		signal = -1;
+			return ss->gw_signal;
+	else if (ss->gw_signal != -1)
+		return ss->gw_signal;
+	else if (ss->lte_signal != -1)
+		return ss->lte_signal;
+
+	return -1;
+}
+
+int g_ril_unsol_parse_signal_strength(GRil *gril, const struct ril_msg *message,
+					int ril_tech)
+{
+	struct unsol_signal_strength ss;
+
+	parse_signal_strength(gril, message, &ss);
 
-	return signal;
+	return g_ril_unsol_signal_strength_for_tech(&ss, ril_tech);
 }
 
 void g_ril_unsol_free_supp_svc_notif(struct unsol_supp_svc_notif *unsol)
@@ -64,6 +64,12 @@ struct unsol_ussd {
 	char *message;
 };
 
+/* Signal strength in percent per technology, -1 if not available */
+struct unsol_signal_strength {
+	int gw_signal;
+	int lte_signal;
+};
+
 int g_ril_unsol_parse_connected(GRil *gril, const struct ril_msg *message);
 
 void g_ril_unsol_free_data_call_list(struct ril_data_call_list *data_call_list);
@@ -85,6 +91,13 @@ int g_ril_unsol_parse_radio_state_changed(GRil *gril,
 int g_ril_unsol_parse_signal_strength(GRil *gril, const struct ril_msg *message,
 					int ril_tech);
 
+/* Technology independent, so that it can be shared between consumers */
+struct unsol_signal_strength *g_ril_unsol_decode_signal_strength(GRil *gril,
+						const struct ril_msg *message);
+
+int g_ril_unsol_signal_strength_for_tech(const struct unsol_signal_strength *ss,
+						int ril_tech);
+
 void g_ril_unsol_free_supp_svc_notif(struct unsol_supp_svc_notif *unsol);
 
 struct unsol_supp_svc_notif *g_ril_unsol_parse_supp_svc_notif(GRil *gril,
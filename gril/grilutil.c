@@ -187,6 +187,7 @@ const char *ril_error_to_string(int error)
 	case RIL_E_SS_MODIFIED_TO_SS: return "SS_MODIFIED_TO_SS";
 	case RIL_E_SUBSCRIPTION_NOT_SUPPORTED:
 		return "SUBSCRIPTION_NOT_SUPPORTED";
+	case RIL_E_GRIL_TIMEOUT: return "GRIL_TIMEOUT";
 	default: return "<unknown errno>";
 	}
 }
@@ -47,20 +47,43 @@
 
 typedef uint16_t char16_t;
 
-void parcel_init(struct parcel *p)
+void parcel_init_sized(struct parcel *p, size_t size)
 {
-	p->data = g_malloc0(sizeof(int32_t));
+	if (size < PARCEL_MIN_CAPACITY)
+		size = PARCEL_MIN_CAPACITY;
+
+	p->data = g_malloc(size);
 	p->size = 0;
-	p->capacity = sizeof(int32_t);
+	p->capacity = size;
 	p->offset = 0;
 	p->malformed = 0;
 }
 
+void parcel_init(struct parcel *p)
+{
+	parcel_init_sized(p, PARCEL_MIN_CAPACITY);
+}
+
+/*
+ * Make room for at least size more bytes.  The capacity is doubled so
+ * that building a parcel field by field costs an amortized constant
+ * number of reallocations.
+ */
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t capacity = p->capacity ? p->capacity : PARCEL_MIN_CAPACITY;
+
+	while (capacity < p->capacity + size)
+		capacity *= 2;
+
+	p->data = g_realloc(p->data, capacity);
+	p->capacity = capacity;
+}
+
+static inline void parcel_reserve(struct parcel *p, size_t len)
+{
+	if (p->offset + len > p->capacity)
+		parcel_grow(p, p->offset + len - p->capacity);
 }
 
 void parcel_free(struct parcel *p)
@@ -91,79 +114,86 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
-
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
-		}
-	}
+	parcel_reserve(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
+
 	return 0;
 }
 
+/* Number of UTF-16 code units needed for str, or -1 if it is not UTF-8 */
+static glong utf8_to_utf16_len(const char *str)
+{
+	glong len = 0;
+
+	while (*str) {
+		gunichar c = g_utf8_get_char_validated(str, -1);
+
+		if (c == (gunichar) -1 || c == (gunichar) -2)
+			return -1;
+
+		len += c >= 0x10000 ? 2 : 1;
+		str = g_utf8_next_char(str);
+	}
+
+	return len;
+}
+
+/*
+ * Strings are written as their length in UTF-16 code units followed by
+ * the NUL terminated UTF-16 data, padded to a multiple of four bytes.
+ * The UTF-8 input is transcoded straight into the parcel buffer.
+ */
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
+	glong len16;
 	size_t len;
-	size_t gs16_size;
+	size_t padded;
+	char16_t *out;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
-
-	if (parcel_w_int32(p, gs16_len) == -1)
+	len16 = utf8_to_utf16_len(str);
+	if (len16 < 0) {
+		ofono_error("%s: invalid UTF-8 string", __func__);
+		parcel_w_int32(p, -1);
 		return -1;
+	}
 
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	parcel_w_int32(p, len16);
+
+	len = (len16 + 1) * sizeof(char16_t);
+	padded = PAD_SIZE(len);
+
+	parcel_reserve(p, padded);
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
+	out = (char16_t *) (void *) (p->data + p->offset);
 
+	while (*str) {
+		gunichar c = g_utf8_get_char(str);
+
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			*out++ = 0xd800 + (c >> 10);
+			*out++ = 0xdc00 + (c & 0x3ff);
 		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
+			*out++ = c;
 		}
+
+		str = g_utf8_next_char(str);
 	}
 
-	g_free(gs16);
+	/* NUL terminator plus zeroed padding */
+	memset(out, 0, padded - len + sizeof(char16_t));
+
+	p->offset += padded;
+	p->size += padded;
+
 	return 0;
 }
 
@@ -208,20 +238,12 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 	}
 
 	parcel_w_int32(p, len);
+	parcel_reserve(p, len);
 
-	for (;;) {
+	memcpy(p->data + p->offset, data, len);
+	p->offset += len;
+	p->size += len;
 
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += len;
-			p->size += len;
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, len);
-		}
-	}
 	return 0;
 }
 
@@ -24,6 +24,12 @@
 
 #include <stdlib.h>
 
+/* Initial capacity of parcels created without a size hint */
+#define PARCEL_MIN_CAPACITY 64
+
+/* Bytes taken by a string of len UTF-16 code units, length included */
+#define PARCEL_STRING_SIZE(len) (4 + ((((len) + 1) * 2 + 3) & ~3))
+
 struct parcel {
 	char *data;
 	size_t offset;
@@ -38,6 +44,7 @@ struct parcel_str_array {
 };
 
 void parcel_init(struct parcel *p);
+void parcel_init_sized(struct parcel *p, size_t size);
 void parcel_grow(struct parcel *p, size_t size);
 void parcel_free(struct parcel *p);
 int32_t parcel_r_int32(struct parcel *p);
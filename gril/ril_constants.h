@@ -62,6 +62,9 @@
 #define RIL_E_SS_MODIFIED_TO_SS 25
 #define RIL_E_SUBSCRIPTION_NOT_SUPPORTED 26
 
+/* Never sent by rild, GRil fails requests past their deadline with it */
+#define RIL_E_GRIL_TIMEOUT -1
+
 /* Preferred network types */
 #define PREF_NET_TYPE_GSM_WCDMA 0
 #define PREF_NET_TYPE_GSM_ONLY 1
@@ -125,6 +125,16 @@ void ofono_modem_driver_unregister(const struct ofono_modem_driver *);
 struct ofono_modem *ofono_modem_find(ofono_modem_compare_cb_t func,
 					void *user_data);
 
+enum ofono_latency_result {
+	OFONO_LATENCY_RESULT_OK = 0,
+	OFONO_LATENCY_RESULT_ERROR,
+	OFONO_LATENCY_RESULT_TIMEOUT,
+};
+
+void ofono_modem_record_latency(struct ofono_modem *modem,
+				const char *operation, unsigned int usec,
+				enum ofono_latency_result result);
+
 #ifdef __cplusplus
 }
 #endif
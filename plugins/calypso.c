@@ -56,6 +56,7 @@
 #include <ofono/voicecall.h>
 #include <ofono/stk.h>
 
+#include <drivers/atmodem/atutil.h>
 #include <drivers/atmodem/vendor.h>
 
 #define CALYPSO_POWER_PATH "/sys/bus/platform/devices/gta02-pm-gsm.0/power_on"
@@ -276,6 +277,8 @@ static void mux_setup(GAtMux *mux, gpointer user_data)
 		g_at_syntax_unref(syntax);
 		g_io_channel_unref(io);
 
+		at_util_record_latency(data->dlcs[i], modem);
+
 		if (getenv("OFONO_AT_DEBUG"))
 			g_at_chat_set_debug(data->dlcs[i], calypso_debug,
 							debug_prefixes[i]);
@@ -327,6 +330,8 @@ static void modem_initialize(struct ofono_modem *modem)
 	if (chat == NULL)
 		goto error;
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG") != NULL)
 		g_at_chat_set_debug(chat, calypso_debug, "Setup: ");
 
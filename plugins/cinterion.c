@@ -120,6 +120,8 @@ static int cinterion_enable(struct ofono_modem *modem)
 	if (chat == NULL)
 		return -ENOMEM;
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, cinterion_debug, "");
 
@@ -65,6 +65,7 @@ struct gobi_data {
 	struct qmi_service *dms;
 	unsigned long features;
 	unsigned int discover_attempts;
+	unsigned int dms_queries;
 	uint8_t oper_mode;
 };
 
@@ -146,26 +147,13 @@ static void power_reset_cb(struct qmi_result *result, void *user_data)
 	ofono_modem_set_powered(modem, TRUE);
 }
 
-static void get_oper_mode_cb(struct qmi_result *result, void *user_data)
+static void dms_query_done(struct ofono_modem *modem)
 {
-	struct ofono_modem *modem = user_data;
 	struct gobi_data *data = ofono_modem_get_data(modem);
 	struct qmi_param *param;
-	uint8_t mode;
 
-	DBG("");
-
-	if (qmi_result_set_error(result, NULL)) {
-		shutdown_device(modem);
+	if (--data->dms_queries > 0)
 		return;
-	}
-
-	if (!qmi_result_get_uint8(result, QMI_DMS_RESULT_OPER_MODE, &mode)) {
-		shutdown_device(modem);
-		return;
-	}
-
-	data->oper_mode = mode;
 
 	switch (data->oper_mode) {
 	case QMI_DMS_OPER_MODE_ONLINE:
@@ -188,10 +176,32 @@ static void get_oper_mode_cb(struct qmi_result *result, void *user_data)
 	}
 }
 
-static void get_caps_cb(struct qmi_result *result, void *user_data)
+static void get_oper_mode_cb(struct qmi_result *result, void *user_data)
 {
 	struct ofono_modem *modem = user_data;
 	struct gobi_data *data = ofono_modem_get_data(modem);
+	uint8_t mode;
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		shutdown_device(modem);
+		return;
+	}
+
+	if (!qmi_result_get_uint8(result, QMI_DMS_RESULT_OPER_MODE, &mode)) {
+		shutdown_device(modem);
+		return;
+	}
+
+	data->oper_mode = mode;
+
+	dms_query_done(modem);
+}
+
+static void get_caps_cb(struct qmi_result *result, void *user_data)
+{
+	struct ofono_modem *modem = user_data;
 	const struct qmi_dms_device_caps *caps;
 	uint16_t len;
 	uint8_t i;
@@ -211,9 +221,8 @@ static void get_caps_cb(struct qmi_result *result, void *user_data)
         for (i = 0; i < caps->radio_if_count; i++)
                 DBG("radio = %d", caps->radio_if[i]);
 
-	if (qmi_service_send(data->dms, QMI_DMS_GET_OPER_MODE, NULL,
-					get_oper_mode_cb, modem, NULL) > 0)
-		return;
+	dms_query_done(modem);
+	return;
 
 error:
 	shutdown_device(modem);
@@ -231,8 +240,19 @@ static void create_dms_cb(struct qmi_service *service, void *user_data)
 
 	data->dms = qmi_service_ref(service);
 
+	/*
+	 * Both queries are in flight together, whichever answer arrives
+	 * last finishes the enable.  A failure of either shuts down the
+	 * device, which cancels the other one along with the DMS client.
+	 */
+	data->dms_queries = 2;
+
 	if (qmi_service_send(data->dms, QMI_DMS_GET_CAPS, NULL,
-					get_caps_cb, modem, NULL) > 0)
+					get_caps_cb, modem, NULL) == 0)
+		goto error;
+
+	if (qmi_service_send(data->dms, QMI_DMS_GET_OPER_MODE, NULL,
+					get_oper_mode_cb, modem, NULL) > 0)
 		return;
 
 error:
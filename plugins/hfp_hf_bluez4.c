@@ -46,6 +46,7 @@
 #include <ofono/handsfree.h>
 #include <ofono/siri.h>
 
+#include <drivers/atmodem/atutil.h>
 #include <drivers/hfpmodem/slc.h>
 
 #include "bluez4.h"
@@ -150,6 +151,8 @@ static int service_level_connection(struct ofono_modem *modem, int fd)
 
 	g_at_chat_set_disconnect_function(chat, hfp_disconnected_cb, modem);
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, hfp_debug, "");
 
@@ -165,6 +165,8 @@ static int service_level_connection(struct ofono_modem *modem,
 
 	g_at_chat_set_disconnect_function(chat, hfp_disconnected_cb, modem);
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, hfp_debug, "");
 
@@ -0,0 +1,979 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2011  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <gdbus.h>
+
+#define OFONO_API_SUBJECT_TO_CHANGE
+#include <ofono/plugin.h>
+#include <ofono/log.h>
+#include <ofono/history.h>
+#include <ofono/modem.h>
+#include <ofono/sim.h>
+#include <ofono/dbus.h>
+#include <ofono/types.h>
+
+#include "ofono.h"
+#include "common.h"
+#include "storage.h"
+
+#define HISTORY_STORE_INTERFACE OFONO_SERVICE ".History"
+
+#define HISTORY_STORE_PATH STORAGEDIR "/%s/history"
+#define HISTORY_STORE_MODE 0600
+
+/*
+ * Events are queued in memory and written out as a single batch, either
+ * after HISTORY_FLUSH_INTERVAL seconds or once HISTORY_FLUSH_THRESHOLD
+ * events are pending, whichever comes first.
+ */
+#define HISTORY_FLUSH_INTERVAL 5
+#define HISTORY_FLUSH_THRESHOLD 32
+
+#define HISTORY_QUERY_MAX 256
+#define HISTORY_TEXT_MAX (1024 * 1024)
+
+/*
+ * Once a flush would grow the store past HISTORY_STORE_MAX bytes, the
+ * oldest events are dropped and the file is rewritten so that at most
+ * HISTORY_STORE_KEEP bytes remain.
+ */
+#define HISTORY_STORE_MAX (8 * 1024 * 1024)
+#define HISTORY_STORE_KEEP (6 * 1024 * 1024)
+
+enum history_type {
+	HISTORY_TYPE_CALL_OUTGOING = 0,
+	HISTORY_TYPE_CALL_INCOMING,
+	HISTORY_TYPE_CALL_MISSED,
+	HISTORY_TYPE_SMS_INCOMING,
+	HISTORY_TYPE_SMS_OUTGOING,
+};
+
+/*
+ * On-disk record header, followed by the address, the name and the text
+ * of the event.  None of the strings are NUL terminated.  The store is
+ * private to this host, so the native byte order is used.
+ */
+struct history_record {
+	guint8 type;
+	guint8 status;
+	guint8 addr_len;
+	guint8 name_len;
+	guint32 text_len;
+	gint64 start;
+	gint64 end;
+	unsigned char uuid[OFONO_SHA1_UUID_LEN];
+} __attribute__((packed));
+
+/* In-memory index, one entry per record in file order */
+struct history_entry {
+	gint64 time;
+	guint64 offset;
+	guint8 type;
+	guint8 status;
+};
+
+struct history_store {
+	struct ofono_modem *modem;
+	char *path;
+	int fd;
+	guint64 file_size;
+	GArray *entries;
+	GArray *by_time;
+	GHashTable *numbers;
+	GHashTable *pending_sms;
+	GByteArray *batch;
+	unsigned int batch_count;
+	GSList *dirty;
+	guint flush_source;
+};
+
+static gboolean sms_status_is_final(guint8 status)
+{
+	switch (status) {
+	case OFONO_HISTORY_SMS_STATUS_PENDING:
+	case OFONO_HISTORY_SMS_STATUS_SUBMITTED:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+static void id_array_free(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+static struct history_entry *store_entry(struct history_store *hs,
+						guint32 id)
+{
+	return &g_array_index(hs->entries, struct history_entry, id);
+}
+
+static void store_index(struct history_store *hs, guint64 offset,
+				const struct history_record *rec,
+				const char *addr)
+{
+	struct history_entry entry;
+	guint32 id = hs->entries->len;
+	guint32 lo, hi;
+	GArray *ids;
+
+	entry.time = rec->start;
+	entry.offset = offset;
+	entry.type = rec->type;
+	entry.status = rec->status;
+	g_array_append_val(hs->entries, entry);
+
+	/* Events arrive almost in order, so this is nearly always append */
+	lo = 0;
+	hi = hs->by_time->len;
+
+	if (hi > 0 && store_entry(hs, g_array_index(hs->by_time, guint32,
+						hi - 1))->time > entry.time) {
+		while (lo < hi) {
+			guint32 mid = (lo + hi) / 2;
+			guint32 mid_id = g_array_index(hs->by_time,
+							guint32, mid);
+
+			if (store_entry(hs, mid_id)->time <= entry.time)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+	} else
+		lo = hi;
+
+	g_array_insert_val(hs->by_time, lo, id);
+
+	if (addr[0] != '\0') {
+		ids = g_hash_table_lookup(hs->numbers, addr);
+
+		if (ids == NULL) {
+			ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+			g_hash_table_insert(hs->numbers, g_strdup(addr), ids);
+		}
+
+		g_array_append_val(ids, id);
+	}
+
+	if (rec->type == HISTORY_TYPE_SMS_OUTGOING &&
+			!sms_status_is_final(rec->status))
+		g_hash_table_insert(hs->pending_sms,
+				g_strdup(ofono_uuid_to_str(
+					(const struct ofono_uuid *) rec->uuid)),
+				GUINT_TO_POINTER(id));
+}
+
+static gboolean store_load(struct history_store *hs)
+{
+	struct history_record rec;
+	char addr[256];
+	guint64 offset = 0;
+	struct stat st;
+	ssize_t len;
+
+	if (fstat(hs->fd, &st) < 0)
+		return FALSE;
+
+	while (offset + sizeof(rec) <= (guint64) st.st_size) {
+		len = TFR(pread(hs->fd, &rec, sizeof(rec), offset));
+		if (len != sizeof(rec))
+			break;
+
+		if (rec.type > HISTORY_TYPE_SMS_OUTGOING ||
+				rec.text_len > HISTORY_TEXT_MAX)
+			break;
+
+		len = sizeof(rec) + rec.addr_len + rec.name_len + rec.text_len;
+		if (offset + len > (guint64) st.st_size)
+			break;
+
+		if (TFR(pread(hs->fd, addr, rec.addr_len,
+				offset + sizeof(rec))) != rec.addr_len)
+			break;
+
+		addr[rec.addr_len] = '\0';
+		store_index(hs, offset, &rec, addr);
+		offset += len;
+	}
+
+	/* Drop any partially written trailing batch */
+	if (offset != (guint64) st.st_size) {
+		ofono_warn("History store truncated from %lld to %llu bytes",
+				(long long) st.st_size,
+				(unsigned long long) offset);
+
+		if (ftruncate(hs->fd, offset) < 0)
+			return FALSE;
+	}
+
+	hs->file_size = offset;
+
+	return TRUE;
+}
+
+static void store_reset(struct history_store *hs)
+{
+	g_array_set_size(hs->entries, 0);
+	g_array_set_size(hs->by_time, 0);
+	g_hash_table_remove_all(hs->numbers);
+	g_hash_table_remove_all(hs->pending_sms);
+}
+
+static gboolean copy_range(int from, int to, guint64 offset, guint64 len)
+{
+	unsigned char buf[4096];
+
+	while (len > 0) {
+		ssize_t n = TFR(pread(from, buf, MIN(len, sizeof(buf)),
+					offset));
+
+		if (n <= 0)
+			return FALSE;
+
+		if (TFR(write(to, buf, n)) != n)
+			return FALSE;
+
+		offset += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Drops the oldest events so that the remaining ones and the pending
+ * batch fit into HISTORY_STORE_KEEP bytes.  The result is written to a
+ * new file which then replaces the store, and the index is rebuilt.
+ */
+static gboolean store_compact(struct history_store *hs)
+{
+	guint64 cut = hs->file_size;
+	char *tmp;
+	guint32 i;
+	int fd;
+
+	for (i = 0; i < hs->entries->len; i++) {
+		guint64 offset = store_entry(hs, i)->offset;
+
+		if (offset >= hs->file_size)
+			break;
+
+		if (hs->file_size - offset + hs->batch->len <=
+				HISTORY_STORE_KEEP) {
+			cut = offset;
+			break;
+		}
+	}
+
+	DBG("dropping %llu of %llu bytes", (unsigned long long) cut,
+			(unsigned long long) hs->file_size);
+
+	tmp = g_strconcat(hs->path, ".tmp", NULL);
+
+	fd = TFR(open(tmp, O_RDWR | O_CREAT | O_TRUNC, HISTORY_STORE_MODE));
+	if (fd < 0)
+		goto error;
+
+	if (!copy_range(hs->fd, fd, cut, hs->file_size - cut))
+		goto error;
+
+	if (TFR(write(fd, hs->batch->data, hs->batch->len)) !=
+			(ssize_t) hs->batch->len)
+		goto error;
+
+	if (fdatasync(fd) < 0 || rename(tmp, hs->path) < 0)
+		goto error;
+
+	g_free(tmp);
+
+	close(hs->fd);
+	hs->fd = fd;
+
+	g_byte_array_set_size(hs->batch, 0);
+	hs->batch_count = 0;
+
+	store_reset(hs);
+
+	return store_load(hs);
+
+error:
+	ofono_error("Unable to compact history: %s", strerror(errno));
+
+	if (fd >= 0)
+		close(fd);
+
+	unlink(tmp);
+	g_free(tmp);
+
+	return FALSE;
+}
+
+static gboolean store_flush(struct history_store *hs)
+{
+	GSList *l;
+
+	if (hs->flush_source > 0) {
+		g_source_remove(hs->flush_source);
+		hs->flush_source = 0;
+	}
+
+	/*
+	 * Status updates rewrite the status byte of an already stored
+	 * record, do them first so a compaction copies the new status.
+	 */
+	for (l = hs->dirty; l; l = l->next) {
+		struct history_entry *entry =
+			store_entry(hs, GPOINTER_TO_UINT(l->data));
+		off_t off = entry->offset +
+				G_STRUCT_OFFSET(struct history_record, status);
+
+		if (TFR(pwrite(hs->fd, &entry->status, 1, off)) != 1)
+			ofono_error("Unable to update history status");
+	}
+
+	g_slist_free(hs->dirty);
+	hs->dirty = NULL;
+
+	if (hs->file_size + hs->batch->len > HISTORY_STORE_MAX)
+		return store_compact(hs);
+
+	if (hs->batch->len > 0) {
+		ssize_t written = TFR(pwrite(hs->fd, hs->batch->data,
+						hs->batch->len,
+						hs->file_size));
+
+		if (written != (ssize_t) hs->batch->len) {
+			ofono_error("Unable to write history batch: %s",
+					written < 0 ? strerror(errno) :
+					"short write");
+
+			/* Keep the batch and retry on the next flush */
+			if (ftruncate(hs->fd, hs->file_size) < 0)
+				ofono_error("Unable to roll back history");
+
+			return FALSE;
+		}
+
+		DBG("flushed %u events, %u bytes", hs->batch_count,
+				hs->batch->len);
+
+		hs->file_size += hs->batch->len;
+		g_byte_array_set_size(hs->batch, 0);
+		hs->batch_count = 0;
+	}
+
+	fdatasync(hs->fd);
+
+	return TRUE;
+}
+
+static gboolean store_flush_cb(gpointer user_data)
+{
+	struct history_store *hs = user_data;
+
+	hs->flush_source = 0;
+
+	if (!store_flush(hs))
+		hs->flush_source = g_timeout_add_seconds(HISTORY_FLUSH_INTERVAL,
+							store_flush_cb, hs);
+
+	return FALSE;
+}
+
+static void store_schedule_flush(struct history_store *hs)
+{
+	if (hs->batch_count >= HISTORY_FLUSH_THRESHOLD) {
+		store_flush(hs);
+		return;
+	}
+
+	if (hs->flush_source == 0)
+		hs->flush_source = g_timeout_add_seconds(HISTORY_FLUSH_INTERVAL,
+							store_flush_cb, hs);
+}
+
+static void store_append(struct history_store *hs, enum history_type type,
+				guint8 status, const char *addr,
+				const char *name, const char *text,
+				time_t start, time_t end,
+				const struct ofono_uuid *uuid)
+{
+	struct history_record rec;
+	guint64 offset = hs->file_size + hs->batch->len;
+	char key[256];
+
+	if (addr == NULL)
+		addr = "";
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = type;
+	rec.status = status;
+	rec.addr_len = MIN(strlen(addr), 255);
+	rec.name_len = name ? MIN(strlen(name), 255) : 0;
+	rec.text_len = text ? MIN(strlen(text), HISTORY_TEXT_MAX) : 0;
+	rec.start = start;
+	rec.end = end;
+
+	if (uuid)
+		memcpy(rec.uuid, uuid->uuid, sizeof(rec.uuid));
+
+	g_byte_array_append(hs->batch, (guint8 *) &rec, sizeof(rec));
+	g_byte_array_append(hs->batch, (guint8 *) addr, rec.addr_len);
+	g_byte_array_append(hs->batch, (guint8 *) name, rec.name_len);
+	g_byte_array_append(hs->batch, (guint8 *) text, rec.text_len);
+	hs->batch_count += 1;
+
+	memcpy(key, addr, rec.addr_len);
+	key[rec.addr_len] = '\0';
+	store_index(hs, offset, &rec, key);
+
+	store_schedule_flush(hs);
+}
+
+/* Reads back a record, either from the file or from the pending batch */
+static gboolean store_read(struct history_store *hs, guint64 offset,
+				struct history_record *rec, char **addr,
+				char **name, char **text)
+{
+	unsigned char *buf;
+	gsize len;
+
+	if (offset >= hs->file_size) {
+		const guint8 *data = hs->batch->data + (offset - hs->file_size);
+
+		memcpy(rec, data, sizeof(*rec));
+		data += sizeof(*rec);
+
+		*addr = g_strndup((const char *) data, rec->addr_len);
+		data += rec->addr_len;
+		*name = g_strndup((const char *) data, rec->name_len);
+		data += rec->name_len;
+		*text = g_strndup((const char *) data, rec->text_len);
+
+		return TRUE;
+	}
+
+	if (TFR(pread(hs->fd, rec, sizeof(*rec), offset)) != sizeof(*rec))
+		return FALSE;
+
+	len = rec->addr_len + rec->name_len + rec->text_len;
+	buf = g_malloc(len);
+
+	if (TFR(pread(hs->fd, buf, len, offset + sizeof(*rec))) !=
+			(ssize_t) len) {
+		g_free(buf);
+		return FALSE;
+	}
+
+	*addr = g_strndup((const char *) buf, rec->addr_len);
+	*name = g_strndup((const char *) buf + rec->addr_len, rec->name_len);
+	*text = g_strndup((const char *) buf + rec->addr_len + rec->name_len,
+				rec->text_len);
+	g_free(buf);
+
+	return TRUE;
+}
+
+static void store_set_status(struct history_store *hs, guint32 id,
+				guint8 status)
+{
+	struct history_entry *entry = store_entry(hs, id);
+
+	entry->status = status;
+
+	if (entry->offset >= hs->file_size) {
+		struct history_record *rec = (struct history_record *)
+			(hs->batch->data + (entry->offset - hs->file_size));
+
+		rec->status = status;
+		return;
+	}
+
+	if (g_slist_find(hs->dirty, GUINT_TO_POINTER(id)) == NULL)
+		hs->dirty = g_slist_prepend(hs->dirty, GUINT_TO_POINTER(id));
+
+	store_schedule_flush(hs);
+}
+
+static const char *type_to_string(guint8 type)
+{
+	switch (type) {
+	case HISTORY_TYPE_CALL_OUTGOING:
+	case HISTORY_TYPE_CALL_INCOMING:
+	case HISTORY_TYPE_CALL_MISSED:
+		return "call";
+	}
+
+	return "message";
+}
+
+static const char *sms_status_to_string(guint8 status)
+{
+	switch (status) {
+	case OFONO_HISTORY_SMS_STATUS_PENDING:
+		return "pending";
+	case OFONO_HISTORY_SMS_STATUS_SUBMITTED:
+		return "sent";
+	case OFONO_HISTORY_SMS_STATUS_SUBMIT_FAILED:
+		return "failed";
+	case OFONO_HISTORY_SMS_STATUS_SUBMIT_CANCELLED:
+		return "cancelled";
+	case OFONO_HISTORY_SMS_STATUS_DELIVERED:
+		return "delivered";
+	case OFONO_HISTORY_SMS_STATUS_DELIVER_FAILED:
+		return "undeliverable";
+	}
+
+	return "unknown";
+}
+
+static void append_time(DBusMessageIter *dict, const char *key, gint64 t)
+{
+	time_t when = t;
+	char buf[128];
+	const char *str = buf;
+
+	strftime(buf, 127, "%Y-%m-%dT%H:%M:%S%z", localtime(&when));
+	buf[127] = '\0';
+
+	ofono_dbus_dict_append(dict, key, DBUS_TYPE_STRING, &str);
+}
+
+static void append_entry(DBusMessageIter *array, struct history_store *hs,
+				guint32 id)
+{
+	struct history_entry *entry = store_entry(hs, id);
+	struct history_record rec;
+	DBusMessageIter dict;
+	char *addr, *name, *text;
+	const char *str;
+	dbus_bool_t missed;
+
+	if (!store_read(hs, entry->offset, &rec, &addr, &name, &text))
+		return;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	str = type_to_string(entry->type);
+	ofono_dbus_dict_append(&dict, "Type", DBUS_TYPE_STRING, &str);
+
+	if (entry->type == HISTORY_TYPE_CALL_OUTGOING ||
+			entry->type == HISTORY_TYPE_SMS_OUTGOING)
+		str = "outgoing";
+	else
+		str = "incoming";
+
+	ofono_dbus_dict_append(&dict, "Direction", DBUS_TYPE_STRING, &str);
+
+	str = addr;
+	ofono_dbus_dict_append(&dict, "LineIdentification",
+				DBUS_TYPE_STRING, &str);
+
+	if (rec.name_len > 0) {
+		str = name;
+		ofono_dbus_dict_append(&dict, "Name", DBUS_TYPE_STRING, &str);
+	}
+
+	append_time(&dict, "StartTime", rec.start);
+
+	switch (entry->type) {
+	case HISTORY_TYPE_CALL_OUTGOING:
+	case HISTORY_TYPE_CALL_INCOMING:
+	case HISTORY_TYPE_CALL_MISSED:
+		missed = entry->type == HISTORY_TYPE_CALL_MISSED;
+		ofono_dbus_dict_append(&dict, "Missed", DBUS_TYPE_BOOLEAN,
+					&missed);
+		append_time(&dict, "EndTime", rec.end);
+		break;
+	case HISTORY_TYPE_SMS_OUTGOING:
+		str = sms_status_to_string(entry->status);
+		ofono_dbus_dict_append(&dict, "Status", DBUS_TYPE_STRING,
+					&str);
+		/* fall through */
+	case HISTORY_TYPE_SMS_INCOMING:
+		str = ofono_uuid_to_str((const struct ofono_uuid *) rec.uuid);
+		ofono_dbus_dict_append(&dict, "Identifier", DBUS_TYPE_STRING,
+					&str);
+		str = text;
+		ofono_dbus_dict_append(&dict, "Text", DBUS_TYPE_STRING, &str);
+		break;
+	}
+
+	dbus_message_iter_close_container(array, &dict);
+
+	g_free(addr);
+	g_free(name);
+	g_free(text);
+}
+
+static DBusMessage *history_get_range(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct history_store *hs = data;
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	dbus_int64_t start, end;
+	dbus_uint32_t max;
+	guint32 lo, hi, i;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_INT64, &start,
+					DBUS_TYPE_INT64, &end,
+					DBUS_TYPE_UINT32, &max,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (end < start)
+		return __ofono_error_invalid_args(msg);
+
+	if (max == 0 || max > HISTORY_QUERY_MAX)
+		max = HISTORY_QUERY_MAX;
+
+	/* Find the first event at or after start */
+	lo = 0;
+	hi = hs->by_time->len;
+
+	while (lo < hi) {
+		guint32 mid = (lo + hi) / 2;
+		guint32 id = g_array_index(hs->by_time, guint32, mid);
+
+		if (store_entry(hs, id)->time < start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_ARRAY_AS_STRING
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&array);
+
+	for (i = lo; i < hs->by_time->len && max > 0; i++, max--) {
+		guint32 id = g_array_index(hs->by_time, guint32, i);
+
+		if (store_entry(hs, id)->time > end)
+			break;
+
+		append_entry(&array, hs, id);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static gint compare_time_desc(gconstpointer a, gconstpointer b,
+				gpointer user_data)
+{
+	struct history_store *hs = user_data;
+	gint64 ta = store_entry(hs, *(const guint32 *) a)->time;
+	gint64 tb = store_entry(hs, *(const guint32 *) b)->time;
+
+	if (ta == tb)
+		return *(const guint32 *) b > *(const guint32 *) a ? 1 : -1;
+
+	return tb > ta ? 1 : -1;
+}
+
+static DBusMessage *history_get_number(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct history_store *hs = data;
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	const char *number;
+	dbus_uint32_t max;
+	GArray *ids;
+	GArray *sorted = NULL;
+	guint32 i;
+
+	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &number,
+					DBUS_TYPE_UINT32, &max,
+					DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (max == 0 || max > HISTORY_QUERY_MAX)
+		max = HISTORY_QUERY_MAX;
+
+	ids = g_hash_table_lookup(hs->numbers, number);
+	if (ids != NULL) {
+		sorted = g_array_sized_new(FALSE, FALSE, sizeof(guint32),
+						ids->len);
+		g_array_append_vals(sorted, ids->data, ids->len);
+		g_array_sort_with_data(sorted, compare_time_desc, hs);
+	}
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		goto out;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_ARRAY_AS_STRING
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&array);
+
+	for (i = 0; sorted && i < sorted->len && i < max; i++)
+		append_entry(&array, hs, g_array_index(sorted, guint32, i));
+
+	dbus_message_iter_close_container(&iter, &array);
+
+out:
+	if (sorted)
+		g_array_free(sorted, TRUE);
+
+	return reply;
+}
+
+static const GDBusMethodTable history_methods[] = {
+	{ GDBUS_METHOD("GetHistory",
+			GDBUS_ARGS({ "start", "x" }, { "end", "x" },
+					{ "max", "u" }),
+			GDBUS_ARGS({ "events", "aa{sv}" }),
+			history_get_range) },
+	{ GDBUS_METHOD("GetNumberHistory",
+			GDBUS_ARGS({ "number", "s" }, { "max", "u" }),
+			GDBUS_ARGS({ "events", "aa{sv}" }),
+			history_get_number) },
+	{ }
+};
+
+static void history_store_free(struct history_store *hs)
+{
+	if (hs->flush_source > 0)
+		g_source_remove(hs->flush_source);
+
+	if (hs->fd >= 0)
+		close(hs->fd);
+
+	g_slist_free(hs->dirty);
+	g_byte_array_free(hs->batch, TRUE);
+	g_hash_table_destroy(hs->pending_sms);
+	g_hash_table_destroy(hs->numbers);
+	g_array_free(hs->by_time, TRUE);
+	g_array_free(hs->entries, TRUE);
+	g_free(hs->path);
+	g_free(hs);
+}
+
+static int history_store_probe(struct ofono_history_context *context)
+{
+	struct ofono_modem *modem = context->modem;
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct ofono_atom *sim_atom;
+	struct history_store *hs;
+	const char *imsi;
+
+	sim_atom = __ofono_modem_find_atom(modem, OFONO_ATOM_TYPE_SIM);
+	if (sim_atom == NULL)
+		return -ENODEV;
+
+	imsi = ofono_sim_get_imsi(__ofono_atom_get_data(sim_atom));
+	if (imsi == NULL)
+		return -ENODEV;
+
+	DBG("modem: %p imsi: %s", modem, imsi);
+
+	hs = g_new0(struct history_store, 1);
+	hs->modem = modem;
+	hs->path = g_strdup_printf(HISTORY_STORE_PATH, imsi);
+	hs->entries = g_array_new(FALSE, FALSE, sizeof(struct history_entry));
+	hs->by_time = g_array_new(FALSE, FALSE, sizeof(guint32));
+	hs->numbers = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, id_array_free);
+	hs->pending_sms = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, NULL);
+	hs->batch = g_byte_array_new();
+	hs->fd = -1;
+
+	if (create_dirs(hs->path, HISTORY_STORE_MODE | S_IXUSR) == 0)
+		hs->fd = TFR(open(hs->path, O_RDWR | O_CREAT,
+					HISTORY_STORE_MODE));
+
+	if (hs->fd < 0 || !store_load(hs)) {
+		ofono_error("Unable to open history store %s", hs->path);
+		history_store_free(hs);
+		return -EIO;
+	}
+
+	DBG("loaded %u events", hs->entries->len);
+
+	if (!g_dbus_register_interface(conn, ofono_modem_get_path(modem),
+					HISTORY_STORE_INTERFACE,
+					history_methods, NULL, NULL,
+					hs, NULL)) {
+		ofono_error("Could not create %s interface",
+				HISTORY_STORE_INTERFACE);
+		history_store_free(hs);
+		return -EIO;
+	}
+
+	ofono_modem_add_interface(modem, HISTORY_STORE_INTERFACE);
+	context->data = hs;
+
+	return 0;
+}
+
+static void history_store_remove(struct ofono_history_context *context)
+{
+	struct history_store *hs = context->data;
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	DBG("modem: %p", context->modem);
+
+	store_flush(hs);
+
+	ofono_modem_remove_interface(hs->modem, HISTORY_STORE_INTERFACE);
+	g_dbus_unregister_interface(conn, ofono_modem_get_path(hs->modem),
+					HISTORY_STORE_INTERFACE);
+
+	history_store_free(hs);
+	context->data = NULL;
+}
+
+static void history_store_call(struct history_store *hs,
+				enum history_type type,
+				const struct ofono_call *call,
+				time_t start, time_t end)
+{
+	const char *addr = NULL;
+	const char *name = NULL;
+
+	if (call->type != 0)
+		return;
+
+	if (call->clip_validity == CLIP_VALIDITY_VALID)
+		addr = phone_number_to_string(&call->phone_number);
+
+	if (call->cnap_validity == CNAP_VALIDITY_VALID)
+		name = call->name;
+
+	store_append(hs, type, 0, addr, name, NULL, start, end, NULL);
+}
+
+static void history_store_call_ended(struct ofono_history_context *context,
+					const struct ofono_call *call,
+					time_t start, time_t end)
+{
+	enum history_type type = HISTORY_TYPE_CALL_INCOMING;
+
+	if (call->direction == CALL_DIRECTION_MOBILE_ORIGINATED)
+		type = HISTORY_TYPE_CALL_OUTGOING;
+
+	history_store_call(context->data, type, call, start, end);
+}
+
+static void history_store_call_missed(struct ofono_history_context *context,
+					const struct ofono_call *call,
+					time_t when)
+{
+	history_store_call(context->data, HISTORY_TYPE_CALL_MISSED,
+				call, when, when);
+}
+
+static void history_store_sms_received(struct ofono_history_context *context,
+					const struct ofono_uuid *uuid,
+					const char *from,
+					const struct tm *remote,
+					const struct tm *local,
+					const char *text)
+{
+	struct tm remote_tm = *remote;
+	struct tm local_tm = *local;
+
+	store_append(context->data, HISTORY_TYPE_SMS_INCOMING, 0, from,
+			NULL, text, mktime(&local_tm), mktime(&remote_tm),
+			uuid);
+}
+
+static void history_store_sms_send_pending(
+					struct ofono_history_context *context,
+					const struct ofono_uuid *uuid,
+					const char *to, time_t when,
+					const char *text)
+{
+	store_append(context->data, HISTORY_TYPE_SMS_OUTGOING,
+			OFONO_HISTORY_SMS_STATUS_PENDING, to, NULL, text,
+			when, when, uuid);
+}
+
+static void history_store_sms_send_status(
+					struct ofono_history_context *context,
+					const struct ofono_uuid *uuid,
+					time_t when,
+					enum ofono_history_sms_status s)
+{
+	struct history_store *hs = context->data;
+	const char *key = ofono_uuid_to_str(uuid);
+	gpointer value;
+
+	if (!g_hash_table_lookup_extended(hs->pending_sms, key, NULL, &value))
+		return;
+
+	store_set_status(hs, GPOINTER_TO_UINT(value), s);
+
+	if (sms_status_is_final(s))
+		g_hash_table_remove(hs->pending_sms, key);
+}
+
+static struct ofono_history_driver history_store_driver = {
+	.name = "History Store",
+	.probe = history_store_probe,
+	.remove = history_store_remove,
+	.call_ended = history_store_call_ended,
+	.call_missed = history_store_call_missed,
+	.sms_received = history_store_sms_received,
+	.sms_send_pending = history_store_sms_send_pending,
+	.sms_send_status = history_store_sms_send_status,
+};
+
+static int history_store_init(void)
+{
+	DBG("");
+	return ofono_history_driver_register(&history_store_driver);
+}
+
+static void history_store_exit(void)
+{
+	DBG("");
+	ofono_history_driver_unregister(&history_store_driver);
+}
+
+OFONO_PLUGIN_DEFINE(history_store, "Call and SMS History Store Plugin",
+			VERSION, OFONO_PLUGIN_PRIORITY_DEFAULT,
+			history_store_init, history_store_exit)
@@ -283,6 +283,8 @@ static GAtChat *create_chat(GIOChannel *channel, struct ofono_modem *modem,
 	if (chat == NULL)
 		return NULL;
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, ifx_debug, debug);
 
@@ -570,6 +572,8 @@ static int ifx_enable(struct ofono_modem *modem)
 		return -EIO;
 	}
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, ifx_debug, "Master: ");
 
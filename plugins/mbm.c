@@ -326,6 +326,8 @@ static int mbm_enable(struct ofono_modem *modem)
 	if (data->modem_port == NULL)
 		return -EIO;
 
+	at_util_record_latency(data->modem_port, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->modem_port, mbm_debug, "Modem: ");
 
@@ -337,6 +339,8 @@ static int mbm_enable(struct ofono_modem *modem)
 		return -EIO;
 	}
 
+	at_util_record_latency(data->data_port, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->data_port, mbm_debug, "Data: ");
 
@@ -191,6 +191,22 @@ static void mtk_debug(const char *str, void *user_data)
 	ofono_info("%s%s", prefix, str);
 }
 
+static void mtk_latency(const char *request, int error, guint usec,
+			gpointer user_data)
+{
+	struct ofono_modem *modem = user_data;
+	enum ofono_latency_result result;
+
+	if (error == RIL_E_SUCCESS)
+		result = OFONO_LATENCY_RESULT_OK;
+	else if (error == RIL_E_GRIL_TIMEOUT)
+		result = OFONO_LATENCY_RESULT_TIMEOUT;
+	else
+		result = OFONO_LATENCY_RESULT_ERROR;
+
+	ofono_modem_record_latency(modem, request, usec, result);
+}
+
 static struct mtk_data *mtk_data_complement(struct mtk_data *md)
 {
 	if (md->slot == MULTISIM_SLOT_0)
@@ -1397,6 +1413,7 @@ static void start_slot(struct mtk_data *md, struct socket_data *sock,
 	md->radio_state = sock->radio_state;
 
 	g_ril_set_slot(md->ril, md->slot);
+	g_ril_set_latency_function(md->ril, mtk_latency, md->modem);
 
 	if (getenv("OFONO_RIL_TRACE"))
 		g_ril_set_trace(md->ril, TRUE);
@@ -1604,6 +1621,12 @@ static int create_gril(struct ofono_modem *modem)
 						mtk_request_id_to_string,
 						mtk_unsol_request_to_string);
 
+	/* Kept in order with the data calls they prepare */
+	g_ril_set_request_lane(sock->ril, MTK_RIL_REQUEST_SET_GPRS_CONNECT_TYPE,
+				G_RIL_LANE_DATA);
+	g_ril_set_request_lane(sock->ril, MTK_RIL_REQUEST_SET_GPRS_TRANSFER_TYPE,
+				G_RIL_LANE_DATA);
+
 	if (getenv("OFONO_RIL_TRACE"))
 		g_ril_set_trace(sock->ril, TRUE);
 
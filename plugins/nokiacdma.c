@@ -118,6 +118,8 @@ static int nokiacdma_enable(struct ofono_modem *modem)
 	if (data->chat == NULL)
 		return -ENOMEM;
 
+	at_util_record_latency(data->chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->chat, nokiacdma_debug,
 					"CDMA Device: ");
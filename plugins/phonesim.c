@@ -632,6 +632,8 @@ static void mux_setup(GAtMux *mux, gpointer user_data)
 	g_at_syntax_unref(syntax);
 	g_io_channel_unref(io);
 
+	at_util_record_latency(data->chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->chat, phonesim_debug, "");
 
@@ -729,6 +731,8 @@ static int phonesim_enable(struct ofono_modem *modem)
 	if (data->chat == NULL)
 		return -ENOMEM;
 
+	at_util_record_latency(data->chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->chat, phonesim_debug, "");
 
@@ -997,6 +1001,8 @@ static int localhfp_enable(struct ofono_modem *modem)
 	if (chat == NULL)
 		return -ENOMEM;
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, phonesim_debug, "LocalHfp: ");
 
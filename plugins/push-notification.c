@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 #include <glib.h>
 #include <gdbus.h>
 #include <ofono.h>
@@ -49,8 +50,10 @@ static unsigned int modemwatch_id;
 struct push_notification {
 	struct ofono_modem *modem;
 	struct ofono_sms *sms;
+	struct ofono_cbs *cbs;
 	struct sms_agent *agent;
 	unsigned int push_watch;
+	unsigned int cbs_push_watch;
 };
 
 static void agent_exited(void *userdata)
@@ -62,6 +65,11 @@ static void agent_exited(void *userdata)
 		pn->push_watch = 0;
 	}
 
+	if (pn->cbs_push_watch > 0) {
+		__ofono_cbs_datagram_watch_remove(pn->cbs, pn->cbs_push_watch);
+		pn->cbs_push_watch = 0;
+	}
+
 	pn->agent = NULL;
 }
 
@@ -82,6 +90,42 @@ static void push_received(const char *from, const struct tm *remote,
 					NULL, NULL, NULL);
 }
 
+/*
+ * WAP PUSH delivered over cell broadcast carries neither an originator
+ * nor a timestamp, report it as sent by nobody at the time it arrived.
+ */
+static void cbs_push_received(unsigned short channel, int dst, int src,
+				const unsigned char *buffer,
+				unsigned int len, void *data)
+{
+	struct push_notification *pn = data;
+	time_t now = time(NULL);
+	struct tm local;
+
+	DBG("Received push of size: %u on channel %hu", len, channel);
+
+	if (pn->agent == NULL)
+		return;
+
+	localtime_r(&now, &local);
+
+	sms_agent_dispatch_datagram(pn->agent, "ReceiveNotification",
+					"", &local, &local, buffer, len,
+					NULL, NULL, NULL);
+}
+
+static void cbs_push_watch_add(struct push_notification *pn)
+{
+	if (pn->cbs == NULL || pn->agent == NULL || pn->cbs_push_watch > 0)
+		return;
+
+	pn->cbs_push_watch = __ofono_cbs_datagram_watch_add(pn->cbs,
+							cbs_push_received,
+							WAP_PUSH_DST_PORT,
+							WAP_PUSH_SRC_PORT,
+							pn, NULL);
+}
+
 static DBusMessage *push_notification_register_agent(DBusConnection *conn,
 						DBusMessage *msg, void *data)
 {
@@ -114,6 +158,8 @@ static DBusMessage *push_notification_register_agent(DBusConnection *conn,
 							WAP_PUSH_SRC_PORT,
 							pn, NULL);
 
+	cbs_push_watch_add(pn);
+
 	return dbus_message_new_method_return(msg);
 }
 
@@ -194,6 +240,24 @@ static void sms_watch(struct ofono_atom *atom,
 	ofono_modem_add_interface(pn->modem, PUSH_NOTIFICATION_INTERFACE);
 }
 
+static void cbs_watch(struct ofono_atom *atom,
+				enum ofono_atom_watch_condition cond,
+				void *data)
+{
+	struct push_notification *pn = data;
+
+	if (cond == OFONO_ATOM_WATCH_CONDITION_UNREGISTERED) {
+		/* The CBS atom dropped its datagram watches already */
+		pn->cbs_push_watch = 0;
+		pn->cbs = NULL;
+		return;
+	}
+
+	pn->cbs = __ofono_atom_get_data(atom);
+
+	cbs_push_watch_add(pn);
+}
+
 static void modem_watch(struct ofono_modem *modem, gboolean added, void *user)
 {
 	struct push_notification *pn;
@@ -207,6 +271,8 @@ static void modem_watch(struct ofono_modem *modem, gboolean added, void *user)
 		return;
 
 	pn->modem = modem;
+	__ofono_modem_add_atom_watch(modem, OFONO_ATOM_TYPE_CBS,
+					cbs_watch, pn, NULL);
 	__ofono_modem_add_atom_watch(modem, OFONO_ATOM_TYPE_SMS,
 					sms_watch, pn, g_free);
 }
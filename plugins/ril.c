@@ -119,6 +119,22 @@ static void ril_debug(const char *str, void *user_data)
 	ofono_info("Device %d: %s", g_ril_get_slot(rd->ril), str);
 }
 
+static void ril_latency(const char *request, int error, guint usec,
+			gpointer user_data)
+{
+	struct ofono_modem *modem = user_data;
+	enum ofono_latency_result result;
+
+	if (error == RIL_E_SUCCESS)
+		result = OFONO_LATENCY_RESULT_OK;
+	else if (error == RIL_E_GRIL_TIMEOUT)
+		result = OFONO_LATENCY_RESULT_TIMEOUT;
+	else
+		result = OFONO_LATENCY_RESULT_ERROR;
+
+	ofono_modem_record_latency(modem, request, usec, result);
+}
+
 static const char *get_driver_type(struct ril_data *rd,
 					enum ofono_atom_type atom)
 {
@@ -514,6 +530,8 @@ static int create_gril(struct ofono_modem *modem)
 						rd->request_id_to_string,
 						rd->unsol_request_to_string);
 
+	g_ril_set_latency_function(rd->ril, ril_latency, modem);
+
 	if (getenv("OFONO_RIL_TRACE"))
 		g_ril_set_trace(rd->ril, TRUE);
 
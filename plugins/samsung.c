@@ -187,6 +187,8 @@ static int samsung_enable(struct ofono_modem *modem)
 	if (data->chat == NULL)
 		return -ENOMEM;
 
+	at_util_record_latency(data->chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->chat, samsung_debug, "Device: ");
 
@@ -45,6 +45,7 @@
 #include <ofono/log.h>
 #include <ofono/voicecall.h>
 #include <ofono/call-volume.h>
+#include <drivers/atmodem/atutil.h>
 #include <drivers/atmodem/vendor.h>
 
 #define NUM_DLC 5
@@ -147,6 +148,8 @@ static GAtChat *open_device(struct ofono_modem *modem,
 		return NULL;
 	}
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, sim900_debug, debug);
 
@@ -170,6 +173,8 @@ static GAtChat *create_chat(GIOChannel *channel, struct ofono_modem *modem,
 	if (chat == NULL)
 		return NULL;
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, sim900_debug, debug);
 
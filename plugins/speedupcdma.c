@@ -38,6 +38,7 @@
 #include <ofono/cdma-connman.h>
 #include <ofono/log.h>
 
+#include "drivers/atmodem/atutil.h"
 #include "drivers/atmodem/vendor.h"
 
 struct speedupcdma_data {
@@ -126,6 +127,8 @@ static GAtChat *open_device(struct ofono_modem *modem,
 	if (chat == NULL)
 		return NULL;
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, speedupcdma_debug, debug);
 
@@ -332,6 +332,8 @@ static int ste_enable(struct ofono_modem *modem)
 			goto error;
 		}
 
+		at_util_record_latency(data->chat[i], modem);
+
 		if (getenv("OFONO_AT_DEBUG"))
 			g_at_chat_set_debug(data->chat[i], ste_debug,
 						chat_prefixes[i]);
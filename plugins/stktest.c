@@ -149,6 +149,8 @@ static int stktest_enable(struct ofono_modem *modem)
 	if (data->chat == NULL)
 		return -ENOMEM;
 
+	at_util_record_latency(data->chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(data->chat, stktest_debug, "");
 
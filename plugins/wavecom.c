@@ -48,6 +48,7 @@
 #include <ofono/ussd.h>
 #include <ofono/voicecall.h>
 
+#include <drivers/atmodem/atutil.h>
 #include <drivers/atmodem/vendor.h>
 
 
@@ -113,6 +114,8 @@ static int wavecom_enable(struct ofono_modem *modem)
 
 	g_at_chat_add_terminator(chat, "+CPIN:", 6, TRUE);
 
+	at_util_record_latency(chat, modem);
+
 	if (getenv("OFONO_AT_DEBUG"))
 		g_at_chat_set_debug(chat, wavecom_debug, "");
 
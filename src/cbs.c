@@ -51,6 +51,10 @@ enum etws_topic_type {
 	ETWS_TOPIC_TYPE_EMERGENCY =		4356,
 };
 
+static struct cbs_topic_range etws_range = {
+	ETWS_TOPIC_TYPE_EARTHQUAKE, ETWS_TOPIC_TYPE_EMERGENCY
+};
+
 struct ofono_cbs {
 	DBusMessage *pending;
 	struct cbs_assembly *assembly;
@@ -69,6 +73,8 @@ struct ofono_cbs {
 	unsigned short efcbmid_length;
 	GSList *efcbmid_contents;
 	gboolean efcbmid_update;
+	guint32 efcbmid_map[CBS_TOPIC_BITMAP_WORDS];
+	guint32 topic_map[CBS_TOPIC_BITMAP_WORDS];
 	guint reset_source;
 	int lac;
 	int ci;
@@ -80,8 +86,57 @@ struct ofono_cbs {
 	const struct ofono_cbs_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
+	struct ofono_watchlist *datagram_handlers;
+};
+
+struct cbs_handler {
+	struct ofono_watchlist_item item;
+	int dst;
+	int src;
 };
 
+static gboolean port_equal(int received, int expected)
+{
+	return expected == -1 || received == expected;
+}
+
+unsigned int __ofono_cbs_datagram_watch_add(struct ofono_cbs *cbs,
+					ofono_cbs_datagram_notify_cb_t cb,
+					int dst, int src, void *data,
+					ofono_destroy_func destroy)
+{
+	struct cbs_handler *handler;
+
+	if (cbs == NULL || cb == NULL)
+		return 0;
+
+	DBG("%p: dst %d, src %d", cbs, dst, src);
+
+	handler = g_try_new0(struct cbs_handler, 1);
+	if (handler == NULL)
+		return 0;
+
+	handler->dst = dst;
+	handler->src = src;
+	handler->item.notify = cb;
+	handler->item.notify_data = data;
+	handler->item.destroy = destroy;
+
+	return __ofono_watchlist_add_item(cbs->datagram_handlers,
+				(struct ofono_watchlist_item *) handler);
+}
+
+gboolean __ofono_cbs_datagram_watch_remove(struct ofono_cbs *cbs,
+					unsigned int id)
+{
+	if (cbs == NULL)
+		return FALSE;
+
+	DBG("%p", cbs);
+
+	return __ofono_watchlist_remove_item(cbs->datagram_handlers, id);
+}
+
 static void cbs_dispatch_base_station_id(struct ofono_cbs *cbs, const char *id)
 {
 	DBG("Base station id: %s", id);
@@ -171,6 +226,70 @@ static void cbs_dispatch_text(struct ofono_cbs *cbs, enum sms_class cls,
 				DBUS_TYPE_INVALID);
 }
 
+static gboolean cbs_extract_ports(const struct cbs *c, int *dst, int *src)
+{
+	gboolean is_8bit;
+
+	if (!cbs_extract_app_port(c, dst, src, &is_8bit))
+		return FALSE;
+
+	/* Keep 8 and 16 bit port spaces apart, same as for SMS */
+	if (is_8bit) {
+		*dst <<= 16;
+		*src <<= 16;
+	}
+
+	return TRUE;
+}
+
+static void cbs_dispatch_datagram(struct ofono_cbs *cbs, GSList *cbs_list)
+{
+	const struct cbs *c = cbs_list->data;
+	ofono_cbs_datagram_notify_cb_t notify;
+	gboolean dispatched = FALSE;
+	struct cbs_handler *h;
+	unsigned char *buf;
+	long len;
+	int dst, src;
+	int cdst, csrc;
+	GSList *l;
+
+	if (!cbs_extract_ports(c, &dst, &src))
+		return;
+
+	for (l = cbs_list->next; l; l = l->next) {
+		if (!cbs_extract_ports(l->data, &cdst, &csrc) ||
+				cdst != dst || csrc != src) {
+			ofono_error("Source / Destination ports across "
+					"CBS pages are not the same, ignoring");
+			return;
+		}
+	}
+
+	buf = cbs_decode_datagram(cbs_list, &len);
+	if (buf == NULL)
+		return;
+
+	for (l = cbs->datagram_handlers->items; l; l = l->next) {
+		h = l->data;
+		notify = h->item.notify;
+
+		if (!port_equal(dst, h->dst) || !port_equal(src, h->src))
+			continue;
+
+		dispatched = TRUE;
+
+		notify(c->message_identifier, dst, src, buf, len,
+			h->item.notify_data);
+	}
+
+	if (!dispatched)
+		ofono_info("CBS datagram with ports [%d,%d] not delivered",
+								dst, src);
+
+	g_free(buf);
+}
+
 void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 				int pdu_len)
 {
@@ -182,6 +301,7 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 	enum sms_charset charset;
 	char *message;
 	char iso639_lang[3];
+	int dst, src;
 
 	if (cbs->assembly == NULL)
 		return;
@@ -191,7 +311,7 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 		return;
 	}
 
-	if (cbs_topic_in_range(c.message_identifier, cbs->efcbmid_contents)) {
+	if (cbs_topic_bitmap_test(cbs->efcbmid_map, c.message_identifier)) {
 		if (cbs->sim == NULL)
 			return;
 
@@ -211,23 +331,33 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 		return;
 	}
 
-	if (!cbs_dcs_decode(c.dcs, &udhi, &cls, &charset, &comp, NULL, NULL)) {
-		ofono_error("Unknown / Reserved DCS.  Ignoring");
+	/*
+	 * Drop pages for topics the modem was not asked for before they
+	 * reach the assembly, some modems pass on every broadcast
+	 */
+	if (cbs->driver->set_topics &&
+			!cbs_topic_bitmap_test(cbs->topic_map,
+						c.message_identifier))
 		return;
-	}
 
-	if (udhi) {
-		ofono_error("CBS messages with UDH not supported");
+	if (!cbs_dcs_decode(c.dcs, &udhi, &cls, &charset, &comp, NULL, NULL)) {
+		ofono_error("Unknown / Reserved DCS.  Ignoring");
 		return;
 	}
 
-	if (charset == SMS_CHARSET_8BIT) {
-		ofono_error("Datagram CBS not supported");
+	if (comp) {
+		ofono_error("CBS messages with compression not supported");
 		return;
 	}
 
-	if (comp) {
-		ofono_error("CBS messages with compression not supported");
+	/*
+	 * Datagrams are only of use to whoever listens on their ports,
+	 * drop pages without ports before they take up assembly space
+	 */
+	if (charset == SMS_CHARSET_8BIT && (!udhi ||
+				!cbs_extract_ports(&c, &dst, &src))) {
+		ofono_error("Got an 8-bit encoded CBS, however no valid "
+				"src/dst port, ignore");
 		return;
 	}
 
@@ -236,6 +366,12 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 	if (cbs_list == NULL)
 		return;
 
+	if (charset == SMS_CHARSET_8BIT) {
+		cbs_dispatch_datagram(cbs, cbs_list);
+		message = NULL;
+		goto out;
+	}
+
 	message = cbs_decode_text(cbs_list, iso639_lang);
 
 	if (message == NULL)
@@ -306,11 +442,13 @@ static DBusMessage *cbs_get_properties(DBusConnection *conn,
 	return reply;
 }
 
-static char *cbs_topics_to_str(struct ofono_cbs *cbs, GSList *user_topics)
+/*
+ * The topics requested from the modem, the list only borrows the ranges
+ * and has to be freed with g_slist_free.
+ */
+static GSList *cbs_modem_topics(struct ofono_cbs *cbs, GSList *user_topics)
 {
 	GSList *topics = NULL;
-	char *topic_str;
-	struct cbs_topic_range etws_range = { 4352, 4356 };
 
 	if (user_topics != NULL)
 		topics = g_slist_concat(topics,
@@ -322,12 +460,34 @@ static char *cbs_topics_to_str(struct ofono_cbs *cbs, GSList *user_topics)
 
 	topics = g_slist_append(topics, &etws_range);
 
+	return topics;
+}
+
+static char *cbs_topics_to_str(struct ofono_cbs *cbs, GSList *user_topics)
+{
+	GSList *topics = cbs_modem_topics(cbs, user_topics);
+	char *topic_str;
+
 	topic_str = cbs_topic_ranges_to_string(topics);
 	g_slist_free(topics);
 
 	return topic_str;
 }
 
+/*
+ * Incoming pages are checked against the topics once per page, so keep
+ * bitmaps of them instead of walking the range lists.
+ */
+static void cbs_update_topic_maps(struct ofono_cbs *cbs)
+{
+	GSList *topics = cbs_modem_topics(cbs, cbs->topics);
+
+	cbs_topic_bitmap_set_ranges(cbs->efcbmid_map, cbs->efcbmid_contents);
+	cbs_topic_bitmap_set_ranges(cbs->topic_map, topics);
+
+	g_slist_free(topics);
+}
+
 static void cbs_set_topics_cb(const struct ofono_error *error, void *data)
 {
 	struct ofono_cbs *cbs = data;
@@ -352,6 +512,8 @@ static void cbs_set_topics_cb(const struct ofono_error *error, void *data)
 	cbs->topics = cbs->new_topics;
 	cbs->new_topics = NULL;
 
+	cbs_update_topic_maps(cbs);
+
 	reply = dbus_message_new_method_return(cbs->pending);
 	__ofono_dbus_pending_reply(&cbs->pending, reply);
 
@@ -589,6 +751,9 @@ static void cbs_unregister(struct ofono_atom *atom)
 	g_dbus_unregister_interface(conn, path, OFONO_CELL_BROADCAST_INTERFACE);
 	ofono_modem_remove_interface(modem, OFONO_CELL_BROADCAST_INTERFACE);
 
+	__ofono_watchlist_free(cbs->datagram_handlers);
+	cbs->datagram_handlers = NULL;
+
 	if (cbs->topics) {
 		g_slist_foreach(cbs->topics, (GFunc) g_free, NULL);
 		g_slist_free(cbs->topics);
@@ -608,6 +773,8 @@ static void cbs_unregister(struct ofono_atom *atom)
 		cbs->efcbmid_contents = NULL;
 	}
 
+	cbs_update_topic_maps(cbs);
+
 	if (cbs->sim_context) {
 		ofono_sim_context_free(cbs->sim_context);
 		cbs->sim_context = NULL;
@@ -682,6 +849,8 @@ struct ofono_cbs *ofono_cbs_create(struct ofono_modem *modem,
 		return NULL;
 
 	cbs->assembly = cbs_assembly_new();
+	cbs_update_topic_maps(cbs);
+
 	cbs->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_CBS,
 						cbs_remove, cbs);
 
@@ -719,6 +888,7 @@ static void cbs_got_file_contents(struct ofono_cbs *cbs)
 
 		cbs->topics = cbs_optimize_ranges(initial_topics);
 		g_slist_free(initial_topics);
+		cbs_update_topic_maps(cbs);
 
 		topics_str = cbs_topic_ranges_to_string(cbs->topics);
 		g_key_file_set_string(cbs->settings, SETTINGS_GROUP,
@@ -888,6 +1058,8 @@ static void sim_cbmid_read_cb(int ok, int length, int record,
 	g_free(str);
 
 done:
+	cbs_update_topic_maps(cbs);
+
 	if (cbs->efcbmid_update) {
 		if (cbs->powered == TRUE) {
 			char *topic_str = cbs_topics_to_str(cbs, cbs->topics);
@@ -912,6 +1084,7 @@ static void cbs_efcbmid_changed(int id, void *userdata)
 		cbs->efcbmid_contents = NULL;
 	}
 
+	cbs_update_topic_maps(cbs);
 	cbs->efcbmid_update = TRUE;
 
 	ofono_sim_read(cbs->sim_context, SIM_EFCBMID_FILEID,
@@ -939,6 +1112,8 @@ static void cbs_got_imsi(struct ofono_cbs *cbs)
 	if (topics_str)
 		cbs->topics = cbs_extract_topic_ranges(topics_str);
 
+	cbs_update_topic_maps(cbs);
+
 	/*
 	 * If stored value is invalid or no stored value, bootstrap
 	 * topics list from SIM contents
@@ -1098,6 +1273,8 @@ void ofono_cbs_register(struct ofono_cbs *cbs)
 
 	ofono_modem_add_interface(modem, OFONO_CELL_BROADCAST_INTERFACE);
 
+	cbs->datagram_handlers = __ofono_watchlist_new(g_free);
+
 	cbs->sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
 	if (cbs->sim) {
 		cbs->sim_context = ofono_sim_context_create(cbs->sim);
@@ -0,0 +1,338 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2011  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+#include <gdbus.h>
+
+#include "ofono.h"
+
+/*
+ * Latencies are kept in log-linear buckets: values below
+ * LATENCY_LINEAR_LIMIT microseconds get a bucket each, every power of two
+ * above that is split into LATENCY_SUB_BUCKETS buckets.  This bounds the
+ * relative error to 1 / LATENCY_SUB_BUCKETS over the whole 32 bit range
+ * with a fixed, small amount of memory per operation.
+ */
+#define LATENCY_SUB_BITS	3
+#define LATENCY_SUB_BUCKETS	(1 << LATENCY_SUB_BITS)
+#define LATENCY_LINEAR_BITS	(LATENCY_SUB_BITS + 1)
+#define LATENCY_LINEAR_LIMIT	(1 << LATENCY_LINEAR_BITS)
+#define LATENCY_BUCKETS		(LATENCY_LINEAR_LIMIT + \
+				(32 - LATENCY_LINEAR_BITS) * LATENCY_SUB_BUCKETS)
+
+struct latency_histogram {
+	guint32 buckets[LATENCY_BUCKETS];
+	guint32 count;
+	guint32 errors;
+	guint32 timeouts;
+	guint32 max;
+	guint64 total;
+};
+
+struct modem_latency {
+	struct ofono_modem *modem;
+	GHashTable *histograms;
+};
+
+static GHashTable *modem_latencies;
+static unsigned int modemwatch_id;
+
+static unsigned int latency_bucket(guint32 usec)
+{
+	unsigned int msb;
+
+	if (usec < LATENCY_LINEAR_LIMIT)
+		return usec;
+
+	msb = g_bit_storage(usec) - 1;
+
+	return LATENCY_LINEAR_LIMIT +
+		(msb - LATENCY_LINEAR_BITS) * LATENCY_SUB_BUCKETS +
+		((usec >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+/* Largest value that still falls into the given bucket */
+static guint32 latency_bucket_limit(unsigned int bucket)
+{
+	unsigned int msb, sub;
+	guint64 limit;
+
+	if (bucket < LATENCY_LINEAR_LIMIT)
+		return bucket;
+
+	bucket -= LATENCY_LINEAR_LIMIT;
+	msb = bucket / LATENCY_SUB_BUCKETS + LATENCY_LINEAR_BITS;
+	sub = bucket % LATENCY_SUB_BUCKETS;
+
+	limit = (guint64) (LATENCY_SUB_BUCKETS + sub + 1) <<
+						(msb - LATENCY_SUB_BITS);
+
+	return MIN(limit - 1, G_MAXUINT32);
+}
+
+static guint32 latency_percentile(const struct latency_histogram *h,
+					unsigned int percent)
+{
+	guint64 rank = ((guint64) h->count * percent + 99) / 100;
+	guint64 seen = 0;
+	unsigned int i;
+
+	if (rank == 0)
+		return 0;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += h->buckets[i];
+
+		if (seen >= rank)
+			return MIN(latency_bucket_limit(i), h->max);
+	}
+
+	return h->max;
+}
+
+void ofono_modem_record_latency(struct ofono_modem *modem,
+				const char *operation, unsigned int usec,
+				enum ofono_latency_result result)
+{
+	struct modem_latency *ml;
+	struct latency_histogram *h;
+
+	if (modem_latencies == NULL || operation == NULL)
+		return;
+
+	ml = g_hash_table_lookup(modem_latencies, modem);
+	if (ml == NULL)
+		return;
+
+	h = g_hash_table_lookup(ml->histograms, operation);
+	if (h == NULL) {
+		h = g_new0(struct latency_histogram, 1);
+		g_hash_table_insert(ml->histograms, g_strdup(operation), h);
+	}
+
+	h->buckets[latency_bucket(usec)] += 1;
+	h->count += 1;
+	h->total += usec;
+
+	if (usec > h->max)
+		h->max = usec;
+
+	if (result == OFONO_LATENCY_RESULT_ERROR)
+		h->errors += 1;
+	else if (result == OFONO_LATENCY_RESULT_TIMEOUT)
+		h->timeouts += 1;
+}
+
+static void append_buckets(DBusMessageIter *dict,
+				const struct latency_histogram *h)
+{
+	const char *key = "Histogram";
+	DBusMessageIter entry, variant, array, bucket;
+	unsigned int i;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+						"a(uu)", &variant);
+	dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY,
+						"(uu)", &array);
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		guint32 limit;
+
+		if (h->buckets[i] == 0)
+			continue;
+
+		limit = latency_bucket_limit(i);
+
+		dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+							NULL, &bucket);
+		dbus_message_iter_append_basic(&bucket, DBUS_TYPE_UINT32,
+						&limit);
+		dbus_message_iter_append_basic(&bucket, DBUS_TYPE_UINT32,
+						&h->buckets[i]);
+		dbus_message_iter_close_container(&array, &bucket);
+	}
+
+	dbus_message_iter_close_container(&variant, &array);
+	dbus_message_iter_close_container(&entry, &variant);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void append_histogram(DBusMessageIter *array, const char *operation,
+				const struct latency_histogram *h)
+{
+	DBusMessageIter entry, dict;
+	guint32 value;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &operation);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	ofono_dbus_dict_append(&dict, "Count", DBUS_TYPE_UINT32, &h->count);
+	ofono_dbus_dict_append(&dict, "Errors", DBUS_TYPE_UINT32, &h->errors);
+	ofono_dbus_dict_append(&dict, "Timeouts", DBUS_TYPE_UINT32,
+				&h->timeouts);
+
+	value = h->count ? h->total / h->count : 0;
+	ofono_dbus_dict_append(&dict, "Average", DBUS_TYPE_UINT32, &value);
+
+	value = latency_percentile(h, 50);
+	ofono_dbus_dict_append(&dict, "Median", DBUS_TYPE_UINT32, &value);
+
+	value = latency_percentile(h, 90);
+	ofono_dbus_dict_append(&dict, "Percentile90", DBUS_TYPE_UINT32,
+				&value);
+
+	value = latency_percentile(h, 99);
+	ofono_dbus_dict_append(&dict, "Percentile99", DBUS_TYPE_UINT32,
+				&value);
+
+	ofono_dbus_dict_append(&dict, "Maximum", DBUS_TYPE_UINT32, &h->max);
+
+	append_buckets(&dict, h);
+
+	dbus_message_iter_close_container(&entry, &dict);
+	dbus_message_iter_close_container(array, &entry);
+}
+
+static DBusMessage *latency_get_statistics(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct modem_latency *ml = data;
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	GHashTableIter hash_iter;
+	gpointer key, value;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&array);
+
+	g_hash_table_iter_init(&hash_iter, ml->histograms);
+
+	while (g_hash_table_iter_next(&hash_iter, &key, &value))
+		append_histogram(&array, key, value);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *latency_reset(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct modem_latency *ml = data;
+
+	g_hash_table_remove_all(ml->histograms);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable latency_methods[] = {
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sa{sv}}" }),
+			latency_get_statistics) },
+	{ GDBUS_METHOD("Reset", NULL, NULL, latency_reset) },
+	{ }
+};
+
+static void modem_latency_free(gpointer data)
+{
+	struct modem_latency *ml = data;
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	g_dbus_unregister_interface(conn, ofono_modem_get_path(ml->modem),
+					OFONO_LATENCY_INTERFACE);
+
+	g_hash_table_destroy(ml->histograms);
+	g_free(ml);
+}
+
+static void modem_watch(struct ofono_modem *modem, gboolean added, void *data)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	struct modem_latency *ml;
+
+	if (added == FALSE) {
+		g_hash_table_remove(modem_latencies, modem);
+		return;
+	}
+
+	ml = g_new0(struct modem_latency, 1);
+	ml->modem = modem;
+	ml->histograms = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, g_free);
+
+	if (!g_dbus_register_interface(conn, ofono_modem_get_path(modem),
+					OFONO_LATENCY_INTERFACE,
+					latency_methods, NULL, NULL,
+					ml, NULL)) {
+		ofono_error("Could not register Latency interface");
+		g_hash_table_destroy(ml->histograms);
+		g_free(ml);
+		return;
+	}
+
+	g_hash_table_insert(modem_latencies, modem, ml);
+}
+
+int __ofono_latency_init(void)
+{
+	modem_latencies = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						modem_latency_free);
+
+	modemwatch_id = __ofono_modemwatch_add(modem_watch, NULL, NULL);
+
+	return 0;
+}
+
+void __ofono_latency_cleanup(void)
+{
+	__ofono_modemwatch_remove(modemwatch_id);
+	modemwatch_id = 0;
+
+	g_hash_table_destroy(modem_latencies);
+	modem_latencies = NULL;
+}
@@ -237,6 +237,8 @@ int main(int argc, char **argv)
 
 	__ofono_modemwatch_init();
 
+	__ofono_latency_init();
+
 	__ofono_manager_init();
 
 	__ofono_plugin_init(option_plugin, option_noplugin);
@@ -254,6 +256,8 @@ int main(int argc, char **argv)
 
 	__ofono_manager_cleanup();
 
+	__ofono_latency_cleanup();
+
 	__ofono_modemwatch_cleanup();
 
 	__ofono_dbus_cleanup();
@@ -223,6 +223,9 @@ unsigned int __ofono_modemwatch_add(ofono_modemwatch_cb_t cb, void *user,
 					ofono_destroy_func destroy);
 gboolean __ofono_modemwatch_remove(unsigned int id);
 
+int __ofono_latency_init(void);
+void __ofono_latency_cleanup(void);
+
 typedef void (*ofono_modem_online_notify_func)(struct ofono_modem *modem,
 						ofono_bool_t online,
 						void *data);
@@ -261,6 +264,20 @@ gboolean __ofono_call_forwarding_is_busy(struct ofono_call_forwarding *cf);
 gboolean __ofono_call_settings_is_busy(struct ofono_call_settings *cs);
 
 #include <ofono/cbs.h>
+
+typedef void (*ofono_cbs_datagram_notify_cb_t)(unsigned short channel,
+						int dst, int src,
+						const unsigned char *buffer,
+						unsigned int len,
+						void *data);
+
+unsigned int __ofono_cbs_datagram_watch_add(struct ofono_cbs *cbs,
+					ofono_cbs_datagram_notify_cb_t cb,
+					int dst, int src, void *data,
+					ofono_destroy_func destroy);
+gboolean __ofono_cbs_datagram_watch_remove(struct ofono_cbs *cbs,
+					unsigned int id);
+
 #include <ofono/devinfo.h>
 #include <ofono/phonebook.h>
 #include <ofono/gprs.h>
@@ -36,11 +36,20 @@
 #include "ofono.h"
 
 #include "common.h"
+#include "simutil.h"
+#include "storage.h"
 
 #define LEN_MAX 128
 #define TYPE_INTERNATIONAL 145
 
 #define PHONEBOOK_FLAG_CACHED 0x1
+#define PHONEBOOK_FLAG_STREAMING 0x2
+
+/* Number of vCards delivered to the agent per ReceiveEntries call */
+#define PHONEBOOK_CHUNK_ENTRIES 32
+
+#define PHONEBOOK_CACHE_STORE "phonebook"
+#define PHONEBOOK_CACHE_GROUP "Cache"
 
 static GSList *g_drivers = NULL;
 
@@ -58,6 +67,14 @@ struct ofono_phonebook {
 	int flags;
 	GString *vcards; /* entries with vcard 3.0 format */
 	GSList *merge_list; /* cache the entries that may need a merge */
+	GHashTable *merge_table; /* merge_list entries keyed by name */
+	struct phonebook_agent *agent;
+	unsigned int chunk_entries; /* vCards in vcards not yet streamed */
+	struct ofono_sim *sim;
+	struct ofono_sim_context *sim_context;
+	GString *validator; /* SIM phonebook state the SM cache belongs to */
+	unsigned int validate_step;
+	gboolean sync_found;
 	const struct ofono_phonebook_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
@@ -69,6 +86,12 @@ struct phonebook_number {
 	enum phonebook_number_type category;
 };
 
+struct phonebook_agent {
+	char *path;
+	char *bus;
+	guint disconnect_watch;
+};
+
 struct phonebook_person {
 	GSList *number_list; /* one person may have more than one numbers */
 	char *text;
@@ -79,6 +102,27 @@ struct phonebook_person {
 };
 
 static const char *storage_support[] = { "SM", "ME", NULL };
+
+/*
+ * The synchronisation counters of 31.102 Section 4.4.2.12 live in both
+ * the global (DF_TELECOM) and the USIM local phonebook.  EF_CC changes
+ * on every update of the phonebook, EF_PSC and EF_PUID whenever the
+ * phonebook is regenerated.
+ */
+static const unsigned char global_pb_path[] = {
+	0x3F, 0x00, 0x7F, 0x10, 0x5F, 0x3A
+};
+static const unsigned char local_pb_path[] = {
+	0x3F, 0x00, 0x7F, 0xFF, 0x5F, 0x3A
+};
+static const unsigned char telecom_path[] = { 0x3F, 0x00, 0x7F, 0x10 };
+
+static const int sync_files[] = {
+	SIM_EFPSC_FILEID, SIM_EFCC_FILEID, SIM_EFPUID_FILEID
+};
+
+#define SYNC_STEPS (2 * G_N_ELEMENTS(sync_files))
+
 static void export_phonebook(struct ofono_phonebook *pb);
 
 /* according to RFC 2425, the output string may need folding */
@@ -233,6 +277,117 @@ static void vcard_printf_end(GString *vcards)
 	vcard_printf(vcards, "");
 }
 
+static void phonebook_agent_send_noreply(struct phonebook_agent *agent,
+						const char *method, int type, ...)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	DBusMessage *message;
+	va_list args;
+
+	message = dbus_message_new_method_call(agent->bus, agent->path,
+					OFONO_PHONEBOOK_AGENT_INTERFACE,
+					method);
+	if (message == NULL)
+		return;
+
+	va_start(args, type);
+	dbus_message_append_args_valist(message, type, args);
+	va_end(args);
+
+	dbus_message_set_no_reply(message, TRUE);
+
+	g_dbus_send_message(conn, message);
+}
+
+static void phonebook_agent_free(struct phonebook_agent *agent)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	if (agent->disconnect_watch) {
+		phonebook_agent_send_noreply(agent, "Release",
+						DBUS_TYPE_INVALID);
+		g_dbus_remove_watch(conn, agent->disconnect_watch);
+	}
+
+	g_free(agent->path);
+	g_free(agent->bus);
+	g_free(agent);
+}
+
+static void phonebook_agent_disconnect_cb(DBusConnection *conn,
+						void *user_data)
+{
+	struct ofono_phonebook *pb = user_data;
+
+	DBG("Agent %s disconnected", pb->agent->bus);
+
+	pb->agent->disconnect_watch = 0;
+	phonebook_agent_free(pb->agent);
+	pb->agent = NULL;
+}
+
+static void stream_chunk(struct ofono_phonebook *pb, const char *vcards)
+{
+	if (pb->agent == NULL || vcards[0] == '\0')
+		return;
+
+	phonebook_agent_send_noreply(pb->agent, "ReceiveEntries",
+					DBUS_TYPE_STRING, &vcards,
+					DBUS_TYPE_INVALID);
+}
+
+/*
+ * Called once a complete vCard has been appended to pb->vcards.  While
+ * streaming, pb->vcards only ever holds the current chunk.
+ */
+static void vcard_complete(struct ofono_phonebook *pb)
+{
+	if (!(pb->flags & PHONEBOOK_FLAG_STREAMING))
+		return;
+
+	if (++pb->chunk_entries < PHONEBOOK_CHUNK_ENTRIES)
+		return;
+
+	stream_chunk(pb, pb->vcards->str);
+	g_string_truncate(pb->vcards, 0);
+	pb->chunk_entries = 0;
+}
+
+static void stream_flush(struct ofono_phonebook *pb)
+{
+	stream_chunk(pb, pb->vcards->str);
+	g_string_truncate(pb->vcards, 0);
+	pb->chunk_entries = 0;
+}
+
+/* Streams already generated vCards without splitting any of them */
+static void stream_vcards(struct ofono_phonebook *pb, const char *vcards)
+{
+	static const char vcard_end[] = "END:VCARD\r\n\r\n";
+	const char *start = vcards;
+	const char *p = start;
+	unsigned int count = 0;
+
+	while ((p = strstr(p, vcard_end)) != NULL) {
+		p += sizeof(vcard_end) - 1;
+
+		if (++count < PHONEBOOK_CHUNK_ENTRIES)
+			continue;
+
+		if (pb->agent) {
+			char *chunk = g_strndup(start, p - start);
+
+			stream_chunk(pb, chunk);
+			g_free(chunk);
+		}
+
+		start = p;
+		count = 0;
+	}
+
+	stream_chunk(pb, start);
+}
+
 static void print_number(struct phonebook_number *pn, GString *vcards)
 {
 	vcard_printf_number(vcards, pn->number, pn->type, pn->category);
@@ -244,8 +399,11 @@ static void destroy_number(struct phonebook_number *pn)
 	g_free(pn);
 }
 
-static void print_merged_entry(struct phonebook_person *person, GString *vcards)
+static void print_merged_entry(struct phonebook_person *person,
+				struct ofono_phonebook *pb)
 {
+	GString *vcards = pb->vcards;
+
 	vcard_printf_begin(vcards);
 	vcard_printf_text(vcards, person->text);
 
@@ -255,6 +413,8 @@ static void print_merged_entry(struct phonebook_person *person, GString *vcards)
 	vcard_printf_email(vcards, person->email);
 	vcard_printf_sip_uri(vcards, person->sip_uri);
 	vcard_printf_end(vcards);
+
+	vcard_complete(pb);
 }
 
 static void destroy_merged_entry(struct phonebook_person *person)
@@ -363,23 +523,21 @@ void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 	 * are deemed as entries of one person.
 	 */
 	if (need_merge(text)) {
-		GSList *l;
 		size_t len_text = strlen(text) - 2;
 		struct phonebook_person *person;
+		char *name = g_strndup(text, len_text);
 
-		for (l = phonebook->merge_list; l; l = l->next) {
-			person = l->data;
-			if (!strncmp(text, person->text, len_text) &&
-					(strlen(person->text) == len_text))
-				break;
-		}
+		person = g_hash_table_lookup(phonebook->merge_table, name);
 
-		if (l == NULL) {
+		if (person == NULL) {
 			person = g_new0(struct phonebook_person, 1);
 			phonebook->merge_list =
 				g_slist_prepend(phonebook->merge_list, person);
-			person->text = g_strndup(text, len_text);
-		}
+			person->text = name;
+			g_hash_table_insert(phonebook->merge_table,
+						person->text, person);
+		} else
+			g_free(name);
 
 		merge_field_number(&(person->number_list), number, type,
 					text[len_text + 1]);
@@ -407,6 +565,167 @@ void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 	vcard_printf_email(phonebook->vcards, email);
 	vcard_printf_sip_uri(phonebook->vcards, sip_uri);
 	vcard_printf_end(phonebook->vcards);
+
+	vcard_complete(phonebook);
+}
+
+/*
+ * The SM part of the export is stored per ICCID, along with the state of
+ * the SIM phonebook it was generated from.  ME entries are always read
+ * from the modem, there is no way to detect changes to them.
+ */
+static void phonebook_cache_store(struct ofono_phonebook *pb)
+{
+	const char *iccid = ofono_sim_get_iccid(pb->sim);
+	GKeyFile *cache;
+
+	if (iccid == NULL || pb->validator == NULL || pb->validator->len == 0)
+		return;
+
+	/* While streaming only the last chunk is around */
+	if (pb->flags & PHONEBOOK_FLAG_STREAMING)
+		return;
+
+	cache = storage_open(iccid, PHONEBOOK_CACHE_STORE);
+	if (cache == NULL)
+		return;
+
+	g_key_file_set_string(cache, PHONEBOOK_CACHE_GROUP, "Validator",
+				pb->validator->str);
+	g_key_file_set_string(cache, PHONEBOOK_CACHE_GROUP, "SM",
+				pb->vcards->str);
+
+	storage_close(iccid, PHONEBOOK_CACHE_STORE, cache, TRUE);
+}
+
+static gboolean phonebook_cache_load(struct ofono_phonebook *pb)
+{
+	const char *iccid = ofono_sim_get_iccid(pb->sim);
+	GKeyFile *cache;
+	char *validator;
+	char *vcards = NULL;
+
+	if (iccid == NULL || pb->validator->len == 0)
+		return FALSE;
+
+	cache = storage_open(iccid, PHONEBOOK_CACHE_STORE);
+	if (cache == NULL)
+		return FALSE;
+
+	validator = g_key_file_get_string(cache, PHONEBOOK_CACHE_GROUP,
+						"Validator", NULL);
+
+	if (g_strcmp0(validator, pb->validator->str) == 0)
+		vcards = g_key_file_get_string(cache, PHONEBOOK_CACHE_GROUP,
+						"SM", NULL);
+
+	g_free(validator);
+	storage_close(iccid, PHONEBOOK_CACHE_STORE, cache, FALSE);
+
+	if (vcards == NULL)
+		return FALSE;
+
+	DBG("SM phonebook served from cache");
+
+	if (pb->flags & PHONEBOOK_FLAG_STREAMING)
+		stream_vcards(pb, vcards);
+	else
+		g_string_append(pb->vcards, vcards);
+
+	g_free(vcards);
+
+	return TRUE;
+}
+
+static void validate_adn_info_cb(int ok, unsigned char file_status,
+					int total_length, int record_length,
+					void *userdata)
+{
+	struct ofono_phonebook *pb = userdata;
+
+	if (ok)
+		g_string_append_printf(pb->validator, "%04x=%02x:%d:%d;",
+					SIM_EFADN_FILEID, file_status,
+					total_length, record_length);
+
+	/* The EF_ADN layout alone can't tell whether entries changed */
+	if (!pb->sync_found)
+		g_string_truncate(pb->validator, 0);
+
+	DBG("validator: %s", pb->validator->str);
+
+	if (phonebook_cache_load(pb))
+		pb->storage_index = 1;
+
+	export_phonebook(pb);
+}
+
+static void validate_sync_cb(int ok, int total_length, int record,
+				const unsigned char *data,
+				int record_length, void *userdata)
+{
+	struct ofono_phonebook *pb = userdata;
+	unsigned int step = pb->validate_step;
+	int i;
+
+	if (ok) {
+		g_string_append_printf(pb->validator, "%u:%04x=", step,
+					sync_files[step % G_N_ELEMENTS(sync_files)]);
+
+		for (i = 0; i < total_length; i++)
+			g_string_append_printf(pb->validator, "%02x", data[i]);
+
+		g_string_append_c(pb->validator, ';');
+		pb->sync_found = TRUE;
+	}
+
+	step = ++pb->validate_step;
+
+	if (step < SYNC_STEPS) {
+		if (ofono_sim_read_path(pb->sim_context,
+				sync_files[step % G_N_ELEMENTS(sync_files)],
+				OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
+				step < G_N_ELEMENTS(sync_files) ?
+					global_pb_path : local_pb_path,
+				sizeof(global_pb_path),
+				validate_sync_cb, pb) < 0)
+			goto error;
+
+		return;
+	}
+
+	if (ofono_sim_read_info(pb->sim_context, SIM_EFADN_FILEID,
+				OFONO_SIM_FILE_STRUCTURE_FIXED,
+				telecom_path, sizeof(telecom_path),
+				validate_adn_info_cb, pb) == 0)
+		return;
+
+error:
+	g_string_truncate(pb->validator, 0);
+	export_phonebook(pb);
+}
+
+static void start_export(struct ofono_phonebook *pb)
+{
+	pb->storage_index = 0;
+
+	if (pb->sim_context == NULL || ofono_sim_get_iccid(pb->sim) == NULL) {
+		export_phonebook(pb);
+		return;
+	}
+
+	if (pb->validator == NULL)
+		pb->validator = g_string_new(NULL);
+
+	g_string_truncate(pb->validator, 0);
+	pb->validate_step = 0;
+	pb->sync_found = FALSE;
+
+	if (ofono_sim_read_path(pb->sim_context, sync_files[0],
+				OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
+				global_pb_path, sizeof(global_pb_path),
+				validate_sync_cb, pb) < 0)
+		export_phonebook(pb);
 }
 
 static void export_phonebook_cb(const struct ofono_error *error, void *data)
@@ -420,12 +739,17 @@ static void export_phonebook_cb(const struct ofono_error *error, void *data)
 	/* convert the collected entries that are already merged to vcard */
 	phonebook->merge_list = g_slist_reverse(phonebook->merge_list);
 	g_slist_foreach(phonebook->merge_list, (GFunc) print_merged_entry,
-				phonebook->vcards);
+				phonebook);
+	g_hash_table_remove_all(phonebook->merge_table);
 	g_slist_foreach(phonebook->merge_list, (GFunc) destroy_merged_entry,
 				NULL);
 	g_slist_free(phonebook->merge_list);
 	phonebook->merge_list = NULL;
 
+	if (phonebook->storage_index == 0 &&
+			error->type == OFONO_ERROR_TYPE_NO_ERROR)
+		phonebook_cache_store(phonebook);
+
 	phonebook->storage_index++;
 	export_phonebook(phonebook);
 	return;
@@ -442,6 +766,16 @@ static void export_phonebook(struct ofono_phonebook *phonebook)
 		return;
 	}
 
+	if (phonebook->flags & PHONEBOOK_FLAG_STREAMING) {
+		stream_flush(phonebook);
+		phonebook->flags &= ~PHONEBOOK_FLAG_STREAMING;
+
+		__ofono_dbus_pending_reply(&phonebook->pending,
+				dbus_message_new_method_return(
+					phonebook->pending));
+		return;
+	}
+
 	reply = generate_export_entries_reply(phonebook, phonebook->pending);
 	if (reply == NULL) {
 		dbus_message_unref(phonebook->pending);
@@ -471,18 +805,107 @@ static DBusMessage *import_entries(DBusConnection *conn, DBusMessage *msg,
 	}
 
 	g_string_set_size(phonebook->vcards, 0);
-	phonebook->storage_index = 0;
 
 	phonebook->pending = dbus_message_ref(msg);
-	export_phonebook(phonebook);
+	start_export(phonebook);
+
+	return NULL;
+}
+
+static DBusMessage *import_to_agent(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_phonebook *phonebook = data;
+	const char *caller = dbus_message_get_sender(msg);
+
+	if (phonebook->agent == NULL ||
+			!g_str_equal(phonebook->agent->bus, caller))
+		return __ofono_error_access_denied(msg);
+
+	if (phonebook->pending)
+		return __ofono_error_busy(msg);
+
+	if (phonebook->flags & PHONEBOOK_FLAG_CACHED) {
+		stream_vcards(phonebook, phonebook->vcards->str);
+		return dbus_message_new_method_return(msg);
+	}
+
+	g_string_set_size(phonebook->vcards, 0);
+	phonebook->chunk_entries = 0;
+	phonebook->flags |= PHONEBOOK_FLAG_STREAMING;
+
+	phonebook->pending = dbus_message_ref(msg);
+	start_export(phonebook);
 
 	return NULL;
 }
 
+static DBusMessage *register_agent(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_phonebook *phonebook = data;
+	struct phonebook_agent *agent;
+	const char *agent_path;
+
+	if (phonebook->agent)
+		return __ofono_error_busy(msg);
+
+	if (dbus_message_get_args(msg, NULL,
+				DBUS_TYPE_OBJECT_PATH, &agent_path,
+				DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (!__ofono_dbus_valid_object_path(agent_path))
+		return __ofono_error_invalid_format(msg);
+
+	agent = g_new0(struct phonebook_agent, 1);
+	agent->path = g_strdup(agent_path);
+	agent->bus = g_strdup(dbus_message_get_sender(msg));
+	agent->disconnect_watch = g_dbus_add_disconnect_watch(conn, agent->bus,
+						phonebook_agent_disconnect_cb,
+						phonebook, NULL);
+	phonebook->agent = agent;
+
+	return dbus_message_new_method_return(msg);
+}
+
+static DBusMessage *unregister_agent(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct ofono_phonebook *phonebook = data;
+	const char *agent_path;
+
+	if (dbus_message_get_args(msg, NULL,
+				DBUS_TYPE_OBJECT_PATH, &agent_path,
+				DBUS_TYPE_INVALID) == FALSE)
+		return __ofono_error_invalid_args(msg);
+
+	if (phonebook->agent == NULL)
+		return __ofono_error_failed(msg);
+
+	if (!g_str_equal(phonebook->agent->path, agent_path) ||
+			!g_str_equal(phonebook->agent->bus,
+					dbus_message_get_sender(msg)))
+		return __ofono_error_access_denied(msg);
+
+	phonebook_agent_free(phonebook->agent);
+	phonebook->agent = NULL;
+
+	return dbus_message_new_method_return(msg);
+}
+
 static const GDBusMethodTable phonebook_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Import",
 			NULL, GDBUS_ARGS({ "entries", "s" }),
 			import_entries) },
+	{ GDBUS_ASYNC_METHOD("ImportToAgent", NULL, NULL,
+			import_to_agent) },
+	{ GDBUS_METHOD("RegisterAgent",
+			GDBUS_ARGS({ "path", "o" }), NULL,
+			register_agent) },
+	{ GDBUS_METHOD("UnregisterAgent",
+			GDBUS_ARGS({ "path", "o" }), NULL,
+			unregister_agent) },
 	{ }
 };
 
@@ -516,6 +939,11 @@ static void phonebook_unregister(struct ofono_atom *atom)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_modem *modem = __ofono_atom_get_modem(pb->atom);
 
+	if (pb->agent) {
+		phonebook_agent_free(pb->agent);
+		pb->agent = NULL;
+	}
+
 	ofono_modem_remove_interface(modem, OFONO_PHONEBOOK_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_PHONEBOOK_INTERFACE);
 }
@@ -532,6 +960,13 @@ static void phonebook_remove(struct ofono_atom *atom)
 	if (pb->driver && pb->driver->remove)
 		pb->driver->remove(pb);
 
+	if (pb->sim_context)
+		ofono_sim_context_free(pb->sim_context);
+
+	if (pb->validator)
+		g_string_free(pb->validator, TRUE);
+
+	g_hash_table_destroy(pb->merge_table);
 	g_string_free(pb->vcards, TRUE);
 	g_free(pb);
 }
@@ -552,6 +987,7 @@ struct ofono_phonebook *ofono_phonebook_create(struct ofono_modem *modem,
 		return NULL;
 
 	pb->vcards = g_string_new(NULL);
+	pb->merge_table = g_hash_table_new(g_str_hash, g_str_equal);
 	pb->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_PHONEBOOK,
 						phonebook_remove, pb);
 
@@ -588,6 +1024,10 @@ void ofono_phonebook_register(struct ofono_phonebook *pb)
 
 	ofono_modem_add_interface(modem, OFONO_PHONEBOOK_INTERFACE);
 
+	pb->sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
+	if (pb->sim)
+		pb->sim_context = ofono_sim_context_create(pb->sim);
+
 	__ofono_atom_register(pb->atom, phonebook_unregister);
 }
 
@@ -2276,6 +2276,14 @@ const char *ofono_sim_get_imsi(struct ofono_sim *sim)
 	return sim->imsi;
 }
 
+const char *ofono_sim_get_iccid(struct ofono_sim *sim)
+{
+	if (sim == NULL)
+		return NULL;
+
+	return sim->iccid;
+}
+
 const char *ofono_sim_get_mcc(struct ofono_sim *sim)
 {
 	if (sim == NULL)
@@ -73,6 +73,9 @@ static struct sim_ef_info ef_db[] = {
 {	0x2F05, ROOTMF, ROOTMF, EF, BINARY, 0,		ALW,	PIN	},
 {	0x2FE2, ROOTMF, ROOTMF, EF, BINARY, 10,		ALW,	NEV	},
 {	0x4F20, 0x5F50, 0x5F50, EF, BINARY, 0,		PIN,	ADM	},
+{	0x4F22, 0x5F3A, 0x5F3A, EF, BINARY, 4,		PIN,	PIN	},
+{	0x4F23, 0x5F3A, 0x5F3A, EF, BINARY, 2,		PIN,	PIN	},
+{	0x4F24, 0x5F3A, 0x5F3A, EF, BINARY, 2,		PIN,	PIN	},
 {	0x4F30, 0x5F3A, 0x5F3A, EF, RECORD, 0,		PIN,	ADM	},
 {	0x5F3A, 0x7F10, 0x7F10, DF, 0, 0,		PIN,	PIN	},
 {	0x5F50, 0x7F10, 0x7F10, DF, 0, 0,		PIN,	ADM	},
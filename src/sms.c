@@ -50,6 +50,17 @@
 #define TXQ_MAX_RETRIES 4
 #define NETWORK_TIMEOUT 332
 
+/*
+ * Up to TXQ_BATCH_SIZE PDUs are submitted back to back while asking the
+ * modem to keep the relay link open (AT+CMMS / RIL "expect more").  The
+ * link is then given a chance to close so that other traffic is not
+ * starved by a long queue.
+ */
+#define TXQ_BATCH_SIZE 16
+
+/* Interval in seconds over which the submission rate is measured */
+#define TXQ_RATE_INTERVAL 10
+
 static gboolean tx_next(gpointer user_data);
 
 static GSList *g_drivers = NULL;
@@ -69,6 +80,11 @@ struct ofono_sms {
 	GQueue *txq;
 	unsigned long tx_counter;
 	guint tx_source;
+	unsigned int tx_batch;
+	struct sms_tx_journal *tx_journal;
+	time_t tx_rate_start;
+	unsigned int tx_rate_count;
+	double tx_rate;
 	struct ofono_message_waiting *mw;
 	unsigned int mw_watch;
 	ofono_bool_t registered;
@@ -79,6 +95,7 @@ struct ofono_sms {
 	char *imsi;
 	int bearer;
 	enum sms_alphabet alphabet;
+	int assembly_limit;
 	const struct ofono_sms_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
@@ -309,6 +326,60 @@ static void set_alphabet(struct ofono_sms *sms, enum sms_alphabet alphabet)
 						DBUS_TYPE_STRING, &value);
 }
 
+static void txq_depth_changed(struct ofono_sms *sms)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = __ofono_atom_get_path(sms->atom);
+	dbus_uint32_t depth = g_queue_get_length(sms->txq);
+
+	ofono_dbus_signal_property_changed(conn, path,
+						OFONO_MESSAGE_MANAGER_INTERFACE,
+						"QueueDepth",
+						DBUS_TYPE_UINT32, &depth);
+}
+
+/*
+ * Accounts for a submitted PDU, the rate is refreshed every
+ * TXQ_RATE_INTERVAL seconds while sending and once more when the
+ * queue drains, so it reflects the most recent burst of messages.
+ */
+static void txq_rate_update(struct ofono_sms *sms, gboolean submitted)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = __ofono_atom_get_path(sms->atom);
+	time_t now = time(NULL);
+	time_t elapsed;
+	double rate;
+
+	if (submitted) {
+		if (sms->tx_rate_count == 0)
+			sms->tx_rate_start = now;
+
+		sms->tx_rate_count += 1;
+	}
+
+	if (sms->tx_rate_count == 0)
+		return;
+
+	elapsed = now - sms->tx_rate_start;
+
+	if (elapsed < TXQ_RATE_INTERVAL && g_queue_get_length(sms->txq) > 0)
+		return;
+
+	rate = (double) sms->tx_rate_count / MAX(elapsed, 1);
+	sms->tx_rate_count = 0;
+
+	if (rate == sms->tx_rate)
+		return;
+
+	sms->tx_rate = rate;
+
+	ofono_dbus_signal_property_changed(conn, path,
+						OFONO_MESSAGE_MANAGER_INTERFACE,
+						"SubmissionRate",
+						DBUS_TYPE_DOUBLE, &sms->tx_rate);
+}
+
 static void set_sca(struct ofono_sms *sms,
 			const struct ofono_phone_number *sca)
 {
@@ -341,6 +412,7 @@ static DBusMessage *generate_get_properties_reply(struct ofono_sms *sms,
 	const char *sca;
 	const char *bearer;
 	const char *alphabet;
+	dbus_uint32_t queue_depth;
 
 	reply = dbus_message_new_method_return(msg);
 	if (reply == NULL)
@@ -366,6 +438,13 @@ static DBusMessage *generate_get_properties_reply(struct ofono_sms *sms,
 	alphabet = sms_alphabet_to_string(sms->alphabet);
 	ofono_dbus_dict_append(&dict, "Alphabet", DBUS_TYPE_STRING, &alphabet);
 
+	queue_depth = g_queue_get_length(sms->txq);
+	ofono_dbus_dict_append(&dict, "QueueDepth", DBUS_TYPE_UINT32,
+				&queue_depth);
+
+	ofono_dbus_dict_append(&dict, "SubmissionRate", DBUS_TYPE_DOUBLE,
+				&sms->tx_rate);
+
 	dbus_message_iter_close_container(&iter, &dict);
 
 	return reply;
@@ -622,6 +701,7 @@ static void sms_tx_queue_remove_entry(struct ofono_sms *sms, GList *entry_list,
 	struct ofono_modem *modem = __ofono_atom_get_modem(sms->atom);
 
 	g_queue_delete_link(sms->txq, entry_list);
+	txq_depth_changed(sms);
 
 	DBG("%p", entry);
 
@@ -653,8 +733,7 @@ static void sms_tx_queue_remove_entry(struct ofono_sms *sms, GList *entry_list,
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS) {
 		struct message *m;
 
-		sms_tx_backup_free(sms->imsi, entry->id, entry->flags,
-					ofono_uuid_to_str(&entry->uuid));
+		sms_tx_backup_free(sms->tx_journal, entry->id);
 
 		m = g_hash_table_lookup(sms->messages, &entry->uuid);
 
@@ -713,13 +792,14 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 	}
 
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS)
-		sms_tx_backup_remove(sms->imsi, entry->id, entry->flags,
-						ofono_uuid_to_str(&entry->uuid),
-						entry->cur_pdu);
+		sms_tx_backup_remove(sms->tx_journal, entry->id,
+					entry->cur_pdu);
 
 	entry->cur_pdu += 1;
 	entry->retry = 0;
 
+	txq_rate_update(sms, TRUE);
+
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR)
 		status_report_assembly_add_fragment(sms->sr_assembly,
 							entry->uuid.uuid,
@@ -738,13 +818,17 @@ next_q:
 	sms_tx_queue_remove_entry(sms, g_queue_peek_head_link(sms->txq),
 					tx_state);
 
+	if (g_queue_peek_head(sms->txq) == NULL) {
+		sms->tx_batch = 0;
+		txq_rate_update(sms, FALSE);
+		return;
+	}
+
 	if (sms->registered == FALSE)
 		return;
 
-	if (g_queue_peek_head(sms->txq)) {
-		DBG("Scheduling next");
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
-	}
+	DBG("Scheduling next");
+	sms->tx_source = g_timeout_add(0, tx_next, sms);
 }
 
 static gboolean tx_next(gpointer user_data)
@@ -761,10 +845,18 @@ static gboolean tx_next(gpointer user_data)
 	if (sms->registered == FALSE)
 		return FALSE;
 
-	if (g_queue_get_length(sms->txq) > 1
+	/*
+	 * Keep the link open while more PDUs are queued, until the batch
+	 * is full.  The next batch starts with the following PDU.
+	 */
+	if (++sms->tx_batch >= TXQ_BATCH_SIZE)
+		sms->tx_batch = 0;
+	else if (g_queue_get_length(sms->txq) > 1
 			|| (entry->num_pdus - entry->cur_pdu) > 1)
 		send_mms = 1;
 
+	DBG("batch: %u, mms: %d", sms->tx_batch, send_mms);
+
 	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
 	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
@@ -1475,22 +1567,24 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	struct ofono_modem *modem = __ofono_atom_get_modem(sms->atom);
 	struct ofono_sim *sim;
 	struct ofono_stk *stk;
+	struct sms_view view;
 	struct sms s;
 	enum sms_class cls;
+	gboolean mwi = FALSE;
 
 	DBG("len %d tpdu len %d", len, tpdu_len);
 
-	if (!sms_decode(pdu, len, FALSE, tpdu_len, &s)) {
-		ofono_error("Unable to decode PDU");
-		return;
-	}
-
-	if (s.type != SMS_TYPE_DELIVER) {
-		ofono_error("Expecting a DELIVER pdu");
+	/*
+	 * Most of the filtering below only needs the PID, DCS and UDH,
+	 * so validate the PDU and build the full struct sms only once
+	 * the message is known to be processed further.
+	 */
+	if (!sms_view_init(&view, pdu, len, tpdu_len)) {
+		ofono_error("Unable to decode DELIVER PDU");
 		return;
 	}
 
-	if (s.deliver.pid == SMS_PID_TYPE_SM_TYPE_0) {
+	if (view.pid == SMS_PID_TYPE_SM_TYPE_0) {
 		DBG("Explicitly ignoring type 0 SMS");
 		return;
 	}
@@ -1499,10 +1593,8 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	 * This is an older style MWI notification, process MWI
 	 * headers and handle it like any other message
 	 */
-	if (s.deliver.pid == SMS_PID_TYPE_RETURN_CALL) {
-		if (handle_mwi(sms, &s))
-			return;
-
+	if (view.pid == SMS_PID_TYPE_RETURN_CALL) {
+		mwi = TRUE;
 		goto out;
 	}
 
@@ -1510,19 +1602,17 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	 * The DCS indicates this is an MWI notification, process it
 	 * and then handle the User-Data as any other message
 	 */
-	if (sms_mwi_dcs_decode(s.deliver.dcs, NULL, NULL, NULL, NULL)) {
-		if (handle_mwi(sms, &s))
-			return;
-
+	if (sms_mwi_dcs_decode(view.dcs, NULL, NULL, NULL, NULL)) {
+		mwi = TRUE;
 		goto out;
 	}
 
-	if (!sms_dcs_decode(s.deliver.dcs, &cls, NULL, NULL, NULL)) {
+	if (!sms_dcs_decode(view.dcs, &cls, NULL, NULL, NULL)) {
 		ofono_error("Unknown / Reserved DCS.  Ignoring");
 		return;
 	}
 
-	switch (s.deliver.pid) {
+	switch (view.pid) {
 	case SMS_PID_TYPE_ME_DOWNLOAD:
 		if (cls == SMS_CLASS_1) {
 			ofono_error("ME Download message ignored");
@@ -1531,7 +1621,7 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 
 		break;
 	case SMS_PID_TYPE_ME_DEPERSONALIZATION:
-		if (s.deliver.dcs == 0x11) {
+		if (view.dcs == 0x11) {
 			ofono_error("ME Depersonalization message ignored");
 			return;
 		}
@@ -1556,6 +1646,11 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 		if (stk == NULL)
 			return;
 
+		if (!sms_view_to_sms(&view, &s)) {
+			ofono_error("Unable to decode PDU");
+			return;
+		}
+
 		__ofono_sms_sim_download(stk, &s, NULL, sms);
 
 		/*
@@ -1576,11 +1671,11 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	 * WCMP headers or headers that can't possibly be in a normal
 	 * message.  If we find messages like that, we ignore them.
 	 */
-	if (s.deliver.udhi) {
+	if (is_bit_set(view.first_octet, 6)) {
 		struct sms_udh_iter iter;
 		enum sms_iei iei;
 
-		if (!sms_udh_iter_init(&s, &iter))
+		if (!sms_udh_iter_init_from_view(&view, &iter))
 			goto out;
 
 		while ((iei = sms_udh_iter_get_ie_type(&iter)) !=
@@ -1599,9 +1694,7 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 				 * segment of a concatenated SM so as not
 				 * to repeat the indication.
 				 */
-				if (handle_mwi(sms, &s))
-					return;
-
+				mwi = TRUE;
 				goto out;
 			case SMS_IEI_WCMP:
 				ofono_error("No support for WCMP, ignoring");
@@ -1613,6 +1706,14 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	}
 
 out:
+	if (!sms_view_to_sms(&view, &s)) {
+		ofono_error("Unable to decode PDU");
+		return;
+	}
+
+	if (mwi && handle_mwi(sms, &s))
+		return;
+
 	handle_deliver(sms, &s);
 }
 
@@ -1747,6 +1848,11 @@ static void sms_remove(struct ofono_atom *atom)
 		sms->txq = NULL;
 	}
 
+	if (sms->tx_journal) {
+		sms_tx_journal_free(sms->tx_journal);
+		sms->tx_journal = NULL;
+	}
+
 	if (sms->settings) {
 		g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
 					"NextReference", sms->ref);
@@ -1892,6 +1998,22 @@ static void sms_load_settings(struct ofono_sms *sms, const char *imsi)
 		g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
 					"Alphabet", sms->alphabet);
 	}
+
+	error = NULL;
+	sms->assembly_limit = g_key_file_get_integer(sms->settings,
+						SETTINGS_GROUP,
+						"AssemblyFragmentLimit",
+						&error);
+
+	if (error || sms->assembly_limit < 0) {
+		g_error_free(error);
+		sms->assembly_limit = SMS_ASSEMBLY_DEFAULT_MAX_FRAGMENTS;
+		g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
+					"AssemblyFragmentLimit",
+					sms->assembly_limit);
+	}
+
+	sms_assembly_set_max_fragments(sms->assembly, sms->assembly_limit);
 }
 
 static void bearer_init_callback(const struct ofono_error *error, void *data)
@@ -1907,7 +2029,7 @@ static void sms_restore_tx_queue(struct ofono_sms *sms)
 
 	DBG("");
 
-	backupq = sms_tx_queue_load(sms->imsi);
+	backupq = sms_tx_queue_load(sms->tx_journal);
 
 	if (backupq == NULL)
 		return;
@@ -2007,6 +2129,9 @@ void ofono_sms_register(struct ofono_sms *sms)
 		sms->sr_assembly = status_report_assembly_new(imsi);
 
 		sms_load_settings(sms, imsi);
+
+		/* Outgoing messages are only backed up with settings */
+		sms->tx_journal = sms_tx_journal_new(sms->imsi);
 	} else {
 		sms->assembly = sms_assembly_new(NULL);
 		sms->sr_assembly = status_report_assembly_new(NULL);
@@ -2080,6 +2205,7 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 	entry->id = sms->tx_counter++;
 
 	g_queue_push_tail(sms->txq, entry);
+	txq_depth_changed(sms);
 
 	if (sms->registered && g_queue_get_length(sms->txq) == 1)
 		sms->tx_source = g_timeout_add(0, tx_next, sms);
@@ -2088,19 +2214,17 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 		memcpy(uuid, &entry->uuid, sizeof(*uuid));
 
 	if (flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS) {
-		const char *uuid_str;
 		unsigned char i;
 
-		uuid_str = ofono_uuid_to_str(&entry->uuid);
-
 		for (i = 0; i < entry->num_pdus; i++) {
 			struct pending_pdu *pdu;
 
 			pdu = &entry->pdus[i];
 
-			sms_tx_backup_store(sms->imsi, entry->id, entry->flags,
-						uuid_str, i, pdu->pdu,
-						pdu->pdu_len, pdu->tpdu_len);
+			sms_tx_backup_store(sms->tx_journal, entry->id,
+						entry->flags, entry->uuid.uuid,
+						i, pdu->pdu, pdu->pdu_len,
+						pdu->tpdu_len);
 		}
 	}
 
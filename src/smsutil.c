@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -42,15 +43,33 @@
 
 #define SMS_BACKUP_MODE 0600
 #define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
+#define SMS_BACKUP_JOURNAL SMS_BACKUP_PATH "/journal"
+
+/*
+ * Journal records are a type and payload length octet followed by the
+ * payload.  The largest record is a fragment: time stamp (8), reference
+ * (2), max (1), sequence (1), address (12) and the serialized SMS (177).
+ */
+#define SMS_JOURNAL_FRAGMENT 0x01
+#define SMS_JOURNAL_DROP 0x02
+#define SMS_JOURNAL_HEADER_LEN 2
+#define SMS_JOURNAL_RECORD_MAX 203
+#define SMS_JOURNAL_SLACK 64
+
+/*
+ * Status report journal records carry the address and message id, and for
+ * updates also the expiration (8), total, sent and deliverable counters (3)
+ * and the bitmap of outstanding message references (32).
+ */
+#define SR_JOURNAL_UPDATE 0x01
+#define SR_JOURNAL_REMOVE 0x02
+#define SR_JOURNAL_RECORD_MAX 77
 
 #define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
-#define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
+#define SMS_SR_BACKUP_JOURNAL SMS_SR_BACKUP_PATH "/journal"
 
 #define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
-#define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
-#define SMS_TX_BACKUP_PATH_FILE SMS_TX_BACKUP_PATH_DIR "/%03i"
+#define SMS_TX_BACKUP_JOURNAL SMS_TX_BACKUP_PATH "/journal"
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 #define SMS_MSGID_FMT "%40[0-9A-F]"
@@ -1583,6 +1602,151 @@ gboolean sms_decode(const unsigned char *pdu, int len, gboolean outgoing,
 	return FALSE;
 }
 
+static gboolean skip_address_field(const unsigned char *pdu, int len,
+					int *offset, gboolean sc)
+{
+	unsigned char addr_len;
+	int byte_len;
+
+	if (!next_octet(pdu, len, offset, &addr_len))
+		return FALSE;
+
+	if (sc && addr_len == 0)
+		return TRUE;
+
+	/* Type of address */
+	if (len == *offset)
+		return FALSE;
+
+	*offset += 1;
+
+	if (sc)
+		byte_len = addr_len - 1;
+	else
+		byte_len = (addr_len + 1) / 2;
+
+	if ((len - *offset) < byte_len)
+		return FALSE;
+
+	*offset += byte_len;
+
+	return TRUE;
+}
+
+/*
+ * Validates an incoming SMS-DELIVER PDU without decoding it.  The field
+ * offsets are recorded in the view so that the caller can look at the
+ * few fields it needs for filtering and only build the full struct sms,
+ * using sms_view_to_sms(), for messages that are actually delivered.
+ */
+gboolean sms_view_init(struct sms_view *view, const unsigned char *pdu,
+			int len, int tpdu_len)
+{
+	const unsigned char *tpdu;
+	int offset = 0;
+	int expected;
+
+	if (view == NULL)
+		return FALSE;
+
+	if (len == 0)
+		return FALSE;
+
+	if (tpdu_len < len) {
+		if (!skip_address_field(pdu, len, &offset, TRUE))
+			return FALSE;
+	}
+
+	if ((len - offset) < tpdu_len)
+		return FALSE;
+
+	tpdu = pdu + offset;
+
+	/* 23.040 9.2.3.1, Reserved is treated as deliver */
+	if ((tpdu[0] & 0x3) != 0 && (tpdu[0] & 0x3) != 3)
+		return FALSE;
+
+	view->pdu = pdu;
+	view->len = len;
+	view->tpdu_len = tpdu_len;
+	view->tpdu = tpdu;
+	view->first_octet = tpdu[0];
+
+	offset = 1;
+	view->oaddr_offset = offset;
+
+	if (!skip_address_field(tpdu, tpdu_len, &offset, FALSE))
+		return FALSE;
+
+	if (!next_octet(tpdu, tpdu_len, &offset, &view->pid))
+		return FALSE;
+
+	if (!next_octet(tpdu, tpdu_len, &offset, &view->dcs))
+		return FALSE;
+
+	if ((tpdu_len - offset) < 7)
+		return FALSE;
+
+	view->scts_offset = offset;
+	offset += 7;
+
+	if (!next_octet(tpdu, tpdu_len, &offset, &view->udl))
+		return FALSE;
+
+	expected = sms_udl_in_bytes(view->udl, view->dcs);
+
+	if ((tpdu_len - offset) < expected)
+		return FALSE;
+
+	view->ud_offset = offset;
+	view->ud_len = expected;
+
+	return TRUE;
+}
+
+/*
+ * Builds the struct sms from a view without validating the PDU again,
+ * only the fields not recorded in the view are decoded here.
+ */
+gboolean sms_view_to_sms(const struct sms_view *view, struct sms *out)
+{
+	int offset = 0;
+
+	memset(out, 0, sizeof(*out));
+
+	if (view->tpdu_len < view->len) {
+		if (!sms_decode_address_field(view->pdu, view->len, &offset,
+						TRUE, &out->sc_addr))
+			return FALSE;
+	}
+
+	out->type = SMS_TYPE_DELIVER;
+	out->deliver.mms = !is_bit_set(view->first_octet, 2);
+	out->deliver.sri = is_bit_set(view->first_octet, 5);
+	out->deliver.udhi = is_bit_set(view->first_octet, 6);
+	out->deliver.rp = is_bit_set(view->first_octet, 7);
+
+	offset = view->oaddr_offset;
+
+	if (!sms_decode_address_field(view->tpdu, view->tpdu_len, &offset,
+					FALSE, &out->deliver.oaddr))
+		return FALSE;
+
+	out->deliver.pid = view->pid;
+	out->deliver.dcs = view->dcs;
+
+	offset = view->scts_offset;
+
+	if (!sms_decode_scts(view->tpdu, view->tpdu_len, &offset,
+				&out->deliver.scts))
+		return FALSE;
+
+	out->deliver.udl = view->udl;
+	memcpy(out->deliver.ud, view->tpdu + view->ud_offset, view->ud_len);
+
+	return TRUE;
+}
+
 const guint8 *sms_extract_common(const struct sms *sms, gboolean *out_udhi,
 					guint8 *out_dcs, guint8 *out_udl,
 					guint8 *out_max)
@@ -1774,6 +1938,36 @@ gboolean sms_udh_iter_init_from_cbs(const struct cbs *cbs,
 
 	return TRUE;
 }
+
+gboolean sms_udh_iter_init_from_view(const struct sms_view *view,
+					struct sms_udh_iter *iter)
+{
+	const guint8 *hdr;
+	guint8 max_len;
+
+	if (!is_bit_set(view->first_octet, 6))
+		return FALSE;
+
+	hdr = view->tpdu + view->ud_offset;
+	max_len = view->ud_len;
+
+	/* Can't actually store the HDL + IEI / IEL */
+	if (max_len < 3)
+		return FALSE;
+
+	/* TP-UD of an SMS-DELIVER is at most 140 octets */
+	if (max_len > 140)
+		return FALSE;
+
+	if (!verify_udh(hdr, max_len))
+		return FALSE;
+
+	iter->data = hdr;
+	iter->offset = 1;
+
+	return TRUE;
+}
+
 guint8 sms_udh_iter_get_udh_length(struct sms_udh_iter *iter)
 {
 	return iter->data[0];
@@ -2380,202 +2574,575 @@ gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr)
 	return TRUE;
 }
 
-static void sms_assembly_load(struct sms_assembly *assembly,
-				const struct dirent *dir)
+static guint sms_assembly_node_hash(gconstpointer v)
 {
-	struct sms_address addr;
-	DECLARE_SMS_ADDR_STR(straddr);
-	guint16 ref;
-	guint8 max;
-	guint8 seq;
-	char *path;
-	int len;
-	struct stat segment_stat;
-	struct dirent **segments;
-	char *endp;
-	int r;
-	int i;
-	unsigned char buf[177];
-	struct sms segment;
+	const struct sms_assembly_node *node = v;
+	guint h = g_str_hash(node->addr.address);
 
-	if (dir->d_type != DT_DIR)
-		return;
+	h = h * 31 + (node->addr.number_type << 4 | node->addr.numbering_plan);
 
-	/* Max of SMS address size is 12 bytes, hex encoded */
-	if (sscanf(dir->d_name, SMS_ADDR_FMT "-%hi-%hhi",
-				straddr, &ref, &max) < 3)
-		return;
+	return h * 31 + node->ref;
+}
 
-	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
-		return;
+static gboolean sms_assembly_node_equal(gconstpointer v1, gconstpointer v2)
+{
+	const struct sms_assembly_node *a = v1;
+	const struct sms_assembly_node *b = v2;
 
-	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
-			assembly->imsi, dir->d_name);
-	len = scandir(path, &segments, NULL, versionsort);
-	g_free(path);
+	if (a->ref != b->ref)
+		return FALSE;
 
-	if (len < 0)
-		return;
+	if (a->addr.number_type != b->addr.number_type)
+		return FALSE;
 
-	for (i = 0; i < len; i++) {
-		if (segments[i]->d_type != DT_REG)
-			continue;
+	if (a->addr.numbering_plan != b->addr.numbering_plan)
+		return FALSE;
 
-		seq = strtol(segments[i]->d_name, &endp, 10);
-		if (*endp != '\0')
-			continue;
+	return strcmp(a->addr.address, b->addr.address) == 0;
+}
 
-		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		if (r < 0)
-			continue;
+static void sms_assembly_node_free(gpointer data)
+{
+	struct sms_assembly_node *node = data;
 
-		if (!sms_deserialize(buf, &segment, r))
-			continue;
+	g_slist_foreach(node->fragment_list, (GFunc) g_free, 0);
+	g_slist_free(node->fragment_list);
+	g_free(node);
+}
 
-		path = g_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		r = stat(path, &segment_stat);
-		g_free(path);
+static int sms_assembly_encode_fragment(unsigned char *buf, time_t ts,
+					const struct sms_address *addr,
+					guint16 ref, guint8 max, guint8 seq,
+					const struct sms *sms)
+{
+	guint64 t = ts;
+	int offset = SMS_JOURNAL_HEADER_LEN;
+	int i;
 
-		if (r != 0)
-			continue;
+	buf[0] = SMS_JOURNAL_FRAGMENT;
 
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
-						segment_stat.st_mtime,
-						&addr, ref, max, seq, FALSE);
-	}
+	for (i = 7; i >= 0; i--)
+		buf[offset++] = t >> (i * 8);
 
-	for (i = 0; i < len; i++)
-		free(segments[i]);
+	buf[offset++] = ref >> 8;
+	buf[offset++] = ref & 0xff;
+	buf[offset++] = max;
+	buf[offset++] = seq;
 
-	free(segments);
+	if (sms_encode_address_field(addr, FALSE, buf, &offset) == FALSE)
+		return -1;
+
+	offset += sms_serialize(buf + offset, sms);
+	buf[1] = offset - SMS_JOURNAL_HEADER_LEN;
+
+	return offset;
 }
 
-static gboolean sms_assembly_store(struct sms_assembly *assembly,
-				struct sms_assembly_node *node,
-				const struct sms *sms, guint8 seq)
+static int sms_assembly_encode_drop(unsigned char *buf,
+					const struct sms_assembly_node *node)
 {
-	unsigned char buf[177];
-	int len;
-	DECLARE_SMS_ADDR_STR(straddr);
-
-	if (assembly->imsi == NULL)
-		return FALSE;
+	int offset = SMS_JOURNAL_HEADER_LEN;
 
-	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
-		return FALSE;
+	buf[0] = SMS_JOURNAL_DROP;
+	buf[offset++] = node->ref >> 8;
+	buf[offset++] = node->ref & 0xff;
+	buf[offset++] = node->max_fragments;
 
-	len = sms_serialize(buf, sms);
+	if (sms_encode_address_field(&node->addr, FALSE, buf,
+					&offset) == FALSE)
+		return -1;
 
-	if (write_file(buf, len, SMS_BACKUP_MODE,
-				SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	buf[1] = offset - SMS_JOURNAL_HEADER_LEN;
 
-	return TRUE;
+	return offset;
 }
 
-static void sms_assembly_backup_free(struct sms_assembly *assembly,
-					struct sms_assembly_node *node)
+static void journal_close(int *fd)
 {
-	char *path;
-	int seq;
-	DECLARE_SMS_ADDR_STR(straddr);
-
-	if (assembly->imsi == NULL)
-		return;
-
-	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
+	if (*fd < 0)
 		return;
 
-	for (seq = 0; seq < node->max_fragments; seq++) {
-		int offset = seq / 32;
-		int bit = 1 << (seq % 32);
-
-		if (node->bitmap[offset] & bit) {
-			path = g_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
-					node->ref, node->max_fragments, seq);
-			unlink(path);
-			g_free(path);
-		}
-	}
-
-	path = g_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	g_free(path);
+	TFR(close(*fd));
+	*fd = -1;
 }
 
-struct sms_assembly *sms_assembly_new(const char *imsi)
+/*
+ * Appends records to an IMSI specific journal, opening it on first use.
+ * Records always go out with a single write, so at most the last record
+ * can be torn by a crash and replay simply stops at it.
+ */
+static gboolean journal_append(int *fd, const char *path_fmt,
+				const char *imsi,
+				const unsigned char *buf, int len)
 {
-	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
 	char *path;
-	struct dirent **entries;
-	int len;
-
-	if (imsi) {
-		ret->imsi = imsi;
 
-		/* Restore state from backup */
+	if (imsi == NULL || len <= 0)
+		return FALSE;
 
-		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
-		len = scandir(path, &entries, NULL, alphasort);
-		g_free(path);
+	if (*fd < 0) {
+		path = g_strdup_printf(path_fmt, imsi);
 
-		if (len < 0)
-			return ret;
+		if (create_dirs(path, SMS_BACKUP_MODE | S_IXUSR) == 0)
+			*fd = TFR(open(path, O_WRONLY | O_CREAT | O_APPEND,
+					SMS_BACKUP_MODE));
 
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
-		}
+		g_free(path);
 
-		free(entries);
+		if (*fd < 0)
+			return FALSE;
 	}
 
-	return ret;
+	if (TFR(write(*fd, buf, len)) != len)
+		return FALSE;
+
+	return TRUE;
 }
 
-void sms_assembly_free(struct sms_assembly *assembly)
+static gboolean journal_load(const char *path_fmt, const char *imsi,
+				gchar **contents, gsize *len)
 {
-	GSList *l;
+	char *path;
+	gboolean ret;
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	path = g_strdup_printf(path_fmt, imsi);
+	ret = g_file_get_contents(path, contents, len, NULL);
+	g_free(path);
 
-		g_slist_foreach(node->fragment_list, (GFunc) g_free, 0);
-		g_slist_free(node->fragment_list);
-		g_free(node);
-	}
+	return ret;
+}
 
-	g_slist_free(assembly->assembly_list);
-	g_free(assembly);
+static void sms_assembly_journal_close(struct sms_assembly *assembly)
+{
+	journal_close(&assembly->journal_fd);
 }
 
-GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
-					const struct sms *sms, time_t ts,
-					const struct sms_address *addr,
-					guint16 ref, guint8 max, guint8 seq)
+static void sms_assembly_journal_append(struct sms_assembly *assembly,
+					const unsigned char *buf, int len)
 {
-	return sms_assembly_add_fragment_backup(assembly, sms,
-						ts, addr, ref, max, seq, TRUE);
+	if (journal_append(&assembly->journal_fd, SMS_BACKUP_JOURNAL,
+				assembly->imsi, buf, len))
+		assembly->journal_records += 1;
 }
 
-static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
-					const struct sms *sms, time_t ts,
+/*
+ * Rewrites the journal so that it only contains the fragments still
+ * waiting for reassembly.  The new journal atomically replaces the old.
+ */
+static gboolean sms_assembly_journal_compact(struct sms_assembly *assembly)
+{
+	GByteArray *journal;
+	unsigned char buf[SMS_JOURNAL_RECORD_MAX];
+	gboolean ret = TRUE;
+	unsigned int records = 0;
+	GList *l;
+
+	if (assembly->imsi == NULL)
+		return FALSE;
+
+	journal = g_byte_array_new();
+
+	for (l = assembly->expire_queue.head; l; l = l->next) {
+		struct sms_assembly_node *node = l->data;
+		GSList *f = node->fragment_list;
+		unsigned int seq;
+		int len;
+
+		/* Sequence numbers start at 1, walk the whole bitmap */
+		for (seq = 0; seq < 256 && f; seq++) {
+			if (!(node->bitmap[seq / 32] & (1 << (seq % 32))))
+				continue;
+
+			len = sms_assembly_encode_fragment(buf, node->ts,
+							&node->addr, node->ref,
+							node->max_fragments,
+							seq, f->data);
+			f = f->next;
+
+			if (len < 0)
+				continue;
+
+			g_byte_array_append(journal, buf, len);
+			records += 1;
+		}
+	}
+
+	sms_assembly_journal_close(assembly);
+
+	if (write_file(journal->data, journal->len, SMS_BACKUP_MODE,
+				SMS_BACKUP_JOURNAL, assembly->imsi) !=
+			(ssize_t) journal->len)
+		ret = FALSE;
+	else
+		assembly->journal_records = records;
+
+	g_byte_array_free(journal, TRUE);
+
+	return ret;
+}
+
+static void sms_assembly_journal_check(struct sms_assembly *assembly)
+{
+	if (assembly->journal_records < SMS_JOURNAL_SLACK +
+						assembly->num_fragments * 2)
+		return;
+
+	sms_assembly_journal_compact(assembly);
+}
+
+static void sms_assembly_remove_node(struct sms_assembly *assembly,
+					struct sms_assembly_node *node,
+					gboolean backup)
+{
+	unsigned char buf[SMS_JOURNAL_RECORD_MAX];
+
+	if (backup)
+		sms_assembly_journal_append(assembly, buf,
+				sms_assembly_encode_drop(buf, node));
+
+	assembly->num_fragments -= node->num_fragments;
+
+	g_queue_unlink(&assembly->expire_queue, &node->expire_link);
+	g_queue_unlink(&assembly->lru_queue, &node->lru_link);
+	g_hash_table_remove(assembly->assembly_table, node);
+}
+
+static void sms_assembly_journal_load(struct sms_assembly *assembly)
+{
+	gchar *contents;
+	gsize len;
+	gsize offset = 0;
+
+	if (!journal_load(SMS_BACKUP_JOURNAL, assembly->imsi, &contents, &len))
+		return;
+
+	while (len - offset >= SMS_JOURNAL_HEADER_LEN) {
+		const unsigned char *rec = (unsigned char *) contents + offset;
+		int rec_len = rec[1];
+		int pos = SMS_JOURNAL_HEADER_LEN + rec_len;
+		struct sms_assembly_node key;
+		struct sms_assembly_node *node;
+		struct sms segment;
+		GSList *completed;
+		guint64 ts = 0;
+		guint8 max, seq;
+		int i;
+
+		if (len - offset < (gsize) pos)
+			break;
+
+		offset += pos;
+		pos = SMS_JOURNAL_HEADER_LEN;
+		rec_len += SMS_JOURNAL_HEADER_LEN;
+
+		switch (rec[0]) {
+		case SMS_JOURNAL_FRAGMENT:
+			if (rec_len < pos + 12)
+				continue;
+
+			for (i = 0; i < 8; i++)
+				ts = ts << 8 | rec[pos++];
+
+			key.ref = rec[pos] << 8 | rec[pos + 1];
+			max = rec[pos + 2];
+			seq = rec[pos + 3];
+			pos += 4;
+
+			if (!sms_decode_address_field(rec, rec_len, &pos,
+							FALSE, &key.addr))
+				continue;
+
+			if (!sms_deserialize(rec + pos, &segment,
+						rec_len - pos))
+				continue;
+
+			completed = sms_assembly_add_fragment_backup(assembly,
+						&segment, ts, &key.addr,
+						key.ref, max, seq, FALSE);
+
+			/* Completion would have been followed by a drop */
+			g_slist_foreach(completed, (GFunc) g_free, NULL);
+			g_slist_free(completed);
+			break;
+
+		case SMS_JOURNAL_DROP:
+			if (rec_len < pos + 3)
+				continue;
+
+			key.ref = rec[pos] << 8 | rec[pos + 1];
+			pos += 3;
+
+			if (!sms_decode_address_field(rec, rec_len, &pos,
+							FALSE, &key.addr))
+				continue;
+
+			node = g_hash_table_lookup(assembly->assembly_table,
+							&key);
+			if (node)
+				sms_assembly_remove_node(assembly, node, FALSE);
+
+			break;
+		}
+	}
+
+	g_free(contents);
+}
+
+static void sms_assembly_load(struct sms_assembly *assembly,
+				const struct dirent *dir)
+{
+	struct sms_address addr;
+	DECLARE_SMS_ADDR_STR(straddr);
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	char *path;
+	int len;
+	struct stat segment_stat;
+	struct dirent **segments;
+	char *endp;
+	int r;
+	int i;
+	unsigned char buf[177];
+	struct sms segment;
+
+	if (dir->d_type != DT_DIR)
+		return;
+
+	/* Max of SMS address size is 12 bytes, hex encoded */
+	if (sscanf(dir->d_name, SMS_ADDR_FMT "-%hi-%hhi",
+				straddr, &ref, &max) < 3)
+		return;
+
+	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
+		return;
+
+	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
+			assembly->imsi, dir->d_name);
+	len = scandir(path, &segments, NULL, versionsort);
+	g_free(path);
+
+	if (len < 0)
+		return;
+
+	for (i = 0; i < len; i++) {
+		if (segments[i]->d_type != DT_REG)
+			continue;
+
+		seq = strtol(segments[i]->d_name, &endp, 10);
+		if (*endp != '\0')
+			continue;
+
+		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
+				assembly->imsi,
+				dir->d_name, segments[i]->d_name);
+		if (r < 0)
+			continue;
+
+		if (!sms_deserialize(buf, &segment, r))
+			continue;
+
+		path = g_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
+				assembly->imsi,
+				dir->d_name, segments[i]->d_name);
+		r = stat(path, &segment_stat);
+		g_free(path);
+
+		if (r != 0)
+			continue;
+
+		/* Errors cannot occur here */
+		sms_assembly_add_fragment_backup(assembly, &segment,
+						segment_stat.st_mtime,
+						&addr, ref, max, seq, FALSE);
+	}
+
+	for (i = 0; i < len; i++)
+		free(segments[i]);
+
+	free(segments);
+}
+
+/*
+ * Older versions stored every fragment in a file of its own, remove
+ * those once their contents have been migrated into the journal.
+ */
+static void sms_assembly_remove_legacy(struct sms_assembly *assembly,
+					const struct dirent *dir)
+{
+	struct dirent **segments;
+	char *path;
+	int len;
+	int i;
+
+	if (dir->d_type != DT_DIR)
+		return;
+
+	if (dir->d_name[0] == '.')
+		return;
+
+	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
+			assembly->imsi, dir->d_name);
+	len = scandir(path, &segments, NULL, alphasort);
+
+	if (len < 0) {
+		g_free(path);
+		return;
+	}
+
+	for (i = 0; i < len; i++) {
+		char *file;
+
+		if (segments[i]->d_type == DT_REG) {
+			file = g_strdup_printf("%s/%s", path,
+						segments[i]->d_name);
+			unlink(file);
+			g_free(file);
+		}
+
+		free(segments[i]);
+	}
+
+	free(segments);
+
+	rmdir(path);
+	g_free(path);
+}
+
+struct sms_assembly *sms_assembly_new(const char *imsi)
+{
+	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
+	char *path;
+	struct dirent **entries;
+	int len;
+	int i;
+
+	ret->assembly_table = g_hash_table_new_full(sms_assembly_node_hash,
+						sms_assembly_node_equal,
+						sms_assembly_node_free, NULL);
+	g_queue_init(&ret->expire_queue);
+	g_queue_init(&ret->lru_queue);
+	ret->max_fragments = SMS_ASSEMBLY_DEFAULT_MAX_FRAGMENTS;
+	ret->journal_fd = -1;
+
+	if (imsi) {
+		ret->imsi = imsi;
+
+		/* Restore state from backup */
+
+		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
+		len = scandir(path, &entries, NULL, alphasort);
+		g_free(path);
+
+		for (i = len - 1; i >= 0; i--)
+			sms_assembly_load(ret, entries[i]);
+
+		sms_assembly_journal_load(ret);
+
+		if (sms_assembly_journal_compact(ret))
+			for (i = 0; i < len; i++)
+				sms_assembly_remove_legacy(ret, entries[i]);
+
+		for (i = 0; i < len; i++)
+			free(entries[i]);
+
+		if (len >= 0)
+			free(entries);
+	}
+
+	return ret;
+}
+
+void sms_assembly_free(struct sms_assembly *assembly)
+{
+	sms_assembly_journal_close(assembly);
+
+	/* The queue links are embedded in the nodes, freed with the table */
+	g_hash_table_destroy(assembly->assembly_table);
+	g_free(assembly);
+}
+
+/*!
+ * Limits the number of fragments kept waiting for reassembly.  Once the
+ * limit is reached, the least recently updated messages are dropped to
+ * make room for new fragments.  A limit of 0 disables the check.
+ */
+void sms_assembly_set_max_fragments(struct sms_assembly *assembly,
+					unsigned int max)
+{
+	assembly->max_fragments = max;
+}
+
+GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
+					const struct sms *sms, time_t ts,
+					const struct sms_address *addr,
+					guint16 ref, guint8 max, guint8 seq)
+{
+	return sms_assembly_add_fragment_backup(assembly, sms,
+						ts, addr, ref, max, seq, TRUE);
+}
+
+static void sms_assembly_evict(struct sms_assembly *assembly,
+				struct sms_assembly_node *keep,
+				gboolean backup)
+{
+	GList *l = assembly->lru_queue.tail;
+
+	while (l && assembly->num_fragments > assembly->max_fragments) {
+		struct sms_assembly_node *node = l->data;
+
+		l = l->prev;
+
+		if (node == keep)
+			continue;
+
+		sms_assembly_remove_node(assembly, node, backup);
+	}
+}
+
+static void sms_assembly_expire_queue_insert(struct sms_assembly *assembly,
+					struct sms_assembly_node *node)
+{
+	GList *l;
+
+	/* Fragments mostly arrive in order, so this is usually O(1) */
+	for (l = assembly->expire_queue.tail; l; l = l->prev) {
+		struct sms_assembly_node *cur = l->data;
+
+		if (cur->ts <= node->ts)
+			break;
+	}
+
+	node->expire_link.data = node;
+
+	if (l == NULL) {
+		g_queue_push_head_link(&assembly->expire_queue,
+					&node->expire_link);
+		return;
+	}
+
+	/* Link after l */
+	node->expire_link.prev = l;
+	node->expire_link.next = l->next;
+
+	if (l->next)
+		l->next->prev = &node->expire_link;
+	else
+		assembly->expire_queue.tail = &node->expire_link;
+
+	l->next = &node->expire_link;
+	assembly->expire_queue.length += 1;
+}
+
+static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
+					const struct sms *sms, time_t ts,
 					const struct sms_address *addr,
 					guint16 ref, guint8 max, guint8 seq,
 					gboolean backup)
 {
 	unsigned int offset = seq / 32;
 	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
+	struct sms_assembly_node key;
 	struct sms *newsms;
 	struct sms_assembly_node *node;
 	GSList *completed;
@@ -2583,23 +3150,12 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 	unsigned int i;
 	unsigned int j;
 
-	prev = NULL;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
+	memcpy(&key.addr, addr, sizeof(struct sms_address));
+	key.ref = ref;
 
-		if (node->addr.number_type != addr->number_type)
-			continue;
-
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
-
-		if (strcmp(node->addr.address, addr->address))
-			continue;
-
-		if (ref != node->ref)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table, &key);
 
+	if (node) {
 		/*
 		 * Message Reference and address the same, but max is not
 		 * ignore the SMS completely
@@ -2628,6 +3184,8 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 			if (node->bitmap[offset] & j)
 				position += 1;
 
+		g_queue_unlink(&assembly->lru_queue, &node->lru_link);
+
 		goto out;
 	}
 
@@ -2637,114 +3195,433 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 	node->ref = ref;
 	node->max_fragments = max;
 
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+	g_hash_table_insert(assembly->assembly_table, node, node);
+	sms_assembly_expire_queue_insert(assembly, node);
+
+	position = 0;
+
+out:
+	node->lru_link.data = node;
+	g_queue_push_head_link(&assembly->lru_queue, &node->lru_link);
+
+	newsms = g_new(struct sms, 1);
+
+	memcpy(newsms, sms, sizeof(struct sms));
+	node->fragment_list = g_slist_insert(node->fragment_list,
+						newsms, position);
+	node->bitmap[offset] |= bit;
+	node->num_fragments += 1;
+	assembly->num_fragments += 1;
+
+	if (node->num_fragments < node->max_fragments) {
+		unsigned char buf[SMS_JOURNAL_RECORD_MAX];
+
+		if (assembly->max_fragments &&
+				assembly->num_fragments >
+					assembly->max_fragments)
+			sms_assembly_evict(assembly, node, backup);
+
+		if (backup) {
+			sms_assembly_journal_append(assembly, buf,
+				sms_assembly_encode_fragment(buf, node->ts,
+							addr, ref, max,
+							seq, sms));
+			sms_assembly_journal_check(assembly);
+		}
+
+		return NULL;
+	}
+
+	completed = node->fragment_list;
+	node->fragment_list = NULL;
+
+	sms_assembly_remove_node(assembly, node, backup);
+
+	if (backup)
+		sms_assembly_journal_check(assembly);
+
+	return completed;
+}
+
+/*!
+ * Expires all incomplete messages that have been received at time prior
+ * to one given by before argument.  The fragment list is freed and the
+ * SMSes are vaporized.
+ */
+void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
+{
+	struct sms_assembly_node *node;
+
+	/* The expiry queue is sorted by time, oldest messages first */
+	while ((node = g_queue_peek_head(&assembly->expire_queue))) {
+		if (node->ts > before)
+			break;
+
+		sms_assembly_remove_node(assembly, node, TRUE);
+	}
+
+	sms_assembly_journal_check(assembly);
+}
+
+static gboolean sha1_equal(gconstpointer v1, gconstpointer v2)
+{
+	return memcmp(v1, v2, SMS_MSGID_LEN) == 0;
+}
+
+static guint sha1_hash(gconstpointer v)
+{
+	guint h;
+
+	memcpy(&h, v, sizeof(h));
+
+	return h;
+}
+
+/*
+ * A message waiting for status reports.  The id_table_node is kept as the
+ * first member, it is also the format used by older per-message backups.
+ */
+struct sr_assembly_node {
+	struct id_table_node info;
+	unsigned char msgid[SMS_MSGID_LEN];
+	struct sr_assembly_addr *addr;
+	GList expire_link;
+};
+
+struct sr_assembly_addr {
+	char *straddr;
+	GHashTable *id_table;
+	GHashTable *mr_table;
+};
+
+static void sr_assembly_addr_free(gpointer data)
+{
+	struct sr_assembly_addr *addr = data;
+
+	g_hash_table_destroy(addr->mr_table);
+	g_hash_table_destroy(addr->id_table);
+	g_free(addr);
+}
+
+static struct sr_assembly_addr *sr_assembly_addr_get(
+				struct status_report_assembly *assembly,
+				const char *straddr)
+{
+	struct sr_assembly_addr *addr;
+
+	addr = g_hash_table_lookup(assembly->assembly_table, straddr);
+	if (addr != NULL)
+		return addr;
+
+	/* Create the tables keyed by message id and mr for this address */
+	addr = g_new0(struct sr_assembly_addr, 1);
+	addr->straddr = g_strdup(straddr);
+	addr->id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
+						NULL, g_free);
+	addr->mr_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	g_hash_table_insert(assembly->assembly_table, addr->straddr, addr);
+
+	return addr;
+}
+
+static struct sr_assembly_node *sr_assembly_node_get(
+				struct status_report_assembly *assembly,
+				struct sr_assembly_addr *addr,
+				const unsigned char *msgid)
+{
+	struct sr_assembly_node *node;
+
+	node = g_hash_table_lookup(addr->id_table, msgid);
+	if (node != NULL)
+		return node;
+
+	node = g_new0(struct sr_assembly_node, 1);
+	memcpy(node->msgid, msgid, SMS_MSGID_LEN);
+	node->addr = addr;
+	node->info.deliverable = TRUE;
+	node->expire_link.data = node;
+
+	g_hash_table_insert(addr->id_table, node->msgid, node);
+	g_queue_push_tail_link(&assembly->expire_queue, &node->expire_link);
+	assembly->num_nodes += 1;
+
+	return node;
+}
+
+static void sr_assembly_node_unindex(struct sr_assembly_node *node)
+{
+	unsigned int mr;
+
+	for (mr = 0; mr < 256; mr++) {
+		gpointer key = GUINT_TO_POINTER(mr);
+
+		if (!(node->info.mrs[mr / 32] & (1 << (mr % 32))))
+			continue;
+
+		if (g_hash_table_lookup(node->addr->mr_table, key) == node)
+			g_hash_table_remove(node->addr->mr_table, key);
+	}
+}
+
+static void sr_assembly_node_index(struct sr_assembly_node *node)
+{
+	unsigned int mr;
+
+	for (mr = 0; mr < 256; mr++)
+		if (node->info.mrs[mr / 32] & (1 << (mr % 32)))
+			g_hash_table_replace(node->addr->mr_table,
+						GUINT_TO_POINTER(mr), node);
+}
+
+/*
+ * Keeps the expiry queue sorted, the expiration time is normally bumped
+ * to the current time so the node usually moves straight to the tail.
+ */
+static void sr_assembly_node_requeue(struct status_report_assembly *assembly,
+					struct sr_assembly_node *node)
+{
+	GList *l;
+
+	g_queue_unlink(&assembly->expire_queue, &node->expire_link);
+
+	for (l = assembly->expire_queue.tail; l; l = l->prev) {
+		struct sr_assembly_node *cur = l->data;
+
+		if (cur->info.expiration <= node->info.expiration)
+			break;
+	}
+
+	if (l == NULL) {
+		g_queue_push_head_link(&assembly->expire_queue,
+					&node->expire_link);
+		return;
+	}
+
+	node->expire_link.prev = l;
+	node->expire_link.next = l->next;
+
+	if (l->next)
+		l->next->prev = &node->expire_link;
+	else
+		assembly->expire_queue.tail = &node->expire_link;
+
+	l->next = &node->expire_link;
+	assembly->expire_queue.length += 1;
+}
+
+static void sr_assembly_node_remove(struct status_report_assembly *assembly,
+					struct sr_assembly_node *node)
+{
+	struct sr_assembly_addr *addr = node->addr;
+
+	sr_assembly_node_unindex(node);
+	g_queue_unlink(&assembly->expire_queue, &node->expire_link);
+	assembly->num_nodes -= 1;
+
+	g_hash_table_remove(addr->id_table, node->msgid);
+
+	if (g_hash_table_size(addr->id_table) == 0)
+		g_hash_table_remove(assembly->assembly_table, addr->straddr);
+}
+
+static int sr_journal_encode(unsigned char *buf, unsigned char type,
+				const struct sr_assembly_node *node)
+{
+	struct sms_address addr;
+	guint64 expiration = node->info.expiration;
+	int offset = SMS_JOURNAL_HEADER_LEN;
+	int i;
+
+	sms_address_from_string(&addr, node->addr->straddr);
+
+	buf[0] = type;
+
+	if (sms_encode_address_field(&addr, FALSE, buf, &offset) == FALSE)
+		return -1;
+
+	memcpy(buf + offset, node->msgid, SMS_MSGID_LEN);
+	offset += SMS_MSGID_LEN;
+
+	if (type == SR_JOURNAL_REMOVE)
+		goto out;
+
+	for (i = 7; i >= 0; i--)
+		buf[offset++] = expiration >> (i * 8);
+
+	buf[offset++] = node->info.total_mrs;
+	buf[offset++] = node->info.sent_mrs;
+	buf[offset++] = node->info.deliverable;
+
+	for (i = 0; i < 8; i++) {
+		buf[offset++] = node->info.mrs[i] >> 24;
+		buf[offset++] = node->info.mrs[i] >> 16;
+		buf[offset++] = node->info.mrs[i] >> 8;
+		buf[offset++] = node->info.mrs[i];
+	}
+
+out:
+	buf[1] = offset - SMS_JOURNAL_HEADER_LEN;
+
+	return offset;
+}
+
+static void sr_assembly_journal_append(struct status_report_assembly *assy,
+					const unsigned char *buf, int len,
+					unsigned int records)
+{
+	if (journal_append(&assy->journal_fd, SMS_SR_BACKUP_JOURNAL,
+				assy->imsi, buf, len))
+		assy->journal_records += records;
+}
+
+static void sr_assembly_journal_record(struct status_report_assembly *assy,
+					unsigned char type,
+					const struct sr_assembly_node *node)
+{
+	unsigned char buf[SR_JOURNAL_RECORD_MAX];
+
+	sr_assembly_journal_append(assy, buf,
+					sr_journal_encode(buf, type, node), 1);
+}
+
+static gboolean sr_assembly_journal_compact(
+				struct status_report_assembly *assembly)
+{
+	unsigned char buf[SR_JOURNAL_RECORD_MAX];
+	GByteArray *journal;
+	gboolean ret = TRUE;
+	GList *l;
+	int len;
+
+	if (assembly->imsi == NULL)
+		return FALSE;
+
+	journal = g_byte_array_new();
+
+	for (l = assembly->expire_queue.head; l; l = l->next) {
+		len = sr_journal_encode(buf, SR_JOURNAL_UPDATE, l->data);
+
+		if (len > 0)
+			g_byte_array_append(journal, buf, len);
+	}
+
+	journal_close(&assembly->journal_fd);
+
+	if (write_file(journal->data, journal->len, SMS_BACKUP_MODE,
+				SMS_SR_BACKUP_JOURNAL, assembly->imsi) !=
+			(ssize_t) journal->len)
+		ret = FALSE;
+	else
+		assembly->journal_records = assembly->num_nodes;
+
+	g_byte_array_free(journal, TRUE);
+
+	return ret;
+}
+
+static void sr_assembly_journal_check(struct status_report_assembly *assy)
+{
+	if (assy->journal_records < SMS_JOURNAL_SLACK + assy->num_nodes * 2)
+		return;
 
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
+	sr_assembly_journal_compact(assy);
+}
 
-out:
-	newsms = g_new(struct sms, 1);
+static void sr_assembly_journal_load(struct status_report_assembly *assy)
+{
+	gchar *contents;
+	gsize len;
+	gsize offset = 0;
 
-	memcpy(newsms, sms, sizeof(struct sms));
-	node->fragment_list = g_slist_insert(node->fragment_list,
-						newsms, position);
-	node->bitmap[offset] |= bit;
-	node->num_fragments += 1;
+	if (!journal_load(SMS_SR_BACKUP_JOURNAL, assy->imsi, &contents, &len))
+		return;
 
-	if (node->num_fragments < node->max_fragments) {
-		if (backup)
-			sms_assembly_store(assembly, node, sms, seq);
+	while (len - offset >= SMS_JOURNAL_HEADER_LEN) {
+		const unsigned char *rec = (unsigned char *) contents + offset;
+		int rec_len = SMS_JOURNAL_HEADER_LEN + rec[1];
+		int pos = SMS_JOURNAL_HEADER_LEN;
+		struct sms_address addr;
+		struct sr_assembly_addr *entry;
+		struct sr_assembly_node *node;
+		const unsigned char *msgid;
+		guint64 expiration = 0;
+		int i;
 
-		return NULL;
-	}
+		if (len - offset < (gsize) rec_len)
+			break;
 
-	completed = node->fragment_list;
+		offset += rec_len;
 
-	sms_assembly_backup_free(assembly, node);
+		if (!sms_decode_address_field(rec, rec_len, &pos, FALSE,
+						&addr))
+			continue;
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+		if (rec_len - pos < SMS_MSGID_LEN)
+			continue;
 
-	g_free(node);
-	g_slist_free_1(l);
-	return completed;
-}
+		msgid = rec + pos;
+		pos += SMS_MSGID_LEN;
 
-/*!
- * Expires all incomplete messages that have been received at time prior
- * to one given by before argument.  The fragment list is freed and the
- * SMSes are vaporized.
- */
-void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
-{
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
+		entry = g_hash_table_lookup(assy->assembly_table,
+						sms_address_to_string(&addr));
 
-	prev = NULL;
-	cur = assembly->assembly_list;
+		if (rec[0] == SR_JOURNAL_REMOVE) {
+			if (entry == NULL)
+				continue;
 
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
+			node = g_hash_table_lookup(entry->id_table, msgid);
+			if (node != NULL)
+				sr_assembly_node_remove(assy, node);
 
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
 			continue;
 		}
 
-		sms_assembly_backup_free(assembly, node);
+		if (rec[0] != SR_JOURNAL_UPDATE || rec_len - pos < 43)
+			continue;
 
-		g_slist_foreach(node->fragment_list, (GFunc) g_free, 0);
-		g_slist_free(node->fragment_list);
-		g_free(node);
+		if (entry == NULL)
+			entry = sr_assembly_addr_get(assy,
+						sms_address_to_string(&addr));
 
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
+		node = sr_assembly_node_get(assy, entry, msgid);
+		sr_assembly_node_unindex(node);
 
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
-	}
-}
+		for (i = 0; i < 8; i++)
+			expiration = expiration << 8 | rec[pos++];
 
-static gboolean sha1_equal(gconstpointer v1, gconstpointer v2)
-{
-	return memcmp(v1, v2, SMS_MSGID_LEN) == 0;
-}
+		node->info.expiration = expiration;
+		node->info.total_mrs = rec[pos++];
+		node->info.sent_mrs = rec[pos++];
+		node->info.deliverable = rec[pos++];
 
-static guint sha1_hash(gconstpointer v)
-{
-	guint h;
+		for (i = 0; i < 8; i++, pos += 4)
+			node->info.mrs[i] = rec[pos] << 24 |
+						rec[pos + 1] << 16 |
+						rec[pos + 2] << 8 |
+						rec[pos + 3];
 
-	memcpy(&h, v, sizeof(h));
+		sr_assembly_node_index(node);
+		sr_assembly_node_requeue(assy, node);
+	}
 
-	return h;
+	g_free(contents);
 }
 
-static void sr_assembly_load_backup(GHashTable *assembly_table,
-					const char *imsi,
+static gboolean sr_assembly_load_backup(struct status_report_assembly *assy,
 					const struct dirent *addr_dir)
 {
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
-	struct id_table_node *node;
-	GHashTable *id_table;
+	struct id_table_node info;
+	struct sr_assembly_node *node;
 	int r;
-	char *assembly_table_key;
-	unsigned int *id_table_key;
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
 	unsigned char msgid[SMS_MSGID_LEN];
 	char endc;
 
 	if (addr_dir->d_type != DT_REG)
-		return;
+		return FALSE;
 
 	/*
 	 * All SMS-messages under the same IMSI-code are
@@ -2755,59 +3632,53 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 	 */
 	if (sscanf(addr_dir->d_name, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
 				straddr, msgid_str, &endc) != 2)
-		return;
+		return FALSE;
 
 	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
-		return;
+		return FALSE;
 
 	if (strlen(msgid_str) != 2 * SMS_MSGID_LEN)
-		return;
+		return FALSE;
 
 	if (decode_hex_own_buf(msgid_str, 2 * SMS_MSGID_LEN,
 				NULL, 0, msgid) == NULL)
-		return;
+		return FALSE;
 
-	node = g_new0(struct id_table_node, 1);
+	memset(&info, 0, sizeof(info));
 
-	r = read_file((unsigned char *) node,
+	r = read_file((unsigned char *) &info,
 			sizeof(struct id_table_node),
 			SMS_SR_BACKUP_PATH "/%s",
-			imsi, addr_dir->d_name);
-
-	if (r < 0) {
-		g_free(node);
-		return;
-	}
+			assy->imsi, addr_dir->d_name);
 
-	id_table = g_hash_table_lookup(assembly_table,
-					sms_address_to_string(&addr));
-
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
-							g_free, g_free);
-
-		assembly_table_key = g_strdup(sms_address_to_string(&addr));
-		g_hash_table_insert(assembly_table, assembly_table_key,
-					id_table);
-	}
+	if (r < 0)
+		return FALSE;
 
-	/* Node ready, create key and add them to the table */
-	id_table_key = g_memdup(msgid, SMS_MSGID_LEN);
+	node = sr_assembly_node_get(assy,
+			sr_assembly_addr_get(assy, sms_address_to_string(&addr)),
+			msgid);
+	sr_assembly_node_unindex(node);
+	memcpy(&node->info, &info, sizeof(info));
+	sr_assembly_node_index(node);
+	sr_assembly_node_requeue(assy, node);
 
-	g_hash_table_insert(id_table, id_table_key, node);
+	return TRUE;
 }
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi)
 {
 	char *path;
 	int len;
+	int len_migrated;
+	int i;
 	struct dirent **addresses;
 	struct status_report_assembly *ret =
 				g_new0(struct status_report_assembly, 1);
 
 	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
-				g_free, (GDestroyNotify) g_hash_table_destroy);
+						g_free, sr_assembly_addr_free);
+	g_queue_init(&ret->expire_queue);
+	ret->journal_fd = -1;
 
 	if (imsi) {
 		ret->imsi = imsi;
@@ -2816,83 +3687,57 @@ struct status_report_assembly *status_report_assembly_new(const char *imsi)
 		path = g_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
 		len = scandir(path, &addresses, NULL, alphasort);
 
-		g_free(path);
-
-		if (len < 0)
-			return ret;
-
 		/*
-		 * Go through different addresses. Each address can relate to
-		 * 1-n msg_ids.
+		 * Older versions stored one file per message, load those
+		 * first and remove them once migrated to the journal.
 		 */
+		for (i = len - 1; i >= 0; i--)
+			if (!sr_assembly_load_backup(ret, addresses[i])) {
+				g_free(addresses[i]);
+				addresses[i] = NULL;
+			}
 
-		while (len--) {
-			sr_assembly_load_backup(ret->assembly_table, imsi,
-								addresses[len]);
-			g_free(addresses[len]);
-		}
-
-		g_free(addresses);
-	}
-
-	return ret;
-}
-
-static gboolean sr_assembly_add_fragment_backup(const char *imsi,
-					const struct id_table_node *node,
-					const struct sms_address *addr,
-					const unsigned char *msgid)
-{
-	int len = sizeof(struct id_table_node);
-	DECLARE_SMS_ADDR_STR(straddr);
-	char msgid_str[SMS_MSGID_LEN * 2 + 1];
-
-	if (imsi == NULL)
-		return FALSE;
-
-	if (sms_address_to_hex_string(addr, straddr) == FALSE)
-		return FALSE;
-
-	if (encode_hex_own_buf(msgid, SMS_MSGID_LEN, 0, msgid_str) == NULL)
-		return FALSE;
-
-	/* storagedir/%s/sms_sr/%s-%s */
-	if (write_file((unsigned char *) node, len, SMS_BACKUP_MODE,
-			SMS_SR_BACKUP_PATH_FILE, imsi,
-			straddr, msgid_str) != len)
-		return FALSE;
+		sr_assembly_journal_load(ret);
 
-	return TRUE;
-}
+		/*
+		 * Rewriting the journal also drops a torn trailing record,
+		 * which new records would otherwise be appended behind.
+		 */
+		if (sr_assembly_journal_compact(ret))
+			len_migrated = len;
+		else
+			len_migrated = 0;
 
-static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
-					const struct sms_address *addr,
-					const unsigned char *sha1)
-{
-	char *path;
-	DECLARE_SMS_ADDR_STR(straddr);
-	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+		for (i = 0; i < len; i++) {
+			char *file;
 
-	if (imsi == NULL)
-		return FALSE;
+			if (addresses[i] == NULL)
+				continue;
 
-	if (sms_address_to_hex_string(addr, straddr) == FALSE)
-		return FALSE;
+			if (i < len_migrated) {
+				file = g_strdup_printf("%s/%s", path,
+							addresses[i]->d_name);
+				unlink(file);
+				g_free(file);
+			}
 
-	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == FALSE)
-		return FALSE;
+			g_free(addresses[i]);
+		}
 
-	path = g_strdup_printf(SMS_SR_BACKUP_PATH_FILE,
-					imsi, straddr, msgid_str);
+		if (len >= 0)
+			g_free(addresses);
 
-	unlink(path);
-	g_free(path);
+		g_free(path);
+	}
 
-	return TRUE;
+	return ret;
 }
 
 void status_report_assembly_free(struct status_report_assembly *assembly)
 {
+	journal_close(&assembly->journal_fd);
+
+	/* Queue links are embedded in the nodes, freed with the tables */
 	g_hash_table_destroy(assembly->assembly_table);
 	g_free(assembly);
 }
@@ -2918,30 +3763,23 @@ static gboolean sr_st_to_delivered(enum sms_st st, gboolean *delivered)
 	return FALSE;
 }
 
-static struct id_table_node *find_by_mr_and_mark(GHashTable *id_table,
-						unsigned char mr,
-						GHashTableIter *out_iter,
-						unsigned char **out_id)
+static struct sr_assembly_node *find_by_mr_and_mark(
+						struct sr_assembly_addr *addr,
+						unsigned char mr)
 {
 	unsigned int offset = mr / 32;
 	unsigned int bit = 1 << (mr % 32);
-	gpointer key, value;
-	struct id_table_node *node;
+	struct sr_assembly_node *node;
 
-	g_hash_table_iter_init(out_iter, id_table);
-	while (g_hash_table_iter_next(out_iter, &key, &value)) {
-		node = value;
-
-		/* Address and MR matched */
-		if (node->mrs[offset] & bit) {
-			node->mrs[offset] ^= bit;
-			*out_id = key;
+	node = g_hash_table_lookup(addr->mr_table, GUINT_TO_POINTER(mr));
+	if (node == NULL)
+		return NULL;
 
-			return node;
-		}
-	}
+	/* Address and MR matched */
+	node->info.mrs[offset] &= ~bit;
+	g_hash_table_remove(addr->mr_table, GUINT_TO_POINTER(mr));
 
-	return NULL;
+	return node;
 }
 
 /*
@@ -2952,11 +3790,9 @@ static struct id_table_node *find_by_mr_and_mark(GHashTable *id_table,
  * addresses and received address. If address contains less than six digits,
  * compare only existing digits.
  */
-static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
-						const struct sms *sr,
-						const char **out_addr,
-						GHashTableIter *out_iter,
-						unsigned char **out_msgid)
+static struct sr_assembly_node *fuzzy_lookup(
+					struct status_report_assembly *assy,
+					const struct sms *sr)
 {
 	GHashTableIter iter_addr;
 	gpointer key, value;
@@ -2967,10 +3803,9 @@ static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
 
 	while (g_hash_table_iter_next(&iter_addr, &key, &value)) {
 		const char *s_addr = key;
-		GHashTable *id_table = value;
 		unsigned int len, r_len, s_len;
 		unsigned int i;
-		struct id_table_node *node;
+		struct sr_assembly_node *node;
 
 		if (r_addr[0] == '+' && s_addr[0] == '+')
 			continue;
@@ -2992,12 +3827,9 @@ static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
 			continue;
 
 		/* Address matched. Check message reference. */
-		node = find_by_mr_and_mark(id_table, sr->status_report.mr,
-						out_iter, out_msgid);
-		if (node != NULL) {
-			*out_addr = s_addr;
+		node = find_by_mr_and_mark(value, sr->status_report.mr);
+		if (node != NULL)
 			return node;
-		}
 	}
 
 	return NULL;
@@ -3008,168 +3840,445 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 					unsigned char *out_msgid,
 					gboolean *out_delivered)
 {
-	const char *straddr;
-	GHashTable *id_table;
-	GHashTableIter iter;
-	struct sms_address addr;
-	struct id_table_node *node;
+	struct sr_assembly_addr *addr;
+	struct sr_assembly_node *node;
 	gboolean delivered;
 	gboolean pending;
-	unsigned char *msgid = 0;
 	int i;
 
 	/* We ignore temporary or tempfinal status reports */
 	if (sr_st_to_delivered(sr->status_report.st, &delivered) == FALSE)
 		return FALSE;
 
-	straddr = sms_address_to_string(&sr->status_report.raddr);
-	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
+	addr = g_hash_table_lookup(assembly->assembly_table,
+			sms_address_to_string(&sr->status_report.raddr));
 
-	if (id_table != NULL)
-		node = find_by_mr_and_mark(id_table, sr->status_report.mr,
-						&iter, &msgid);
+	if (addr != NULL)
+		node = find_by_mr_and_mark(addr, sr->status_report.mr);
 	else
-		node = fuzzy_lookup(assembly, sr, &straddr, &iter, &msgid);
+		node = fuzzy_lookup(assembly, sr);
 
 	/* Unable to find a message reference belonging to this address */
 	if (node == NULL)
 		return FALSE;
 
-	node->deliverable = node->deliverable && delivered;
+	node->info.deliverable = node->info.deliverable && delivered;
 
 	/* If we haven't sent the entire message yet, wait until sent */
-	if (node->sent_mrs < node->total_mrs)
+	if (node->info.sent_mrs < node->info.total_mrs)
 		return FALSE;
 
 	/* Figure out if we are expecting more status reports */
 	for (i = 0, pending = FALSE; i < 8; i++) {
 		/* There are still pending mr(s). */
-		if (node->mrs[i] != 0) {
+		if (node->info.mrs[i] != 0) {
 			pending = TRUE;
 			break;
 		}
 	}
 
-	sms_address_from_string(&addr, straddr);
-
-	if (pending == TRUE && node->deliverable == TRUE) {
+	if (pending == TRUE && node->info.deliverable == TRUE) {
 		/*
 		 * More status reports expected, and already received
-		 * reports completed. Update backup file.
+		 * reports completed. Update backup.
 		 */
-		sr_assembly_add_fragment_backup(assembly->imsi, node,
-						&addr, msgid);
+		sr_assembly_journal_record(assembly, SR_JOURNAL_UPDATE, node);
+		sr_assembly_journal_check(assembly);
+
+		return FALSE;
+	}
+
+	if (out_delivered)
+		*out_delivered = node->info.deliverable;
+
+	if (out_msgid)
+		memcpy(out_msgid, node->msgid, SMS_MSGID_LEN);
+
+	sr_assembly_journal_record(assembly, SR_JOURNAL_REMOVE, node);
+	sr_assembly_node_remove(assembly, node);
+	sr_assembly_journal_check(assembly);
+
+	return TRUE;
+}
+
+void status_report_assembly_add_fragment(
+					struct status_report_assembly *assembly,
+					const unsigned char *msgid,
+					const struct sms_address *to,
+					unsigned char mr, time_t expiration,
+					unsigned char total_mrs)
+{
+	unsigned int offset = mr / 32;
+	unsigned int bit = 1 << (mr % 32);
+	struct sr_assembly_addr *addr;
+	struct sr_assembly_node *node;
+
+	addr = sr_assembly_addr_get(assembly, sms_address_to_string(to));
+
+	node = g_hash_table_lookup(addr->id_table, msgid);
+
+	/* Create node in the message id hashtable if required */
+	if (node == NULL) {
+		node = sr_assembly_node_get(assembly, addr, msgid);
+		node->info.total_mrs = total_mrs;
+	}
+
+	/* addr and node both exist */
+	node->info.mrs[offset] |= bit;
+	node->info.expiration = expiration;
+	node->info.sent_mrs++;
+
+	g_hash_table_replace(addr->mr_table, GUINT_TO_POINTER(mr), node);
+	sr_assembly_node_requeue(assembly, node);
+
+	sr_assembly_journal_record(assembly, SR_JOURNAL_UPDATE, node);
+	sr_assembly_journal_check(assembly);
+}
+
+/*!
+ * Expires all messages that were last updated prior to the given time.
+ * The expiry queue is ordered, so only the expired messages are visited,
+ * and their removal is written to the backup journal in a single batch.
+ */
+void status_report_assembly_expire(struct status_report_assembly *assembly,
+					time_t before)
+{
+	unsigned char buf[SR_JOURNAL_RECORD_MAX];
+	struct sr_assembly_node *node;
+	GByteArray *batch = NULL;
+	unsigned int records = 0;
+	int len;
+
+	while ((node = g_queue_peek_head(&assembly->expire_queue))) {
+		if (node->info.expiration > before)
+			break;
+
+		if (assembly->imsi != NULL) {
+			if (batch == NULL)
+				batch = g_byte_array_new();
+
+			len = sr_journal_encode(buf, SR_JOURNAL_REMOVE, node);
+
+			if (len > 0) {
+				g_byte_array_append(batch, buf, len);
+				records += 1;
+			}
+		}
+
+		sr_assembly_node_remove(assembly, node);
+	}
+
+	if (batch == NULL)
+		return;
+
+	sr_assembly_journal_append(assembly, batch->data, batch->len, records);
+	g_byte_array_free(batch, TRUE);
+
+	sr_assembly_journal_check(assembly);
+}
+
+/*
+ * Each TX journal record carries the queue position of the message it
+ * belongs to.  Stored PDUs also carry the submit flags, message uuid and
+ * sequence number, followed by the TPDU length and the PDU itself, the
+ * same layout used by the older per-PDU backup files.
+ */
+#define TX_JOURNAL_STORE 0x01
+#define TX_JOURNAL_REMOVE 0x02
+#define TX_JOURNAL_FREE 0x03
+#define TX_JOURNAL_STORE_LEN (4 + 4 + SMS_MSGID_LEN + 1)
+#define TX_JOURNAL_RECORD_MAX (SMS_JOURNAL_HEADER_LEN + \
+				TX_JOURNAL_STORE_LEN + 177)
+
+struct tx_journal_pdu {
+	guint8 seq;
+	int len;
+	unsigned char buf[177];
+};
+
+struct tx_journal_entry {
+	unsigned long id;
+	unsigned long flags;
+	unsigned char uuid[SMS_MSGID_LEN];
+	GSList *pdus;
+};
+
+static void tx_journal_entry_free(gpointer data)
+{
+	struct tx_journal_entry *entry = data;
+
+	g_slist_free_full(entry->pdus, g_free);
+	g_free(entry);
+}
+
+static gint tx_journal_pdu_compare(gconstpointer a, gconstpointer b)
+{
+	const struct tx_journal_pdu *pa = a;
+	const struct tx_journal_pdu *pb = b;
+
+	return pa->seq - pb->seq;
+}
+
+static GSList *tx_journal_pdu_find(GSList *pdus, guint8 seq)
+{
+	for (; pdus; pdus = pdus->next) {
+		struct tx_journal_pdu *pdu = pdus->data;
+
+		if (pdu->seq == seq)
+			return pdus;
+	}
+
+	return NULL;
+}
+
+static void tx_journal_put_u32(unsigned char *buf, unsigned long v)
+{
+	buf[0] = v >> 24;
+	buf[1] = v >> 16;
+	buf[2] = v >> 8;
+	buf[3] = v;
+}
+
+static unsigned long tx_journal_get_u32(const unsigned char *buf)
+{
+	return (unsigned long) buf[0] << 24 | buf[1] << 16 | buf[2] << 8 |
+		buf[3];
+}
+
+static int tx_journal_encode_store(unsigned char *buf, unsigned long id,
+					unsigned long flags,
+					const unsigned char *uuid,
+					guint8 seq, const unsigned char *pdu,
+					int len)
+{
+	unsigned char *p = buf + SMS_JOURNAL_HEADER_LEN;
+
+	buf[0] = TX_JOURNAL_STORE;
+	buf[1] = TX_JOURNAL_STORE_LEN + len;
+
+	tx_journal_put_u32(p, id);
+	tx_journal_put_u32(p + 4, flags);
+	memcpy(p + 8, uuid, SMS_MSGID_LEN);
+	p[8 + SMS_MSGID_LEN] = seq;
+	memcpy(p + TX_JOURNAL_STORE_LEN, pdu, len);
+
+	return SMS_JOURNAL_HEADER_LEN + buf[1];
+}
+
+/*
+ * Replays the journal into the list of messages still queued, in the
+ * order they were first stored.
+ */
+static GQueue *tx_journal_replay(const char *imsi)
+{
+	GHashTable *table;
+	GQueue *entries;
+	gchar *contents;
+	gsize len;
+	gsize offset = 0;
+	GList *l;
+
+	entries = g_queue_new();
+
+	if (!journal_load(SMS_TX_BACKUP_JOURNAL, imsi, &contents, &len))
+		return entries;
+
+	table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	while (len - offset >= SMS_JOURNAL_HEADER_LEN) {
+		const unsigned char *rec = (unsigned char *) contents + offset;
+		int rec_len = rec[1];
+		struct tx_journal_entry *entry;
+		struct tx_journal_pdu *pdu;
+		unsigned long id;
+		GSList *found;
+
+		if (len - offset < (gsize) SMS_JOURNAL_HEADER_LEN + rec_len)
+			break;
+
+		offset += SMS_JOURNAL_HEADER_LEN + rec_len;
+
+		if (rec_len < 4)
+			continue;
+
+		id = tx_journal_get_u32(rec + SMS_JOURNAL_HEADER_LEN);
+		entry = g_hash_table_lookup(table, GUINT_TO_POINTER(id));
+		rec += SMS_JOURNAL_HEADER_LEN;
+
+		switch (rec[-SMS_JOURNAL_HEADER_LEN]) {
+		case TX_JOURNAL_STORE:
+			if (rec_len <= TX_JOURNAL_STORE_LEN ||
+					rec_len > TX_JOURNAL_STORE_LEN + 177)
+				break;
+
+			if (entry == NULL) {
+				entry = g_new0(struct tx_journal_entry, 1);
+				entry->id = id;
+				entry->flags = tx_journal_get_u32(rec + 4);
+				memcpy(entry->uuid, rec + 8, SMS_MSGID_LEN);
+
+				g_hash_table_insert(table,
+						GUINT_TO_POINTER(id), entry);
+				g_queue_push_tail(entries, entry);
+			}
+
+			pdu = g_new0(struct tx_journal_pdu, 1);
+			pdu->seq = rec[8 + SMS_MSGID_LEN];
+			pdu->len = rec_len - TX_JOURNAL_STORE_LEN;
+			memcpy(pdu->buf, rec + TX_JOURNAL_STORE_LEN, pdu->len);
+
+			found = tx_journal_pdu_find(entry->pdus, pdu->seq);
+			if (found != NULL) {
+				g_free(found->data);
+				entry->pdus = g_slist_delete_link(entry->pdus,
+									found);
+			}
+
+			entry->pdus = g_slist_insert_sorted(entry->pdus, pdu,
+						tx_journal_pdu_compare);
+			break;
+		case TX_JOURNAL_REMOVE:
+			if (entry == NULL || rec_len < 5)
+				break;
+
+			found = tx_journal_pdu_find(entry->pdus, rec[4]);
+			if (found == NULL)
+				break;
+
+			g_free(found->data);
+			entry->pdus = g_slist_delete_link(entry->pdus, found);
+			break;
+		case TX_JOURNAL_FREE:
+			if (entry == NULL)
+				break;
+
+			g_hash_table_remove(table, GUINT_TO_POINTER(id));
+			g_queue_remove(entries, entry);
+			tx_journal_entry_free(entry);
+			break;
+		}
+	}
+
+	g_hash_table_destroy(table);
+	g_free(contents);
+
+	/* Messages with every PDU already sent have nothing to restore */
+	for (l = entries->head; l;) {
+		struct tx_journal_entry *entry = l->data;
+		GList *next = l->next;
+
+		if (entry->pdus == NULL) {
+			g_queue_delete_link(entries, l);
+			tx_journal_entry_free(entry);
+		}
+
+		l = next;
+	}
+
+	return entries;
+}
+
+/*
+ * Rewrites the journal with just the PDUs of the given messages, the new
+ * journal atomically replaces the old one.  Also rebuilds the count of
+ * PDUs pending per message.
+ */
+static gboolean tx_journal_write(struct sms_tx_journal *journal,
+					GQueue *entries)
+{
+	unsigned char buf[TX_JOURNAL_RECORD_MAX];
+	GByteArray *contents;
+	gboolean ret = TRUE;
+	GList *l;
+	GSList *p;
+
+	contents = g_byte_array_new();
+
+	g_hash_table_remove_all(journal->pending);
+	journal->live_records = 0;
+
+	for (l = entries->head; l; l = l->next) {
+		struct tx_journal_entry *entry = l->data;
+		guint count = 0;
+
+		for (p = entry->pdus; p; p = p->next, count++) {
+			struct tx_journal_pdu *pdu = p->data;
+			int len;
+
+			len = tx_journal_encode_store(buf, entry->id,
+							entry->flags,
+							entry->uuid, pdu->seq,
+							pdu->buf, pdu->len);
+			g_byte_array_append(contents, buf, len);
+		}
 
-		return FALSE;
+		g_hash_table_insert(journal->pending,
+					GUINT_TO_POINTER(entry->id),
+					GUINT_TO_POINTER(count));
+		journal->live_records += count;
 	}
 
-	if (out_delivered)
-		*out_delivered = node->deliverable;
+	journal_close(&journal->fd);
 
-	if (out_msgid)
-		memcpy(out_msgid, msgid, SMS_MSGID_LEN);
+	if (write_file(contents->data, contents->len, SMS_BACKUP_MODE,
+				SMS_TX_BACKUP_JOURNAL, journal->imsi) !=
+			(ssize_t) contents->len)
+		ret = FALSE;
 
-	sr_assembly_remove_fragment_backup(assembly->imsi, &addr, msgid);
-	id_table = g_hash_table_iter_get_hash_table(&iter);
-	g_hash_table_iter_remove(&iter);
+	journal->records = journal->live_records;
 
-	if (g_hash_table_size(id_table) == 0)
-		g_hash_table_remove(assembly->assembly_table, straddr);
+	g_byte_array_free(contents, TRUE);
 
-	return TRUE;
+	return ret;
 }
 
-void status_report_assembly_add_fragment(
-					struct status_report_assembly *assembly,
-					const unsigned char *msgid,
-					const struct sms_address *to,
-					unsigned char mr, time_t expiration,
-					unsigned char total_mrs)
+static void tx_journal_compact(struct sms_tx_journal *journal)
 {
-	unsigned int offset = mr / 32;
-	unsigned int bit = 1 << (mr % 32);
-	GHashTable *id_table;
-	struct id_table_node *node;
-	unsigned char *id_table_key;
-
-	id_table = g_hash_table_lookup(assembly->assembly_table,
-					sms_address_to_string(to));
-
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
-								g_free, g_free);
-		g_hash_table_insert(assembly->assembly_table,
-					g_strdup(sms_address_to_string(to)),
-					id_table);
-	}
+	GQueue *entries;
 
-	node = g_hash_table_lookup(id_table, msgid);
+	entries = tx_journal_replay(journal->imsi);
+	tx_journal_write(journal, entries);
 
-	/* Create node in the message id hashtable if required */
-	if (node == NULL) {
-		id_table_key = g_memdup(msgid, SMS_MSGID_LEN);
+	g_queue_foreach(entries, (GFunc) tx_journal_entry_free, NULL);
+	g_queue_free(entries);
+}
 
-		node = g_new0(struct id_table_node, 1);
-		node->total_mrs = total_mrs;
-		node->deliverable = TRUE;
+static void tx_journal_append(struct sms_tx_journal *journal,
+				const unsigned char *buf, int len)
+{
+	if (journal_append(&journal->fd, SMS_TX_BACKUP_JOURNAL,
+				journal->imsi, buf, len))
+		journal->records += 1;
 
-		g_hash_table_insert(id_table, id_table_key, node);
-	}
+	if (journal->records < SMS_JOURNAL_SLACK + journal->live_records * 2)
+		return;
 
-	/* id_table and node both exists */
-	node->mrs[offset] |= bit;
-	node->expiration = expiration;
-	node->sent_mrs++;
-	sr_assembly_add_fragment_backup(assembly->imsi, node, to, msgid);
+	tx_journal_compact(journal);
 }
 
-void status_report_assembly_expire(struct status_report_assembly *assembly,
-					time_t before)
+struct sms_tx_journal *sms_tx_journal_new(const char *imsi)
 {
-	GHashTable *id_table;
-	GHashTableIter iter_addr, iter_node;
-	struct sms_address addr;
-	char *straddr;
-	gpointer key;
-	struct id_table_node *node;
+	struct sms_tx_journal *journal;
 
-	g_hash_table_iter_init(&iter_addr, assembly->assembly_table);
-
-	/*
-	 * Go through different addresses. Each address can relate to
-	 * 1-n msg_ids.
-	 */
-	while (g_hash_table_iter_next(&iter_addr, (gpointer) &straddr,
-					(gpointer) &id_table)) {
+	if (imsi == NULL)
+		return NULL;
 
-		sms_address_from_string(&addr, straddr);
-		g_hash_table_iter_init(&iter_node, id_table);
+	journal = g_new0(struct sms_tx_journal, 1);
+	journal->imsi = imsi;
+	journal->fd = -1;
+	journal->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-		/* Go through different messages. */
-		while (g_hash_table_iter_next(&iter_node, &key,
-						(gpointer) &node)) {
-			/*
-			 * If message is expired, removed it from the
-			 * hash-table and remove the backup-file
-			 */
-			if (node->expiration <= before) {
-				g_hash_table_iter_remove(&iter_node);
+	return journal;
+}
 
-				sr_assembly_remove_fragment_backup(
-								assembly->imsi,
-								&addr,
-								key);
-			}
-		}
+void sms_tx_journal_free(struct sms_tx_journal *journal)
+{
+	if (journal == NULL)
+		return;
 
-		/*
-		 * If all messages are removed, remove address
-		 * from the hash-table.
-		 */
-		if (g_hash_table_size(id_table) == 0)
-			g_hash_table_iter_remove(&iter_addr);
-	}
+	journal_close(&journal->fd);
+	g_hash_table_destroy(journal->pending);
+	g_free(journal);
 }
 
 static int sms_tx_load_filter(const struct dirent *dent)
@@ -3188,7 +4297,7 @@ static int sms_tx_load_filter(const struct dirent *dent)
 }
 
 /*
- * Each directory contains a file per pdu.
+ * Older versions stored a directory per message with a file per pdu.
  */
 static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
 {
@@ -3196,37 +4305,39 @@ static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
 	struct dirent **pdus;
 	char *path;
 	int len, r;
-	unsigned char buf[177];
-	struct sms s;
+	struct tx_journal_pdu *pdu;
 
 	if (dir->d_type != DT_DIR)
 		return NULL;
 
 	path = g_strdup_printf(SMS_TX_BACKUP_PATH "/%s", imsi, dir->d_name);
 	len = scandir(path, &pdus, sms_tx_load_filter, versionsort);
-	g_free(path);
 
 	if (len < 0)
-		return NULL;
+		goto out;
 
 	while (len--) {
-		r = read_file(buf, sizeof(buf), SMS_TX_BACKUP_PATH "/%s/%s",
-					imsi, dir->d_name, pdus[len]->d_name);
-
-		if (r < 0)
-			goto free_pdu;
+		pdu = g_new0(struct tx_journal_pdu, 1);
+		pdu->seq = strtol(pdus[len]->d_name, NULL, 10);
 
-		if (sms_deserialize_outgoing(buf, &s, r) == FALSE)
-			goto free_pdu;
+		r = read_file(pdu->buf, sizeof(pdu->buf), SMS_TX_BACKUP_PATH
+					"/%s/%s", imsi, dir->d_name,
+					pdus[len]->d_name);
 
-		list = g_slist_prepend(list, g_memdup(&s, sizeof(s)));
+		if (r > 0) {
+			pdu->len = r;
+			list = g_slist_prepend(list, pdu);
+		} else
+			g_free(pdu);
 
-free_pdu:
 		g_free(pdus[len]);
 	}
 
 	g_free(pdus);
 
+out:
+	g_free(path);
+
 	return list;
 }
 
@@ -3241,157 +4352,258 @@ static int sms_tx_queue_filter(const struct dirent *dirent)
 	return 1;
 }
 
-/*
- * populate the queue with tx_backup_entry from stored backup
- * data.
- */
-GQueue *sms_tx_queue_load(const char *imsi)
+static void sms_tx_queue_load_legacy(const char *imsi, GQueue *entries)
 {
-	GQueue *retq = 0;
 	char *path;
-	struct dirent **entries;
+	struct dirent **dirs;
 	int len;
 	int i;
-	unsigned long id;
-
-	if (imsi == NULL)
-		return NULL;
 
 	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
 
-	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
+	len = scandir(path, &dirs, sms_tx_queue_filter, versionsort);
 	if (len < 0)
 		goto nodir_exit;
 
-	retq = g_queue_new();
-
-	for (i = 0, id = 0; i < len; i++) {
+	for (i = 0; i < len; i++) {
 		char uuid[SMS_MSGID_LEN * 2 + 1];
-		GSList *msg_list;
+		struct tx_journal_entry *entry;
+		struct dirent *dir = dirs[i];
 		unsigned long oldid;
 		unsigned long flags;
-		char *oldpath, *newpath;
-		struct txq_backup_entry *entry;
-		struct dirent *dir = entries[i];
+		GSList *pdus;
 		char endc;
 
 		if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
 					&oldid, &flags, uuid, &endc) != 3)
-			continue;
+			goto next;
 
 		if (strlen(uuid) !=  2 * SMS_MSGID_LEN)
-			continue;
+			goto next;
 
-		msg_list = sms_tx_load(imsi, dir);
-		if (msg_list == NULL)
-			continue;
+		pdus = sms_tx_load(imsi, dir);
+		if (pdus == NULL)
+			goto next;
 
-		entry = g_new0(struct txq_backup_entry, 1);
-		entry->msg_list = msg_list;
+		entry = g_new0(struct tx_journal_entry, 1);
+		entry->pdus = pdus;
 		entry->flags = flags;
 		decode_hex_own_buf(uuid, -1, NULL, 0, entry->uuid);
 
-		g_queue_push_tail(retq, entry);
+		g_queue_push_tail(entries, entry);
 
-		/* Don't bother re-shuffling the ids if they are the same */
-		if (oldid == id) {
-			id++;
-			continue;
-		}
+next:
+		g_free(dirs[i]);
+	}
 
-		oldpath = g_strdup_printf("%s/%s", path, dir->d_name);
-		newpath = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-						imsi, id++, flags, uuid);
+	g_free(dirs);
 
-		/* rename directory to reflect new position in queue */
-		rename(oldpath, newpath);
+nodir_exit:
+	g_free(path);
+}
 
-		g_free(newpath);
-		g_free(oldpath);
-	}
+static void sms_tx_queue_remove_legacy(const char *imsi)
+{
+	char *path;
+	struct dirent **dirs;
+	int len;
 
-	for (i = 0; i < len; i++)
-		g_free(entries[i]);
+	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
+
+	len = scandir(path, &dirs, sms_tx_queue_filter, NULL);
+	if (len < 0)
+		goto nodir_exit;
+
+	while (len--) {
+		char *dirpath = g_strdup_printf("%s/%s", path,
+							dirs[len]->d_name);
+		struct dirent **files;
+		int n;
+
+		n = scandir(dirpath, &files, sms_tx_load_filter, NULL);
 
-	g_free(entries);
+		if (n >= 0) {
+			while (n--) {
+				char *file = g_strdup_printf("%s/%s", dirpath,
+							files[n]->d_name);
+
+				unlink(file);
+				g_free(file);
+				g_free(files[n]);
+			}
+
+			g_free(files);
+		}
+
+		rmdir(dirpath);
+		g_free(dirpath);
+		g_free(dirs[len]);
+	}
+
+	g_free(dirs);
 
 nodir_exit:
 	g_free(path);
+}
+
+/*
+ * populate the queue with tx_backup_entry from stored backup
+ * data.  Messages are renumbered to match their new position in the
+ * queue and the journal is rewritten to only contain them.
+ */
+GQueue *sms_tx_queue_load(struct sms_tx_journal *journal)
+{
+	GQueue *retq;
+	GQueue *entries;
+	GQueue legacy;
+	struct tx_journal_entry *entry;
+	unsigned long id = 0;
+	GList *l;
+
+	if (journal == NULL)
+		return NULL;
+
+	entries = tx_journal_replay(journal->imsi);
+
+	/*
+	 * Backups from before the journal are migrated when writing the
+	 * journal, they always predate anything stored in the journal
+	 */
+	g_queue_init(&legacy);
+	sms_tx_queue_load_legacy(journal->imsi, &legacy);
+
+	while ((entry = g_queue_pop_tail(&legacy)))
+		g_queue_push_head(entries, entry);
+
+	for (l = entries->head; l; l = l->next) {
+		entry = l->data;
+		entry->id = id++;
+	}
+
+	if (tx_journal_write(journal, entries))
+		sms_tx_queue_remove_legacy(journal->imsi);
+
+	retq = g_queue_new();
+
+	while ((entry = g_queue_pop_head(entries))) {
+		struct txq_backup_entry *backup;
+		GSList *msg_list = NULL;
+		GSList *p;
+
+		for (p = entry->pdus; p; p = p->next) {
+			struct tx_journal_pdu *pdu = p->data;
+			struct sms s;
+
+			if (sms_deserialize_outgoing(pdu->buf, &s,
+							pdu->len) == FALSE)
+				continue;
+
+			msg_list = g_slist_prepend(msg_list,
+						g_memdup(&s, sizeof(s)));
+		}
+
+		if (msg_list != NULL) {
+			backup = g_new0(struct txq_backup_entry, 1);
+			backup->msg_list = g_slist_reverse(msg_list);
+			backup->flags = entry->flags;
+			memcpy(backup->uuid, entry->uuid, SMS_MSGID_LEN);
+
+			g_queue_push_tail(retq, backup);
+		}
+
+		tx_journal_entry_free(entry);
+	}
+
+	g_queue_free(entries);
+
 	return retq;
 }
 
-gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid,
-				guint8 seq, const unsigned char *pdu,
-				int pdu_len, int tpdu_len)
+gboolean sms_tx_backup_store(struct sms_tx_journal *journal,
+				unsigned long id, unsigned long flags,
+				const unsigned char *uuid, guint8 seq,
+				const unsigned char *pdu, int pdu_len,
+				int tpdu_len)
 {
-	unsigned char buf[177];
+	unsigned char buf[TX_JOURNAL_RECORD_MAX];
+	unsigned char serialized[177];
+	gpointer count;
 	int len;
 
-	if (!imsi)
+	if (journal == NULL)
 		return FALSE;
 
-	memcpy(buf + 1, pdu, pdu_len);
-	buf[0] = tpdu_len;
-	len = pdu_len + 1;
+	serialized[0] = tpdu_len;
+	memcpy(serialized + 1, pdu, pdu_len);
 
-	/*
-	 * file name is: imsi/tx_queue/order-flags-uuid/pdu
-	 */
-	if (write_file(buf, len, SMS_BACKUP_MODE, SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq) != len)
+	len = tx_journal_encode_store(buf, id, flags, uuid, seq,
+					serialized, pdu_len + 1);
+
+	count = g_hash_table_lookup(journal->pending, GUINT_TO_POINTER(id));
+	g_hash_table_insert(journal->pending, GUINT_TO_POINTER(id),
+				GUINT_TO_POINTER(GPOINTER_TO_UINT(count) + 1));
+	journal->live_records += 1;
+
+	if (journal_append(&journal->fd, SMS_TX_BACKUP_JOURNAL,
+				journal->imsi, buf, len) == FALSE)
 		return FALSE;
 
+	journal->records += 1;
+
 	return TRUE;
 }
 
-void sms_tx_backup_free(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid)
+void sms_tx_backup_free(struct sms_tx_journal *journal, unsigned long id)
 {
-	char *path;
-	struct dirent **entries;
-	int len;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-					imsi, id, flags, uuid);
+	unsigned char buf[SMS_JOURNAL_HEADER_LEN + 4];
+	gpointer count;
 
-	len = scandir(path, &entries, NULL, versionsort);
-
-	if (len < 0)
-		goto nodir_exit;
+	if (journal == NULL)
+		return;
 
-	/* skip '..' and '.' entries */
-	while (len-- > 2) {
-		struct dirent *dir = entries[len];
-		char *file = g_strdup_printf("%s/%s", path, dir->d_name);
+	count = g_hash_table_lookup(journal->pending, GUINT_TO_POINTER(id));
+	journal->live_records -= GPOINTER_TO_UINT(count);
+	g_hash_table_remove(journal->pending, GUINT_TO_POINTER(id));
 
-		unlink(file);
-		g_free(file);
+	/* Nothing left to send, start over with an empty journal */
+	if (journal->live_records == 0 &&
+			g_hash_table_size(journal->pending) == 0) {
+		GQueue empty;
 
-		g_free(entries[len]);
+		g_queue_init(&empty);
+		tx_journal_write(journal, &empty);
+		return;
 	}
 
-	g_free(entries[1]);
-	g_free(entries[0]);
-	g_free(entries);
-
-	rmdir(path);
+	buf[0] = TX_JOURNAL_FREE;
+	buf[1] = 4;
+	tx_journal_put_u32(buf + SMS_JOURNAL_HEADER_LEN, id);
 
-nodir_exit:
-	g_free(path);
+	tx_journal_append(journal, buf, sizeof(buf));
 }
 
-void sms_tx_backup_remove(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid,
+void sms_tx_backup_remove(struct sms_tx_journal *journal, unsigned long id,
 				guint8 seq)
 {
-	char *path;
+	unsigned char buf[SMS_JOURNAL_HEADER_LEN + 5];
+	gpointer count;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq);
-	unlink(path);
+	if (journal == NULL)
+		return;
 
-	g_free(path);
+	count = g_hash_table_lookup(journal->pending, GUINT_TO_POINTER(id));
+	if (count != NULL) {
+		g_hash_table_insert(journal->pending, GUINT_TO_POINTER(id),
+				GUINT_TO_POINTER(GPOINTER_TO_UINT(count) - 1));
+		journal->live_records -= 1;
+	}
+
+	buf[0] = TX_JOURNAL_REMOVE;
+	buf[1] = 5;
+	tx_journal_put_u32(buf + SMS_JOURNAL_HEADER_LEN, id);
+	buf[SMS_JOURNAL_HEADER_LEN + 4] = seq;
+
+	tx_journal_append(journal, buf, sizeof(buf));
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
@@ -4189,6 +5401,53 @@ char *cbs_decode_text(GSList *cbs_list, char *iso639_lang)
 	return utf8;
 }
 
+/*
+ * CBS pages carry no user data length, 8-bit pages always hold 82 octets
+ * including the UDH.  The pages are copied straight into a buffer sized
+ * up front, in page order as kept by the assembly.
+ */
+unsigned char *cbs_decode_datagram(GSList *cbs_list, long *out_len)
+{
+	GSList *l;
+	unsigned char *buf;
+	long len = 0;
+	guint8 taken[15];
+	int i;
+
+	for (l = cbs_list, i = 0; l && i < 15; l = l->next, i++) {
+		const struct cbs *cbs = l->data;
+		struct sms_udh_iter iter;
+
+		taken[i] = 0;
+
+		if (sms_udh_iter_init_from_cbs(cbs, &iter))
+			taken[i] = sms_udh_iter_get_udh_length(&iter) + 1;
+
+		len += 82 - taken[i];
+	}
+
+	if (l != NULL || len == 0)
+		return NULL;
+
+	buf = g_try_new(unsigned char, len);
+	if (buf == NULL)
+		return NULL;
+
+	len = 0;
+
+	for (l = cbs_list, i = 0; l; l = l->next, i++) {
+		const struct cbs *cbs = l->data;
+
+		memcpy(buf + len, cbs->ud + taken[i], 82 - taken[i]);
+		len += 82 - taken[i];
+	}
+
+	if (out_len)
+		*out_len = len;
+
+	return buf;
+}
+
 static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 {
 	unsigned int old_update = o & 0xf;
@@ -4209,105 +5468,97 @@ static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 	return FALSE;
 }
 
-struct cbs_assembly *cbs_assembly_new(void)
+static void cbs_assembly_node_free(gpointer data)
 {
-	return g_new0(struct cbs_assembly, 1);
+	struct cbs_assembly_node *node = data;
+
+	g_slist_foreach(node->pages, (GFunc) g_free, NULL);
+	g_slist_free(node->pages);
+	g_free(node);
 }
 
-void cbs_assembly_free(struct cbs_assembly *assembly)
+struct cbs_assembly *cbs_assembly_new(void)
 {
-	GSList *l;
+	struct cbs_assembly *assembly = g_new0(struct cbs_assembly, 1);
+	int i;
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct cbs_assembly_node *node = l->data;
+	/* Nodes are keyed on their own serial */
+	assembly->assembly_table = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						cbs_assembly_node_free);
 
-		g_slist_foreach(node->pages, (GFunc) g_free, 0);
-		g_slist_free(node->pages);
-		g_free(node);
-	}
+	for (i = 0; i < 4; i++)
+		g_queue_init(&assembly->scope_queue[i]);
 
-	g_slist_free(assembly->assembly_list);
-	g_slist_free(assembly->recv_plmn);
-	g_slist_free(assembly->recv_loc);
-	g_slist_free(assembly->recv_cell);
+	/*
+	 * The received tables map the serial without its update number to
+	 * the last update received
+	 */
+	assembly->recv_plmn = g_hash_table_new(g_direct_hash, g_direct_equal);
+	assembly->recv_loc = g_hash_table_new(g_direct_hash, g_direct_equal);
+	assembly->recv_cell = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-	g_free(assembly);
+	return assembly;
 }
 
-static gint cbs_compare_node_by_gs(gconstpointer a, gconstpointer b)
+void cbs_assembly_free(struct cbs_assembly *assembly)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int gs = GPOINTER_TO_UINT(b);
-
-	if (((node->serial >> 14) & 0x3) == gs)
-		return 0;
+	/* The scope queue links are embedded in the nodes */
+	g_hash_table_destroy(assembly->assembly_table);
+	g_hash_table_destroy(assembly->recv_plmn);
+	g_hash_table_destroy(assembly->recv_loc);
+	g_hash_table_destroy(assembly->recv_cell);
 
-	return 1;
+	g_free(assembly);
 }
 
-static gint cbs_compare_node_by_update(gconstpointer a, gconstpointer b)
+static void cbs_assembly_remove_node(struct cbs_assembly *assembly,
+					struct cbs_assembly_node *node,
+					gboolean free_pages)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int serial = GPOINTER_TO_UINT(b);
+	unsigned int gs = (node->serial >> 14) & 0x3;
 
-	if ((serial & (~0xf)) != (node->serial & (~0xf)))
-		return 1;
+	g_queue_unlink(&assembly->scope_queue[gs], &node->scope_link);
 
-	if (cbs_is_update_newer(node->serial, serial))
-		return 1;
+	if (free_pages == FALSE)
+		node->pages = NULL;
 
-	return 0;
+	g_hash_table_remove(assembly->assembly_table,
+				GUINT_TO_POINTER(node->serial));
 }
 
-static gint cbs_compare_recv_by_serial(gconstpointer a, gconstpointer b)
+/*
+ * Take care of the case where several updates are being reassembled at
+ * the same time.  If the newer one is assembled first, then the
+ * subsequent old update is discarded, make sure that we're also
+ * discarding the assembly nodes for the partially assembled ones.
+ */
+static void cbs_assembly_expire_updates(struct cbs_assembly *assembly,
+					unsigned int serial)
 {
-	unsigned int old_serial = GPOINTER_TO_UINT(a);
-	unsigned int new_serial = GPOINTER_TO_UINT(b);
+	unsigned int update;
 
-	if ((old_serial & (~0xf)) == (new_serial & (~0xf)))
-		return 0;
+	for (update = 0; update < 16; update++) {
+		unsigned int old = (serial & ~0xf) | update;
+		struct cbs_assembly_node *node;
 
-	return 1;
+		if (cbs_is_update_newer(old, serial))
+			continue;
+
+		node = g_hash_table_lookup(assembly->assembly_table,
+						GUINT_TO_POINTER(old));
+		if (node != NULL)
+			cbs_assembly_remove_node(assembly, node, TRUE);
+	}
 }
 
-static void cbs_assembly_expire(struct cbs_assembly *assembly,
-				GCompareFunc func, gconstpointer *userdata)
+static void cbs_assembly_expire_scope(struct cbs_assembly *assembly,
+					enum cbs_geo_scope gs)
 {
-	GSList *l;
-	GSList *prev;
-	GSList *tmp;
-
-	/*
-	 * Take care of the case where several updates are being
-	 * reassembled at the same time. If the newer one is assembled
-	 * first, then the subsequent old update is discarded, make
-	 * sure that we're also discarding the assembly node for the
-	 * partially assembled ones
-	 */
-	prev = NULL;
-	l = assembly->assembly_list;
-
-	while (l) {
-		struct cbs_assembly_node *node = l->data;
-
-		if (func(node, userdata) != 0) {
-			prev = l;
-			l = l->next;
-			continue;
-		}
+	struct cbs_assembly_node *node;
 
-		if (prev)
-			prev->next = l->next;
-		else
-			assembly->assembly_list = l->next;
-
-		g_slist_foreach(node->pages, (GFunc) g_free, NULL);
-		g_slist_free(node->pages);
-		g_free(node->pages);
-		tmp = l;
-		l = l->next;
-		g_slist_free_1(tmp);
-	}
+	while ((node = g_queue_peek_head(&assembly->scope_queue[gs])))
+		cbs_assembly_remove_node(assembly, node, TRUE);
 }
 
 void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
@@ -4330,30 +5581,27 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 
 	if (plmn) {
 		lac = TRUE;
-		g_slist_free(assembly->recv_plmn);
-		assembly->recv_plmn = NULL;
+		g_hash_table_remove_all(assembly->recv_plmn);
 
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_PLMN));
+		cbs_assembly_expire_scope(assembly, CBS_GEO_SCOPE_PLMN);
 	}
 
 	if (lac) {
 		/* If LAC changed, then cell id has changed */
 		ci = TRUE;
-		g_slist_free(assembly->recv_loc);
-		assembly->recv_loc = NULL;
+		g_hash_table_remove_all(assembly->recv_loc);
 
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_SERVICE_AREA));
+		cbs_assembly_expire_scope(assembly,
+						CBS_GEO_SCOPE_SERVICE_AREA);
 	}
 
 	if (ci) {
-		g_slist_free(assembly->recv_cell);
-		assembly->recv_cell = NULL;
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_IMMEDIATE));
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_NORMAL));
+		g_hash_table_remove_all(assembly->recv_cell);
+
+		cbs_assembly_expire_scope(assembly,
+						CBS_GEO_SCOPE_CELL_IMMEDIATE);
+		cbs_assembly_expire_scope(assembly,
+						CBS_GEO_SCOPE_CELL_NORMAL);
 	}
 }
 
@@ -4364,10 +5612,10 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	struct cbs_assembly_node *node;
 	GSList *completed;
 	unsigned int new_serial;
-	GSList **recv;
-	GSList *l;
-	GSList *prev;
+	gpointer old_serial;
+	GHashTable *recv;
 	int position;
+	int j;
 
 	new_serial = cbs->gs << 14;
 	new_serial |= cbs->message_code << 4;
@@ -4375,27 +5623,24 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	new_serial |= cbs->message_identifier << 16;
 
 	if (cbs->gs == CBS_GEO_SCOPE_PLMN)
-		recv = &assembly->recv_plmn;
+		recv = assembly->recv_plmn;
 	else if (cbs->gs == CBS_GEO_SCOPE_SERVICE_AREA)
-		recv = &assembly->recv_loc;
+		recv = assembly->recv_loc;
 	else
-		recv = &assembly->recv_cell;
-
-	/* Have we seen this message before? */
-	l = g_slist_find_custom(*recv, GUINT_TO_POINTER(new_serial),
-				cbs_compare_recv_by_serial);
-
-	/* If we have, is the message newer? */
-	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data)))
+		recv = assembly->recv_cell;
+
+	/* Have we seen this message before?  If we have, is it newer? */
+	if (g_hash_table_lookup_extended(recv,
+					GUINT_TO_POINTER(new_serial & ~0xf),
+					NULL, &old_serial) &&
+			!cbs_is_update_newer(new_serial,
+						GPOINTER_TO_UINT(old_serial)))
 		return NULL;
 
 	/* Easy case first, page 1 of 1 */
 	if (cbs->max_pages == 1 && cbs->page == 1) {
-		if (l)
-			l->data = GUINT_TO_POINTER(new_serial);
-		else
-			*recv = g_slist_prepend(*recv,
-						GUINT_TO_POINTER(new_serial));
+		g_hash_table_insert(recv, GUINT_TO_POINTER(new_serial & ~0xf),
+					GUINT_TO_POINTER(new_serial));
 
 		newcbs = g_new(struct cbs, 1);
 		memcpy(newcbs, cbs, sizeof(struct cbs));
@@ -4404,37 +5649,28 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 		return completed;
 	}
 
-	prev = NULL;
-	position = 0;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		int j;
-		node = l->data;
-
-		if (new_serial != node->serial)
-			continue;
-
-		if (node->bitmap & (1 << cbs->page))
-			return NULL;
+	node = g_hash_table_lookup(assembly->assembly_table,
+					GUINT_TO_POINTER(new_serial));
 
-		for (j = 1; j < cbs->page; j++)
-			if (node->bitmap & (1 << j))
-				position += 1;
+	if (node == NULL) {
+		node = g_new0(struct cbs_assembly_node, 1);
+		node->serial = new_serial;
+		node->scope_link.data = node;
 
-		goto out;
+		g_hash_table_insert(assembly->assembly_table,
+					GUINT_TO_POINTER(new_serial), node);
+		g_queue_push_tail_link(&assembly->scope_queue[cbs->gs],
+					&node->scope_link);
 	}
 
-	node = g_new0(struct cbs_assembly_node, 1);
-	node->serial = new_serial;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+	/* Repeated pages are dropped here, without touching the list */
+	if (node->bitmap & (1 << cbs->page))
+		return NULL;
 
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
+	for (j = 1, position = 0; j < cbs->page; j++)
+		if (node->bitmap & (1 << j))
+			position += 1;
 
-out:
 	newcbs = g_new(struct cbs, 1);
 	memcpy(newcbs, cbs, sizeof(struct cbs));
 	node->pages = g_slist_insert(node->pages, newcbs, position);
@@ -4444,18 +5680,11 @@ out:
 		return NULL;
 
 	completed = node->pages;
+	cbs_assembly_remove_node(assembly, node, FALSE);
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
-
-	g_free(node);
-	g_slist_free_1(l);
-
-	cbs_assembly_expire(assembly, cbs_compare_node_by_update,
+	cbs_assembly_expire_updates(assembly, new_serial);
+	g_hash_table_insert(recv, GUINT_TO_POINTER(new_serial & ~0xf),
 				GUINT_TO_POINTER(new_serial));
-	*recv = g_slist_prepend(*recv, GUINT_TO_POINTER(new_serial));
 
 	return completed;
 }
@@ -4692,6 +5921,28 @@ static gint cbs_topic_compare(gconstpointer a, gconstpointer b)
 	return 1;
 }
 
+void cbs_topic_bitmap_set_ranges(guint32 *bitmap, GSList *ranges)
+{
+	GSList *l;
+
+	memset(bitmap, 0, CBS_TOPIC_BITMAP_WORDS * sizeof(guint32));
+
+	for (l = ranges; l; l = l->next) {
+		const struct cbs_topic_range *range = l->data;
+		unsigned int topic = range->min;
+
+		/* Fill the partial words at the edges bit by bit */
+		for (; topic <= range->max && topic % 32; topic++)
+			bitmap[topic / 32] |= 1U << (topic % 32);
+
+		for (; topic + 31 <= range->max; topic += 32)
+			bitmap[topic / 32] = 0xffffffff;
+
+		for (; topic <= range->max; topic++)
+			bitmap[topic / 32] |= 1U << (topic % 32);
+	}
+}
+
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges)
 {
 	if (ranges == NULL)
@@ -21,6 +21,7 @@
 
 #define CBS_MAX_GSM_CHARS 93
 #define SMS_MSGID_LEN 20
+#define SMS_ASSEMBLY_DEFAULT_MAX_FRAGMENTS 1024
 
 enum sms_type {
 	SMS_TYPE_DELIVER = 0,
@@ -362,6 +363,26 @@ struct sms_udh_iter {
 	guint8 offset;
 };
 
+/*
+ * Lightweight view of an incoming SMS-DELIVER PDU.  The PDU is validated
+ * in one pass and only the offsets of the variable length fields are
+ * recorded, the PDU buffer must outlive the view.
+ */
+struct sms_view {
+	const unsigned char *pdu;
+	int len;
+	int tpdu_len;
+	const unsigned char *tpdu;
+	guint8 first_octet;
+	guint8 oaddr_offset;
+	guint8 pid;
+	guint8 dcs;
+	guint8 scts_offset;
+	guint8 udl;
+	guint8 ud_offset;
+	guint8 ud_len;
+};
+
 struct sms_assembly_node {
 	struct sms_address addr;
 	time_t ts;
@@ -370,11 +391,19 @@ struct sms_assembly_node {
 	guint8 max_fragments;
 	guint8 num_fragments;
 	unsigned int bitmap[8];
+	GList expire_link;
+	GList lru_link;
 };
 
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	GHashTable *assembly_table;
+	GQueue expire_queue;
+	GQueue lru_queue;
+	unsigned int num_fragments;
+	unsigned int max_fragments;
+	unsigned int journal_records;
+	int journal_fd;
 };
 
 struct id_table_node {
@@ -388,6 +417,10 @@ struct id_table_node {
 struct status_report_assembly {
 	const char *imsi;
 	GHashTable *assembly_table;
+	GQueue expire_queue;
+	unsigned int num_nodes;
+	unsigned int journal_records;
+	int journal_fd;
 };
 
 struct cbs {
@@ -405,13 +438,15 @@ struct cbs_assembly_node {
 	guint32 serial;
 	guint16 bitmap;
 	GSList *pages;
+	GList scope_link;
 };
 
 struct cbs_assembly {
-	GSList *assembly_list;
-	GSList *recv_plmn;
-	GSList *recv_loc;
-	GSList *recv_cell;
+	GHashTable *assembly_table;
+	GQueue scope_queue[4];
+	GHashTable *recv_plmn;
+	GHashTable *recv_loc;
+	GHashTable *recv_cell;
 };
 
 struct cbs_topic_range {
@@ -419,6 +454,17 @@ struct cbs_topic_range {
 	unsigned short max;
 };
 
+/* One bit for each of the 65536 CBS message identifiers */
+#define CBS_TOPIC_BITMAP_WORDS (65536 / 32)
+
+struct sms_tx_journal {
+	const char *imsi;
+	int fd;
+	unsigned int records;
+	unsigned int live_records;
+	GHashTable *pending;
+};
+
 struct txq_backup_entry {
 	GSList *msg_list;
 	unsigned char uuid[SMS_MSGID_LEN];
@@ -450,6 +496,10 @@ gboolean sms_decode_unpacked_stk_pdu(const unsigned char *pdu, int len,
 gboolean sms_encode(const struct sms *in, int *len, int *tpdu_len,
 			unsigned char *pdu);
 
+gboolean sms_view_init(struct sms_view *view, const unsigned char *pdu,
+			int len, int tpdu_len);
+gboolean sms_view_to_sms(const struct sms_view *view, struct sms *out);
+
 /*
  * Length is based on the address being 12 hex characters plus a
  * terminating NUL char. See sms_assembly_extract_address().
@@ -485,6 +535,8 @@ const guint8 *sms_extract_common(const struct sms *sms, gboolean *out_udhi,
 gboolean sms_udh_iter_init(const struct sms *sms, struct sms_udh_iter *iter);
 gboolean sms_udh_iter_init_from_cbs(const struct cbs *cbs,
 					struct sms_udh_iter *iter);
+gboolean sms_udh_iter_init_from_view(const struct sms_view *view,
+					struct sms_udh_iter *iter);
 guint8 sms_udh_iter_get_udh_length(struct sms_udh_iter *iter);
 const guint8 *sms_udh_iter_get_ud_after_header(struct sms_udh_iter *iter);
 enum sms_iei sms_udh_iter_get_ie_type(struct sms_udh_iter *iter);
@@ -518,6 +570,8 @@ GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms_address *addr,
 					guint16 ref, guint8 max, guint8 seq);
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before);
+void sms_assembly_set_max_fragments(struct sms_assembly *assembly,
+					unsigned int max);
 gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr);
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi);
@@ -534,16 +588,17 @@ void status_report_assembly_add_fragment(struct status_report_assembly
 void status_report_assembly_expire(struct status_report_assembly *assembly,
 					time_t before);
 
-gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid,
-				guint8 seq, const unsigned char *pdu,
-				int pdu_len, int tpdu_len);
-void sms_tx_backup_remove(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid,
+struct sms_tx_journal *sms_tx_journal_new(const char *imsi);
+void sms_tx_journal_free(struct sms_tx_journal *journal);
+gboolean sms_tx_backup_store(struct sms_tx_journal *journal,
+				unsigned long id, unsigned long flags,
+				const unsigned char *uuid, guint8 seq,
+				const unsigned char *pdu, int pdu_len,
+				int tpdu_len);
+void sms_tx_backup_remove(struct sms_tx_journal *journal, unsigned long id,
 				guint8 seq);
-void sms_tx_backup_free(const char *imsi, unsigned long id,
-				unsigned long flags, const char *uuid);
-GQueue *sms_tx_queue_load(const char *imsi);
+void sms_tx_backup_free(struct sms_tx_journal *journal, unsigned long id);
+GQueue *sms_tx_queue_load(struct sms_tx_journal *journal);
 
 GSList *sms_text_prepare(const char *to, const char *utf8, guint16 ref,
 				gboolean use_16bit,
@@ -572,6 +627,7 @@ gboolean cbs_extract_app_port(const struct cbs *cbs, int *dst, int *src,
 				gboolean *is_8bit);
 
 char *cbs_decode_text(GSList *cbs_list, char *iso639_lang);
+unsigned char *cbs_decode_datagram(GSList *cbs_list, long *out_len);
 
 struct cbs_assembly *cbs_assembly_new(void);
 void cbs_assembly_free(struct cbs_assembly *assembly);
@@ -584,6 +640,13 @@ char *cbs_topic_ranges_to_string(GSList *ranges);
 GSList *cbs_extract_topic_ranges(const char *ranges);
 GSList *cbs_optimize_ranges(GSList *ranges);
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges);
+void cbs_topic_bitmap_set_ranges(guint32 *bitmap, GSList *ranges);
+
+static inline gboolean cbs_topic_bitmap_test(const guint32 *bitmap,
+						unsigned int topic)
+{
+	return (bitmap[topic / 32] >> (topic % 32)) & 1;
+}
 
 char *ussd_decode(int dcs, int len, const unsigned char *data);
 gboolean ussd_encode(const char *str, long *items_written, unsigned char *pdu);
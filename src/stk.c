@@ -50,13 +50,31 @@ struct stk_timer {
 	time_t start;
 };
 
+static const char *envelope_class_name[STK_ENVELOPE_CLASS_COUNT] = {
+	[STK_ENVELOPE_CLASS_USER] = "user",
+	[STK_ENVELOPE_CLASS_SMS_PP] = "sms-pp",
+	[STK_ENVELOPE_CLASS_TIMER] = "timer",
+	[STK_ENVELOPE_CLASS_CBS] = "cbs",
+};
+
+struct envelope_stats {
+	unsigned int queued;
+	unsigned int sent;
+	unsigned int failed;
+	unsigned int merged;
+	unsigned int dropped;
+	unsigned int max_depth;
+};
+
 struct ofono_stk {
 	const struct ofono_stk_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
 	struct stk_command *pending_cmd;
 	void (*cancel_cmd)(struct ofono_stk *stk);
-	GQueue *envelope_q;
+	struct stk_envelope_queue *envelope_q;
+	struct envelope_stats envelope_stats[STK_ENVELOPE_CLASS_COUNT];
+	struct envelope_op *envelope_current;
 	DBusMessage *pending;
 
 	struct stk_timer timers[8];
@@ -85,6 +103,8 @@ struct envelope_op {
 	uint8_t tlv[256];
 	unsigned int tlv_len;
 	int retries;
+	enum stk_envelope_class class;
+	int timer_id;
 	void (*cb)(struct ofono_stk *stk, gboolean ok,
 			const unsigned char *data, int length);
 };
@@ -181,11 +201,23 @@ static void send_simple_response(struct ofono_stk *stk,
 		stk_command_cb(&error, stk);
 }
 
+static void envelope_stats_dump(struct ofono_stk *stk,
+					enum stk_envelope_class class)
+{
+	struct envelope_stats *st = &stk->envelope_stats[class];
+
+	DBG("%s: queued %u sent %u failed %u merged %u dropped %u "
+		"depth %u max %u", envelope_class_name[class],
+		st->queued, st->sent, st->failed, st->merged, st->dropped,
+		stk_envelope_queue_length(stk->envelope_q, class),
+		st->max_depth);
+}
+
 static void envelope_cb(const struct ofono_error *error, const uint8_t *data,
 			int length, void *user_data)
 {
 	struct ofono_stk *stk = user_data;
-	struct envelope_op *op = g_queue_peek_head(stk->envelope_q);
+	struct envelope_op *op = stk->envelope_current;
 	gboolean result = TRUE;
 
 	DBG("length %d", length);
@@ -196,10 +228,15 @@ static void envelope_cb(const struct ofono_error *error, const uint8_t *data,
 		goto out;
 	}
 
-	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
+		stk->envelope_stats[op->class].failed += 1;
 		result = FALSE;
+	} else
+		stk->envelope_stats[op->class].sent += 1;
 
-	g_queue_pop_head(stk->envelope_q);
+	stk->envelope_current = NULL;
+
+	envelope_stats_dump(stk, op->class);
 
 	if (op->cb)
 		op->cb(stk, result, data, length);
@@ -210,16 +247,70 @@ out:
 	envelope_queue_run(stk);
 }
 
+/*
+ * Envelopes are sent to the UICC one at a time.  The current one is
+ * sent again while it is being retried, otherwise the queue hands out
+ * the next one by priority.
+ */
 static void envelope_queue_run(struct ofono_stk *stk)
 {
-	if (g_queue_get_length(stk->envelope_q) > 0) {
-		struct envelope_op *op = g_queue_peek_head(stk->envelope_q);
+	struct envelope_op *op = stk->envelope_current;
 
-		stk->driver->envelope(stk, op->tlv_len, op->tlv,
-					envelope_cb, stk);
+	if (op == NULL)
+		op = stk_envelope_queue_pop(stk->envelope_q);
+
+	if (op == NULL)
+		return;
+
+	stk->envelope_current = op;
+
+	stk->driver->envelope(stk, op->tlv_len, op->tlv, envelope_cb, stk);
+}
+
+static enum stk_envelope_class envelope_class_from_type(
+						enum stk_envelope_type t)
+{
+	switch (t) {
+	case STK_ENVELOPE_TYPE_SMS_PP_DOWNLOAD:
+		return STK_ENVELOPE_CLASS_SMS_PP;
+	case STK_ENVELOPE_TYPE_CBS_PP_DOWNLOAD:
+		return STK_ENVELOPE_CLASS_CBS;
+	case STK_ENVELOPE_TYPE_TIMER_EXPIRATION:
+		return STK_ENVELOPE_CLASS_TIMER;
+	default:
+		return STK_ENVELOPE_CLASS_USER;
 	}
 }
 
+/*
+ * Only the latest expiration of a given timer is of interest since it
+ * carries the most recent elapsed time, so a queued one is updated in
+ * place instead of sending both.
+ */
+static gint envelope_same_timer(gconstpointer a, gconstpointer b)
+{
+	const struct envelope_op *queued = a;
+	const struct envelope_op *new = b;
+
+	if (queued->cb == new->cb && queued->timer_id == new->timer_id)
+		return 0;
+
+	return 1;
+}
+
+static void envelope_dropped(void *data, void *user_data)
+{
+	struct envelope_op *op = data;
+	struct ofono_stk *stk = user_data;
+
+	stk->envelope_stats[op->class].dropped += 1;
+
+	if (op->cb)
+		op->cb(stk, FALSE, NULL, -1);
+
+	g_free(op);
+}
+
 static int stk_send_envelope(struct ofono_stk *stk, struct stk_envelope *e,
 				void (*cb)(struct ofono_stk *stk, gboolean ok,
 						const uint8_t *data,
@@ -228,6 +319,9 @@ static int stk_send_envelope(struct ofono_stk *stk, struct stk_envelope *e,
 	const uint8_t *tlv;
 	unsigned int tlv_len;
 	struct envelope_op *op;
+	struct envelope_op *queued;
+	struct envelope_stats *st;
+	unsigned int depth;
 
 	DBG("");
 
@@ -243,12 +337,38 @@ static int stk_send_envelope(struct ofono_stk *stk, struct stk_envelope *e,
 
 	op->cb = cb;
 	op->retries = retries;
+	op->class = envelope_class_from_type(e->type);
 	memcpy(op->tlv, tlv, tlv_len);
 	op->tlv_len = tlv_len;
 
-	g_queue_push_tail(stk->envelope_q, op);
+	st = &stk->envelope_stats[op->class];
+	st->queued += 1;
+
+	if (op->class == STK_ENVELOPE_CLASS_TIMER) {
+		op->timer_id = e->timer_expiration.id;
+		queued = stk_envelope_queue_find(stk->envelope_q, op->class,
+						envelope_same_timer, op);
+	} else
+		queued = NULL;
+
+	if (queued) {
+		memcpy(queued->tlv, op->tlv, op->tlv_len);
+		queued->tlv_len = op->tlv_len;
+		st->merged += 1;
+		g_free(op);
+
+		envelope_stats_dump(stk, queued->class);
+
+		return 0;
+	}
 
-	if (g_queue_get_length(stk->envelope_q) == 1)
+	stk_envelope_queue_push(stk->envelope_q, op->class, op);
+
+	depth = stk_envelope_queue_length(stk->envelope_q, op->class);
+	if (depth > st->max_depth)
+		st->max_depth = depth;
+
+	if (stk->envelope_current == NULL)
 		envelope_queue_run(stk);
 
 	return 0;
@@ -3137,6 +3257,7 @@ static void stk_unregister(struct ofono_atom *atom)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	struct ofono_modem *modem = __ofono_atom_get_modem(atom);
 	const char *path = __ofono_atom_get_path(atom);
+	int i;
 
 	if (stk->session_agent)
 		stk_agent_free(stk->session_agent);
@@ -3163,8 +3284,14 @@ static void stk_unregister(struct ofono_atom *atom)
 		stk->main_menu = NULL;
 	}
 
-	g_queue_foreach(stk->envelope_q, (GFunc) g_free, NULL);
-	g_queue_free(stk->envelope_q);
+	for (i = 0; i < STK_ENVELOPE_CLASS_COUNT; i++)
+		envelope_stats_dump(stk, i);
+
+	stk_envelope_queue_free(stk->envelope_q, g_free);
+	stk->envelope_q = NULL;
+
+	g_free(stk->envelope_current);
+	stk->envelope_current = NULL;
 
 	ofono_modem_remove_interface(modem, OFONO_STK_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_STK_INTERFACE);
@@ -3241,7 +3368,7 @@ void ofono_stk_register(struct ofono_stk *stk)
 
 	stk->timeout = 180; /* 3 minutes */
 	stk->short_timeout = 25; /* 25 seconds */
-	stk->envelope_q = g_queue_new();
+	stk->envelope_q = stk_envelope_queue_new(envelope_dropped, stk);
 }
 
 void ofono_stk_remove(struct ofono_stk *stk)
@@ -2065,192 +2065,133 @@ static gboolean parse_dataobj_broadcast_network_info(
 	return TRUE;
 }
 
+/* Indexed by comprehension tag, built at compile time */
+static const dataobj_handler dataobj_handlers[] = {
+	[STK_DATA_OBJECT_TYPE_ADDRESS] = parse_dataobj_address,
+	[STK_DATA_OBJECT_TYPE_ALPHA_ID] = parse_dataobj_alpha_id,
+	[STK_DATA_OBJECT_TYPE_SUBADDRESS] = parse_dataobj_subaddress,
+	[STK_DATA_OBJECT_TYPE_CCP] = parse_dataobj_ccp,
+	[STK_DATA_OBJECT_TYPE_CBS_PAGE] = parse_dataobj_cbs_page,
+	[STK_DATA_OBJECT_TYPE_DURATION] = parse_dataobj_duration,
+	[STK_DATA_OBJECT_TYPE_ITEM] = parse_dataobj_item,
+	[STK_DATA_OBJECT_TYPE_ITEM_ID] = parse_dataobj_item_id,
+	[STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH] = parse_dataobj_response_len,
+	[STK_DATA_OBJECT_TYPE_RESULT] = parse_dataobj_result,
+	[STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU] = parse_dataobj_gsm_sms_tpdu,
+	[STK_DATA_OBJECT_TYPE_SS_STRING] = parse_dataobj_ss,
+	[STK_DATA_OBJECT_TYPE_TEXT] = parse_dataobj_text,
+	[STK_DATA_OBJECT_TYPE_TONE] = parse_dataobj_tone,
+	[STK_DATA_OBJECT_TYPE_USSD_STRING] = parse_dataobj_ussd,
+	[STK_DATA_OBJECT_TYPE_FILE_LIST] = parse_dataobj_file_list,
+	[STK_DATA_OBJECT_TYPE_LOCATION_INFO] = parse_dataobj_location_info,
+	[STK_DATA_OBJECT_TYPE_IMEI] = parse_dataobj_imei,
+	[STK_DATA_OBJECT_TYPE_HELP_REQUEST] = parse_dataobj_help_request,
+	[STK_DATA_OBJECT_TYPE_NETWORK_MEASUREMENT_RESULTS] =
+			parse_dataobj_network_measurement_results,
+	[STK_DATA_OBJECT_TYPE_DEFAULT_TEXT] = parse_dataobj_default_text,
+	[STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR] =
+			parse_dataobj_items_next_action_indicator,
+	[STK_DATA_OBJECT_TYPE_EVENT_LIST] = parse_dataobj_event_list,
+	[STK_DATA_OBJECT_TYPE_CAUSE] = parse_dataobj_cause,
+	[STK_DATA_OBJECT_TYPE_LOCATION_STATUS] = parse_dataobj_location_status,
+	[STK_DATA_OBJECT_TYPE_TRANSACTION_ID] = parse_dataobj_transaction_id,
+	[STK_DATA_OBJECT_TYPE_BCCH_CHANNEL_LIST] =
+			parse_dataobj_bcch_channel_list,
+	[STK_DATA_OBJECT_TYPE_CALL_CONTROL_REQUESTED_ACTION] =
+			parse_dataobj_call_control_requested_action,
+	[STK_DATA_OBJECT_TYPE_ICON_ID] = parse_dataobj_icon_id,
+	[STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST] =
+			parse_dataobj_item_icon_id_list,
+	[STK_DATA_OBJECT_TYPE_CARD_READER_STATUS] =
+			parse_dataobj_card_reader_status,
+	[STK_DATA_OBJECT_TYPE_CARD_ATR] = parse_dataobj_card_atr,
+	[STK_DATA_OBJECT_TYPE_C_APDU] = parse_dataobj_c_apdu,
+	[STK_DATA_OBJECT_TYPE_R_APDU] = parse_dataobj_r_apdu,
+	[STK_DATA_OBJECT_TYPE_TIMER_ID] = parse_dataobj_timer_id,
+	[STK_DATA_OBJECT_TYPE_TIMER_VALUE] = parse_dataobj_timer_value,
+	[STK_DATA_OBJECT_TYPE_DATETIME_TIMEZONE] =
+			parse_dataobj_datetime_timezone,
+	[STK_DATA_OBJECT_TYPE_AT_COMMAND] = parse_dataobj_at_command,
+	[STK_DATA_OBJECT_TYPE_AT_RESPONSE] = parse_dataobj_at_response,
+	[STK_DATA_OBJECT_TYPE_BC_REPEAT_INDICATOR] =
+			parse_dataobj_bc_repeat_indicator,
+	[STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE] = parse_dataobj_imm_resp,
+	[STK_DATA_OBJECT_TYPE_DTMF_STRING] = parse_dataobj_dtmf_string,
+	[STK_DATA_OBJECT_TYPE_LANGUAGE] = parse_dataobj_language,
+	[STK_DATA_OBJECT_TYPE_BROWSER_ID] = parse_dataobj_browser_id,
+	[STK_DATA_OBJECT_TYPE_TIMING_ADVANCE] = parse_dataobj_timing_advance,
+	[STK_DATA_OBJECT_TYPE_URL] = parse_dataobj_url,
+	[STK_DATA_OBJECT_TYPE_BEARER] = parse_dataobj_bearer,
+	[STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF] =
+			parse_dataobj_provisioning_file_reference,
+	[STK_DATA_OBJECT_TYPE_BROWSER_TERMINATION_CAUSE] =
+			parse_dataobj_browser_termination_cause,
+	[STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION] =
+			parse_dataobj_bearer_description,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_DATA] = parse_dataobj_channel_data,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH] =
+			parse_dataobj_channel_data_length,
+	[STK_DATA_OBJECT_TYPE_BUFFER_SIZE] = parse_dataobj_buffer_size,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_STATUS] = parse_dataobj_channel_status,
+	[STK_DATA_OBJECT_TYPE_CARD_READER_ID] = parse_dataobj_card_reader_id,
+	[STK_DATA_OBJECT_TYPE_OTHER_ADDRESS] = parse_dataobj_other_address,
+	[STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE] =
+			parse_dataobj_uicc_te_interface,
+	[STK_DATA_OBJECT_TYPE_AID] = parse_dataobj_aid,
+	[STK_DATA_OBJECT_TYPE_ACCESS_TECHNOLOGY] =
+			parse_dataobj_access_technology,
+	[STK_DATA_OBJECT_TYPE_DISPLAY_PARAMETERS] =
+			parse_dataobj_display_parameters,
+	[STK_DATA_OBJECT_TYPE_SERVICE_RECORD] = parse_dataobj_service_record,
+	[STK_DATA_OBJECT_TYPE_DEVICE_FILTER] = parse_dataobj_device_filter,
+	[STK_DATA_OBJECT_TYPE_SERVICE_SEARCH] = parse_dataobj_service_search,
+	[STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO] = parse_dataobj_attribute_info,
+	[STK_DATA_OBJECT_TYPE_SERVICE_AVAILABILITY] =
+			parse_dataobj_service_availability,
+	[STK_DATA_OBJECT_TYPE_REMOTE_ENTITY_ADDRESS] =
+			parse_dataobj_remote_entity_address,
+	[STK_DATA_OBJECT_TYPE_ESN] = parse_dataobj_esn,
+	[STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME] =
+			parse_dataobj_network_access_name,
+	[STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU] = parse_dataobj_cdma_sms_tpdu,
+	[STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE] = parse_dataobj_text_attr,
+	[STK_DATA_OBJECT_TYPE_PDP_ACTIVATION_PARAMETER] =
+			parse_dataobj_pdp_act_par,
+	[STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST] =
+			parse_dataobj_item_text_attribute_list,
+	[STK_DATA_OBJECT_TYPE_UTRAN_MEASUREMENT_QUALIFIER] =
+			parse_dataobj_utran_meas_qualifier,
+	[STK_DATA_OBJECT_TYPE_IMEISV] = parse_dataobj_imeisv,
+	[STK_DATA_OBJECT_TYPE_NETWORK_SEARCH_MODE] =
+			parse_dataobj_network_search_mode,
+	[STK_DATA_OBJECT_TYPE_BATTERY_STATE] = parse_dataobj_battery_state,
+	[STK_DATA_OBJECT_TYPE_BROWSING_STATUS] = parse_dataobj_browsing_status,
+	[STK_DATA_OBJECT_TYPE_FRAME_LAYOUT] = parse_dataobj_frame_layout,
+	[STK_DATA_OBJECT_TYPE_FRAMES_INFO] = parse_dataobj_frames_info,
+	[STK_DATA_OBJECT_TYPE_FRAME_ID] = parse_dataobj_frame_id,
+	[STK_DATA_OBJECT_TYPE_MEID] = parse_dataobj_meid,
+	[STK_DATA_OBJECT_TYPE_MMS_REFERENCE] = parse_dataobj_mms_reference,
+	[STK_DATA_OBJECT_TYPE_MMS_ID] = parse_dataobj_mms_id,
+	[STK_DATA_OBJECT_TYPE_MMS_TRANSFER_STATUS] =
+			parse_dataobj_mms_transfer_status,
+	[STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID] = parse_dataobj_mms_content_id,
+	[STK_DATA_OBJECT_TYPE_MMS_NOTIFICATION] =
+			parse_dataobj_mms_notification,
+	[STK_DATA_OBJECT_TYPE_LAST_ENVELOPE] = parse_dataobj_last_envelope,
+	[STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA] =
+			parse_dataobj_registry_application_data,
+	[STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR] =
+			parse_dataobj_activate_descriptor,
+	[STK_DATA_OBJECT_TYPE_BROADCAST_NETWORK_INFO] =
+			parse_dataobj_broadcast_network_info,
+};
+
 static dataobj_handler handler_for_type(enum stk_data_object_type type)
 {
-	switch (type) {
-	case STK_DATA_OBJECT_TYPE_ADDRESS:
-		return parse_dataobj_address;
-	case STK_DATA_OBJECT_TYPE_ALPHA_ID:
-		return parse_dataobj_alpha_id;
-	case STK_DATA_OBJECT_TYPE_SUBADDRESS:
-		return parse_dataobj_subaddress;
-	case STK_DATA_OBJECT_TYPE_CCP:
-		return parse_dataobj_ccp;
-	case STK_DATA_OBJECT_TYPE_CBS_PAGE:
-		return parse_dataobj_cbs_page;
-	case STK_DATA_OBJECT_TYPE_DURATION:
-		return parse_dataobj_duration;
-	case STK_DATA_OBJECT_TYPE_ITEM:
-		return parse_dataobj_item;
-	case STK_DATA_OBJECT_TYPE_ITEM_ID:
-		return parse_dataobj_item_id;
-	case STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH:
-		return parse_dataobj_response_len;
-	case STK_DATA_OBJECT_TYPE_RESULT:
-		return parse_dataobj_result;
-	case STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU:
-		return parse_dataobj_gsm_sms_tpdu;
-	case STK_DATA_OBJECT_TYPE_SS_STRING:
-		return parse_dataobj_ss;
-	case STK_DATA_OBJECT_TYPE_TEXT:
-		return parse_dataobj_text;
-	case STK_DATA_OBJECT_TYPE_TONE:
-		return parse_dataobj_tone;
-	case STK_DATA_OBJECT_TYPE_USSD_STRING:
-		return parse_dataobj_ussd;
-	case STK_DATA_OBJECT_TYPE_FILE_LIST:
-		return parse_dataobj_file_list;
-	case STK_DATA_OBJECT_TYPE_LOCATION_INFO:
-		return parse_dataobj_location_info;
-	case STK_DATA_OBJECT_TYPE_IMEI:
-		return parse_dataobj_imei;
-	case STK_DATA_OBJECT_TYPE_HELP_REQUEST:
-		return parse_dataobj_help_request;
-	case STK_DATA_OBJECT_TYPE_NETWORK_MEASUREMENT_RESULTS:
-		return parse_dataobj_network_measurement_results;
-	case STK_DATA_OBJECT_TYPE_DEFAULT_TEXT:
-		return parse_dataobj_default_text;
-	case STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR:
-		return parse_dataobj_items_next_action_indicator;
-	case STK_DATA_OBJECT_TYPE_EVENT_LIST:
-		return parse_dataobj_event_list;
-	case STK_DATA_OBJECT_TYPE_CAUSE:
-		return parse_dataobj_cause;
-	case STK_DATA_OBJECT_TYPE_LOCATION_STATUS:
-		return parse_dataobj_location_status;
-	case STK_DATA_OBJECT_TYPE_TRANSACTION_ID:
-		return parse_dataobj_transaction_id;
-	case STK_DATA_OBJECT_TYPE_BCCH_CHANNEL_LIST:
-		return parse_dataobj_bcch_channel_list;
-	case STK_DATA_OBJECT_TYPE_CALL_CONTROL_REQUESTED_ACTION:
-		return parse_dataobj_call_control_requested_action;
-	case STK_DATA_OBJECT_TYPE_ICON_ID:
-		return parse_dataobj_icon_id;
-	case STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST:
-		return parse_dataobj_item_icon_id_list;
-	case STK_DATA_OBJECT_TYPE_CARD_READER_STATUS:
-		return parse_dataobj_card_reader_status;
-	case STK_DATA_OBJECT_TYPE_CARD_ATR:
-		return parse_dataobj_card_atr;
-	case STK_DATA_OBJECT_TYPE_C_APDU:
-		return parse_dataobj_c_apdu;
-	case STK_DATA_OBJECT_TYPE_R_APDU:
-		return parse_dataobj_r_apdu;
-	case STK_DATA_OBJECT_TYPE_TIMER_ID:
-		return parse_dataobj_timer_id;
-	case STK_DATA_OBJECT_TYPE_TIMER_VALUE:
-		return parse_dataobj_timer_value;
-	case STK_DATA_OBJECT_TYPE_DATETIME_TIMEZONE:
-		return parse_dataobj_datetime_timezone;
-	case STK_DATA_OBJECT_TYPE_AT_COMMAND:
-		return parse_dataobj_at_command;
-	case STK_DATA_OBJECT_TYPE_AT_RESPONSE:
-		return parse_dataobj_at_response;
-	case STK_DATA_OBJECT_TYPE_BC_REPEAT_INDICATOR:
-		return parse_dataobj_bc_repeat_indicator;
-	case STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE:
-		return parse_dataobj_imm_resp;
-	case STK_DATA_OBJECT_TYPE_DTMF_STRING:
-		return parse_dataobj_dtmf_string;
-	case STK_DATA_OBJECT_TYPE_LANGUAGE:
-		return parse_dataobj_language;
-	case STK_DATA_OBJECT_TYPE_BROWSER_ID:
-		return parse_dataobj_browser_id;
-	case STK_DATA_OBJECT_TYPE_TIMING_ADVANCE:
-		return parse_dataobj_timing_advance;
-	case STK_DATA_OBJECT_TYPE_URL:
-		return parse_dataobj_url;
-	case STK_DATA_OBJECT_TYPE_BEARER:
-		return parse_dataobj_bearer;
-	case STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF:
-		return parse_dataobj_provisioning_file_reference;
-	case STK_DATA_OBJECT_TYPE_BROWSER_TERMINATION_CAUSE:
-		return parse_dataobj_browser_termination_cause;
-	case STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION:
-		return parse_dataobj_bearer_description;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_DATA:
-		return parse_dataobj_channel_data;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH:
-		return parse_dataobj_channel_data_length;
-	case STK_DATA_OBJECT_TYPE_BUFFER_SIZE:
-		return parse_dataobj_buffer_size;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_STATUS:
-		return parse_dataobj_channel_status;
-	case STK_DATA_OBJECT_TYPE_CARD_READER_ID:
-		return parse_dataobj_card_reader_id;
-	case STK_DATA_OBJECT_TYPE_OTHER_ADDRESS:
-		return parse_dataobj_other_address;
-	case STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE:
-		return parse_dataobj_uicc_te_interface;
-	case STK_DATA_OBJECT_TYPE_AID:
-		return parse_dataobj_aid;
-	case STK_DATA_OBJECT_TYPE_ACCESS_TECHNOLOGY:
-		return parse_dataobj_access_technology;
-	case STK_DATA_OBJECT_TYPE_DISPLAY_PARAMETERS:
-		return parse_dataobj_display_parameters;
-	case STK_DATA_OBJECT_TYPE_SERVICE_RECORD:
-		return parse_dataobj_service_record;
-	case STK_DATA_OBJECT_TYPE_DEVICE_FILTER:
-		return parse_dataobj_device_filter;
-	case STK_DATA_OBJECT_TYPE_SERVICE_SEARCH:
-		return parse_dataobj_service_search;
-	case STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO:
-		return parse_dataobj_attribute_info;
-	case STK_DATA_OBJECT_TYPE_SERVICE_AVAILABILITY:
-		return parse_dataobj_service_availability;
-	case STK_DATA_OBJECT_TYPE_REMOTE_ENTITY_ADDRESS:
-		return parse_dataobj_remote_entity_address;
-	case STK_DATA_OBJECT_TYPE_ESN:
-		return parse_dataobj_esn;
-	case STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME:
-		return parse_dataobj_network_access_name;
-	case STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU:
-		return parse_dataobj_cdma_sms_tpdu;
-	case STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE:
-		return parse_dataobj_text_attr;
-	case STK_DATA_OBJECT_TYPE_PDP_ACTIVATION_PARAMETER:
-		return parse_dataobj_pdp_act_par;
-	case STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST:
-		return parse_dataobj_item_text_attribute_list;
-	case STK_DATA_OBJECT_TYPE_UTRAN_MEASUREMENT_QUALIFIER:
-		return parse_dataobj_utran_meas_qualifier;
-	case STK_DATA_OBJECT_TYPE_IMEISV:
-		return parse_dataobj_imeisv;
-	case STK_DATA_OBJECT_TYPE_NETWORK_SEARCH_MODE:
-		return parse_dataobj_network_search_mode;
-	case STK_DATA_OBJECT_TYPE_BATTERY_STATE:
-		return parse_dataobj_battery_state;
-	case STK_DATA_OBJECT_TYPE_BROWSING_STATUS:
-		return parse_dataobj_browsing_status;
-	case STK_DATA_OBJECT_TYPE_FRAME_LAYOUT:
-		return parse_dataobj_frame_layout;
-	case STK_DATA_OBJECT_TYPE_FRAMES_INFO:
-		return parse_dataobj_frames_info;
-	case STK_DATA_OBJECT_TYPE_FRAME_ID:
-		return parse_dataobj_frame_id;
-	case STK_DATA_OBJECT_TYPE_MEID:
-		return parse_dataobj_meid;
-	case STK_DATA_OBJECT_TYPE_MMS_REFERENCE:
-		return parse_dataobj_mms_reference;
-	case STK_DATA_OBJECT_TYPE_MMS_ID:
-		return parse_dataobj_mms_id;
-	case STK_DATA_OBJECT_TYPE_MMS_TRANSFER_STATUS:
-		return parse_dataobj_mms_transfer_status;
-	case STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID:
-		return parse_dataobj_mms_content_id;
-	case STK_DATA_OBJECT_TYPE_MMS_NOTIFICATION:
-		return parse_dataobj_mms_notification;
-	case STK_DATA_OBJECT_TYPE_LAST_ENVELOPE:
-		return parse_dataobj_last_envelope;
-	case STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA:
-		return parse_dataobj_registry_application_data;
-	case STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR:
-		return parse_dataobj_activate_descriptor;
-	case STK_DATA_OBJECT_TYPE_BROADCAST_NETWORK_INFO:
-		return parse_dataobj_broadcast_network_info;
-	default:
+	if ((unsigned int) type >= G_N_ELEMENTS(dataobj_handlers))
 		return NULL;
-	}
+
+	return dataobj_handlers[type];
 }
 
 static void destroy_stk_item(struct stk_item *item)
@@ -2347,55 +2288,37 @@ struct dataobj_handler_entry {
 	void *data;
 };
 
+/*
+ * Single pass over the comprehension TLVs of a command.  entries lists the
+ * data objects the command expects, in the order mandated by the spec.
+ */
 static enum stk_command_parse_result parse_dataobj(
-					struct comprehension_tlv_iter *iter,
-					enum stk_data_object_type type, ...)
+				struct comprehension_tlv_iter *iter,
+				const struct dataobj_handler_entry *entries,
+				unsigned int n_entries)
 {
-	GSList *entries = NULL;
-	GSList *l;
-	va_list args;
+	unsigned int next = 0;
 	gboolean minimum_set = TRUE;
 	gboolean parse_error = FALSE;
 
-	va_start(args, type);
-
-	while (type != STK_DATA_OBJECT_TYPE_INVALID) {
-		struct dataobj_handler_entry *entry;
-
-		entry = g_new0(struct dataobj_handler_entry, 1);
-
-		entry->type = type;
-		entry->flags = va_arg(args, int);
-		entry->data = va_arg(args, void *);
-
-		type = va_arg(args, enum stk_data_object_type);
-		entries = g_slist_prepend(entries, entry);
-	}
-
-	va_end(args);
-
-	entries = g_slist_reverse(entries);
-
-	l = entries;
 	while (comprehension_tlv_iter_next(iter) == TRUE) {
+		unsigned short tag = comprehension_tlv_iter_get_tag(iter);
+		const struct dataobj_handler_entry *entry = NULL;
 		dataobj_handler handler;
-		struct dataobj_handler_entry *entry;
-		GSList *l2;
+		unsigned int i;
 
-		for (l2 = l; l2; l2 = l2->next) {
-			entry = l2->data;
-
-			if (comprehension_tlv_iter_get_tag(iter) == entry->type)
+		for (i = next; i < n_entries; i++) {
+			if (tag == entries[i].type) {
+				entry = &entries[i];
 				break;
+			}
 
 			/* Can't skip over mandatory objects */
-			if (entry->flags & DATAOBJ_FLAG_MANDATORY) {
-				l2 = NULL;
+			if (entries[i].flags & DATAOBJ_FLAG_MANDATORY)
 				break;
-			}
 		}
 
-		if (l2 == NULL) {
+		if (entry == NULL) {
 			if (comprehension_tlv_get_cr(iter) == TRUE)
 				parse_error = TRUE;
 
@@ -2410,19 +2333,14 @@ static enum stk_command_parse_result parse_dataobj(
 		if (handler(iter, entry->data) == FALSE)
 			parse_error = TRUE;
 
-		l = l2->next;
+		next = i + 1;
 	}
 
-	for (; l; l = l->next) {
-		struct dataobj_handler_entry *entry = l->data;
-
-		if (entry->flags & DATAOBJ_FLAG_MANDATORY)
+	for (; next < n_entries; next++) {
+		if (entries[next].flags & DATAOBJ_FLAG_MANDATORY)
 			minimum_set = FALSE;
 	}
 
-	g_slist_foreach(entries, (GFunc) g_free, NULL);
-	g_slist_free(entries);
-
 	if (minimum_set == FALSE)
 		return STK_PARSE_RESULT_MISSING_VALUE;
 	if (parse_error == TRUE)
@@ -2442,6 +2360,17 @@ static enum stk_command_parse_result parse_display_text(
 {
 	struct stk_command_display_text *obj = &command->display_text;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->text },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+			&obj->immediate_response },
+		{ STK_DATA_OBJECT_TYPE_DURATION, 0, &obj->duration },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2451,20 +2380,7 @@ static enum stk_command_parse_result parse_display_text(
 
 	command->destructor = destroy_display_text;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->immediate_response,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2482,6 +2398,15 @@ static enum stk_command_parse_result parse_get_inkey(
 {
 	struct stk_command_get_inkey *obj = &command->get_inkey;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->text },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_DURATION, 0, &obj->duration },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2491,18 +2416,7 @@ static enum stk_command_parse_result parse_get_inkey(
 
 	command->destructor = destroy_get_inkey;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2521,6 +2435,18 @@ static enum stk_command_parse_result parse_get_input(
 {
 	struct stk_command_get_input *obj = &command->get_input;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->text },
+		{ STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->resp_len },
+		{ STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0, &obj->default_text },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2530,21 +2456,7 @@ static enum stk_command_parse_result parse_get_input(
 
 	command->destructor = destroy_get_input;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->resp_len,
-				STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
-				&obj->default_text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2575,6 +2487,14 @@ static enum stk_command_parse_result parse_play_tone(
 {
 	struct stk_command_play_tone *obj = &command->play_tone;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_TONE, 0, &obj->tone },
+		{ STK_DATA_OBJECT_TYPE_DURATION, 0, &obj->duration },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2584,19 +2504,7 @@ static enum stk_command_parse_result parse_play_tone(
 
 	command->destructor = destroy_play_tone;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_TONE, 0,
-				&obj->tone,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -2608,6 +2516,11 @@ static enum stk_command_parse_result parse_poll_interval(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_poll_interval *obj = &command->poll_interval;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_DURATION,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->duration },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2615,10 +2528,7 @@ static enum stk_command_parse_result parse_poll_interval(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_DURATION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_setup_menu(struct stk_command *command)
@@ -2635,6 +2545,23 @@ static enum stk_command_parse_result parse_setup_menu(
 {
 	struct stk_command_setup_menu *obj = &command->setup_menu;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ITEM,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+			DATAOBJ_FLAG_LIST,
+			&obj->items },
+		{ STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+			&obj->next_act },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+			&obj->item_icon_id_list },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+			&obj->item_text_attr_list },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2644,24 +2571,7 @@ static enum stk_command_parse_result parse_setup_menu(
 
 	command->destructor = destroy_setup_menu;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -2682,6 +2592,23 @@ static enum stk_command_parse_result parse_select_item(
 {
 	struct stk_command_select_item *obj = &command->select_item;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ITEM,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+			DATAOBJ_FLAG_LIST,
+			&obj->items },
+		{ STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+			&obj->next_act },
+		{ STK_DATA_OBJECT_TYPE_ITEM_ID, 0, &obj->item_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+			&obj->item_icon_id_list },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+			&obj->item_text_attr_list },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2689,27 +2616,7 @@ static enum stk_command_parse_result parse_select_item(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
-			&obj->item_id,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-			&obj->frame_id,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	command->destructor = destroy_select_item;
 
@@ -2735,6 +2642,15 @@ static enum stk_command_parse_result parse_send_sms(
 	enum stk_command_parse_result status;
 	struct gsm_sms_tpdu gsm_tpdu;
 	struct stk_address sc_address = { 0, NULL };
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ADDRESS, 0, &sc_address },
+		{ STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0, &gsm_tpdu },
+		{ STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0, &obj->cdma_sms },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2743,21 +2659,7 @@ static enum stk_command_parse_result parse_send_sms(
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	memset(&gsm_tpdu, 0, sizeof(gsm_tpdu));
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ADDRESS, 0,
-				&sc_address,
-				STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
-				&gsm_tpdu,
-				STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
-				&obj->cdma_sms,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	command->destructor = destroy_send_sms;
 
@@ -2836,6 +2738,15 @@ static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_send_ss *obj = &command->send_ss;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_SS_STRING,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->ss },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2845,18 +2756,7 @@ static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 
 	command->destructor = destroy_send_ss;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_SS_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ss,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_send_ussd(struct stk_command *command)
@@ -2869,6 +2769,15 @@ static enum stk_command_parse_result parse_send_ussd(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_send_ussd *obj = &command->send_ussd;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_USSD_STRING,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->ussd_string },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2878,18 +2787,7 @@ static enum stk_command_parse_result parse_send_ussd(
 
 	command->destructor = destroy_send_ussd;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_USSD_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ussd_string,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_setup_call(struct stk_command *command)
@@ -2905,6 +2803,23 @@ static enum stk_command_parse_result parse_setup_call(
 {
 	struct stk_command_setup_call *obj = &command->setup_call;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id_usr_cfm },
+		{ STK_DATA_OBJECT_TYPE_ADDRESS,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->addr },
+		{ STK_DATA_OBJECT_TYPE_CCP, 0, &obj->ccp },
+		{ STK_DATA_OBJECT_TYPE_SUBADDRESS, 0, &obj->subaddr },
+		{ STK_DATA_OBJECT_TYPE_DURATION, 0, &obj->duration },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id_usr_cfm },
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id_call_setup },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id_call_setup },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			&obj->text_attr_usr_cfm },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			&obj->text_attr_call_setup },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2914,30 +2829,7 @@ static enum stk_command_parse_result parse_setup_call(
 
 	command->destructor = destroy_setup_call;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ADDRESS,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->addr,
-				STK_DATA_OBJECT_TYPE_CCP, 0,
-				&obj->ccp,
-				STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
-				&obj->subaddr,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_call_setup,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_call_setup,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_usr_cfm,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_call_setup,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id_usr_cfm, obj->icon_id_usr_cfm.id);
 	CHECK_TEXT_AND_ICON(obj->alpha_id_call_setup,
@@ -2959,6 +2851,14 @@ static enum stk_command_parse_result parse_refresh(
 {
 	struct stk_command_refresh *obj = &command->refresh;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_FILE_LIST, 0, &obj->file_list },
+		{ STK_DATA_OBJECT_TYPE_AID, 0, &obj->aid },
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2968,19 +2868,7 @@ static enum stk_command_parse_result parse_refresh(
 
 	command->destructor = destroy_refresh;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
-				&obj->file_list,
-				STK_DATA_OBJECT_TYPE_AID, 0,
-				&obj->aid,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3018,6 +2906,11 @@ static enum stk_command_parse_result parse_setup_event_list(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_setup_event_list *obj = &command->setup_event_list;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_EVENT_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->event_list },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3025,10 +2918,7 @@ static enum stk_command_parse_result parse_setup_event_list(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_EVENT_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->event_list,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static enum stk_command_parse_result parse_perform_card_apdu(
@@ -3036,6 +2926,11 @@ static enum stk_command_parse_result parse_perform_card_apdu(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_perform_card_apdu *obj = &command->perform_card_apdu;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_C_APDU,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->c_apdu },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3044,10 +2939,7 @@ static enum stk_command_parse_result parse_perform_card_apdu(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CARD_READER_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_C_APDU,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->c_apdu,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static enum stk_command_parse_result parse_power_off_card(
@@ -3109,6 +3001,13 @@ static enum stk_command_parse_result parse_timer_mgmt(
 {
 	struct stk_command_timer_mgmt *obj = &command->timer_mgmt;
 	enum stk_data_object_flag value_flags = 0;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_TIMER_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->timer_id },
+		{ STK_DATA_OBJECT_TYPE_TIMER_VALUE, value_flags,
+			&obj->timer_value },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3119,12 +3018,7 @@ static enum stk_command_parse_result parse_timer_mgmt(
 	if ((command->qualifier & 3) == 0) /* Start a timer */
 		value_flags = DATAOBJ_FLAG_MANDATORY;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TIMER_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->timer_id,
-				STK_DATA_OBJECT_TYPE_TIMER_VALUE, value_flags,
-				&obj->timer_value,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_setup_idle_mode_text(struct stk_command *command)
@@ -3139,6 +3033,14 @@ static enum stk_command_parse_result parse_setup_idle_mode_text(
 	struct stk_command_setup_idle_mode_text *obj =
 					&command->setup_idle_mode_text;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->text },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3148,16 +3050,7 @@ static enum stk_command_parse_result parse_setup_idle_mode_text(
 
 	command->destructor = destroy_setup_idle_mode_text;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -3176,6 +3069,15 @@ static enum stk_command_parse_result parse_run_at_command(
 {
 	struct stk_command_run_at_command *obj = &command->run_at_command;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_AT_COMMAND,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->at_command },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3185,18 +3087,7 @@ static enum stk_command_parse_result parse_run_at_command(
 
 	command->destructor = destroy_run_at_command;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_AT_COMMAND,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->at_command,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3215,6 +3106,15 @@ static enum stk_command_parse_result parse_send_dtmf(
 {
 	struct stk_command_send_dtmf *obj = &command->send_dtmf;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_DTMF_STRING,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->dtmf },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3224,18 +3124,7 @@ static enum stk_command_parse_result parse_send_dtmf(
 
 	command->destructor = destroy_send_dtmf;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_DTMF_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->dtmf,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3248,6 +3137,9 @@ static enum stk_command_parse_result parse_language_notification(
 {
 	struct stk_command_language_notification *obj =
 					&command->language_notification;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_LANGUAGE, 0, &obj->language },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3255,9 +3147,7 @@ static enum stk_command_parse_result parse_language_notification(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
-				&obj->language,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_launch_browser(struct stk_command *command)
@@ -3279,6 +3169,24 @@ static enum stk_command_parse_result parse_launch_browser(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_launch_browser *obj = &command->launch_browser;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_BROWSER_ID, 0, &obj->browser_id },
+		{ STK_DATA_OBJECT_TYPE_URL,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->url },
+		{ STK_DATA_OBJECT_TYPE_BEARER, 0, &obj->bearer },
+		{ STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF, DATAOBJ_FLAG_LIST,
+			&obj->prov_file_refs },
+		{ STK_DATA_OBJECT_TYPE_TEXT, 0, &obj->text_gateway_proxy_id },
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+		{ STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
+			&obj->network_name },
+		{ STK_DATA_OBJECT_TYPE_TEXT, 0, &obj->text_usr },
+		{ STK_DATA_OBJECT_TYPE_TEXT, 0, &obj->text_passwd },
+	};
 
 	if (command->qualifier > 3 || command->qualifier == 1)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3291,34 +3199,7 @@ static enum stk_command_parse_result parse_launch_browser(
 
 	command->destructor = destroy_launch_browser;
 
-	return parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
-				&obj->browser_id,
-				STK_DATA_OBJECT_TYPE_URL,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->url,
-				STK_DATA_OBJECT_TYPE_BEARER, 0,
-				&obj->bearer,
-				STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF,
-				DATAOBJ_FLAG_LIST,
-				&obj->prov_file_refs,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_gateway_proxy_id,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->network_name,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_open_channel(struct stk_command *command)
@@ -3335,6 +3216,24 @@ static enum stk_command_parse_result parse_open_channel(
 {
 	struct stk_command_open_channel *obj = &command->open_channel;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->bearer_desc },
+		{ STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->buf_size },
+		{ STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0, &obj->apn },
+		{ STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0, &obj->local_addr },
+		{ STK_DATA_OBJECT_TYPE_TEXT, 0, &obj->text_usr },
+		{ STK_DATA_OBJECT_TYPE_TEXT, 0, &obj->text_passwd },
+		{ STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0, &obj->uti },
+		{ STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0, &obj->data_dest_addr },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->qualifier >= 0x08)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3351,34 +3250,7 @@ static enum stk_command_parse_result parse_open_channel(
 	 * parse the Open Channel data objects related to packet data service
 	 * bearer
 	 */
-	status = parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->bearer_desc,
-				STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->buf_size,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->apn,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->local_addr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->uti,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->data_dest_addr,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3396,6 +3268,12 @@ static enum stk_command_parse_result parse_close_channel(
 {
 	struct stk_command_close_channel *obj = &command->close_channel;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3406,15 +3284,7 @@ static enum stk_command_parse_result parse_close_channel(
 
 	command->destructor = destroy_close_channel;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3432,6 +3302,15 @@ static enum stk_command_parse_result parse_receive_data(
 {
 	struct stk_command_receive_data *obj = &command->receive_data;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->data_len },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3442,18 +3321,7 @@ static enum stk_command_parse_result parse_receive_data(
 
 	command->destructor = destroy_receive_data;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data_len,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3472,6 +3340,15 @@ static enum stk_command_parse_result parse_send_data(
 {
 	struct stk_command_send_data *obj = &command->send_data;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->data },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->qualifier > STK_SEND_DATA_IMMEDIATELY)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3485,18 +3362,7 @@ static enum stk_command_parse_result parse_send_data(
 
 	command->destructor = destroy_send_data;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3528,6 +3394,16 @@ static enum stk_command_parse_result parse_service_search(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_service_search *obj = &command->service_search;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->serv_search },
+		{ STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0, &obj->dev_filter },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3537,20 +3413,7 @@ static enum stk_command_parse_result parse_service_search(
 
 	command->destructor = destroy_service_search;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_search,
-				STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
-				&obj->dev_filter,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_get_service_info(struct stk_command *command)
@@ -3564,6 +3427,15 @@ static enum stk_command_parse_result parse_get_service_info(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_get_service_info *obj = &command->get_service_info;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->attr_info },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3573,18 +3445,7 @@ static enum stk_command_parse_result parse_get_service_info(
 
 	command->destructor = destroy_get_service_info;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->attr_info,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static void destroy_declare_service(struct stk_command *command)
@@ -3597,6 +3458,12 @@ static enum stk_command_parse_result parse_declare_service(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_declare_service *obj = &command->declare_service;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->serv_rec },
+		{ STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0, &obj->intf },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3606,12 +3473,7 @@ static enum stk_command_parse_result parse_declare_service(
 
 	command->destructor = destroy_declare_service;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_rec,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->intf,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static enum stk_command_parse_result parse_set_frames(
@@ -3619,6 +3481,13 @@ static enum stk_command_parse_result parse_set_frames(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_set_frames *obj = &command->set_frames;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->frame_id },
+		{ STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0, &obj->frame_layout },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id_default },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3626,14 +3495,7 @@ static enum stk_command_parse_result parse_set_frames(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FRAME_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
-				&obj->frame_layout,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id_default,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static enum stk_command_parse_result parse_get_frames_status(
@@ -3663,6 +3525,22 @@ static enum stk_command_parse_result parse_retrieve_mms(
 {
 	struct stk_command_retrieve_mms *obj = &command->retrieve_mms;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->mms_ref },
+		{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->mms_rec_files },
+		{ STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->mms_content_id },
+		{ STK_DATA_OBJECT_TYPE_MMS_ID, 0, &obj->mms_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3672,26 +3550,7 @@ static enum stk_command_parse_result parse_retrieve_mms(
 
 	command->destructor = destroy_retrieve_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_ref,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_rec_files,
-				STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_content_id,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3712,6 +3571,16 @@ static enum stk_command_parse_result parse_submit_mms(
 {
 	struct stk_command_submit_mms *obj = &command->submit_mms;
 	enum stk_command_parse_result status;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, &obj->alpha_id },
+		{ STK_DATA_OBJECT_TYPE_ICON_ID, 0, &obj->icon_id },
+		{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->mms_subm_files },
+		{ STK_DATA_OBJECT_TYPE_MMS_ID, 0, &obj->mms_id },
+		{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, &obj->text_attr },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3721,20 +3590,7 @@ static enum stk_command_parse_result parse_submit_mms(
 
 	command->destructor = destroy_submit_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3753,6 +3609,16 @@ static enum stk_command_parse_result parse_display_mms(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_display_mms *obj = &command->display_mms;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->mms_subm_files },
+		{ STK_DATA_OBJECT_TYPE_MMS_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->mms_id },
+		{ STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0, &obj->imd_resp },
+		{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0, &obj->frame_id },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3762,17 +3628,7 @@ static enum stk_command_parse_result parse_display_mms(
 
 	command->destructor = destroy_display_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->imd_resp,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static enum stk_command_parse_result parse_activate(
@@ -3780,6 +3636,11 @@ static enum stk_command_parse_result parse_activate(
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_activate *obj = &command->activate;
+	const struct dataobj_handler_entry entries[] = {
+		{ STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			&obj->actv_desc },
+	};
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3787,10 +3648,7 @@ static enum stk_command_parse_result parse_activate(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->actv_desc,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, entries, G_N_ELEMENTS(entries));
 }
 
 static enum stk_command_parse_result parse_command_body(
@@ -6604,3 +6462,96 @@ char *stk_image_to_xpm(const unsigned char *img, unsigned int len,
 	/* Caller must free char data */
 	return g_string_free(xpm, FALSE);
 }
+
+struct stk_envelope_queue {
+	GQueue *classes[STK_ENVELOPE_CLASS_COUNT];
+	stk_envelope_drop_func_t drop;
+	void *user_data;
+};
+
+struct stk_envelope_queue *stk_envelope_queue_new(
+					stk_envelope_drop_func_t drop,
+					void *user_data)
+{
+	struct stk_envelope_queue *queue;
+	int i;
+
+	queue = g_new0(struct stk_envelope_queue, 1);
+
+	for (i = 0; i < STK_ENVELOPE_CLASS_COUNT; i++)
+		queue->classes[i] = g_queue_new();
+
+	queue->drop = drop;
+	queue->user_data = user_data;
+
+	return queue;
+}
+
+void stk_envelope_queue_free(struct stk_envelope_queue *queue,
+				GDestroyNotify destroy)
+{
+	int i;
+
+	if (queue == NULL)
+		return;
+
+	for (i = 0; i < STK_ENVELOPE_CLASS_COUNT; i++) {
+		if (destroy)
+			g_queue_foreach(queue->classes[i], (GFunc) destroy,
+					NULL);
+
+		g_queue_free(queue->classes[i]);
+	}
+
+	g_free(queue);
+}
+
+/*
+ * Queues an envelope behind the others of its class.  When the CBS
+ * backlog overflows the oldest page is handed to the drop function.
+ */
+void stk_envelope_queue_push(struct stk_envelope_queue *queue,
+				enum stk_envelope_class class, void *data)
+{
+	GQueue *q = queue->classes[class];
+
+	g_queue_push_tail(q, data);
+
+	if (class != STK_ENVELOPE_CLASS_CBS)
+		return;
+
+	while (g_queue_get_length(q) > STK_ENVELOPE_CBS_QUEUE_MAX) {
+		void *dropped = g_queue_pop_head(q);
+
+		if (queue->drop)
+			queue->drop(dropped, queue->user_data);
+	}
+}
+
+/* Takes the oldest envelope of the highest priority non-empty class */
+void *stk_envelope_queue_pop(struct stk_envelope_queue *queue)
+{
+	int i;
+
+	for (i = 0; i < STK_ENVELOPE_CLASS_COUNT; i++) {
+		if (!g_queue_is_empty(queue->classes[i]))
+			return g_queue_pop_head(queue->classes[i]);
+	}
+
+	return NULL;
+}
+
+void *stk_envelope_queue_find(struct stk_envelope_queue *queue,
+				enum stk_envelope_class class,
+				GCompareFunc func, const void *data)
+{
+	GList *l = g_queue_find_custom(queue->classes[class], data, func);
+
+	return l ? l->data : NULL;
+}
+
+unsigned int stk_envelope_queue_length(struct stk_envelope_queue *queue,
+					enum stk_envelope_class class)
+{
+	return g_queue_get_length(queue->classes[class]);
+}
@@ -1771,6 +1771,29 @@ struct stk_envelope {
 	};
 };
 
+/*
+ * Envelopes waiting for the UICC, one FIFO per class.  Lower classes
+ * are served first, so that a burst of network originated downloads
+ * can not hold up a menu selection made by the user.
+ */
+enum stk_envelope_class {
+	STK_ENVELOPE_CLASS_USER = 0,
+	STK_ENVELOPE_CLASS_SMS_PP,
+	STK_ENVELOPE_CLASS_TIMER,
+	STK_ENVELOPE_CLASS_CBS,
+	STK_ENVELOPE_CLASS_COUNT,
+};
+
+/*
+ * Cell Broadcast pages keep coming whether or not the UICC keeps up,
+ * bound the backlog and shed the oldest pages first.
+ */
+#define STK_ENVELOPE_CBS_QUEUE_MAX 16
+
+typedef void (*stk_envelope_drop_func_t)(void *data, void *user_data);
+
+struct stk_envelope_queue;
+
 struct stk_command *stk_command_new_from_pdu(const unsigned char *pdu,
 						unsigned int len);
 void stk_command_free(struct stk_command *command);
@@ -1784,3 +1807,17 @@ char *stk_text_to_html(const char *text,
 char *stk_image_to_xpm(const unsigned char *img, unsigned int len,
 			enum stk_img_scheme scheme, const unsigned char *clut,
 			unsigned short clut_len);
+
+struct stk_envelope_queue *stk_envelope_queue_new(
+					stk_envelope_drop_func_t drop,
+					void *user_data);
+void stk_envelope_queue_free(struct stk_envelope_queue *queue,
+				GDestroyNotify destroy);
+void stk_envelope_queue_push(struct stk_envelope_queue *queue,
+				enum stk_envelope_class class, void *data);
+void *stk_envelope_queue_pop(struct stk_envelope_queue *queue);
+void *stk_envelope_queue_find(struct stk_envelope_queue *queue,
+				enum stk_envelope_class class,
+				GCompareFunc func, const void *data);
+unsigned int stk_envelope_queue_length(struct stk_envelope_queue *queue,
+					enum stk_envelope_class class);
@@ -868,6 +868,22 @@ out:
 	return encoded;
 }
 
+/*
+ * Hex digit values offset by one, so that every character not listed
+ * here maps to zero and is rejected by the decoder.
+ */
+static const unsigned char hex_digit_table[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static const char hex_encode_table[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7',
+	'8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
+};
+
 /*!
  * Decodes the hex encoded data and converts to a byte array.  If terminator
  * is not 0, the terminator character is appended to the end of the result.
@@ -882,37 +898,54 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
-	long i, j;
-	char c;
-	unsigned char b;
+	const unsigned char *p = (const unsigned char *) in;
+	unsigned char hi, lo;
+	unsigned char invalid = 0;
+	long j;
 
 	if (len < 0)
 		len = strlen(in);
 
-	len &= ~0x1;
-
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = toupper(in[i]);
+	len >>= 1;
 
-		if (c >= '0' && c <= '9')
-			b = c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = 10 + c - 'A';
-		else
+	/*
+	 * Any invalid digit maps to zero in the table, so instead of
+	 * branching per character accumulate a flag and check it once
+	 * per group of bytes.
+	 */
+	for (j = 0; j + 4 <= len; j += 4, p += 8) {
+		hi = hex_digit_table[p[0]];
+		lo = hex_digit_table[p[1]];
+		invalid |= !hi | !lo;
+		buf[j] = ((hi - 1) << 4) | (lo - 1);
+
+		hi = hex_digit_table[p[2]];
+		lo = hex_digit_table[p[3]];
+		invalid |= !hi | !lo;
+		buf[j + 1] = ((hi - 1) << 4) | (lo - 1);
+
+		hi = hex_digit_table[p[4]];
+		lo = hex_digit_table[p[5]];
+		invalid |= !hi | !lo;
+		buf[j + 2] = ((hi - 1) << 4) | (lo - 1);
+
+		hi = hex_digit_table[p[6]];
+		lo = hex_digit_table[p[7]];
+		invalid |= !hi | !lo;
+		buf[j + 3] = ((hi - 1) << 4) | (lo - 1);
+
+		if (invalid)
 			return NULL;
+	}
 
-		i += 1;
-
-		c = toupper(in[i]);
+	for (; j < len; j++, p += 2) {
+		hi = hex_digit_table[p[0]];
+		lo = hex_digit_table[p[1]];
 
-		if (c >= '0' && c <= '9')
-			b = b * 16 + c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = b * 16 + 10 + c - 'A';
-		else
+		if (hi == 0 || lo == 0)
 			return NULL;
 
-		buf[j] = b;
+		buf[j] = ((hi - 1) << 4) | (lo - 1);
 	}
 
 	if (terminator)
@@ -927,8 +960,6 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 unsigned char *decode_hex(const char *in, long len, long *items_written,
 				unsigned char terminator)
 {
-	long i;
-	char c;
 	unsigned char *buf;
 
 	if (len < 0)
@@ -936,18 +967,15 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 
 	len &= ~0x1;
 
-	for (i = 0; i < len; i++) {
-		c = toupper(in[i]);
-
-		if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F'))
-			continue;
+	buf = g_new(unsigned char, (len >> 1) + (terminator ? 1 : 0));
 
+	if (decode_hex_own_buf(in, len, items_written, terminator,
+					buf) == NULL) {
+		g_free(buf);
 		return NULL;
 	}
 
-	buf = g_new(unsigned char, (len >> 1) + (terminator ? 1 : 0));
-
-	return decode_hex_own_buf(in, len, items_written, terminator, buf);
+	return buf;
 }
 
 /*!
@@ -959,8 +987,8 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 char *encode_hex_own_buf(const unsigned char *in, long len,
 				unsigned char terminator, char *buf)
 {
-	long i, j;
-	char c;
+	long i;
+	char *out = buf;
 
 	if (len < 0) {
 		i = 0;
@@ -971,25 +999,23 @@ char *encode_hex_own_buf(const unsigned char *in, long len,
 		len = i;
 	}
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = (in[i] >> 4) & 0xf;
-
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
-
-		j += 1;
-
-		c = (in[i]) & 0xf;
+	for (i = 0; i + 4 <= len; i += 4, out += 8) {
+		out[0] = hex_encode_table[in[i] >> 4];
+		out[1] = hex_encode_table[in[i] & 0xf];
+		out[2] = hex_encode_table[in[i + 1] >> 4];
+		out[3] = hex_encode_table[in[i + 1] & 0xf];
+		out[4] = hex_encode_table[in[i + 2] >> 4];
+		out[5] = hex_encode_table[in[i + 2] & 0xf];
+		out[6] = hex_encode_table[in[i + 3] >> 4];
+		out[7] = hex_encode_table[in[i + 3] & 0xf];
+	}
 
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
+	for (; i < len; i++, out += 2) {
+		out[0] = hex_encode_table[in[i] >> 4];
+		out[1] = hex_encode_table[in[i] & 0xf];
 	}
 
-	buf[j] = '\0';
+	*out = '\0';
 
 	return buf;
 }
@@ -0,0 +1,715 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2011  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Replays a modem trace through GAtChat, GAtMux or GAtHDLC as fast as
+ * the stack will take it and reports throughput, heap allocations and
+ * dispatch latency.
+ *
+ * Traces use the format written by g_at_hdlc_set_recording() and
+ * g_at_ppp_set_recording(): a 0x07 tag followed by a 32 bit timestamp,
+ * or a direction tag (0x01 sent, 0x02 received) followed by a 16 bit
+ * length and the data, all in network byte order.  Only the received
+ * data is replayed, each record is written to the socket in one go.
+ * Without a trace a synthetic one is generated for the selected mode.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+#include "gatmux.h"
+#include "gathdlc.h"
+#include "gsm0710.h"
+#include "crc-ccitt.h"
+
+#define MAX_CHUNK		4096
+#define MAX_SAMPLES		(1 << 20)
+#define MAX_PREFIXES		64
+#define MUX_CHANNELS		4
+
+#define HDLC_FLAG		0x7e
+#define HDLC_ESCAPE		0x7d
+#define HDLC_TRANS		0x20
+#define HDLC_INITFCS		0xffff
+
+enum bench_mode {
+	BENCH_MODE_AT,
+	BENCH_MODE_MUX,
+	BENCH_MODE_HDLC,
+};
+
+struct trace {
+	GByteArray *data;
+	GArray *chunks;		/* guint length of each received record */
+};
+
+struct bench {
+	enum bench_mode mode;
+	int modem_fd;
+	int host_fd;
+	GAtChat *chats[MUX_CHANNELS];
+	GAtMux *mux;
+	GAtHDLC *hdlc;
+	struct timespec written;
+	unsigned long units;
+	guint32 *samples;
+	unsigned int n_samples;
+};
+
+static gchar *option_mode = NULL;
+static gchar *option_trace = NULL;
+static gint option_rounds = 0;
+static gint option_lines = 20000;
+
+/*
+ * Every malloc family call made while a replay is running is counted.
+ * This relies on the glibc internal entry points, elsewhere the count
+ * is simply not available.
+ */
+static gboolean count_allocs;
+static unsigned long n_allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	if (count_allocs)
+		n_allocs++;
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (count_allocs)
+		n_allocs++;
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (count_allocs)
+		n_allocs++;
+
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static const char *synthetic_lines[] = {
+	"\r\n+CREG: 1,\"00A1\",\"0000BEEF\",2\r\n",
+	"\r\n+CSQ: 17,99\r\n",
+	"\r\nRING\r\n",
+	"\r\n+CLIP: \"+15551234567\",145,,,,0\r\n",
+	"\r\n+CMTI: \"SM\",3\r\n",
+	"\r\n+CGEV: NW DEACT \"IP\",\"10.0.0.2\",1\r\n",
+	"\r\n+CUSD: 0,\"Your balance is 12.34\",15\r\n",
+	"\r\nOK\r\n",
+	NULL
+};
+
+static guint64 timespec_diff_ns(const struct timespec *a,
+					const struct timespec *b)
+{
+	return (guint64) (b->tv_sec - a->tv_sec) * 1000000000ULL +
+		b->tv_nsec - a->tv_nsec;
+}
+
+static void record_unit(struct bench *bench)
+{
+	struct timespec now;
+	guint64 ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = timespec_diff_ns(&bench->written, &now);
+
+	bench->units += 1;
+
+	if (bench->n_samples < MAX_SAMPLES)
+		bench->samples[bench->n_samples++] = MIN(ns, G_MAXUINT32);
+}
+
+static void chat_notify(GAtResult *result, gpointer user_data)
+{
+	record_unit(user_data);
+}
+
+static void hdlc_receive(const unsigned char *buf, gsize len, void *data)
+{
+	record_unit(data);
+}
+
+static void trace_free(struct trace *trace)
+{
+	g_byte_array_free(trace->data, TRUE);
+	g_array_free(trace->chunks, TRUE);
+	g_free(trace);
+}
+
+static struct trace *trace_new(void)
+{
+	struct trace *trace = g_new0(struct trace, 1);
+
+	trace->data = g_byte_array_new();
+	trace->chunks = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	return trace;
+}
+
+static void trace_append(struct trace *trace, const guint8 *data, guint len)
+{
+	while (len > 0) {
+		guint chunk = MIN(len, MAX_CHUNK);
+
+		g_byte_array_append(trace->data, data, chunk);
+		g_array_append_val(trace->chunks, chunk);
+
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+static struct trace *trace_load(const char *filename)
+{
+	struct trace *trace;
+	gchar *contents;
+	gsize size, pos = 0;
+	GError *error = NULL;
+
+	if (g_file_get_contents(filename, &contents, &size, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	trace = trace_new();
+
+	while (pos < size) {
+		guint8 id = contents[pos++];
+		guint16 len;
+
+		if (id == 0x07) {
+			pos += 4;
+			continue;
+		}
+
+		if ((id != 0x01 && id != 0x02) || pos + 2 > size)
+			goto corrupt;
+
+		memcpy(&len, contents + pos, 2);
+		len = ntohs(len);
+		pos += 2;
+
+		if (pos + len > size)
+			goto corrupt;
+
+		if (id == 0x02)
+			trace_append(trace, (guint8 *) contents + pos, len);
+
+		pos += len;
+	}
+
+	g_free(contents);
+
+	return trace;
+
+corrupt:
+	g_printerr("Trace %s is corrupt at offset %zu\n", filename, pos);
+	g_free(contents);
+	trace_free(trace);
+
+	return NULL;
+}
+
+static struct trace *trace_synthetic_at(int lines)
+{
+	struct trace *trace = trace_new();
+	int i;
+
+	for (i = 0; i < lines; i++) {
+		const char *line = synthetic_lines[i % 8];
+
+		trace_append(trace, (const guint8 *) line, strlen(line));
+	}
+
+	return trace;
+}
+
+static struct trace *trace_synthetic_mux(int lines)
+{
+	struct trace *trace = trace_new();
+	guint8 frame[MAX_CHUNK];
+	int i;
+
+	for (i = 0; i < lines; i++) {
+		const char *line = synthetic_lines[i % 8];
+		int len;
+
+		len = gsm0710_basic_fill_frame(frame, i % MUX_CHANNELS + 1,
+						GSM0710_DATA,
+						(const guint8 *) line,
+						strlen(line));
+		trace_append(trace, frame, len);
+	}
+
+	return trace;
+}
+
+static int hdlc_escape(guint8 *out, guint8 c)
+{
+	if (c < 0x20 || c == HDLC_FLAG || c == HDLC_ESCAPE) {
+		out[0] = HDLC_ESCAPE;
+		out[1] = c ^ HDLC_TRANS;
+		return 2;
+	}
+
+	out[0] = c;
+	return 1;
+}
+
+static struct trace *trace_synthetic_hdlc(int frames)
+{
+	struct trace *trace = trace_new();
+	guint8 payload[1500];
+	guint8 frame[MAX_CHUNK];
+	int i;
+
+	for (i = 0; i < frames; i++) {
+		/* Mix of TCP ACK sized and full MTU sized IPv4 datagrams */
+		int len = (i % 4) ? 44 : (int) sizeof(payload);
+		guint16 fcs = HDLC_INITFCS;
+		int pos = 0;
+		int j;
+
+		payload[0] = 0xff;
+		payload[1] = 0x03;
+		payload[2] = 0x00;
+		payload[3] = 0x21;
+
+		for (j = 4; j < len; j++)
+			payload[j] = (i + j) & 0xff;
+
+		frame[pos++] = HDLC_FLAG;
+
+		for (j = 0; j < len; j++) {
+			fcs = crc_ccitt_byte(fcs, payload[j]);
+			pos += hdlc_escape(frame + pos, payload[j]);
+		}
+
+		fcs ^= 0xffff;
+		pos += hdlc_escape(frame + pos, fcs & 0xff);
+		pos += hdlc_escape(frame + pos, fcs >> 8);
+		frame[pos++] = HDLC_FLAG;
+
+		trace_append(trace, frame, pos);
+	}
+
+	return trace;
+}
+
+/*
+ * Registers a notification for every distinct prefix found in the
+ * trace, so that each received line ends up in a callback.  Lines that
+ * look like PDUs are skipped.
+ */
+static GHashTable *trace_prefixes(const struct trace *trace)
+{
+	GHashTable *prefixes = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, NULL);
+	const char *data = (const char *) trace->data->data;
+	guint len = trace->data->len;
+	guint start = 0;
+	guint i;
+
+	for (i = 0; i <= len; i++) {
+		const char *line = data + start;
+		guint line_len = i - start;
+		const char *colon;
+		gboolean hex = TRUE;
+		guint j;
+
+		if (i < len && data[i] != '\r' && data[i] != '\n')
+			continue;
+
+		start = i + 1;
+
+		colon = memchr(line, ':', line_len);
+		if (colon)
+			line_len = colon - line + 1;
+
+		if (line_len == 0 || line_len > 32)
+			continue;
+
+		for (j = 0; j < line_len; j++) {
+			if (!g_ascii_isprint(line[j]))
+				break;
+
+			if (!g_ascii_isxdigit(line[j]))
+				hex = FALSE;
+		}
+
+		if (j < line_len || hex)
+			continue;
+
+		if (g_hash_table_size(prefixes) == MAX_PREFIXES)
+			break;
+
+		g_hash_table_replace(prefixes, g_strndup(line, line_len),
+					NULL);
+	}
+
+	return prefixes;
+}
+
+static GAtChat *chat_new(GIOChannel *io, GHashTable *prefixes,
+				struct bench *bench)
+{
+	GAtSyntax *syntax;
+	GAtChat *chat;
+	GHashTableIter iter;
+	gpointer key;
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	chat = g_at_chat_new(io, syntax);
+	g_at_syntax_unref(syntax);
+
+	if (chat == NULL)
+		return NULL;
+
+	g_hash_table_iter_init(&iter, prefixes);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_at_chat_register(chat, key, chat_notify, FALSE, bench, NULL);
+
+	return chat;
+}
+
+static gboolean bench_setup(struct bench *bench, const struct trace *trace)
+{
+	GHashTable *prefixes = NULL;
+	GIOChannel *io;
+	int fds[2];
+	int i;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		perror("Failed to create socket pair");
+		return FALSE;
+	}
+
+	bench->modem_fd = fds[0];
+	bench->host_fd = fds[1];
+
+	io = g_io_channel_unix_new(bench->host_fd);
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	if (bench->mode != BENCH_MODE_HDLC)
+		prefixes = trace_prefixes(trace);
+
+	switch (bench->mode) {
+	case BENCH_MODE_AT:
+		bench->chats[0] = chat_new(io, prefixes, bench);
+		break;
+	case BENCH_MODE_MUX:
+		bench->mux = g_at_mux_new_gsm0710_basic(io, 31);
+		if (bench->mux == NULL)
+			break;
+
+		g_at_mux_start(bench->mux);
+
+		for (i = 0; i < MUX_CHANNELS; i++) {
+			GIOChannel *dlc = g_at_mux_create_channel(bench->mux);
+
+			bench->chats[i] = chat_new(dlc, prefixes, bench);
+			g_io_channel_unref(dlc);
+		}
+
+		break;
+	case BENCH_MODE_HDLC:
+		bench->hdlc = g_at_hdlc_new(io);
+		if (bench->hdlc)
+			g_at_hdlc_set_receive(bench->hdlc, hdlc_receive, bench);
+		break;
+	}
+
+	g_io_channel_unref(io);
+
+	if (prefixes)
+		g_hash_table_destroy(prefixes);
+
+	if (bench->chats[0] == NULL && bench->hdlc == NULL) {
+		g_printerr("Failed to set up the %s stack\n", option_mode);
+		close(bench->modem_fd);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void bench_teardown(struct bench *bench)
+{
+	int i;
+
+	for (i = 0; i < MUX_CHANNELS; i++) {
+		if (bench->chats[i])
+			g_at_chat_unref(bench->chats[i]);
+	}
+
+	if (bench->mux) {
+		g_at_mux_shutdown(bench->mux);
+		g_at_mux_unref(bench->mux);
+	}
+
+	if (bench->hdlc)
+		g_at_hdlc_unref(bench->hdlc);
+
+	close(bench->modem_fd);
+}
+
+static gboolean write_all(int fd, const guint8 *buf, guint len)
+{
+	while (len > 0) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			perror("Failed to write trace data");
+			return FALSE;
+		}
+
+		buf += written;
+		len -= written;
+	}
+
+	return TRUE;
+}
+
+static void drain_modem(struct bench *bench)
+{
+	guint8 buf[MAX_CHUNK];
+
+	/* Anything the stack writes back, e.g. mux SABM frames, is dropped */
+	while (recv(bench->modem_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+}
+
+static gboolean bench_replay(struct bench *bench, const struct trace *trace)
+{
+	const guint8 *data = trace->data->data;
+	guint i;
+
+	for (i = 0; i < trace->chunks->len; i++) {
+		guint len = g_array_index(trace->chunks, guint, i);
+
+		clock_gettime(CLOCK_MONOTONIC, &bench->written);
+
+		if (write_all(bench->modem_fd, data, len) == FALSE)
+			return FALSE;
+
+		while (g_main_context_pending(NULL))
+			g_main_context_iteration(NULL, FALSE);
+
+		drain_modem(bench);
+
+		data += len;
+	}
+
+	return TRUE;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	guint32 x = *(const guint32 *) a;
+	guint32 y = *(const guint32 *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile_us(const struct bench *bench, int pct)
+{
+	unsigned int idx;
+
+	if (bench->n_samples == 0)
+		return 0;
+
+	idx = (bench->n_samples - 1) * pct / 100;
+
+	return bench->samples[idx] / 1000.0;
+}
+
+static void bench_report(struct bench *bench, const struct trace *trace,
+				int rounds, double elapsed)
+{
+	const char *unit = bench->mode == BENCH_MODE_HDLC ? "frames" : "lines";
+	double bytes = (double) trace->data->len * rounds;
+
+	qsort(bench->samples, bench->n_samples, sizeof(guint32),
+		compare_samples);
+
+	g_print("mode %s, %d rounds, %u records per round\n", option_mode,
+			rounds, trace->chunks->len);
+	g_print("%lu %s, %.0f bytes in %.3f s\n", bench->units, unit,
+			bytes, elapsed);
+
+	if (elapsed > 0)
+		g_print("%.0f %s/s, %.2f MB/s\n", bench->units / elapsed,
+				unit, bytes / elapsed / 1000000);
+
+	if (bench->units > 0)
+#ifdef __GLIBC__
+		g_print("%.2f allocations per %s\n",
+				(double) n_allocs / bench->units,
+				bench->mode == BENCH_MODE_HDLC ? "frame" : "line");
+#else
+		g_print("allocation counting not supported\n");
+#endif
+
+	g_print("dispatch latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+			percentile_us(bench, 50), percentile_us(bench, 99),
+			percentile_us(bench, 100));
+}
+
+static GOptionEntry options[] = {
+	{ "mode", 'm', 0, G_OPTION_ARG_STRING, &option_mode,
+				"Stack to drive: at, mux or hdlc", "MODE" },
+	{ "trace", 't', 0, G_OPTION_ARG_FILENAME, &option_trace,
+				"Recorded trace to replay", "FILE" },
+	{ "rounds", 'r', 0, G_OPTION_ARG_INT, &option_rounds,
+				"Number of times to replay the trace", "N" },
+	{ "lines", 'l', 0, G_OPTION_ARG_INT, &option_lines,
+				"Size of the synthetic trace", "N" },
+	{ NULL },
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	struct bench bench;
+	struct trace *trace;
+	GTimer *timer;
+	double elapsed;
+	int ret = EXIT_FAILURE;
+	int i;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		if (error != NULL) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+		} else
+			g_printerr("An unknown error occurred\n");
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	memset(&bench, 0, sizeof(bench));
+
+	if (option_mode == NULL)
+		option_mode = g_strdup("at");
+
+	if (g_str_equal(option_mode, "at"))
+		bench.mode = BENCH_MODE_AT;
+	else if (g_str_equal(option_mode, "mux"))
+		bench.mode = BENCH_MODE_MUX;
+	else if (g_str_equal(option_mode, "hdlc"))
+		bench.mode = BENCH_MODE_HDLC;
+	else {
+		g_printerr("Unknown mode %s\n", option_mode);
+		goto out;
+	}
+
+	if (option_lines <= 0) {
+		g_printerr("Invalid synthetic trace size\n");
+		goto out;
+	}
+
+	if (option_trace)
+		trace = trace_load(option_trace);
+	else if (bench.mode == BENCH_MODE_MUX)
+		trace = trace_synthetic_mux(option_lines);
+	else if (bench.mode == BENCH_MODE_HDLC)
+		trace = trace_synthetic_hdlc(option_lines);
+	else
+		trace = trace_synthetic_at(option_lines);
+
+	if (trace == NULL)
+		goto out;
+
+	if (option_rounds <= 0)
+		option_rounds = option_trace ? 10 : 1;
+
+	if (bench_setup(&bench, trace) == FALSE)
+		goto free_trace;
+
+	bench.samples = g_new(guint32, MAX_SAMPLES);
+
+	timer = g_timer_new();
+	count_allocs = TRUE;
+
+	for (i = 0; i < option_rounds; i++) {
+		if (bench_replay(&bench, trace) == FALSE)
+			break;
+	}
+
+	count_allocs = FALSE;
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	if (i == option_rounds) {
+		bench_report(&bench, trace, option_rounds, elapsed);
+		ret = EXIT_SUCCESS;
+	}
+
+	g_free(bench.samples);
+	bench_teardown(&bench);
+
+free_trace:
+	trace_free(trace);
+
+out:
+	g_free(option_mode);
+	g_free(option_trace);
+
+	return ret;
+}
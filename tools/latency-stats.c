@@ -0,0 +1,299 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2011  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define OFONO_SERVICE "org.ofono"
+
+#define MANAGER_PATH	"/"
+#define MANAGER_INTERFACE OFONO_SERVICE ".Manager"
+#define LATENCY_INTERFACE OFONO_SERVICE ".LatencyStatistics"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+static gboolean option_reset = FALSE;
+static gboolean option_histogram = FALSE;
+
+static DBusMessage *call_method(DBusConnection *conn, const char *path,
+				const char *interface, const char *method)
+{
+	DBusMessage *msg, *reply;
+	DBusError error;
+
+	msg = dbus_message_new_method_call(OFONO_SERVICE, path,
+						interface, method);
+	if (msg == NULL)
+		return NULL;
+
+	dbus_error_init(&error);
+
+	reply = dbus_connection_send_with_reply_and_block(conn, msg, -1,
+									&error);
+	dbus_message_unref(msg);
+
+	if (reply == NULL) {
+		if (dbus_error_is_set(&error)) {
+			fprintf(stderr, "%s: %s\n", path, error.message);
+			dbus_error_free(&error);
+		} else {
+			fprintf(stderr, "%s: %s failed\n", path, method);
+		}
+	}
+
+	return reply;
+}
+
+static GSList *get_modem_paths(DBusConnection *conn)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	GSList *paths = NULL;
+
+	reply = call_method(conn, MANAGER_PATH, MANAGER_INTERFACE,
+							"GetModems");
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init(reply, &iter);
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT) {
+		DBusMessageIter entry;
+		const char *path;
+
+		dbus_message_iter_recurse(&array, &entry);
+
+		if (dbus_message_iter_get_arg_type(&entry) ==
+						DBUS_TYPE_OBJECT_PATH) {
+			dbus_message_iter_get_basic(&entry, &path);
+			paths = g_slist_prepend(paths, g_strdup(path));
+		}
+
+		dbus_message_iter_next(&array);
+	}
+
+	dbus_message_unref(reply);
+
+	return g_slist_reverse(paths);
+}
+
+struct operation_stats {
+	const char *name;
+	dbus_uint32_t count;
+	dbus_uint32_t errors;
+	dbus_uint32_t timeouts;
+	dbus_uint32_t average;
+	dbus_uint32_t median;
+	dbus_uint32_t p90;
+	dbus_uint32_t p99;
+	dbus_uint32_t max;
+	DBusMessageIter histogram;
+	gboolean has_histogram;
+};
+
+static void parse_operation(DBusMessageIter *dict, struct operation_stats *s)
+{
+	while (dbus_message_iter_get_arg_type(dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
+		dbus_uint32_t *target = NULL;
+
+		dbus_message_iter_recurse(dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		if (g_str_equal(key, "Count"))
+			target = &s->count;
+		else if (g_str_equal(key, "Errors"))
+			target = &s->errors;
+		else if (g_str_equal(key, "Timeouts"))
+			target = &s->timeouts;
+		else if (g_str_equal(key, "Average"))
+			target = &s->average;
+		else if (g_str_equal(key, "Median"))
+			target = &s->median;
+		else if (g_str_equal(key, "Percentile90"))
+			target = &s->p90;
+		else if (g_str_equal(key, "Percentile99"))
+			target = &s->p99;
+		else if (g_str_equal(key, "Maximum"))
+			target = &s->max;
+		else if (g_str_equal(key, "Histogram") &&
+				dbus_message_iter_get_arg_type(&value) ==
+							DBUS_TYPE_ARRAY) {
+			dbus_message_iter_recurse(&value, &s->histogram);
+			s->has_histogram = TRUE;
+		}
+
+		if (target != NULL && dbus_message_iter_get_arg_type(&value) ==
+							DBUS_TYPE_UINT32)
+			dbus_message_iter_get_basic(&value, target);
+
+		dbus_message_iter_next(dict);
+	}
+}
+
+static void print_histogram(DBusMessageIter *array, dbus_uint32_t count)
+{
+	while (dbus_message_iter_get_arg_type(array) == DBUS_TYPE_STRUCT) {
+		DBusMessageIter bucket;
+		dbus_uint32_t limit, hits;
+
+		dbus_message_iter_recurse(array, &bucket);
+		dbus_message_iter_get_basic(&bucket, &limit);
+		dbus_message_iter_next(&bucket);
+		dbus_message_iter_get_basic(&bucket, &hits);
+
+		printf("    <= %10u us %8u %5.1f%%\n", limit, hits,
+				count ? 100.0 * hits / count : 0.0);
+
+		dbus_message_iter_next(array);
+	}
+}
+
+static void dump_modem(DBusConnection *conn, const char *path)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+
+	if (option_reset == TRUE) {
+		reply = call_method(conn, path, LATENCY_INTERFACE, "Reset");
+		if (reply != NULL) {
+			printf("%s: statistics reset\n", path);
+			dbus_message_unref(reply);
+		}
+
+		return;
+	}
+
+	reply = call_method(conn, path, LATENCY_INTERFACE, "GetStatistics");
+	if (reply == NULL)
+		return;
+
+	printf("%s\n", path);
+	printf("  %-24s %8s %6s %6s %10s %10s %10s %10s %10s\n",
+			"Operation", "Count", "Errors", "T/O", "Avg(us)",
+			"p50", "p90", "p99", "Max");
+
+	dbus_message_iter_init(reply, &iter);
+	dbus_message_iter_recurse(&iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) ==
+						DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, dict;
+		struct operation_stats s;
+
+		memset(&s, 0, sizeof(s));
+
+		dbus_message_iter_recurse(&array, &entry);
+		dbus_message_iter_get_basic(&entry, &s.name);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &dict);
+
+		parse_operation(&dict, &s);
+
+		printf("  %-24s %8u %6u %6u %10u %10u %10u %10u %10u\n",
+				s.name, s.count, s.errors, s.timeouts,
+				s.average, s.median, s.p90, s.p99, s.max);
+
+		if (option_histogram == TRUE && s.has_histogram == TRUE)
+			print_histogram(&s.histogram, s.count);
+
+		dbus_message_iter_next(&array);
+	}
+
+	printf("\n");
+
+	dbus_message_unref(reply);
+}
+
+static GOptionEntry options[] = {
+	{ "reset", 'r', 0, G_OPTION_ARG_NONE, &option_reset,
+				"Reset the statistics instead of printing" },
+	{ "histogram", 'H', 0, G_OPTION_ARG_NONE, &option_histogram,
+				"Print the histogram buckets as well" },
+	{ NULL },
+};
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	DBusConnection *conn;
+	DBusError err;
+	GSList *paths = NULL;
+	GSList *l;
+	int i;
+
+	context = g_option_context_new("[modem path...]");
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		if (error != NULL) {
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+		} else
+			fprintf(stderr, "An unknown error occurred\n");
+
+		exit(1);
+	}
+
+	g_option_context_free(context);
+
+	dbus_error_init(&err);
+
+	conn = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
+	if (conn == NULL) {
+		if (dbus_error_is_set(&err) == TRUE) {
+			fprintf(stderr, "%s\n", err.message);
+			dbus_error_free(&err);
+		} else
+			fprintf(stderr, "Can't register with system bus\n");
+
+		exit(1);
+	}
+
+	for (i = 1; i < argc; i++)
+		paths = g_slist_append(paths, g_strdup(argv[i]));
+
+	if (paths == NULL)
+		paths = get_modem_paths(conn);
+
+	if (paths == NULL) {
+		fprintf(stderr, "No modems found\n");
+		dbus_connection_unref(conn);
+		exit(1);
+	}
+
+	for (l = paths; l; l = l->next)
+		dump_modem(conn, l->data);
+
+	g_slist_foreach(paths, (GFunc) g_free, NULL);
+	g_slist_free(paths);
+
+	dbus_connection_unref(conn);
+
+	return 0;
+}
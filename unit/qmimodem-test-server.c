@@ -0,0 +1,580 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2017  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+#include "drivers/qmimodem/dms.h"
+#include "drivers/qmimodem/nas.h"
+#include "drivers/qmimodem/wds.h"
+#include "drivers/qmimodem/wms.h"
+#include "drivers/qmimodem/uim.h"
+
+#include "qmimodem-test-server.h"
+
+#define MAX_FRAME_SIZE		2048
+#define LOAD_TICK		1	/* ms */
+
+struct held_request {
+	uint8_t service;
+	uint8_t client;
+	uint16_t tid;
+	uint16_t message;
+};
+
+struct delayed_frame {
+	struct qmimodem_test_server *qs;
+	guint source;
+	size_t len;
+	unsigned char buf[0];
+};
+
+struct qmimodem_test_server {
+	int sk;
+	int device_sk;
+	guint watch;
+	GSList *script;
+	uint8_t next_client[256];
+	unsigned int latency;
+	gboolean hold;
+	GArray *held;
+	GSList *delayed;
+	struct qmimodem_test_stats stats;
+	guint load_source;
+	unsigned char *load_frame;
+	size_t load_len;
+	unsigned int load_rate;
+	unsigned int load_count;
+	unsigned int load_sent;
+	gint64 load_start;
+	QmiLoadDoneFunc load_done;
+	void *load_data;
+};
+
+static const unsigned char dms_caps_tlvs[] = {
+	QMI_DMS_RESULT_DEVICE_CAPS, 0x0c, 0x00,
+		0x00, 0xe1, 0xf5, 0x05, 0x00, 0xc2, 0xeb, 0x0b,
+		QMI_DMS_DATA_CAPA_SIMUL_CS_PS, 0x01, 0x01, 0x08,
+};
+
+static const unsigned char dms_oper_mode_tlvs[] = {
+	0x01, 0x01, 0x00, 0x00,
+};
+
+static const unsigned char nas_ss_info_tlvs[] = {
+	QMI_NAS_RESULT_SERVING_SYSTEM, 0x06, 0x00,
+		0x01, 0x01, 0x01, 0x02, 0x01, 0x08,
+};
+
+static const unsigned char nas_rssi_tlvs[] = {
+	QMI_NAS_RESULT_SIGNAL_STRENGTH, 0x02, 0x00, 0xba, 0x08,
+};
+
+static const unsigned char wds_pkt_status_tlvs[] = {
+	0x01, 0x01, 0x00, 0x01,
+};
+
+static const unsigned char wms_routes_tlvs[] = {
+	QMI_WMS_RESULT_ROUTE_LIST, 0x06, 0x00,
+		0x01, 0x00, 0x00, 0x00, QMI_WMS_STORAGE_TYPE_NV, 0x00,
+};
+
+static const unsigned char uim_card_status_tlvs[] = {
+	QMI_UIM_RESULT_CARD_STATUS, 0x0f, 0x00,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01,
+		0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+#define SCRIPT_ENTRY(s, m, t) { s, m, 0, t, sizeof(t) }
+
+/* Enough to get a modem through enable and the atom probes */
+static const struct qmimodem_test_response default_script[] = {
+	SCRIPT_ENTRY(QMI_SERVICE_DMS, QMI_DMS_GET_CAPS, dms_caps_tlvs),
+	SCRIPT_ENTRY(QMI_SERVICE_DMS, QMI_DMS_GET_OPER_MODE,
+						dms_oper_mode_tlvs),
+	SCRIPT_ENTRY(QMI_SERVICE_NAS, QMI_NAS_GET_SS_INFO, nas_ss_info_tlvs),
+	SCRIPT_ENTRY(QMI_SERVICE_NAS, QMI_NAS_GET_RSSI, nas_rssi_tlvs),
+	SCRIPT_ENTRY(QMI_SERVICE_WDS, QMI_WDS_GET_PKT_STATUS,
+						wds_pkt_status_tlvs),
+	SCRIPT_ENTRY(QMI_SERVICE_WMS, QMI_WMS_GET_ROUTES, wms_routes_tlvs),
+	SCRIPT_ENTRY(QMI_SERVICE_UIM, QMI_UIM_GET_CARD_STATUS,
+						uim_card_status_tlvs),
+};
+
+static size_t put_frame(unsigned char *buf, uint8_t service, uint8_t client,
+				const unsigned char *hdr, size_t hdr_len,
+				uint16_t message,
+				const unsigned char *tlvs, uint16_t tlv_len)
+{
+	size_t len = 6 + hdr_len + 4 + tlv_len;
+
+	g_assert(len <= MAX_FRAME_SIZE);
+
+	buf[0] = 0x01;
+	buf[1] = (len - 1) & 0xff;
+	buf[2] = (len - 1) >> 8;
+	buf[3] = 0x80;
+	buf[4] = service;
+	buf[5] = client;
+
+	memcpy(buf + 6, hdr, hdr_len);
+
+	buf[6 + hdr_len] = message & 0xff;
+	buf[7 + hdr_len] = message >> 8;
+	buf[8 + hdr_len] = tlv_len & 0xff;
+	buf[9 + hdr_len] = tlv_len >> 8;
+
+	memcpy(buf + 10 + hdr_len, tlvs, tlv_len);
+
+	return len;
+}
+
+static size_t put_indication(unsigned char *buf, uint8_t service,
+				uint8_t client, uint16_t message,
+				const unsigned char *tlvs, uint16_t tlv_len)
+{
+	static const unsigned char hdr[] = { 0x04, 0x00, 0x00 };
+
+	return put_frame(buf, service, client, hdr, sizeof(hdr),
+						message, tlvs, tlv_len);
+}
+
+static gboolean send_delayed(gpointer user_data)
+{
+	struct delayed_frame *frame = user_data;
+	struct qmimodem_test_server *qs = frame->qs;
+
+	g_assert(write(qs->sk, frame->buf, frame->len) ==
+						(ssize_t) frame->len);
+
+	qs->delayed = g_slist_remove(qs->delayed, frame);
+	g_free(frame);
+
+	return FALSE;
+}
+
+static void server_send(struct qmimodem_test_server *qs,
+				const unsigned char *buf, size_t len)
+{
+	struct delayed_frame *frame;
+
+	if (!qs->latency) {
+		g_assert(write(qs->sk, buf, len) == (ssize_t) len);
+		return;
+	}
+
+	frame = g_malloc(sizeof(*frame) + len);
+	frame->qs = qs;
+	frame->len = len;
+	memcpy(frame->buf, buf, len);
+
+	frame->source = g_timeout_add(qs->latency, send_delayed, frame);
+	qs->delayed = g_slist_prepend(qs->delayed, frame);
+}
+
+static void control_respond(struct qmimodem_test_server *qs,
+					const unsigned char *req)
+{
+	static const unsigned char version_tlvs[] = {
+		0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x01, 0x29, 0x00, 0x08,
+			QMI_SERVICE_CONTROL, 0x01, 0x00, 0x05, 0x00,
+			QMI_SERVICE_WDS, 0x01, 0x00, 0x0c, 0x00,
+			QMI_SERVICE_DMS, 0x01, 0x00, 0x07, 0x00,
+			QMI_SERVICE_NAS, 0x01, 0x00, 0x19, 0x00,
+			QMI_SERVICE_WMS, 0x01, 0x00, 0x04, 0x00,
+			QMI_SERVICE_PDS, 0x01, 0x00, 0x0a, 0x00,
+			QMI_SERVICE_UIM, 0x01, 0x00, 0x03, 0x00,
+			QMI_SERVICE_VOICE, 0x02, 0x00, 0x01, 0x00,
+	};
+	unsigned char client_tlvs[] = {
+		0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x01, 0x02, 0x00, 0x00, 0x00,
+	};
+	uint16_t message = req[8] | (req[9] << 8);
+	unsigned char hdr[] = { 0x01, req[7] };
+	unsigned char buf[128];
+	const unsigned char *tlvs;
+	uint16_t tlv_len;
+	size_t len;
+	uint8_t type;
+
+	switch (message) {
+	case QMI_CTL_GET_VERSION_INFO:
+		qs->stats.version_requests += 1;
+		tlvs = version_tlvs;
+		tlv_len = sizeof(version_tlvs);
+		break;
+	case QMI_CTL_GET_CLIENT_ID:
+		type = req[15];
+		client_tlvs[10] = type;
+		client_tlvs[11] = ++qs->next_client[type];
+		qs->stats.allocated += 1;
+		tlvs = client_tlvs;
+		tlv_len = sizeof(client_tlvs);
+		break;
+	case QMI_CTL_RELEASE_CLIENT_ID:
+		client_tlvs[10] = req[15];
+		client_tlvs[11] = req[16];
+		qs->stats.released += 1;
+		tlvs = client_tlvs;
+		tlv_len = sizeof(client_tlvs);
+		break;
+	default:
+		g_assert_not_reached();
+	}
+
+	len = put_frame(buf, QMI_SERVICE_CONTROL, 0x00, hdr, sizeof(hdr),
+						message, tlvs, tlv_len);
+
+	server_send(qs, buf, len);
+}
+
+static const struct qmimodem_test_response *script_lookup(
+					struct qmimodem_test_server *qs,
+					uint8_t service, uint16_t message)
+{
+	GSList *l;
+
+	for (l = qs->script; l; l = l->next) {
+		const struct qmimodem_test_response *rsp = l->data;
+
+		if (rsp->service == service && rsp->message == message)
+			return rsp;
+	}
+
+	return NULL;
+}
+
+static void service_respond(struct qmimodem_test_server *qs,
+					const struct held_request *req)
+{
+	const struct qmimodem_test_response *rsp;
+	unsigned char hdr[] = { 0x02, req->tid & 0xff, req->tid >> 8 };
+	unsigned char tlvs[MAX_FRAME_SIZE];
+	unsigned char buf[MAX_FRAME_SIZE];
+	uint16_t error = 0;
+	uint16_t tlv_len = 7;
+	size_t len;
+
+	qs->stats.outstanding -= 1;
+
+	/* Anything not scripted succeeds without further TLVs */
+	rsp = script_lookup(qs, req->service, req->message);
+	if (rsp) {
+		error = rsp->error;
+
+		g_assert(rsp->tlv_len <= sizeof(tlvs) - tlv_len);
+		memcpy(tlvs + tlv_len, rsp->tlvs, rsp->tlv_len);
+		tlv_len += rsp->tlv_len;
+	}
+
+	tlvs[0] = 0x02;
+	tlvs[1] = 0x04;
+	tlvs[2] = 0x00;
+	tlvs[3] = error ? 0x01 : 0x00;
+	tlvs[4] = 0x00;
+	tlvs[5] = error & 0xff;
+	tlvs[6] = error >> 8;
+
+	len = put_frame(buf, req->service, req->client, hdr, sizeof(hdr),
+					req->message, tlvs, tlv_len);
+
+	server_send(qs, buf, len);
+}
+
+static gboolean server_read(GIOChannel *io, GIOCondition cond, gpointer data)
+{
+	struct qmimodem_test_server *qs = data;
+	struct held_request req;
+	unsigned char buf[MAX_FRAME_SIZE];
+	ssize_t len;
+
+	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) {
+		qs->watch = 0;
+		return FALSE;
+	}
+
+	len = read(qs->sk, buf, sizeof(buf));
+	if (len < 0 && errno == EAGAIN)
+		return TRUE;
+
+	g_assert(len >= 12);
+	g_assert(buf[0] == 0x01 && buf[3] == 0x00);
+
+	if (buf[4] == QMI_SERVICE_CONTROL) {
+		control_respond(qs, buf);
+		return TRUE;
+	}
+
+	req.service = buf[4];
+	req.client = buf[5];
+	req.tid = buf[7] | (buf[8] << 8);
+	req.message = buf[9] | (buf[10] << 8);
+
+	qs->stats.requests += 1;
+	qs->stats.outstanding += 1;
+
+	if (qs->stats.outstanding > qs->stats.max_outstanding)
+		qs->stats.max_outstanding = qs->stats.outstanding;
+
+	if (qs->hold)
+		g_array_append_val(qs->held, req);
+	else
+		service_respond(qs, &req);
+
+	return TRUE;
+}
+
+struct qmimodem_test_server *qmimodem_test_server_create(void)
+{
+	struct qmimodem_test_server *qs;
+	GIOChannel *io;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+		return NULL;
+
+	qs = g_new0(struct qmimodem_test_server, 1);
+	qs->sk = sv[1];
+	qs->device_sk = sv[0];
+	qs->held = g_array_new(FALSE, FALSE, sizeof(struct held_request));
+
+	/* Load mode must not block when the device falls behind */
+	fcntl(qs->sk, F_SETFL, fcntl(qs->sk, F_GETFL) | O_NONBLOCK);
+
+	io = g_io_channel_unix_new(qs->sk);
+	qs->watch = g_io_add_watch(io, G_IO_IN | G_IO_HUP | G_IO_ERR,
+							server_read, qs);
+	g_io_channel_unref(io);
+
+	qmimodem_test_server_add_script(qs, default_script,
+					G_N_ELEMENTS(default_script));
+
+	return qs;
+}
+
+void qmimodem_test_server_close(struct qmimodem_test_server *qs)
+{
+	GSList *l;
+
+	qmimodem_test_server_stop_load(qs);
+
+	for (l = qs->delayed; l; l = l->next) {
+		struct delayed_frame *frame = l->data;
+
+		g_source_remove(frame->source);
+		g_free(frame);
+	}
+
+	g_slist_free(qs->delayed);
+	g_slist_free(qs->script);
+	g_array_free(qs->held, TRUE);
+
+	if (qs->watch > 0)
+		g_source_remove(qs->watch);
+
+	close(qs->sk);
+	g_free(qs);
+}
+
+int qmimodem_test_server_get_fd(struct qmimodem_test_server *qs)
+{
+	return qs->device_sk;
+}
+
+void qmimodem_test_server_add_script(struct qmimodem_test_server *qs,
+				const struct qmimodem_test_response *script,
+				unsigned int count)
+{
+	unsigned int i;
+
+	/* Later entries take precedence over earlier ones */
+	for (i = 0; i < count; i++)
+		qs->script = g_slist_prepend(qs->script, (gpointer) &script[i]);
+}
+
+void qmimodem_test_server_set_latency(struct qmimodem_test_server *qs,
+						unsigned int latency)
+{
+	qs->latency = latency;
+}
+
+void qmimodem_test_server_set_hold(struct qmimodem_test_server *qs,
+							gboolean hold)
+{
+	qs->hold = hold;
+}
+
+unsigned int qmimodem_test_server_get_held(struct qmimodem_test_server *qs)
+{
+	return qs->held->len;
+}
+
+void qmimodem_test_server_release_held(struct qmimodem_test_server *qs)
+{
+	unsigned int i;
+
+	for (i = 0; i < qs->held->len; i++)
+		service_respond(qs, &g_array_index(qs->held,
+						struct held_request, i));
+
+	g_array_set_size(qs->held, 0);
+}
+
+const struct qmimodem_test_stats *qmimodem_test_server_get_stats(
+					struct qmimodem_test_server *qs)
+{
+	return &qs->stats;
+}
+
+void qmimodem_test_server_indicate(struct qmimodem_test_server *qs,
+					uint8_t service, uint8_t client,
+					uint16_t message,
+					const unsigned char *tlvs,
+					uint16_t tlv_len)
+{
+	qmimodem_test_server_indicate_batch(qs, service, client, message,
+							tlvs, tlv_len, 1);
+}
+
+unsigned int qmimodem_test_server_indicate_batch(
+					struct qmimodem_test_server *qs,
+					uint8_t service, uint8_t client,
+					uint16_t message,
+					const unsigned char *tlvs,
+					uint16_t tlv_len, unsigned int count)
+{
+	unsigned char buf[MAX_FRAME_SIZE];
+	size_t frame_len = 13 + tlv_len;
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < count && len + frame_len <= sizeof(buf); i++)
+		len += put_indication(buf + len, service, client, message,
+							tlvs, tlv_len);
+
+	g_assert(i > 0);
+	g_assert(write(qs->sk, buf, len) == (ssize_t) len);
+
+	qs->stats.indications += i;
+
+	return i;
+}
+
+static gboolean load_tick(gpointer user_data)
+{
+	struct qmimodem_test_server *qs = user_data;
+	gint64 now = g_get_monotonic_time();
+	guint64 due;
+	uint64_t stamp;
+
+	due = (guint64) (now - qs->load_start) * qs->load_rate / 1000000;
+	if (due > qs->load_count)
+		due = qs->load_count;
+
+	while (qs->load_sent < due) {
+		stamp = GUINT64_TO_LE(g_get_monotonic_time());
+		memcpy(qs->load_frame + qs->load_len - 8, &stamp, 8);
+
+		if (write(qs->sk, qs->load_frame, qs->load_len) < 0) {
+			g_assert(errno == EAGAIN);
+
+			/* Socket full, the device will catch up next tick */
+			qs->stats.load_deferred += 1;
+			break;
+		}
+
+		qs->load_sent += 1;
+		qs->stats.indications += 1;
+	}
+
+	if (qs->load_sent < qs->load_count)
+		return TRUE;
+
+	qs->load_source = 0;
+
+	g_free(qs->load_frame);
+	qs->load_frame = NULL;
+
+	if (qs->load_done)
+		qs->load_done(qs->load_data);
+
+	return FALSE;
+}
+
+void qmimodem_test_server_start_load(struct qmimodem_test_server *qs,
+					uint8_t service, uint8_t client,
+					uint16_t message,
+					const unsigned char *tlvs,
+					uint16_t tlv_len,
+					unsigned int rate, unsigned int count,
+					QmiLoadDoneFunc done, void *data)
+{
+	unsigned char stamped[MAX_FRAME_SIZE];
+
+	g_assert(rate > 0);
+	g_assert(tlv_len + 11 <= sizeof(stamped));
+
+	qmimodem_test_server_stop_load(qs);
+
+	memcpy(stamped, tlvs, tlv_len);
+	stamped[tlv_len] = QMIMODEM_TEST_TLV_TIMESTAMP;
+	stamped[tlv_len + 1] = 0x08;
+	stamped[tlv_len + 2] = 0x00;
+	memset(stamped + tlv_len + 3, 0, 8);
+
+	qs->load_frame = g_malloc(MAX_FRAME_SIZE);
+	qs->load_len = put_indication(qs->load_frame, service, client,
+					message, stamped, tlv_len + 11);
+	qs->load_rate = rate;
+	qs->load_count = count;
+	qs->load_sent = 0;
+	qs->load_done = done;
+	qs->load_data = data;
+	qs->load_start = g_get_monotonic_time();
+
+	qs->load_source = g_timeout_add(LOAD_TICK, load_tick, qs);
+}
+
+void qmimodem_test_server_stop_load(struct qmimodem_test_server *qs)
+{
+	if (qs->load_source == 0)
+		return;
+
+	g_source_remove(qs->load_source);
+	qs->load_source = 0;
+
+	g_free(qs->load_frame);
+	qs->load_frame = NULL;
+}
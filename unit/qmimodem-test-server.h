@@ -0,0 +1,109 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2017  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * A simulated QMI modem on the far end of a socketpair.  The control
+ * service is built in (version list, client allocation and release),
+ * everything else is answered from a script of canned responses.  A
+ * default script covering the DMS, NAS, WDS, WMS and UIM queries done
+ * while enabling a modem is always loaded.
+ */
+
+struct qmimodem_test_server;
+
+struct qmimodem_test_response {
+	uint8_t service;
+	uint16_t message;
+	uint16_t error;			/* QMI error, 0 for success */
+	const unsigned char *tlvs;	/* without the result code TLV */
+	uint16_t tlv_len;
+};
+
+struct qmimodem_test_stats {
+	unsigned int version_requests;
+	unsigned int allocated;
+	unsigned int released;
+	unsigned int requests;
+	unsigned int outstanding;
+	unsigned int max_outstanding;
+	unsigned int indications;
+	unsigned int load_deferred;
+};
+
+/*
+ * Indications sent in load mode carry this TLV with the monotonic time
+ * in microseconds at which they were written, as a uint64.
+ */
+#define QMIMODEM_TEST_TLV_TIMESTAMP	0xfe
+
+typedef void (*QmiLoadDoneFunc)(void *data);
+
+struct qmimodem_test_server *qmimodem_test_server_create(void);
+void qmimodem_test_server_close(struct qmimodem_test_server *qs);
+
+/* The modem end for qmi_device_new(), owned by the caller */
+int qmimodem_test_server_get_fd(struct qmimodem_test_server *qs);
+
+void qmimodem_test_server_add_script(struct qmimodem_test_server *qs,
+				const struct qmimodem_test_response *script,
+				unsigned int count);
+
+/* Delay every answer by this many milliseconds */
+void qmimodem_test_server_set_latency(struct qmimodem_test_server *qs,
+						unsigned int latency);
+
+/* Keep service requests unanswered until released */
+void qmimodem_test_server_set_hold(struct qmimodem_test_server *qs,
+							gboolean hold);
+unsigned int qmimodem_test_server_get_held(struct qmimodem_test_server *qs);
+void qmimodem_test_server_release_held(struct qmimodem_test_server *qs);
+
+const struct qmimodem_test_stats *qmimodem_test_server_get_stats(
+					struct qmimodem_test_server *qs);
+
+/* Client 0xff broadcasts to all clients of the service */
+void qmimodem_test_server_indicate(struct qmimodem_test_server *qs,
+					uint8_t service, uint8_t client,
+					uint16_t message,
+					const unsigned char *tlvs,
+					uint16_t tlv_len);
+
+/* As many copies as fit into one datagram, returns how many were sent */
+unsigned int qmimodem_test_server_indicate_batch(
+					struct qmimodem_test_server *qs,
+					uint8_t service, uint8_t client,
+					uint16_t message,
+					const unsigned char *tlvs,
+					uint16_t tlv_len, unsigned int count);
+
+/*
+ * Load mode: send count indications at rate per second, then call
+ * done.  Indications that do not fit into the socket are deferred to
+ * the next tick and counted in load_deferred.
+ */
+void qmimodem_test_server_start_load(struct qmimodem_test_server *qs,
+					uint8_t service, uint8_t client,
+					uint16_t message,
+					const unsigned char *tlvs,
+					uint16_t tlv_len,
+					unsigned int rate, unsigned int count,
+					QmiLoadDoneFunc done, void *data);
+void qmimodem_test_server_stop_load(struct qmimodem_test_server *qs);
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -46,6 +47,11 @@ struct server_data {
 	char *sock_name;
 	const struct rilmodem_test_data *rtd;
 	void *user_data;
+	const unsigned char *split_buf;
+	size_t split_len;
+	unsigned int split_count;
+	unsigned int split_n;
+	gboolean split_second_half;
 };
 
 /* Warning: length is stored in network order */
@@ -196,6 +202,9 @@ struct server_data *rilmodem_test_server_create(ConnectFunc connect,
 	retval = bind(sd->server_sk, (struct sockaddr *) &addr, sizeof(addr));
 	g_assert(retval >= 0);
 
+	/* GRil connects with the radio user's credentials */
+	chmod(addr.sun_path, 0777);
+
 	retval = listen(sd->server_sk, 0);
 	g_assert(retval >= 0);
 
@@ -235,3 +244,44 @@ const char *rilmodem_test_get_socket_name(struct server_data *sd)
 {
 	return sd->sock_name;
 }
+
+/*
+ * Each record is sent in two writes, split after 1 to len - 1 bytes in
+ * turn.  The halves go out from separate idle callbacks, so the client
+ * reads and has to frame every partial record before the rest arrives.
+ */
+static gboolean write_split_record(gpointer data)
+{
+	struct server_data *sd = data;
+	size_t split = sd->split_n % (sd->split_len - 1) + 1;
+
+	if (sd->split_second_half == FALSE) {
+		rilmodem_test_server_write(sd, sd->split_buf, split);
+		sd->split_second_half = TRUE;
+		return TRUE;
+	}
+
+	rilmodem_test_server_write(sd, sd->split_buf + split,
+						sd->split_len - split);
+	sd->split_second_half = FALSE;
+
+	sd->split_n += 1;
+
+	return sd->split_n < sd->split_count;
+}
+
+void rilmodem_test_server_write_split(struct server_data *sd,
+						const unsigned char *buf,
+						const size_t buf_len,
+						unsigned int count)
+{
+	g_assert(buf_len > 1);
+
+	sd->split_buf = buf;
+	sd->split_len = buf_len;
+	sd->split_count = count;
+	sd->split_n = 0;
+	sd->split_second_half = FALSE;
+
+	g_idle_add(write_split_record, sd);
+}
@@ -44,4 +44,9 @@ void rilmodem_test_server_write(struct server_data *sd,
 						const unsigned char *buf,
 						const size_t buf_len);
 
+void rilmodem_test_server_write_split(struct server_data *sd,
+						const unsigned char *buf,
+						const size_t buf_len,
+						unsigned int count);
+
 const char *rilmodem_test_get_socket_name(struct server_data *sd);
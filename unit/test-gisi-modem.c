@@ -0,0 +1,592 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2017  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gisi/phonet.h"
+#include "gisi/message.h"
+#include "gisi/modem.h"
+#include "gisi/socket.h"
+
+/*
+ * GIsiModem runs on top of a fake Phonet layer: both of its sockets
+ * are one end of a local socketpair and the first byte of every
+ * datagram written to the other end is the resource it comes from.
+ * The clock the timer wheel reads can be moved forward and the once a
+ * second tick comes every TICK_MS instead.
+ */
+#define TEST_MTU	256
+#define TICK_MS		10
+#define RESOURCE	0x42
+
+struct _GIsiPhonetBatch {
+	unsigned int count;
+	struct sockaddr_pn addr[GISI_PHONET_BATCH_MAX];
+	size_t len[GISI_PHONET_BATCH_MAX];
+	uint8_t buf[GISI_PHONET_BATCH_MAX][TEST_MTU];
+};
+
+static int peers[2];
+static unsigned int channels;
+static gint64 clock_offset;
+
+GIOChannel *g_isi_phonet_new(unsigned int ifindex)
+{
+	GIOChannel *io;
+	int sv[2];
+
+	/* GIsiModem opens the indication socket first */
+	g_assert(channels < G_N_ELEMENTS(peers));
+	g_assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+	g_assert(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0);
+
+	peers[channels++] = sv[1];
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+
+	return io;
+}
+
+size_t g_isi_phonet_mtu(GIOChannel *io, unsigned int ifindex)
+{
+	return TEST_MTU;
+}
+
+GIsiPhonetBatch *g_isi_phonet_batch_new(size_t mtu)
+{
+	g_assert(mtu == TEST_MTU);
+
+	return g_try_new0(GIsiPhonetBatch, 1);
+}
+
+void g_isi_phonet_batch_free(GIsiPhonetBatch *batch)
+{
+	g_free(batch);
+}
+
+int g_isi_phonet_batch_read(GIOChannel *io, GIsiPhonetBatch *batch)
+{
+	int fd = g_io_channel_unix_get_fd(io);
+	unsigned int i;
+
+	for (i = 0; i < GISI_PHONET_BATCH_MAX; i++) {
+		ssize_t ret = recv(fd, batch->buf[i], TEST_MTU, 0);
+
+		if (ret < 1)
+			break;
+
+		memset(&batch->addr[i], 0, sizeof(batch->addr[i]));
+		batch->addr[i].spn_family = AF_PHONET;
+		batch->addr[i].spn_resource = batch->buf[i][0];
+		batch->len[i] = ret - 1;
+	}
+
+	batch->count = i;
+
+	return i > 0 ? (int) i : -1;
+}
+
+const void *g_isi_phonet_batch_get(GIsiPhonetBatch *batch, unsigned int i,
+					size_t *len, struct sockaddr_pn **addr)
+{
+	g_assert(i < batch->count);
+
+	*len = batch->len[i];
+	*addr = &batch->addr[i];
+
+	return batch->buf[i] + 1;
+}
+
+/* Requests go nowhere, the tests answer them by hand */
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+	ssize_t len = 0;
+	size_t i;
+
+	for (i = 0; i < msg->msg_iovlen; i++)
+		len += msg->msg_iov[i].iov_len;
+
+	return len;
+}
+
+gint64 g_get_monotonic_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000 +
+								clock_offset;
+}
+
+guint g_timeout_add_seconds(guint interval, GSourceFunc function,
+				gpointer data)
+{
+	return g_timeout_add(interval * TICK_MS, function, data);
+}
+
+/* Moves the clock to the given number of ms past a whole second */
+static void clock_align(unsigned int ms)
+{
+	gint64 now = g_get_monotonic_time();
+
+	clock_offset += G_USEC_PER_SEC - now % G_USEC_PER_SEC + ms * 1000;
+}
+
+static void clock_advance(unsigned int ms)
+{
+	clock_offset += (gint64) ms * 1000;
+}
+
+static gboolean quit_loop(gpointer user_data)
+{
+	g_main_loop_quit(user_data);
+
+	return FALSE;
+}
+
+/* Long enough for several ticks and for any queued message */
+static void run_for(unsigned int ms)
+{
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+
+	g_timeout_add(ms, quit_loop, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+}
+
+static void send_message(int sk, uint8_t utid, uint8_t msgid)
+{
+	uint8_t buf[] = { RESOURCE, utid, msgid, 0x00 };
+
+	g_assert(write(sk, buf, sizeof(buf)) == sizeof(buf));
+}
+
+#define send_ind(utid, msgid)	send_message(peers[0], utid, msgid)
+#define send_resp(utid, msgid)	send_message(peers[1], utid, msgid)
+
+struct modem_test {
+	GIsiModem *modem;
+	GIsiPending *pending[8];
+	unsigned int notified[8];
+	unsigned int order[8];
+	unsigned int count;
+	unsigned int destroyed;
+};
+
+static void modem_test_setup(struct modem_test *mt)
+{
+	memset(mt, 0, sizeof(*mt));
+	channels = 0;
+
+	mt->modem = g_isi_modem_create(1);
+	g_assert(mt->modem != NULL);
+	g_assert(channels == 2);
+}
+
+static void modem_test_teardown(struct modem_test *mt)
+{
+	g_isi_modem_destroy(mt->modem);
+	run_for(TICK_MS);
+
+	close(peers[0]);
+	close(peers[1]);
+}
+
+struct notify_data {
+	struct modem_test *mt;
+	unsigned int index;
+};
+
+static struct notify_data *notify_data_new(struct modem_test *mt,
+						unsigned int index)
+{
+	struct notify_data *nd = g_new0(struct notify_data, 1);
+
+	nd->mt = mt;
+	nd->index = index;
+
+	return nd;
+}
+
+static void notify_data_free(gpointer user_data)
+{
+	struct notify_data *nd = user_data;
+
+	nd->mt->destroyed++;
+	g_free(nd);
+}
+
+static void record_cb(const GIsiMessage *msg, void *user_data)
+{
+	struct notify_data *nd = user_data;
+	struct modem_test *mt = nd->mt;
+
+	mt->notified[nd->index]++;
+
+	if (mt->count < G_N_ELEMENTS(mt->order))
+		mt->order[mt->count] = nd->index;
+
+	mt->count++;
+}
+
+static GIsiPending *subscribe(struct modem_test *mt, unsigned int index,
+				uint8_t msgid, GIsiNotifyFunc notify)
+{
+	GIsiPending *ind;
+
+	ind = g_isi_ind_subscribe(mt->modem, RESOURCE, msgid, notify,
+					notify_data_new(mt, index),
+					notify_data_free);
+	g_assert(ind != NULL);
+
+	mt->pending[index] = ind;
+	return ind;
+}
+
+static GIsiPending *request(struct modem_test *mt, unsigned int index,
+				unsigned int timeout, GIsiNotifyFunc notify)
+{
+	uint8_t msgid = 0x01;
+	GIsiPending *resp;
+
+	resp = g_isi_request_send(mt->modem, RESOURCE, &msgid, 1, timeout,
+					notify, notify_data_new(mt, index),
+					notify_data_free);
+	g_assert(resp != NULL);
+
+	mt->pending[index] = resp;
+	return resp;
+}
+
+static void timeout_cb(const GIsiMessage *msg, void *user_data)
+{
+	g_assert(g_isi_msg_error(msg) == -ETIMEDOUT);
+
+	record_cb(msg, user_data);
+}
+
+/*
+ * A RESP is matched on the transaction ID and an IND on the message
+ * ID, so an indication carrying both must not complete the request.
+ */
+static void test_resp_and_ind(void)
+{
+	struct modem_test mt;
+	uint8_t utid;
+
+	modem_test_setup(&mt);
+
+	subscribe(&mt, 0, 0x10, record_cb);
+	utid = g_isi_request_utid(request(&mt, 1, 0, record_cb));
+
+	send_ind(utid, 0x10);
+	run_for(TICK_MS);
+
+	g_assert(mt.notified[0] == 1);
+	g_assert(mt.notified[1] == 0);
+
+	send_resp(utid, 0x10);
+	run_for(TICK_MS);
+
+	g_assert(mt.notified[0] == 1);
+	g_assert(mt.notified[1] == 1);
+	g_assert(mt.destroyed == 1);
+
+	modem_test_teardown(&mt);
+	g_assert(mt.destroyed == 2);
+}
+
+/* Drops itself and the next subscription, then the one after it */
+static void unsubscribe_cb(const GIsiMessage *msg, void *user_data)
+{
+	struct notify_data *nd = user_data;
+	struct modem_test *mt = nd->mt;
+	unsigned int index = nd->index;
+
+	record_cb(msg, user_data);
+
+	if (index == 0) {
+		g_isi_pending_remove(mt->pending[1]);
+		g_isi_pending_remove(mt->pending[0]);
+		return;
+	}
+
+	g_isi_pending_remove(mt->pending[index]);
+}
+
+static void test_unsubscribe_in_dispatch(void)
+{
+	struct modem_test mt;
+
+	modem_test_setup(&mt);
+
+	subscribe(&mt, 0, 0x10, unsubscribe_cb);
+	subscribe(&mt, 1, 0x10, record_cb);
+	subscribe(&mt, 2, 0x10, unsubscribe_cb);
+	subscribe(&mt, 3, 0x11, record_cb);
+
+	send_ind(0, 0x10);
+	run_for(TICK_MS);
+
+	g_assert(mt.count == 2);
+	g_assert(mt.order[0] == 0);
+	g_assert(mt.order[1] == 2);
+	g_assert(mt.destroyed == 3);
+
+	/* Every subscription to the message ID is gone now */
+	send_ind(0, 0x10);
+	send_ind(0, 0x11);
+	run_for(TICK_MS);
+
+	g_assert(mt.count == 3);
+	g_assert(mt.order[2] == 3);
+
+	modem_test_teardown(&mt);
+	g_assert(mt.destroyed == 4);
+}
+
+/* Both land in the same slot of the wheel, a turn apart */
+static void test_long_timeout(void)
+{
+	struct modem_test mt;
+
+	modem_test_setup(&mt);
+	clock_align(200);
+
+	request(&mt, 0, 100, timeout_cb);
+	request(&mt, 1, 36, timeout_cb);
+
+	clock_advance(37000);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 1);
+	g_assert(mt.order[0] == 1);
+
+	clock_advance(62500);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 1);
+
+	clock_advance(1500);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 2);
+	g_assert(mt.order[1] == 0);
+	g_assert(mt.destroyed == 2);
+
+	modem_test_teardown(&mt);
+}
+
+/* Armed late in a second, a timeout must still last its full length */
+static void test_no_early_timeout(void)
+{
+	struct modem_test mt;
+
+	modem_test_setup(&mt);
+	clock_align(800);
+
+	request(&mt, 0, 3, timeout_cb);
+	request(&mt, 1, 2, timeout_cb);
+
+	clock_advance(2900);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 1);
+	g_assert(mt.order[0] == 1);
+
+	clock_advance(400);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 2);
+	g_assert(mt.order[1] == 0);
+
+	modem_test_teardown(&mt);
+}
+
+/* A tick missed by less and by more than a turn of the wheel */
+static void test_missed_ticks(gconstpointer data)
+{
+	unsigned int missed = GPOINTER_TO_UINT(data);
+	struct modem_test mt;
+
+	modem_test_setup(&mt);
+	clock_align(200);
+
+	request(&mt, 2, 9, timeout_cb);
+	request(&mt, 0, 2, timeout_cb);
+	request(&mt, 3, 200, timeout_cb);
+	request(&mt, 1, 5, timeout_cb);
+
+	clock_advance(missed * 1000);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 3);
+	g_assert(mt.order[0] == 0);
+	g_assert(mt.order[1] == 1);
+	g_assert(mt.order[2] == 2);
+	g_assert(mt.destroyed == 3);
+
+	modem_test_teardown(&mt);
+	g_assert(mt.count == 3);
+	g_assert(mt.destroyed == 4);
+}
+
+static void destroy_cb(const GIsiMessage *msg, void *user_data)
+{
+	struct notify_data *nd = user_data;
+
+	timeout_cb(msg, user_data);
+	g_isi_modem_destroy(nd->mt->modem);
+}
+
+static void test_destroy_in_timeout(void)
+{
+	struct modem_test mt;
+
+	modem_test_setup(&mt);
+	clock_align(200);
+
+	subscribe(&mt, 0, 0x10, record_cb);
+	request(&mt, 1, 1, destroy_cb);
+	request(&mt, 2, 1, destroy_cb);
+	request(&mt, 3, 5, timeout_cb);
+
+	clock_advance(3000);
+	run_for(5 * TICK_MS);
+
+	/* The first to expire took everything else down with it */
+	g_assert(mt.count == 1);
+	g_assert(mt.destroyed == 4);
+
+	clock_advance(5000);
+	run_for(5 * TICK_MS);
+
+	g_assert(mt.count == 1);
+
+	close(peers[0]);
+	close(peers[1]);
+}
+
+/*
+ * Indications to a service with a subscription for every message ID
+ * and a full set of requests in flight, in bursts the size of one
+ * batched read.
+ */
+#define BENCH_ROUNDS		20000
+#define BENCH_IN_FLIGHT		200
+
+static void count_cb(const GIsiMessage *msg, void *user_data)
+{
+	unsigned int *count = user_data;
+
+	*count += 1;
+}
+
+static void test_dispatch_benchmark(void)
+{
+	struct modem_test mt;
+	unsigned int received = 0;
+	unsigned int i, j;
+	uint8_t msgid = 0x01;
+	GTimer *timer;
+	double elapsed;
+
+	modem_test_setup(&mt);
+
+	for (i = 0; i < 256; i++)
+		g_assert(g_isi_ind_subscribe(mt.modem, RESOURCE, i, count_cb,
+						&received, NULL) != NULL);
+
+	for (i = 0; i < BENCH_IN_FLIGHT; i++)
+		g_assert(g_isi_request_send(mt.modem, RESOURCE, &msgid, 1,
+						0, NULL, NULL, NULL) != NULL);
+
+	run_for(TICK_MS);
+
+	timer = g_timer_new();
+	g_timer_stop(timer);
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		for (j = 0; j < GISI_PHONET_BATCH_MAX; j++)
+			send_ind(0, i + j);
+
+		g_timer_continue(timer);
+
+		while (g_main_context_iteration(NULL, FALSE))
+			;
+
+		g_timer_stop(timer);
+	}
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_assert(received == BENCH_ROUNDS * GISI_PHONET_BATCH_MAX);
+
+	g_test_minimized_result(elapsed, "%u messages in %f s",
+						received, elapsed);
+
+	modem_test_teardown(&mt);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgisimodem/RESP and IND sharing a message ID",
+					test_resp_and_ind);
+	g_test_add_func("/testgisimodem/Unsubscribe during dispatch",
+					test_unsubscribe_in_dispatch);
+	g_test_add_func("/testgisimodem/Timeout longer than the wheel",
+					test_long_timeout);
+	g_test_add_func("/testgisimodem/No early timeout",
+					test_no_early_timeout);
+	g_test_add_data_func("/testgisimodem/Missed tick",
+					GUINT_TO_POINTER(10),
+					test_missed_ticks);
+	g_test_add_data_func("/testgisimodem/Missed turn of the wheel",
+					GUINT_TO_POINTER(70),
+					test_missed_ticks);
+	g_test_add_func("/testgisimodem/Destroy in timeout",
+					test_destroy_in_timeout);
+
+	if (g_test_perf())
+		g_test_add_func("/testgisimodem/Dispatch Benchmark",
+					test_dispatch_benchmark);
+
+	return g_test_run();
+}
@@ -0,0 +1,266 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2017  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gisi/phonet.h"
+#include "gisi/socket.h"
+
+/*
+ * The batch reader only relies on datagram semantics, so a local
+ * socketpair stands in for the Phonet socket.
+ */
+struct socket_test {
+	int sk;
+	GIOChannel *io;
+};
+
+static void socket_test_setup(struct socket_test *st)
+{
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == 0);
+
+	st->sk = sv[1];
+	st->io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(st->io, TRUE);
+}
+
+static void socket_test_teardown(struct socket_test *st)
+{
+	g_io_channel_unref(st->io);
+	close(st->sk);
+}
+
+static void send_message(struct socket_test *st, uint8_t seq, size_t len)
+{
+	uint8_t buf[512];
+
+	g_assert(len <= sizeof(buf));
+
+	memset(buf, seq, len);
+	g_assert(write(st->sk, buf, len) == (ssize_t) len);
+}
+
+static void check_message(GIsiPhonetBatch *batch, unsigned int i,
+					uint8_t seq, size_t expected)
+{
+	struct sockaddr_pn *addr;
+	const uint8_t *data;
+	size_t len;
+	size_t j;
+
+	data = g_isi_phonet_batch_get(batch, i, &len, &addr);
+	g_assert(data != NULL);
+	g_assert(addr != NULL);
+	g_assert(len == expected);
+
+	for (j = 0; j < len; j++)
+		g_assert(data[j] == seq);
+}
+
+#define BATCH_MTU	256
+#define BATCH_MESSAGES	(GISI_PHONET_BATCH_MAX + 4)
+
+static void test_batch_read(void)
+{
+	struct socket_test st;
+	GIsiPhonetBatch *batch;
+	unsigned int i;
+
+	socket_test_setup(&st);
+
+	batch = g_isi_phonet_batch_new(BATCH_MTU);
+	g_assert(batch != NULL);
+
+	for (i = 0; i < BATCH_MESSAGES; i++)
+		send_message(&st, i, 2 + i * 7);
+
+	/* One full batch, then the remainder into the same slots */
+	g_assert(g_isi_phonet_batch_read(st.io, batch) ==
+						GISI_PHONET_BATCH_MAX);
+
+	for (i = 0; i < GISI_PHONET_BATCH_MAX; i++)
+		check_message(batch, i, i, 2 + i * 7);
+
+	g_assert(g_isi_phonet_batch_read(st.io, batch) ==
+				BATCH_MESSAGES - GISI_PHONET_BATCH_MAX);
+
+	for (i = GISI_PHONET_BATCH_MAX; i < BATCH_MESSAGES; i++)
+		check_message(batch, i - GISI_PHONET_BATCH_MAX, i, 2 + i * 7);
+
+	g_assert(g_isi_phonet_batch_read(st.io, batch) == -1);
+	g_assert(errno == EAGAIN);
+
+	g_isi_phonet_batch_free(batch);
+	socket_test_teardown(&st);
+}
+
+static void test_batch_truncated(void)
+{
+	struct socket_test st;
+	GIsiPhonetBatch *batch;
+	struct sockaddr_pn *addr;
+	size_t len;
+
+	socket_test_setup(&st);
+
+	batch = g_isi_phonet_batch_new(BATCH_MTU);
+	g_assert(batch != NULL);
+
+	send_message(&st, 1, 8);
+	send_message(&st, 2, BATCH_MTU + 16);
+	send_message(&st, 3, BATCH_MTU);
+
+	g_assert(g_isi_phonet_batch_read(st.io, batch) == 3);
+
+	check_message(batch, 0, 1, 8);
+	g_assert(g_isi_phonet_batch_get(batch, 1, &len, &addr) == NULL);
+	check_message(batch, 2, 3, BATCH_MTU);
+
+	g_isi_phonet_batch_free(batch);
+	socket_test_teardown(&st);
+}
+
+static void test_batch_max_mtu(void)
+{
+	struct socket_test st;
+	GIsiPhonetBatch *batch;
+
+	socket_test_setup(&st);
+
+	/* Without an interface there is nothing to size the slots by */
+	g_assert(g_isi_phonet_mtu(st.io, 0) == GISI_PHONET_MAX_MTU);
+
+	batch = g_isi_phonet_batch_new(GISI_PHONET_MAX_MTU);
+	g_assert(batch != NULL);
+
+	send_message(&st, 1, 8);
+	send_message(&st, 2, 16);
+
+	g_assert(g_isi_phonet_batch_read(st.io, batch) == 1);
+	check_message(batch, 0, 1, 8);
+
+	g_assert(g_isi_phonet_batch_read(st.io, batch) == 1);
+	check_message(batch, 0, 2, 16);
+
+	g_isi_phonet_batch_free(batch);
+	socket_test_teardown(&st);
+}
+
+/*
+ * A burst of indications the size of a typical network status update,
+ * drained either the way GIsiModem used to (length peek plus one read
+ * per message) or with the batch reader.  Only the draining is timed.
+ */
+#define BENCH_ROUNDS		20000
+#define BENCH_BURST		GISI_PHONET_BATCH_MAX
+#define BENCH_MESSAGE_SIZE	48
+
+static void test_read_benchmark(gconstpointer data)
+{
+	gboolean batched = GPOINTER_TO_INT(data);
+	struct socket_test st;
+	GIsiPhonetBatch *batch;
+	unsigned int received = 0;
+	unsigned int i, j;
+	GTimer *timer;
+	double elapsed;
+
+	socket_test_setup(&st);
+
+	batch = g_isi_phonet_batch_new(BATCH_MTU);
+	g_assert(batch != NULL);
+
+	timer = g_timer_new();
+	g_timer_stop(timer);
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		for (j = 0; j < BENCH_BURST; j++)
+			send_message(&st, j, BENCH_MESSAGE_SIZE);
+
+		g_timer_continue(timer);
+
+		if (batched) {
+			int count;
+
+			while ((count = g_isi_phonet_batch_read(st.io,
+								batch)) > 0)
+				received += count;
+
+			g_timer_stop(timer);
+			continue;
+		}
+
+		while (g_isi_phonet_peek_length(st.io) > 0) {
+			struct sockaddr_pn addr;
+			uint32_t buf[BATCH_MTU / 4];
+
+			if (g_isi_phonet_read(st.io, buf, sizeof(buf),
+								&addr) > 0)
+				received += 1;
+		}
+
+		g_timer_stop(timer);
+	}
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_assert(received == BENCH_ROUNDS * BENCH_BURST);
+
+	g_test_minimized_result(elapsed, "%u messages in %f s",
+						received, elapsed);
+
+	g_isi_phonet_batch_free(batch);
+	socket_test_teardown(&st);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgisisocket/Batched read", test_batch_read);
+	g_test_add_func("/testgisisocket/Truncated datagram",
+					test_batch_truncated);
+	g_test_add_func("/testgisisocket/Unknown MTU", test_batch_max_mtu);
+
+	if (g_test_perf()) {
+		g_test_add_data_func("/testgisisocket/Single read Benchmark",
+					GINT_TO_POINTER(FALSE),
+					test_read_benchmark);
+		g_test_add_data_func("/testgisisocket/Batched read Benchmark",
+					GINT_TO_POINTER(TRUE),
+					test_read_benchmark);
+	}
+
+	return g_test_run();
+}
@@ -0,0 +1,673 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2015 Canonical Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include <ofono/types.h>
+
+#include "gril.h"
+
+#include "rilmodem-test-server.h"
+
+#define RIL_SERVER_SOCK_PATH "/tmp/unittestgril"
+
+/*
+ * A fake rild that collects a number of requests and then answers all
+ * of them at once, in reverse order, so that every response has to be
+ * matched against the full set of requests still in flight.
+ */
+struct serial_test {
+	int server_sk;
+	int sk;
+	char *sock_name;
+	GMainLoop *loop;
+	GRil *ril;
+	guint watch;
+	GByteArray *rx;
+	GArray *serials;
+	GArray *reqs;
+	void (*process)(struct serial_test *st);
+	struct pending_request *pending;
+	unsigned int num_requests;
+	unsigned int num_responses;
+	unsigned int num_processed;
+	unsigned int sim_outstanding;
+	unsigned int timeouts;
+};
+
+struct pending_request {
+	struct serial_test *st;
+	gint req;
+	gint id;
+	gint error;
+	gboolean answered;
+};
+
+/* Warning: length is stored in network order */
+struct rsp_hdr {
+	uint32_t length;
+	uint32_t unsolicited;
+	uint32_t serial;
+	uint32_t error;
+};
+
+static void write_all(int sk, const void *buf, size_t len)
+{
+	size_t written = 0;
+
+	while (written < len) {
+		ssize_t ret = write(sk, (const char *) buf + written,
+							len - written);
+
+		g_assert(ret > 0);
+		written += ret;
+	}
+}
+
+static void send_response(struct serial_test *st, uint32_t serial)
+{
+	struct rsp_hdr hdr;
+
+	hdr.length = htonl(sizeof(hdr) - sizeof(hdr.length));
+	hdr.unsolicited = 0;
+	hdr.serial = serial;
+	hdr.error = 0;
+
+	write_all(st->sk, &hdr, sizeof(hdr));
+}
+
+static void send_responses(struct serial_test *st)
+{
+	guint n = st->serials->len;
+	struct rsp_hdr *rsp = g_new(struct rsp_hdr, n);
+	guint i;
+
+	for (i = 0; i < n; i++) {
+		struct rsp_hdr *hdr = &rsp[n - i - 1];
+
+		hdr->length = htonl(sizeof(*hdr) - sizeof(hdr->length));
+		hdr->unsolicited = 0;
+		hdr->serial = g_array_index(st->serials, uint32_t, i);
+		hdr->error = 0;
+	}
+
+	write_all(st->sk, rsp, n * sizeof(*rsp));
+
+	g_free(rsp);
+}
+
+static gboolean server_read(GIOChannel *io, GIOCondition cond, gpointer data)
+{
+	struct serial_test *st = data;
+	unsigned char buf[4096];
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	len = read(st->sk, buf, sizeof(buf));
+	g_assert(len > 0);
+
+	g_byte_array_append(st->rx, buf, len);
+
+	/* Request: length (network order), request id, serial, data */
+	while (st->rx->len >= 3 * sizeof(uint32_t)) {
+		uint32_t rlen, req, serial;
+
+		memcpy(&rlen, st->rx->data, sizeof(rlen));
+		rlen = ntohl(rlen) + sizeof(rlen);
+
+		if (st->rx->len < rlen)
+			break;
+
+		memcpy(&req, st->rx->data + sizeof(uint32_t), sizeof(req));
+		memcpy(&serial, st->rx->data + 2 * sizeof(uint32_t),
+							sizeof(serial));
+		g_array_append_val(st->reqs, req);
+		g_array_append_val(st->serials, serial);
+		g_byte_array_remove_range(st->rx, 0, rlen);
+	}
+
+	if (st->process) {
+		st->process(st);
+		return TRUE;
+	}
+
+	if (st->serials->len == st->num_requests) {
+		g_test_timer_start();
+		send_responses(st);
+	}
+
+	return TRUE;
+}
+
+static void response_cb(struct ril_msg *message, gpointer user_data)
+{
+	struct pending_request *pr = user_data;
+	struct serial_test *st = pr->st;
+
+	g_assert(pr->answered == FALSE);
+	g_assert(message->serial_no == pr->id);
+	g_assert(message->req == pr->req);
+
+	pr->answered = TRUE;
+	pr->error = message->error;
+	st->num_responses += 1;
+
+	if (st->num_responses == st->num_requests)
+		g_main_loop_quit(st->loop);
+}
+
+static void server_setup(struct serial_test *st)
+{
+	struct sockaddr_un addr;
+
+	st->server_sk = socket(AF_UNIX, SOCK_STREAM, 0);
+	g_assert(st->server_sk >= 0);
+
+	st->sock_name = g_strdup_printf(RIL_SERVER_SOCK_PATH "%u",
+						(unsigned) getpid());
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, st->sock_name, sizeof(addr.sun_path) - 1);
+
+	unlink(addr.sun_path);
+
+	g_assert(bind(st->server_sk, (struct sockaddr *) &addr,
+							sizeof(addr)) == 0);
+
+	/* GRil connects with the radio user's credentials */
+	chmod(addr.sun_path, 0777);
+
+	g_assert(listen(st->server_sk, 1) == 0);
+}
+
+static void serial_test_setup(struct serial_test *st,
+				unsigned int num_requests)
+{
+	GIOChannel *io;
+
+	memset(st, 0, sizeof(*st));
+	st->num_requests = num_requests;
+	st->rx = g_byte_array_new();
+	st->serials = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+	st->reqs = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+	st->pending = g_new0(struct pending_request, num_requests);
+	st->loop = g_main_loop_new(NULL, FALSE);
+
+	server_setup(st);
+
+	st->ril = g_ril_new(st->sock_name, OFONO_RIL_VENDOR_AOSP);
+	g_assert(st->ril != NULL);
+
+	st->sk = accept(st->server_sk, NULL, NULL);
+	g_assert(st->sk >= 0);
+
+	io = g_io_channel_unix_new(st->sk);
+	st->watch = g_io_add_watch(io,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				server_read, st);
+	g_io_channel_unref(io);
+}
+
+static void serial_test_send(struct serial_test *st, unsigned int i,
+				gint req, guint timeout)
+{
+	struct pending_request *pr = &st->pending[i];
+
+	pr->st = st;
+	pr->req = req;
+	pr->id = g_ril_send_with_timeout(st->ril, req, NULL, response_cb,
+						pr, NULL, timeout);
+	g_assert(pr->id != 0);
+}
+
+static void serial_test_teardown(struct serial_test *st)
+{
+	g_source_remove(st->watch);
+	g_ril_unref(st->ril);
+
+	close(st->sk);
+	close(st->server_sk);
+	unlink(st->sock_name);
+	g_free(st->sock_name);
+
+	g_main_loop_unref(st->loop);
+	g_free(st->pending);
+	g_array_free(st->reqs, TRUE);
+	g_array_free(st->serials, TRUE);
+	g_byte_array_free(st->rx, TRUE);
+}
+
+static double serial_test_run(unsigned int num_requests)
+{
+	struct serial_test st;
+	unsigned int i;
+	double elapsed;
+
+	serial_test_setup(&st, num_requests);
+
+	/* All of them have to be in flight at once */
+	g_ril_set_request_lane(st.ril, RIL_REQUEST_SIM_IO,
+					G_RIL_LANE_CALL_CONTROL);
+
+	for (i = 0; i < num_requests; i++)
+		serial_test_send(&st, i, i % 2 ? RIL_REQUEST_SIM_IO :
+					RIL_REQUEST_GET_CURRENT_CALLS, 0);
+
+	g_main_loop_run(st.loop);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(st.num_responses == num_requests);
+
+	for (i = 0; i < num_requests; i++)
+		g_assert(st.pending[i].answered == TRUE);
+
+	serial_test_teardown(&st);
+
+	return elapsed;
+}
+
+static void test_out_of_order_responses(void)
+{
+	serial_test_run(16);
+}
+
+#define SERIAL_BENCH_IN_FLIGHT 1000
+
+static void test_serial_benchmark(void)
+{
+	double elapsed = serial_test_run(SERIAL_BENCH_IN_FLIGHT);
+
+	g_test_minimized_result(elapsed, "%u responses in %f s",
+					SERIAL_BENCH_IN_FLIGHT, elapsed);
+}
+
+/*
+ * Answers whatever arrived in one go, after checking that GRil never had
+ * more than two SIM requests waiting for a response.
+ */
+static void lanes_process(struct serial_test *st)
+{
+	unsigned int i;
+
+	for (i = st->num_processed; i < st->serials->len; i++) {
+		if (g_array_index(st->reqs, uint32_t, i) == RIL_REQUEST_SIM_IO)
+			st->sim_outstanding += 1;
+	}
+
+	g_assert(st->sim_outstanding <= 2);
+
+	for (; st->num_processed < st->serials->len; st->num_processed++) {
+		i = st->num_processed;
+
+		if (g_array_index(st->reqs, uint32_t, i) == RIL_REQUEST_SIM_IO)
+			st->sim_outstanding -= 1;
+
+		send_response(st, g_array_index(st->serials, uint32_t, i));
+	}
+}
+
+/* A vendor call setting that has to stay in order with DIAL */
+#define TEST_VENDOR_CALL_REQUEST 2086
+
+static void test_priority_lanes(void)
+{
+	struct serial_test st;
+	unsigned int i;
+
+	serial_test_setup(&st, 7);
+	st.process = lanes_process;
+
+	g_assert(g_ril_set_request_lane(st.ril, TEST_VENDOR_CALL_REQUEST,
+					G_RIL_LANE_CALL_CONTROL) == TRUE);
+
+	/* Queued behind a burst of SIM reads, but written first */
+	for (i = 0; i < 4; i++)
+		serial_test_send(&st, i, RIL_REQUEST_SIM_IO, 0);
+
+	serial_test_send(&st, 4, RIL_REQUEST_SIGNAL_STRENGTH, 0);
+	serial_test_send(&st, 5, TEST_VENDOR_CALL_REQUEST, 0);
+	serial_test_send(&st, 6, RIL_REQUEST_DIAL, 0);
+
+	g_main_loop_run(st.loop);
+
+	g_assert(st.num_responses == 7);
+	g_assert(st.reqs->len == 7);
+
+	g_assert(g_array_index(st.reqs, uint32_t, 0) ==
+						TEST_VENDOR_CALL_REQUEST);
+	g_assert(g_array_index(st.reqs, uint32_t, 1) == RIL_REQUEST_DIAL);
+	g_assert(g_array_index(st.reqs, uint32_t, 2) == RIL_REQUEST_SIM_IO);
+	g_assert(g_array_index(st.serials, uint32_t, 2) ==
+						(uint32_t) st.pending[0].id);
+
+	for (i = 0; i < 7; i++)
+		g_assert(st.pending[i].error == RIL_E_SUCCESS);
+
+	serial_test_teardown(&st);
+}
+
+/*
+ * pending[0] and pending[1] fill the SIM lane and are not answered in
+ * time, pending[2] waits in the lane behind them and expires there,
+ * pending[3] goes out once pending[0] times out.  The late answer to
+ * pending[0] has to be dropped.
+ */
+static void timeout_process(struct serial_test *st)
+{
+	uint32_t serial;
+
+	for (; st->num_processed < st->serials->len; st->num_processed++) {
+		serial = g_array_index(st->serials, uint32_t,
+						st->num_processed);
+
+		g_assert(serial != (uint32_t) st->pending[2].id);
+
+		if (serial != (uint32_t) st->pending[3].id)
+			continue;
+
+		send_response(st, st->pending[0].id);
+		send_response(st, st->pending[1].id);
+		send_response(st, serial);
+	}
+}
+
+static void timeout_latency(const char *request, int error, guint usec,
+				gpointer user_data)
+{
+	struct serial_test *st = user_data;
+
+	if (error == RIL_E_GRIL_TIMEOUT)
+		st->timeouts += 1;
+}
+
+static void test_request_timeout(void)
+{
+	struct serial_test st;
+
+	serial_test_setup(&st, 4);
+	st.process = timeout_process;
+
+	g_ril_set_latency_function(st.ril, timeout_latency, &st);
+
+	serial_test_send(&st, 0, RIL_REQUEST_SIM_IO, 100);
+	serial_test_send(&st, 1, RIL_REQUEST_SIM_IO, 0);
+	serial_test_send(&st, 2, RIL_REQUEST_SIM_IO, 20);
+	serial_test_send(&st, 3, RIL_REQUEST_SIM_IO, 0);
+
+	g_main_loop_run(st.loop);
+
+	g_assert(st.pending[0].error == RIL_E_GRIL_TIMEOUT);
+	g_assert(st.pending[1].error == RIL_E_SUCCESS);
+	g_assert(st.pending[2].error == RIL_E_GRIL_TIMEOUT);
+	g_assert(st.pending[3].error == RIL_E_SUCCESS);
+	g_assert(st.serials->len == 3);
+	g_assert(st.timeouts == 2);
+
+	serial_test_teardown(&st);
+}
+
+/*
+ * An unsolicited record with an odd length, so that over
+ * GRIL_BUFFER_SIZE records it starts at every position of the read
+ * buffer and the wrap point falls at every offset inside it.
+ */
+#define SPLIT_PAYLOAD_LEN 41
+#define SPLIT_RECORD_LEN (3 * sizeof(uint32_t) + SPLIT_PAYLOAD_LEN)
+
+struct split_test {
+	struct server_data *serverd;
+	GRil *ril;
+	GMainLoop *loop;
+	unsigned char record[SPLIT_RECORD_LEN];
+	unsigned int received;
+};
+
+static const struct rilmodem_test_data split_rtd = {
+	.unsol_test = TRUE,
+};
+
+static void split_unsol_cb(struct ril_msg *message, gpointer user_data)
+{
+	struct split_test *spt = user_data;
+
+	g_assert(message->unsolicited == TRUE);
+	g_assert(message->req == RIL_UNSOL_OEM_HOOK_RAW);
+	g_assert(message->buf_len == SPLIT_PAYLOAD_LEN);
+	g_assert(!memcmp(message->buf, spt->record + 3 * sizeof(uint32_t),
+						SPLIT_PAYLOAD_LEN));
+
+	if (++spt->received == GRIL_BUFFER_SIZE)
+		g_main_loop_quit(spt->loop);
+}
+
+static void split_connect_cb(gpointer data)
+{
+	struct split_test *spt = data;
+
+	rilmodem_test_server_write_split(spt->serverd, spt->record,
+					sizeof(spt->record), GRIL_BUFFER_SIZE);
+}
+
+static void fill_oem_hook_record(unsigned char *record)
+{
+	uint32_t field;
+	unsigned int i;
+
+	field = htonl(SPLIT_RECORD_LEN - sizeof(field));
+	memcpy(record, &field, sizeof(field));
+	field = 1;
+	memcpy(record + 4, &field, sizeof(field));
+	field = RIL_UNSOL_OEM_HOOK_RAW;
+	memcpy(record + 8, &field, sizeof(field));
+
+	for (i = 0; i < SPLIT_PAYLOAD_LEN; i++)
+		record[3 * sizeof(uint32_t) + i] = i * 7 + 1;
+}
+
+static void test_split_records(void)
+{
+	struct split_test spt;
+
+	memset(&spt, 0, sizeof(spt));
+	fill_oem_hook_record(spt.record);
+
+	spt.loop = g_main_loop_new(NULL, FALSE);
+	spt.serverd = rilmodem_test_server_create(split_connect_cb,
+							&split_rtd, &spt);
+
+	spt.ril = g_ril_new(rilmodem_test_get_socket_name(spt.serverd),
+							OFONO_RIL_VENDOR_AOSP);
+	g_assert(spt.ril != NULL);
+
+	g_ril_register(spt.ril, RIL_UNSOL_OEM_HOOK_RAW, split_unsol_cb, &spt);
+
+	g_main_loop_run(spt.loop);
+
+	g_assert(spt.received == GRIL_BUFFER_SIZE);
+
+	g_ril_unref(spt.ril);
+	rilmodem_test_server_close(spt.serverd);
+	g_main_loop_unref(spt.loop);
+}
+
+/*
+ * Two clones and a plain listener follow the same unsolicited message;
+ * the decoder has to run once, whether its result is pulled from the
+ * cache or pushed to the decoded listeners.
+ */
+struct decode_test {
+	struct server_data *serverd;
+	GRil *ril;
+	GRil *clone;
+	GMainLoop *loop;
+	unsigned char record[SPLIT_RECORD_LEN];
+	unsigned int decodes;
+	unsigned int destroys;
+	unsigned int notifications;
+	gconstpointer seen;
+};
+
+static struct decode_test *decode_test_data;
+
+static gpointer decode_oem_hook(GRil *ril, const struct ril_msg *message)
+{
+	decode_test_data->decodes += 1;
+
+	return g_memdup(message->buf, message->buf_len);
+}
+
+static void decoded_free(gpointer data)
+{
+	decode_test_data->destroys += 1;
+	g_free(data);
+}
+
+static void decode_notified(struct decode_test *dt)
+{
+	if (++dt->notifications == 3)
+		g_main_loop_quit(dt->loop);
+}
+
+static void decoded_cb(struct ril_msg *message, gconstpointer data,
+			gpointer user_data)
+{
+	struct decode_test *dt = user_data;
+
+	g_assert(data != NULL);
+	g_assert(!memcmp(data, dt->record + 3 * sizeof(uint32_t),
+						SPLIT_PAYLOAD_LEN));
+
+	if (dt->seen != NULL)
+		g_assert(dt->seen == data);
+
+	dt->seen = data;
+	decode_notified(dt);
+}
+
+/* Registered last, so it runs first and fills the cache */
+static void plain_cb(struct ril_msg *message, gpointer user_data)
+{
+	struct decode_test *dt = user_data;
+	gconstpointer data;
+
+	data = g_ril_decode_cached(dt->clone, message, decode_oem_hook,
+					decoded_free);
+	g_assert(data != NULL);
+	g_assert(data == g_ril_decode_cached(dt->ril, message,
+						decode_oem_hook,
+						decoded_free));
+
+	dt->seen = data;
+	decode_notified(dt);
+}
+
+static void decode_connect_cb(gpointer data)
+{
+	struct decode_test *dt = data;
+
+	rilmodem_test_server_write(dt->serverd, dt->record,
+					sizeof(dt->record));
+}
+
+static void test_shared_decoding(void)
+{
+	struct decode_test dt;
+	guint received, decoded;
+
+	memset(&dt, 0, sizeof(dt));
+	fill_oem_hook_record(dt.record);
+	decode_test_data = &dt;
+
+	dt.loop = g_main_loop_new(NULL, FALSE);
+	dt.serverd = rilmodem_test_server_create(decode_connect_cb,
+							&split_rtd, &dt);
+
+	dt.ril = g_ril_new(rilmodem_test_get_socket_name(dt.serverd),
+						OFONO_RIL_VENDOR_AOSP);
+	g_assert(dt.ril != NULL);
+
+	dt.clone = g_ril_clone(dt.ril);
+
+	g_ril_register_decoded(dt.ril, RIL_UNSOL_OEM_HOOK_RAW,
+				decode_oem_hook, decoded_free,
+				decoded_cb, &dt);
+	g_ril_register_decoded(dt.clone, RIL_UNSOL_OEM_HOOK_RAW,
+				decode_oem_hook, decoded_free,
+				decoded_cb, &dt);
+	g_ril_register(dt.clone, RIL_UNSOL_OEM_HOOK_RAW, plain_cb, &dt);
+
+	g_main_loop_run(dt.loop);
+
+	g_assert(dt.notifications == 3);
+	g_assert(dt.decodes == 1);
+	g_assert(dt.destroys == 1);
+
+	g_assert(g_ril_get_unsol_counters(dt.ril, RIL_UNSOL_OEM_HOOK_RAW,
+						&received, &decoded));
+	g_assert(received == 1);
+	g_assert(decoded == 1);
+
+	g_ril_unref(dt.clone);
+	g_ril_unref(dt.ril);
+	rilmodem_test_server_close(dt.serverd);
+	g_main_loop_unref(dt.loop);
+	decode_test_data = NULL;
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgril/Out of order responses",
+				test_out_of_order_responses);
+
+	g_test_add_func("/testgril/Records split at every offset",
+				test_split_records);
+
+	g_test_add_func("/testgril/Shared unsolicited decoding",
+				test_shared_decoding);
+
+	g_test_add_func("/testgril/Priority lanes", test_priority_lanes);
+
+	g_test_add_func("/testgril/Request timeout", test_request_timeout);
+
+	if (g_test_perf())
+		g_test_add_func("/testgril/Response Matching Benchmark",
+					test_serial_benchmark);
+
+	return g_test_run();
+}
@@ -1463,6 +1463,108 @@ static void test_request_oem_hook_strings(gconstpointer data)
 	parcel_free(&rilp);
 }
 
+/*
+ * "A", U+00E9, U+20AC and U+1D11E: one, two, three and four byte UTF-8
+ * sequences, the last one encoded as a surrogate pair.
+ */
+static const guchar parcel_string_utf16[] = {
+	0x05, 0x00, 0x00, 0x00, 0x41, 0x00, 0xe9, 0x00, 0xac, 0x20, 0x34, 0xd8,
+	0x1e, 0xdd, 0x00, 0x00
+};
+
+static void test_parcel_string_utf16(void)
+{
+	struct parcel rilp;
+	char *str;
+
+	parcel_init(&rilp);
+	g_assert(parcel_w_string(&rilp, "A\xc3\xa9\xe2\x82\xac"
+					"\xf0\x9d\x84\x9e") == 0);
+
+	g_assert(rilp.size == sizeof(parcel_string_utf16));
+	g_assert(!memcmp(rilp.data, parcel_string_utf16,
+				sizeof(parcel_string_utf16)));
+
+	rilp.offset = 0;
+	str = parcel_r_string(&rilp);
+	g_assert_cmpstr(str, ==, "A\xc3\xa9\xe2\x82\xac\xf0\x9d\x84\x9e");
+	g_free(str);
+
+	/* Invalid UTF-8 is sent as a NULL string */
+	rilp.size = 0;
+	rilp.offset = 0;
+	g_assert(parcel_w_string(&rilp, "\xc3\x28") == -1);
+	g_assert(rilp.size == sizeof(int32_t));
+	g_assert(*(int32_t *) (void *) rilp.data == -1);
+
+	parcel_free(&rilp);
+}
+
+static void test_parcel_grow(void)
+{
+	struct parcel rilp;
+	int i;
+
+	parcel_init_sized(&rilp, 0);
+	g_assert(rilp.capacity == PARCEL_MIN_CAPACITY);
+
+	for (i = 0; i < 1000; i++)
+		parcel_w_int32(&rilp, i);
+
+	g_assert(rilp.size == 1000 * sizeof(int32_t));
+	g_assert(rilp.capacity >= rilp.size);
+	g_assert(rilp.capacity < 2 * rilp.size);
+
+	rilp.offset = 0;
+
+	for (i = 0; i < 1000; i++)
+		g_assert(parcel_r_int32(&rilp) == i);
+
+	parcel_free(&rilp);
+}
+
+#define REQUEST_BENCH_ROUNDS 100000
+
+static void test_request_benchmark(void)
+{
+	const struct request_test_set_initial_attach_apn *apn =
+					&set_initial_attach_apn_valid_test_1;
+	const struct request_test_oem_hook_strings *oem =
+					&oem_hook_strings_valid_test_1;
+	struct parcel rilp;
+	unsigned int i;
+	double elapsed;
+
+	g_test_timer_start();
+
+	for (i = 0; i < REQUEST_BENCH_ROUNDS; i++) {
+		g_ril_request_dial(NULL, &dial_valid_test_1.ph,
+					dial_valid_test_1.clir, &rilp);
+		parcel_free(&rilp);
+
+		g_ril_request_sms_cmgs(NULL, sms_cmgs_valid_test_1.request,
+					&rilp);
+		parcel_free(&rilp);
+
+		g_ril_request_send_ussd(NULL, send_ussd_valid_test_1.request,
+					&rilp);
+		parcel_free(&rilp);
+
+		g_ril_request_set_initial_attach_apn(NULL, apn->apn,
+					apn->proto, apn->user, apn->passwd,
+					apn->mccmnc, &rilp);
+		parcel_free(&rilp);
+
+		g_ril_request_oem_hook_strings(NULL, oem->str, oem->num_str,
+						&rilp);
+		parcel_free(&rilp);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "%u requests in %f s",
+				REQUEST_BENCH_ROUNDS * 5, elapsed);
+}
+
 #endif
 
 int main(int argc, char **argv)
@@ -1732,6 +1834,16 @@ int main(int argc, char **argv)
 				&oem_hook_strings_valid_test_1,
 				test_request_oem_hook_strings);
 
+	g_test_add_func("/testgrilrequest/parcel: UTF-16 strings",
+				test_parcel_string_utf16);
+
+	g_test_add_func("/testgrilrequest/parcel: geometric growth",
+				test_parcel_grow);
+
+	if (g_test_perf())
+		g_test_add_func("/testgrilrequest/Request Benchmark",
+					test_request_benchmark);
+
 #endif
 	return g_test_run();
 }
@@ -673,7 +673,14 @@ static void test_signal_strength_valid(gconstpointer data)
 	const signal_strength_test *test = data;
 	int strength = g_ril_unsol_parse_signal_strength(NULL, &test->msg,
 								test->ril_tech);
+	struct unsol_signal_strength *ss;
+
 	g_assert(strength == test->strength);
+
+	ss = g_ril_unsol_decode_signal_strength(NULL, &test->msg);
+	g_assert(g_ril_unsol_signal_strength_for_tech(ss, test->ril_tech) ==
+							test->strength);
+	g_free(ss);
 }
 
 static void test_unsol_response_new_sms_valid(gconstpointer data)
@@ -0,0 +1,771 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2017  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+#include "drivers/qmimodem/dms.h"
+#include "drivers/qmimodem/nas.h"
+#include "drivers/qmimodem/wds.h"
+#include "drivers/qmimodem/wms.h"
+#include "drivers/qmimodem/uim.h"
+
+#include "qmimodem-test-server.h"
+
+#define TEST_NAS_CLIENT		0x01
+
+/*
+ * Serving system indication laid out like the ones a live LTE modem
+ * sends: the TLVs network registration reads are interleaved with a run
+ * of TLVs it ignores, so every lookup has to skip over most of the
+ * message.
+ */
+static const unsigned char ss_info_tlvs[] = {
+	0x01, 0x06, 0x00, 0x01, 0x01, 0x01, 0x02, 0x01, 0x08,
+	0x10, 0x01, 0x00, 0x01,
+	0x11, 0x02, 0x00, 0x01, 0x0b,
+	0x15, 0x03, 0x00, 0x01, 0x08, 0x01,
+	0x16, 0x02, 0x00, 0x01, 0x00,
+	0x18, 0x01, 0x00, 0x00,
+	0x1b, 0x01, 0x00, 0x00,
+	0x1c, 0x02, 0x00, 0x00, 0x00,
+	0x21, 0x05, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+	0x22, 0x01, 0x00, 0x00,
+	0x23, 0x01, 0x00, 0x00,
+	0x24, 0x01, 0x00, 0x00,
+	0x25, 0x01, 0x00, 0x00,
+	0x26, 0x02, 0x00, 0x02, 0x01,
+	0x27, 0x01, 0x00, 0x00,
+	0x28, 0x01, 0x00, 0x00,
+	0x29, 0x08, 0x00, 0x1a, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x2a, 0x01, 0x00, 0x00,
+	0x12, 0x0b, 0x00, 0x06, 0x01, 0x01, 0x00, 0x06,
+				'o', 'F', 'o', 'n', 'o', '!',
+	0x1d, 0x02, 0x00, 0x34, 0x12,
+	0x1e, 0x04, 0x00, 0x78, 0x56, 0x34, 0x12,
+};
+
+/* Same message with the cell id TLV claiming more bytes than it has */
+static const unsigned char ss_info_truncated_tlvs[] = {
+	0x01, 0x06, 0x00, 0x01, 0x01, 0x01, 0x02, 0x01, 0x08,
+	0x10, 0x01, 0x00, 0x01,
+	0x1d, 0x01, 0x00, 0x34,
+	0x1e, 0x08, 0x00, 0x78, 0x56, 0x34, 0x12,
+};
+
+struct qmi_test {
+	struct qmimodem_test_server *server;
+	GMainLoop *loop;
+	struct qmi_device *device;
+	struct qmi_service *nas;
+	void (*notify)(struct qmi_result *result, struct qmi_test *qt);
+	unsigned int notified;
+	unsigned int expected;
+	unsigned int batch;
+	gint64 latency_total;
+	gint64 latency_max;
+};
+
+static void flush_events(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void ss_info_notify(struct qmi_result *result, void *user_data)
+{
+	struct qmi_test *qt = user_data;
+
+	qt->notify(result, qt);
+	qt->notified += 1;
+
+	if (qt->notified == qt->expected)
+		g_main_loop_quit(qt->loop);
+}
+
+static void nas_created(struct qmi_service *service, void *user_data)
+{
+	struct qmi_test *qt = user_data;
+
+	g_assert(service != NULL);
+
+	qt->nas = qmi_service_ref(service);
+
+	qmi_service_register(qt->nas, QMI_NAS_SS_INFO_IND,
+						ss_info_notify, qt, NULL);
+
+	g_main_loop_quit(qt->loop);
+}
+
+static void qmi_test_setup(struct qmi_test *qt)
+{
+	memset(qt, 0, sizeof(*qt));
+
+	qt->server = qmimodem_test_server_create();
+	g_assert(qt->server != NULL);
+
+	qt->loop = g_main_loop_new(NULL, FALSE);
+
+	qt->device = qmi_device_new(qmimodem_test_server_get_fd(qt->server));
+	g_assert(qt->device != NULL);
+
+	qmi_device_set_close_on_unref(qt->device, true);
+}
+
+static void qmi_test_create_nas(struct qmi_test *qt,
+		void (*notify)(struct qmi_result *result, struct qmi_test *qt))
+{
+	qt->notify = notify;
+
+	g_assert(qmi_service_create(qt->device, QMI_SERVICE_NAS,
+						nas_created, qt, NULL));
+
+	g_main_loop_run(qt->loop);
+
+	g_assert(qt->nas != NULL);
+}
+
+static void qmi_test_teardown(struct qmi_test *qt)
+{
+	const struct qmimodem_test_stats *stats =
+			qmimodem_test_server_get_stats(qt->server);
+
+	qmimodem_test_server_set_latency(qt->server, 0);
+
+	qmi_service_unref(qt->nas);
+
+	/* Let the client releases complete so the services get freed */
+	while (stats->released < stats->allocated)
+		g_main_context_iteration(NULL, TRUE);
+
+	flush_events();
+
+	qmi_device_unref(qt->device);
+	qmimodem_test_server_close(qt->server);
+
+	g_main_loop_unref(qt->loop);
+}
+
+static void send_ss_info(struct qmi_test *qt, const unsigned char *tlvs,
+							uint16_t tlv_len)
+{
+	qmimodem_test_server_indicate(qt->server, QMI_SERVICE_NAS,
+					TEST_NAS_CLIENT, QMI_NAS_SS_INFO_IND,
+					tlvs, tlv_len);
+}
+
+static void check_ss_info(struct qmi_result *result, struct qmi_test *qt)
+{
+	const struct qmi_nas_serving_system *ss;
+	const struct qmi_nas_current_plmn *plmn;
+	uint8_t roaming;
+	uint16_t lac;
+	uint32_t cellid;
+	uint16_t len;
+
+	ss = qmi_result_get(result, QMI_NAS_RESULT_SERVING_SYSTEM, &len);
+	g_assert(ss != NULL);
+	g_assert(len == 6);
+	g_assert(ss->status == QMI_NAS_ATTACH_STATUS_ATTACHED);
+	g_assert(ss->radio_if[0] == 0x08);
+
+	g_assert(qmi_result_get_uint8(result, QMI_NAS_RESULT_ROAMING_STATUS,
+							&roaming));
+	g_assert(roaming == 0x01);
+
+	plmn = qmi_result_get(result, QMI_NAS_RESULT_CURRENT_PLMN, &len);
+	g_assert(plmn != NULL);
+	g_assert(len == 11);
+	g_assert(GUINT16_FROM_LE(plmn->mcc) == 262);
+	g_assert(GUINT16_FROM_LE(plmn->mnc) == 1);
+	g_assert(memcmp(plmn->desc, "oFono!", plmn->desc_len) == 0);
+
+	g_assert(qmi_result_get_uint16(result,
+				QMI_NAS_RESULT_LOCATION_AREA_CODE, &lac));
+	g_assert(lac == 0x1234);
+
+	g_assert(qmi_result_get_uint32(result, QMI_NAS_RESULT_CELL_ID,
+							&cellid));
+	g_assert(cellid == 0x12345678);
+
+	/* Repeated and missing types go through the same index */
+	g_assert(qmi_result_get(result, QMI_NAS_RESULT_SERVING_SYSTEM,
+							NULL) == ss);
+	g_assert(qmi_result_get(result, 0x13, &len) == NULL);
+	g_assert(qmi_result_get(result, 0xff, &len) == NULL);
+}
+
+static void test_indication_lookup(void)
+{
+	struct qmi_test qt;
+
+	qmi_test_setup(&qt);
+	qmi_test_create_nas(&qt, check_ss_info);
+
+	send_ss_info(&qt, ss_info_tlvs, sizeof(ss_info_tlvs));
+
+	qt.expected = 1;
+	g_main_loop_run(qt.loop);
+
+	g_assert(qt.notified == 1);
+
+	qmi_test_teardown(&qt);
+}
+
+static void check_truncated(struct qmi_result *result, struct qmi_test *qt)
+{
+	uint8_t roaming;
+	uint16_t lac;
+	uint32_t cellid;
+
+	g_assert(qmi_result_get(result, QMI_NAS_RESULT_SERVING_SYSTEM,
+							NULL) != NULL);
+
+	g_assert(qmi_result_get_uint8(result, QMI_NAS_RESULT_ROAMING_STATUS,
+							&roaming));
+	g_assert(roaming == 0x01);
+
+	/* Present, but too short to hold the value */
+	g_assert(!qmi_result_get_uint16(result,
+				QMI_NAS_RESULT_LOCATION_AREA_CODE, &lac));
+
+	/* Runs past the end of the message */
+	g_assert(qmi_result_get(result, QMI_NAS_RESULT_CELL_ID,
+							NULL) == NULL);
+	g_assert(!qmi_result_get_uint32(result, QMI_NAS_RESULT_CELL_ID,
+							&cellid));
+}
+
+static void test_truncated_tlv(void)
+{
+	struct qmi_test qt;
+
+	qmi_test_setup(&qt);
+	qmi_test_create_nas(&qt, check_truncated);
+
+	send_ss_info(&qt, ss_info_truncated_tlvs,
+					sizeof(ss_info_truncated_tlvs));
+
+	qt.expected = 1;
+	g_main_loop_run(qt.loop);
+
+	g_assert(qt.notified == 1);
+
+	qmi_test_teardown(&qt);
+}
+
+/* One query per service in the simulator's default script */
+static const struct {
+	uint8_t service;
+	uint16_t message;
+	uint8_t tlv;
+} scripted_queries[] = {
+	{ QMI_SERVICE_DMS, QMI_DMS_GET_CAPS, QMI_DMS_RESULT_DEVICE_CAPS },
+	{ QMI_SERVICE_NAS, QMI_NAS_GET_SS_INFO, QMI_NAS_RESULT_SERVING_SYSTEM },
+	{ QMI_SERVICE_WDS, QMI_WDS_GET_PKT_STATUS, 0x01 },
+	{ QMI_SERVICE_WMS, QMI_WMS_GET_ROUTES, QMI_WMS_RESULT_ROUTE_LIST },
+	{ QMI_SERVICE_UIM, QMI_UIM_GET_CARD_STATUS,
+					QMI_UIM_RESULT_CARD_STATUS },
+};
+
+static const struct qmimodem_test_response oper_mode_error[] = {
+	{ QMI_SERVICE_DMS, QMI_DMS_GET_OPER_MODE, 0x0003, NULL, 0 },
+};
+
+struct scripted_test {
+	struct qmi_test *qt;
+	struct qmi_service *services[G_N_ELEMENTS(scripted_queries)];
+	unsigned int index;
+	uint16_t error;
+	bool failed;
+	uint8_t mode;
+};
+
+static void scripted_cb(struct qmi_result *result, void *user_data)
+{
+	struct scripted_test *st = user_data;
+	uint16_t len;
+
+	g_assert(!qmi_result_set_error(result, NULL));
+
+	g_assert(qmi_result_get(result, scripted_queries[st->index].tlv,
+							&len) != NULL);
+	g_assert(len > 0);
+
+	g_main_loop_quit(st->qt->loop);
+}
+
+static void oper_mode_cb(struct qmi_result *result, void *user_data)
+{
+	struct scripted_test *st = user_data;
+
+	st->failed = qmi_result_set_error(result, &st->error);
+
+	if (!st->failed)
+		g_assert(qmi_result_get_uint8(result, 0x01, &st->mode));
+
+	g_main_loop_quit(st->qt->loop);
+}
+
+static void scripted_created(struct qmi_service *service, void *user_data)
+{
+	struct scripted_test *st = user_data;
+
+	g_assert(service != NULL);
+
+	st->services[st->index] = qmi_service_ref(service);
+
+	g_main_loop_quit(st->qt->loop);
+}
+
+static void test_scripted_responses(void)
+{
+	struct scripted_test st;
+	struct qmi_test qt;
+	struct qmi_service *dms;
+	unsigned int i;
+
+	qmi_test_setup(&qt);
+
+	memset(&st, 0, sizeof(st));
+	st.qt = &qt;
+
+	for (i = 0; i < G_N_ELEMENTS(scripted_queries); i++) {
+		st.index = i;
+
+		g_assert(qmi_service_create(qt.device,
+					scripted_queries[i].service,
+					scripted_created, &st, NULL));
+		g_main_loop_run(qt.loop);
+
+		g_assert(qmi_service_send(st.services[i],
+					scripted_queries[i].message, NULL,
+					scripted_cb, &st, NULL) > 0);
+		g_main_loop_run(qt.loop);
+	}
+
+	dms = st.services[0];
+
+	g_assert(qmi_service_send(dms, QMI_DMS_GET_OPER_MODE, NULL,
+					oper_mode_cb, &st, NULL) > 0);
+	g_main_loop_run(qt.loop);
+
+	g_assert(!st.failed);
+	g_assert(st.mode == 0x00);
+
+	/* Entries added later override the default script */
+	qmimodem_test_server_add_script(qt.server, oper_mode_error,
+					G_N_ELEMENTS(oper_mode_error));
+
+	g_assert(qmi_service_send(dms, QMI_DMS_GET_OPER_MODE, NULL,
+					oper_mode_cb, &st, NULL) > 0);
+	g_main_loop_run(qt.loop);
+
+	g_assert(st.failed);
+	g_assert(st.error == 0x0003);
+
+	for (i = 0; i < G_N_ELEMENTS(st.services); i++)
+		qmi_service_unref(st.services[i]);
+
+	qmi_test_teardown(&qt);
+}
+
+#define LOOKUP_BENCH_INDICATIONS 100000
+
+static void send_batch(struct qmi_test *qt)
+{
+	g_assert(qmimodem_test_server_indicate_batch(qt->server,
+					QMI_SERVICE_NAS, TEST_NAS_CLIENT,
+					QMI_NAS_SS_INFO_IND, ss_info_tlvs,
+					sizeof(ss_info_tlvs), qt->batch) ==
+								qt->batch);
+}
+
+static void bench_ss_info(struct qmi_result *result, struct qmi_test *qt)
+{
+	check_ss_info(result, qt);
+
+	/* The device reads one datagram at a time, refill once drained */
+	if ((qt->notified + 1) % qt->batch == 0 &&
+				qt->notified + 1 < qt->expected)
+		send_batch(qt);
+}
+
+static void test_lookup_benchmark(void)
+{
+	struct qmi_test qt;
+	double elapsed;
+
+	qmi_test_setup(&qt);
+	qmi_test_create_nas(&qt, bench_ss_info);
+
+	qt.batch = 2048 / (13 + sizeof(ss_info_tlvs));
+	qt.expected = LOOKUP_BENCH_INDICATIONS / qt.batch * qt.batch;
+
+	g_test_timer_start();
+
+	send_batch(&qt);
+	g_main_loop_run(qt.loop);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(qt.notified == qt.expected);
+
+	g_test_minimized_result(elapsed, "%u indications in %f s",
+					qt.expected, elapsed);
+
+	qmi_test_teardown(&qt);
+}
+
+/*
+ * Indications arriving at a steady rate rather than as fast as the
+ * device can read them, each one stamped by the simulator when it was
+ * written so the delivery latency can be measured.
+ */
+#define LOAD_BENCH_RATE		20000
+#define LOAD_BENCH_INDICATIONS	20000
+
+static void bench_load(struct qmi_result *result, struct qmi_test *qt)
+{
+	const void *ptr;
+	uint64_t stamp;
+	uint16_t len;
+	gint64 delay;
+
+	ptr = qmi_result_get(result, QMIMODEM_TEST_TLV_TIMESTAMP, &len);
+	g_assert(ptr != NULL && len == sizeof(stamp));
+
+	memcpy(&stamp, ptr, sizeof(stamp));
+	delay = g_get_monotonic_time() - (gint64) GUINT64_FROM_LE(stamp);
+
+	qt->latency_total += delay;
+
+	if (delay > qt->latency_max)
+		qt->latency_max = delay;
+}
+
+static void test_load_benchmark(void)
+{
+	const struct qmimodem_test_stats *stats;
+	struct qmi_test qt;
+	double elapsed;
+
+	qmi_test_setup(&qt);
+	qmi_test_create_nas(&qt, bench_load);
+
+	qt.expected = LOAD_BENCH_INDICATIONS;
+
+	g_test_timer_start();
+
+	qmimodem_test_server_start_load(qt.server, QMI_SERVICE_NAS,
+					TEST_NAS_CLIENT, QMI_NAS_SS_INFO_IND,
+					ss_info_tlvs, sizeof(ss_info_tlvs),
+					LOAD_BENCH_RATE, qt.expected,
+					NULL, NULL);
+	g_main_loop_run(qt.loop);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(qt.notified == qt.expected);
+
+	stats = qmimodem_test_server_get_stats(qt.server);
+
+	g_test_minimized_result(elapsed, "%u indications in %f s",
+						qt.expected, elapsed);
+	g_test_message("%.0f indications/s, latency avg %" G_GINT64_FORMAT
+			" us max %" G_GINT64_FORMAT " us, %u deferred",
+			qt.expected / elapsed,
+			qt.latency_total / qt.expected, qt.latency_max,
+			stats->load_deferred);
+
+	qmi_test_teardown(&qt);
+}
+
+#define PIPELINE_REQUESTS	10
+#define PIPELINE_DEPTH		3
+
+struct pipeline_request {
+	struct qmi_test *qt;
+	unsigned int index;
+};
+
+static void pipeline_cb(struct qmi_result *result, void *user_data)
+{
+	struct pipeline_request *req = user_data;
+
+	g_assert(!qmi_result_set_error(result, NULL));
+
+	/* Responses come back in the order the requests were sent */
+	g_assert(req->qt->notified == req->index);
+
+	req->qt->notified += 1;
+}
+
+static void count_cb(struct qmi_result *result, void *user_data)
+{
+	struct qmi_test *qt = user_data;
+
+	qt->notified += 1;
+}
+
+static void test_pipelined_requests(void)
+{
+	struct pipeline_request reqs[PIPELINE_REQUESTS];
+	const struct qmimodem_test_stats *stats;
+	struct qmi_test qt;
+	uint16_t ids[PIPELINE_DEPTH + 1];
+	unsigned int i;
+
+	qmi_test_setup(&qt);
+	qmi_test_create_nas(&qt, check_ss_info);
+
+	g_assert(qmi_service_set_max_in_flight(qt.nas, PIPELINE_DEPTH));
+
+	stats = qmimodem_test_server_get_stats(qt.server);
+	qmimodem_test_server_set_hold(qt.server, TRUE);
+
+	for (i = 0; i < PIPELINE_REQUESTS; i++) {
+		reqs[i].qt = &qt;
+		reqs[i].index = i;
+
+		g_assert(qmi_service_send(qt.nas, QMI_NAS_GET_SS_INFO, NULL,
+					pipeline_cb, &reqs[i], NULL) > 0);
+	}
+
+	while (qt.notified < PIPELINE_REQUESTS) {
+		flush_events();
+
+		g_assert(qmimodem_test_server_get_held(qt.server) ==
+					MIN(PIPELINE_DEPTH,
+					PIPELINE_REQUESTS - qt.notified));
+
+		qmimodem_test_server_release_held(qt.server);
+		flush_events();
+	}
+
+	g_assert(stats->max_outstanding == PIPELINE_DEPTH);
+
+	/* Cancelling a request in flight frees its slot */
+	qt.notified = 0;
+
+	for (i = 0; i < PIPELINE_DEPTH + 1; i++)
+		ids[i] = qmi_service_send(qt.nas, QMI_NAS_GET_SS_INFO, NULL,
+							count_cb, &qt, NULL);
+
+	flush_events();
+	g_assert(qmimodem_test_server_get_held(qt.server) == PIPELINE_DEPTH);
+
+	g_assert(qmi_service_cancel(qt.nas, ids[0]));
+
+	flush_events();
+	g_assert(qmimodem_test_server_get_held(qt.server) ==
+							PIPELINE_DEPTH + 1);
+
+	qmimodem_test_server_release_held(qt.server);
+	flush_events();
+
+	g_assert(qt.notified == PIPELINE_DEPTH);
+
+	qmi_test_teardown(&qt);
+}
+
+static void service_created(struct qmi_service *service, void *user_data)
+{
+	struct qmi_service **slot = user_data;
+
+	g_assert(service != NULL);
+
+	*slot = qmi_service_ref(service);
+}
+
+static void test_parallel_create(void)
+{
+	const struct qmimodem_test_stats *stats;
+	struct qmi_service *services[5];
+	struct qmi_test qt;
+	uint16_t major, minor;
+	unsigned int i;
+
+	qmi_test_setup(&qt);
+
+	memset(services, 0, sizeof(services));
+
+	/* All of these are issued before the version list is known */
+	for (i = 0; i < 3; i++)
+		g_assert(qmi_service_create_shared(qt.device, QMI_SERVICE_NAS,
+					service_created, &services[i], NULL));
+
+	g_assert(qmi_service_create(qt.device, QMI_SERVICE_WDS,
+					service_created, &services[3], NULL));
+	g_assert(qmi_service_create_shared(qt.device, QMI_SERVICE_DMS,
+					service_created, &services[4], NULL));
+
+	for (i = 0; i < G_N_ELEMENTS(services); i++)
+		while (!services[i])
+			g_main_context_iteration(NULL, TRUE);
+
+	stats = qmimodem_test_server_get_stats(qt.server);
+	g_assert(stats->version_requests == 1);
+	g_assert(stats->allocated == 3);
+
+	g_assert(services[0] == services[1]);
+	g_assert(services[0] == services[2]);
+
+	g_assert(qmi_service_get_version(services[3], &major, &minor));
+	g_assert(major == 1 && minor == 12);
+
+	for (i = 0; i < G_N_ELEMENTS(services); i++)
+		qmi_service_unref(services[i]);
+
+	qmi_test_teardown(&qt);
+}
+
+/*
+ * Roughly what enabling a Gobi modem and probing its atoms puts on the
+ * wire: one discovery, a client for each service and a handful of
+ * initial queries per client.  The simulated modem answers every
+ * message after a fixed delay.
+ */
+#define ENABLE_LATENCY		2
+#define ENABLE_QUERIES		4
+
+static const uint8_t enable_services[] = {
+	QMI_SERVICE_DMS, QMI_SERVICE_NAS, QMI_SERVICE_WMS,
+	QMI_SERVICE_WDS, QMI_SERVICE_UIM, QMI_SERVICE_PDS,
+};
+
+struct enable_bench {
+	struct qmi_test *qt;
+	unsigned int max_in_flight;
+	struct qmi_service *services[G_N_ELEMENTS(enable_services)];
+	unsigned int created;
+	unsigned int pending;
+};
+
+static void enable_query_cb(struct qmi_result *result, void *user_data)
+{
+	struct enable_bench *eb = user_data;
+
+	g_assert(!qmi_result_set_error(result, NULL));
+
+	if (--eb->pending == 0)
+		g_main_loop_quit(eb->qt->loop);
+}
+
+static void enable_created(struct qmi_service *service, void *user_data)
+{
+	struct enable_bench *eb = user_data;
+	unsigned int i;
+
+	g_assert(service != NULL);
+
+	eb->services[eb->created++] = qmi_service_ref(service);
+
+	if (eb->max_in_flight)
+		qmi_service_set_max_in_flight(service, eb->max_in_flight);
+
+	for (i = 0; i < ENABLE_QUERIES; i++)
+		g_assert(qmi_service_send(service, 0x0020 + i, NULL,
+					enable_query_cb, eb, NULL) > 0);
+}
+
+static void test_enable_benchmark(gconstpointer data)
+{
+	struct enable_bench eb;
+	struct qmi_test qt;
+	double elapsed;
+	unsigned int i;
+
+	qmi_test_setup(&qt);
+
+	qmimodem_test_server_set_latency(qt.server, ENABLE_LATENCY);
+
+	memset(&eb, 0, sizeof(eb));
+	eb.qt = &qt;
+	eb.max_in_flight = GPOINTER_TO_UINT(data);
+	eb.pending = G_N_ELEMENTS(enable_services) * ENABLE_QUERIES;
+
+	g_test_timer_start();
+
+	for (i = 0; i < G_N_ELEMENTS(enable_services); i++)
+		g_assert(qmi_service_create(qt.device, enable_services[i],
+						enable_created, &eb, NULL));
+
+	g_main_loop_run(qt.loop);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(eb.created == G_N_ELEMENTS(enable_services));
+
+	g_test_minimized_result(elapsed, "enabled %u services in %f s",
+							eb.created, elapsed);
+
+	for (i = 0; i < eb.created; i++)
+		qmi_service_unref(eb.services[i]);
+
+	qmi_test_teardown(&qt);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testqmi/Indication TLV lookup",
+				test_indication_lookup);
+
+	g_test_add_func("/testqmi/Truncated TLV", test_truncated_tlv);
+
+	g_test_add_func("/testqmi/Scripted responses",
+				test_scripted_responses);
+
+	g_test_add_func("/testqmi/Pipelined requests",
+				test_pipelined_requests);
+
+	g_test_add_func("/testqmi/Parallel client allocation",
+				test_parallel_create);
+
+	if (g_test_perf()) {
+		g_test_add_func("/testqmi/Indication Lookup Benchmark",
+					test_lookup_benchmark);
+
+		g_test_add_func("/testqmi/Indication Load Benchmark",
+					test_load_benchmark);
+
+		/* One request per client at a time versus the default */
+		g_test_add_data_func("/testqmi/Enable Benchmark serial",
+					GUINT_TO_POINTER(1),
+					test_enable_benchmark);
+		g_test_add_data_func("/testqmi/Enable Benchmark",
+					GUINT_TO_POINTER(0),
+					test_enable_benchmark);
+	}
+
+	return g_test_run();
+}
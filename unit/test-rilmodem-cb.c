@@ -544,9 +544,8 @@ static void test_call_barring_func(gconstpointer data)
 
 	cbdriver->remove(rsd->cb);
 	g_ril_unref(rsd->ril);
-	g_free(rsd);
-
 	rilmodem_test_server_close(rsd->serverd);
+	g_free(rsd);
 
 	ril_call_barring_exit();
 }
@@ -569,9 +569,8 @@ static void test_cf_func(gconstpointer data)
 
 	cfdriver->remove(rcd->cf);
 	g_ril_unref(rcd->ril);
-	g_free(rcd);
-
 	rilmodem_test_server_close(rcd->serverd);
+	g_free(rcd);
 
 	ril_call_forwarding_exit();
 }
@@ -491,9 +491,8 @@ static void test_cs_func(gconstpointer data)
 
 	csdriver->remove(rcd->cs);
 	g_ril_unref(rcd->ril);
-	g_free(rcd);
-
 	rilmodem_test_server_close(rcd->serverd);
+	g_free(rcd);
 
 	ril_call_settings_exit();
 }
@@ -309,9 +309,8 @@ static void test_devinfo_socket(gconstpointer data)
 	devinfo_drv->remove(rdid->devinfo);
 	g_free(rdid->devinfo);
 	g_ril_unref(rdid->ril);
-	g_free(rdid);
-
 	rilmodem_test_server_close(rdid->serverd);
+	g_free(rdid);
 
 	ril_devinfo_exit();
 }
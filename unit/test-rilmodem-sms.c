@@ -540,9 +540,8 @@ static void test_sms_func(gconstpointer data)
 
 	smsdriver->remove(rsd->sms);
 	g_ril_unref(rsd->ril);
-	g_free(rsd);
-
 	rilmodem_test_server_close(rsd->serverd);
+	g_free(rsd);
 
 	ril_sms_exit();
 }
@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <glib/gprintf.h>
@@ -88,7 +89,7 @@ static void test_serialize_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -115,12 +116,257 @@ static void test_serialize_assembly(void)
 	sms_assembly_free(assembly);
 }
 
+static void add_assembly_pdu(struct sms_assembly *assembly,
+				const char *hex, int tpdu_len, GSList **l)
+{
+	unsigned char pdu[176];
+	long pdu_len;
+	struct sms sms;
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+
+	decode_hex_own_buf(hex, -1, &pdu_len, 0, pdu);
+	g_assert(sms_decode(pdu, pdu_len, FALSE, tpdu_len, &sms));
+	g_assert(sms_extract_concatenation(&sms, &ref, &max, &seq));
+
+	*l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
+					&sms.deliver.oaddr, ref, max, seq);
+}
+
+static void test_serialize_assembly_last(void)
+{
+	struct sms_assembly *assembly = sms_assembly_new("1234");
+	GSList *l;
+
+	/* The final fragment arrives early and has to survive a reload */
+	add_assembly_pdu(assembly, assembly_pdu3, assembly_pdu_len3, &l);
+	g_assert(l == NULL);
+
+	add_assembly_pdu(assembly, assembly_pdu1, assembly_pdu_len1, &l);
+	g_assert(l == NULL);
+
+	/* Loading compacts the journal, the second reload reads that */
+	sms_assembly_free(assembly);
+	assembly = sms_assembly_new("1234");
+	g_assert(assembly->num_fragments == 2);
+
+	sms_assembly_free(assembly);
+	assembly = sms_assembly_new("1234");
+	g_assert(assembly->num_fragments == 2);
+
+	add_assembly_pdu(assembly, assembly_pdu2, assembly_pdu_len2, &l);
+	g_assert(l != NULL);
+	g_assert(g_slist_length(l) == 3);
+
+	g_slist_free_full(l, g_free);
+	sms_assembly_free(assembly);
+}
+
+static void test_serialize_sr_assembly(void)
+{
+	struct status_report_assembly *sra = status_report_assembly_new("1234");
+	unsigned char msgid1[SMS_MSGID_LEN] = { 1 };
+	unsigned char msgid2[SMS_MSGID_LEN] = { 2 };
+	unsigned char id[SMS_MSGID_LEN];
+	struct sms_address addr;
+	struct sms sr;
+	gboolean delivered;
+
+	sms_address_from_string(&addr, "+4915259911630");
+
+	status_report_assembly_add_fragment(sra, msgid1, &addr, 4,
+						time(NULL), 2);
+	status_report_assembly_add_fragment(sra, msgid1, &addr, 5,
+						time(NULL), 2);
+	status_report_assembly_add_fragment(sra, msgid2, &addr, 6,
+						time(NULL), 1);
+
+	memset(&sr, 0, sizeof(sr));
+	sr.type = SMS_TYPE_STATUS_REPORT;
+	sr.status_report.raddr = addr;
+	sr.status_report.st = SMS_ST_COMPLETED_RECEIVED;
+	sr.status_report.mr = 6;
+
+	g_assert(status_report_assembly_report(sra, &sr, id, &delivered));
+	g_assert(memcmp(id, msgid2, SMS_MSGID_LEN) == 0);
+
+	sr.status_report.mr = 4;
+	g_assert(!status_report_assembly_report(sra, &sr, id, &delivered));
+
+	status_report_assembly_free(sra);
+
+	/* Only the first message, with mr 5 outstanding, is restored */
+	sra = status_report_assembly_new("1234");
+	g_assert(g_hash_table_size(sra->assembly_table) == 1);
+
+	sr.status_report.mr = 6;
+	g_assert(!status_report_assembly_report(sra, &sr, id, &delivered));
+
+	sr.status_report.mr = 5;
+	g_assert(status_report_assembly_report(sra, &sr, id, &delivered));
+	g_assert(memcmp(id, msgid1, SMS_MSGID_LEN) == 0);
+	g_assert(delivered == TRUE);
+
+	status_report_assembly_free(sra);
+
+	sra = status_report_assembly_new("1234");
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+	status_report_assembly_free(sra);
+}
+
+#define SR_JOURNAL STORAGEDIR "/1234/sms_sr/journal"
+
+static void test_serialize_sr_torn_journal(void)
+{
+	struct status_report_assembly *sra = status_report_assembly_new("1234");
+	unsigned char msgid1[SMS_MSGID_LEN] = { 1 };
+	unsigned char msgid2[SMS_MSGID_LEN] = { 2 };
+	unsigned char msgid3[SMS_MSGID_LEN] = { 3 };
+	unsigned char id[SMS_MSGID_LEN];
+	struct sms_address addr;
+	struct stat st;
+	struct sms sr;
+	gboolean delivered;
+
+	sms_address_from_string(&addr, "+4915259911630");
+
+	status_report_assembly_add_fragment(sra, msgid1, &addr, 4,
+						time(NULL), 1);
+	status_report_assembly_add_fragment(sra, msgid2, &addr, 5,
+						time(NULL), 1);
+	status_report_assembly_free(sra);
+
+	/* A crash tore the record of the second message */
+	g_assert(stat(SR_JOURNAL, &st) == 0);
+	g_assert(truncate(SR_JOURNAL, st.st_size - 3) == 0);
+
+	sra = status_report_assembly_new("1234");
+	g_assert(g_hash_table_size(sra->assembly_table) == 1);
+
+	/* Appended after the torn record, has to survive a reload */
+	status_report_assembly_add_fragment(sra, msgid3, &addr, 6,
+						time(NULL), 1);
+	status_report_assembly_free(sra);
+
+	sra = status_report_assembly_new("1234");
+	g_assert(g_hash_table_size(sra->assembly_table) == 1);
+
+	memset(&sr, 0, sizeof(sr));
+	sr.type = SMS_TYPE_STATUS_REPORT;
+	sr.status_report.raddr = addr;
+	sr.status_report.st = SMS_ST_COMPLETED_RECEIVED;
+
+	sr.status_report.mr = 4;
+	g_assert(status_report_assembly_report(sra, &sr, id, &delivered));
+	g_assert(memcmp(id, msgid1, SMS_MSGID_LEN) == 0);
+
+	sr.status_report.mr = 6;
+	g_assert(status_report_assembly_report(sra, &sr, id, &delivered));
+	g_assert(memcmp(id, msgid3, SMS_MSGID_LEN) == 0);
+	g_assert(delivered == TRUE);
+
+	status_report_assembly_free(sra);
+}
+
+static void tx_store_list(struct sms_tx_journal *journal, unsigned long id,
+				const unsigned char *uuid, GSList *list)
+{
+	unsigned char pdu[176];
+	int pdu_len, tpdu_len;
+	guint8 seq;
+
+	for (seq = 0; list; list = list->next, seq++) {
+		g_assert(sms_encode(list->data, &pdu_len, &tpdu_len, pdu));
+		g_assert(sms_tx_backup_store(journal, id, 0, uuid, seq,
+						pdu, pdu_len, tpdu_len));
+	}
+}
+
+static void tx_queue_free(GQueue *queue)
+{
+	struct txq_backup_entry *entry;
+
+	while ((entry = g_queue_pop_head(queue))) {
+		g_slist_free_full(entry->msg_list, g_free);
+		g_free(entry);
+	}
+
+	g_queue_free(queue);
+}
+
+static void test_serialize_tx_queue(void)
+{
+	struct sms_tx_journal *journal = sms_tx_journal_new("1234");
+	unsigned char uuid1[SMS_MSGID_LEN] = { 1 };
+	unsigned char uuid2[SMS_MSGID_LEN] = { 2 };
+	struct txq_backup_entry *entry;
+	GSList *short_msg, *long_msg;
+	char *long_text;
+	GQueue *queue;
+
+	long_text = g_strnfill(200, 'a');
+	short_msg = sms_text_prepare("+4915259911630", "Hello", 0,
+					FALSE, FALSE);
+	long_msg = sms_text_prepare("+4915259911630", long_text, 1,
+					FALSE, FALSE);
+	g_free(long_text);
+
+	g_assert(g_slist_length(long_msg) == 2);
+
+	queue = sms_tx_queue_load(journal);
+	g_assert(g_queue_get_length(queue) == 0);
+	tx_queue_free(queue);
+
+	tx_store_list(journal, 0, uuid1, short_msg);
+	tx_store_list(journal, 1, uuid2, long_msg);
+
+	/* First fragment of the second message went out */
+	sms_tx_backup_remove(journal, 1, 0);
+	sms_tx_journal_free(journal);
+
+	journal = sms_tx_journal_new("1234");
+	queue = sms_tx_queue_load(journal);
+	g_assert(g_queue_get_length(queue) == 2);
+
+	entry = g_queue_peek_head(queue);
+	g_assert(memcmp(entry->uuid, uuid1, SMS_MSGID_LEN) == 0);
+	g_assert(g_slist_length(entry->msg_list) == 1);
+
+	entry = g_queue_peek_tail(queue);
+	g_assert(memcmp(entry->uuid, uuid2, SMS_MSGID_LEN) == 0);
+	g_assert(g_slist_length(entry->msg_list) == 1);
+
+	tx_queue_free(queue);
+
+	sms_tx_backup_free(journal, 0);
+	sms_tx_backup_free(journal, 1);
+	sms_tx_journal_free(journal);
+
+	journal = sms_tx_journal_new("1234");
+	queue = sms_tx_queue_load(journal);
+	g_assert(g_queue_get_length(queue) == 0);
+	tx_queue_free(queue);
+	sms_tx_journal_free(journal);
+
+	g_slist_free_full(short_msg, g_free);
+	g_slist_free_full(long_msg, g_free);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/testsms/Test SMS Assembly Serialize",
 			test_serialize_assembly);
+	g_test_add_func("/testsms/Test SMS Assembly Serialize Last",
+			test_serialize_assembly_last);
+	g_test_add_func("/testsms/Test SR Assembly Serialize",
+			test_serialize_sr_assembly);
+	g_test_add_func("/testsms/Test SR Torn Journal",
+			test_serialize_sr_torn_journal);
+	g_test_add_func("/testsms/Test TX Queue Serialize",
+			test_serialize_tx_queue);
 
 	return g_test_run();
 }
@@ -1100,17 +1100,17 @@ static void test_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1155,6 +1155,62 @@ static void test_assembly(void)
 	g_free(reencoded);
 }
 
+static void test_assembly_limit(void)
+{
+	unsigned char pdu[176];
+	long pdu_len;
+	struct sms sms;
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	struct sms_assembly_node *node;
+	time_t now = time(NULL);
+	guint16 ref;
+	GSList *l;
+
+	decode_hex_own_buf(assembly_pdu1, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len1, &sms);
+
+	sms_assembly_set_max_fragments(assembly, 4);
+
+	for (ref = 0; ref < 6; ref++) {
+		l = sms_assembly_add_fragment(assembly, &sms, now + ref,
+						&sms.deliver.oaddr, ref, 3, 1);
+		g_assert(l == NULL);
+	}
+
+	/* The two oldest messages have been evicted */
+	g_assert(g_hash_table_size(assembly->assembly_table) == 4);
+	g_assert(assembly->num_fragments == 4);
+
+	node = g_queue_peek_tail(&assembly->lru_queue);
+	g_assert(node->ref == 2);
+
+	/* Touching a message makes it the most recently used one */
+	l = sms_assembly_add_fragment(assembly, &sms, now + 10,
+					&sms.deliver.oaddr, 2, 3, 2);
+	g_assert(l == NULL);
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 3);
+	g_assert(assembly->num_fragments == 4);
+
+	node = g_queue_peek_head(&assembly->lru_queue);
+	g_assert(node->ref == 2);
+	g_assert(node->num_fragments == 2);
+
+	node = g_queue_peek_tail(&assembly->lru_queue);
+	g_assert(node->ref == 4);
+
+	/* Expiry goes by the time the first fragment was received */
+	sms_assembly_expire(assembly, now + 4);
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+	g_assert(assembly->num_fragments == 1);
+
+	node = g_queue_peek_head(&assembly->expire_queue);
+	g_assert(node->ref == 5);
+
+	sms_assembly_free(assembly);
+}
+
 static const char *test_no_fragmentation_7bit = "This is testing !";
 static const char *expected_no_fragmentation_7bit = "079153485002020911000C915"
 			"348870420140000A71154747A0E4ACF41F4F29C9E769F4121";
@@ -1478,7 +1534,7 @@ static void test_cbs_assembly(void)
 	/* Add an initial page to the assembly */
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 1);
 	g_slist_foreach(l, (GFunc)g_free, NULL);
 	g_slist_free(l);
 
@@ -1486,7 +1542,7 @@ static void test_cbs_assembly(void)
 	dec1.update_number = 8;
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 1);
 	g_slist_foreach(l, (GFunc)g_free, NULL);
 	g_slist_free(l);
 
@@ -1500,7 +1556,7 @@ static void test_cbs_assembly(void)
 	g_assert(l == NULL);
 
 	cbs_assembly_location_changed(assembly, TRUE, TRUE, TRUE);
-	g_assert(assembly->recv_cell == NULL);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 0);
 
 	dec1.update_number = 9;
 	dec1.page = 3;
@@ -1515,6 +1571,11 @@ static void test_cbs_assembly(void)
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l == NULL);
 
+	/* Repeated pages are ignored */
+	l = cbs_assembly_add_page(assembly, &dec1);
+	g_assert(l == NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
 	dec1.page = 1;
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
@@ -1540,6 +1601,63 @@ static void test_cbs_assembly(void)
 	cbs_assembly_free(assembly);
 }
 
+static void test_cbs_datagram(void)
+{
+	static const guint8 udh[] = { 0x06, 0x05, 0x04, 0x0b, 0x84, 0x23, 0xf0 };
+	struct cbs_assembly *assembly;
+	struct cbs page;
+	unsigned char *buf;
+	gboolean udhi;
+	enum sms_charset charset;
+	gboolean is_8bit;
+	int dst, src;
+	long len;
+	GSList *l;
+	int i;
+
+	memset(&page, 0, sizeof(page));
+	page.gs = CBS_GEO_SCOPE_PLMN;
+	page.message_identifier = 4400;
+	page.dcs = 0x94;
+	page.max_pages = 2;
+	memcpy(page.ud, udh, sizeof(udh));
+
+	g_assert(cbs_dcs_decode(page.dcs, &udhi, NULL, &charset,
+					NULL, NULL, NULL));
+	g_assert(udhi == TRUE);
+	g_assert(charset == SMS_CHARSET_8BIT);
+
+	g_assert(cbs_extract_app_port(&page, &dst, &src, &is_8bit));
+	g_assert(dst == 2948);
+	g_assert(src == 9200);
+	g_assert(is_8bit == FALSE);
+
+	assembly = cbs_assembly_new();
+
+	/* Send the second page first, the payload must still be in order */
+	page.page = 2;
+	memset(page.ud + sizeof(udh), 2, 82 - sizeof(udh));
+	g_assert(cbs_assembly_add_page(assembly, &page) == NULL);
+
+	page.page = 1;
+	memset(page.ud + sizeof(udh), 1, 82 - sizeof(udh));
+	l = cbs_assembly_add_page(assembly, &page);
+	g_assert(g_slist_length(l) == 2);
+
+	buf = cbs_decode_datagram(l, &len);
+	g_assert(buf);
+	g_assert(len == 2 * (82 - (long) sizeof(udh)));
+
+	for (i = 0; i < len; i++)
+		g_assert(buf[i] == (i < len / 2 ? 1 : 2));
+
+	g_free(buf);
+	g_slist_foreach(l, (GFunc)g_free, NULL);
+	g_slist_free(l);
+
+	cbs_assembly_free(assembly);
+}
+
 static void test_cbs_padding_character(void)
 {
 	unsigned char *decoded_pdu;
@@ -1631,6 +1749,45 @@ static void test_range_minimizer(void)
 	}
 }
 
+static void test_topic_bitmap(void)
+{
+	struct cbs_topic_range edges[] = {
+		{ 0, 0 }, { 31, 33 }, { 4352, 4356 }, { 65504, 65535 },
+	};
+	guint32 bitmap[CBS_TOPIC_BITMAP_WORDS];
+	GSList *r;
+	unsigned int topic;
+	unsigned int i;
+
+	for (i = 0; ranges[i]; i++) {
+		r = cbs_extract_topic_ranges(ranges[i]);
+
+		cbs_topic_bitmap_set_ranges(bitmap, r);
+
+		for (topic = 0; topic < 65536; topic++)
+			g_assert(cbs_topic_bitmap_test(bitmap, topic) ==
+					cbs_topic_in_range(topic, r));
+
+		g_slist_foreach(r, (GFunc)g_free, NULL);
+		g_slist_free(r);
+	}
+
+	for (i = 0, r = NULL; i < G_N_ELEMENTS(edges); i++)
+		r = g_slist_prepend(r, &edges[i]);
+
+	cbs_topic_bitmap_set_ranges(bitmap, r);
+
+	for (topic = 0; topic < 65536; topic++)
+		g_assert(cbs_topic_bitmap_test(bitmap, topic) ==
+				cbs_topic_in_range(topic, r));
+
+	g_slist_free(r);
+
+	cbs_topic_bitmap_set_ranges(bitmap, NULL);
+	g_assert(!cbs_topic_bitmap_test(bitmap, 0));
+	g_assert(!cbs_topic_bitmap_test(bitmap, 4352));
+}
+
 static void test_sr_assembly(void)
 {
 	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
@@ -1729,6 +1886,85 @@ static void test_sr_assembly(void)
 	status_report_assembly_free(sra);
 }
 
+#define SR_BENCH_ADDRESSES 100
+#define SR_BENCH_REPORTS 10000
+
+static void test_sr_assembly_benchmark(void)
+{
+	struct status_report_assembly *sra;
+	struct sms_address addr[SR_BENCH_ADDRESSES];
+	unsigned char msgid[SMS_MSGID_LEN];
+	unsigned char id[SMS_MSGID_LEN];
+	struct sms sr;
+	gboolean delivered;
+	time_t now = time(NULL);
+	double elapsed;
+	int i;
+
+	for (i = 0; i < SR_BENCH_ADDRESSES; i++) {
+		char number[16];
+
+		sprintf(number, "+49152%08d", i);
+		sms_address_from_string(&addr[i], number);
+	}
+
+	memset(msgid, 0, sizeof(msgid));
+	sra = status_report_assembly_new(NULL);
+
+	g_test_timer_start();
+
+	for (i = 0; i < SR_BENCH_REPORTS; i++) {
+		memcpy(msgid, &i, sizeof(i));
+		status_report_assembly_add_fragment(sra, msgid,
+					&addr[i % SR_BENCH_ADDRESSES],
+					i / SR_BENCH_ADDRESSES, now, 1);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "add: %d reports in %f s",
+				SR_BENCH_REPORTS, elapsed);
+
+	memset(&sr, 0, sizeof(sr));
+	sr.type = SMS_TYPE_STATUS_REPORT;
+	sr.status_report.st = SMS_ST_COMPLETED_RECEIVED;
+
+	g_test_timer_start();
+
+	for (i = 0; i < SR_BENCH_REPORTS; i++) {
+		sr.status_report.raddr = addr[i % SR_BENCH_ADDRESSES];
+		sr.status_report.mr = i / SR_BENCH_ADDRESSES;
+
+		g_assert(status_report_assembly_report(sra, &sr, id,
+							&delivered));
+		g_assert(memcmp(id, &i, sizeof(i)) == 0);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "report: %d reports in %f s",
+				SR_BENCH_REPORTS, elapsed);
+
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	for (i = 0; i < SR_BENCH_REPORTS; i++) {
+		memcpy(msgid, &i, sizeof(i));
+		status_report_assembly_add_fragment(sra, msgid,
+					&addr[i % SR_BENCH_ADDRESSES],
+					i / SR_BENCH_ADDRESSES, now + i, 1);
+	}
+
+	g_test_timer_start();
+
+	status_report_assembly_expire(sra, now + SR_BENCH_REPORTS);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "expire: %d reports in %f s",
+				SR_BENCH_REPORTS, elapsed);
+
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	status_report_assembly_free(sra);
+}
+
 struct wap_push_data {
 	const char *pdu;
 	int len;
@@ -1812,6 +2048,86 @@ static void test_wap_push(gconstpointer data)
 	g_slist_free(list);
 }
 
+static struct wap_push_data sms_view_simple = {
+	.pdu = "07911326040000F0040B911346610089F60000208062917314480CC8F71D"
+		"14969741F977FD07",
+	.len = 30,
+};
+
+static struct wap_push_data sms_view_alnum = {
+	.pdu = "0791447758100650040DD0F334FC1CA6970100008080312170224008D4F2"
+		"9CDE0EA7D9",
+	.len = 27,
+};
+
+static void test_sms_view(gconstpointer data)
+{
+	const struct wap_push_data *test = data;
+	struct sms_view view;
+	struct sms sms;
+	struct sms from_view;
+	unsigned char *decoded_pdu;
+	long pdu_len;
+	int i;
+
+	decoded_pdu = decode_hex(test->pdu, -1, &pdu_len, 0);
+	g_assert(decoded_pdu);
+
+	g_assert(sms_view_init(&view, decoded_pdu, pdu_len, test->len));
+	g_assert(sms_decode(decoded_pdu, pdu_len, FALSE, test->len, &sms));
+	g_assert(sms.type == SMS_TYPE_DELIVER);
+
+	g_assert(view.pid == sms.deliver.pid);
+	g_assert(view.dcs == sms.deliver.dcs);
+	g_assert(view.udl == sms.deliver.udl);
+	g_assert(view.ud_len == sms_udl_in_bytes(sms.deliver.udl,
+							sms.deliver.dcs));
+	g_assert(memcmp(view.tpdu + view.ud_offset, sms.deliver.ud,
+				view.ud_len) == 0);
+
+	g_assert(sms_view_to_sms(&view, &from_view));
+	g_assert(memcmp(&from_view, &sms, sizeof(sms)) == 0);
+
+	/* Truncated PDUs must never validate */
+	for (i = 1; i < test->len; i++)
+		g_assert(!sms_view_init(&view, decoded_pdu,
+					pdu_len - test->len + i, i));
+
+	g_free(decoded_pdu);
+}
+
+static void test_sms_view_filter(void)
+{
+	struct sms_view view;
+	struct sms_udh_iter iter;
+	struct sms sms;
+	unsigned char *decoded_pdu;
+	long pdu_len;
+	int dst, src;
+	gboolean is_8bit;
+
+	/* Only SMS-DELIVER PDUs can be viewed */
+	decoded_pdu = decode_hex(simple_submit, -1, &pdu_len, 0);
+	g_assert(decoded_pdu);
+	g_assert(!sms_view_init(&view, decoded_pdu, pdu_len, 23));
+	g_free(decoded_pdu);
+
+	decoded_pdu = decode_hex(wap_push_1.pdu, -1, &pdu_len, 0);
+	g_assert(decoded_pdu);
+	g_assert(sms_view_init(&view, decoded_pdu, pdu_len, wap_push_1.len));
+
+	g_assert(sms_udh_iter_init_from_view(&view, &iter));
+	g_assert(sms_udh_iter_get_ie_type(&iter) ==
+					SMS_IEI_APPLICATION_ADDRESS_16BIT);
+
+	g_assert(sms_view_to_sms(&view, &sms));
+	g_assert(sms_extract_app_port(&sms, &dst, &src, &is_8bit));
+	g_assert(is_8bit == FALSE);
+	g_assert(dst == 2948);
+
+	g_free(decoded_pdu);
+}
+
 int main(int argc, char **argv)
 {
 	char long_string[152*33 + 1];
@@ -1860,6 +2176,7 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Limit", test_assembly_limit);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
@@ -1886,15 +2203,29 @@ int main(int argc, char **argv)
 			test_cbs_encode_decode);
 	g_test_add_func("/testsms/Test CBS Assembly", test_cbs_assembly);
 
+	g_test_add_func("/testsms/Test CBS Datagram", test_cbs_datagram);
 	g_test_add_func("/testsms/Test CBS Padding Character",
 			test_cbs_padding_character);
 
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
+	g_test_add_func("/testsms/Topic bitmap", test_topic_bitmap);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
 
+	if (g_test_perf())
+		g_test_add_func("/testsms/Status Report Assembly Benchmark",
+				test_sr_assembly_benchmark);
+
 	g_test_add_data_func("/testsms/Test WAP Push 1", &wap_push_1,
 				test_wap_push);
 
+	g_test_add_data_func("/testsms/Test View Simple Deliver",
+				&sms_view_simple, test_sms_view);
+	g_test_add_data_func("/testsms/Test View Alnum Deliver",
+				&sms_view_alnum, test_sms_view);
+	g_test_add_data_func("/testsms/Test View WAP Push", &wap_push_1,
+				test_sms_view);
+	g_test_add_func("/testsms/Test View Filter", test_sms_view_filter);
+
 	return g_test_run();
 }
@@ -22273,6 +22273,282 @@ static void test_img_to_xpm(gconstpointer data)
 	g_free(xpm);
 }
 
+struct stk_bench_pdu {
+	const unsigned char *pdu;
+	unsigned int len;
+};
+
+/* The proactive commands of stk-test-data.h */
+static const struct stk_bench_pdu stk_bench_pdus[] = {
+	{ display_text_111, sizeof(display_text_111) },
+	{ display_text_131, sizeof(display_text_131) },
+	{ display_text_141, sizeof(display_text_141) },
+	{ display_text_151, sizeof(display_text_151) },
+	{ display_text_161, sizeof(display_text_161) },
+	{ display_text_171, sizeof(display_text_171) },
+	{ display_text_181, sizeof(display_text_181) },
+	{ display_text_191, sizeof(display_text_191) },
+	{ display_text_211, sizeof(display_text_211) },
+	{ display_text_311, sizeof(display_text_311) },
+	{ display_text_411, sizeof(display_text_411) },
+	{ display_text_421, sizeof(display_text_421) },
+	{ display_text_431, sizeof(display_text_431) },
+	{ display_text_511, sizeof(display_text_511) },
+	{ display_text_521, sizeof(display_text_521) },
+	{ display_text_531, sizeof(display_text_531) },
+	{ display_text_611, sizeof(display_text_611) },
+	{ display_text_711, sizeof(display_text_711) },
+	{ display_text_811, sizeof(display_text_811) },
+	{ display_text_812, sizeof(display_text_812) },
+	{ display_text_821, sizeof(display_text_821) },
+	{ display_text_831, sizeof(display_text_831) },
+	{ display_text_841, sizeof(display_text_841) },
+	{ display_text_851, sizeof(display_text_851) },
+	{ display_text_861, sizeof(display_text_861) },
+	{ display_text_871, sizeof(display_text_871) },
+	{ display_text_881, sizeof(display_text_881) },
+	{ display_text_891, sizeof(display_text_891) },
+	{ display_text_8101, sizeof(display_text_8101) },
+	{ display_text_911, sizeof(display_text_911) },
+	{ display_text_1011, sizeof(display_text_1011) },
+	{ get_inkey_111, sizeof(get_inkey_111) },
+	{ get_inkey_121, sizeof(get_inkey_121) },
+	{ get_inkey_131, sizeof(get_inkey_131) },
+	{ get_inkey_141, sizeof(get_inkey_141) },
+	{ get_inkey_151, sizeof(get_inkey_151) },
+	{ get_inkey_161, sizeof(get_inkey_161) },
+	{ get_inkey_211, sizeof(get_inkey_211) },
+	{ get_inkey_311, sizeof(get_inkey_311) },
+	{ get_inkey_321, sizeof(get_inkey_321) },
+	{ get_inkey_411, sizeof(get_inkey_411) },
+	{ get_inkey_511, sizeof(get_inkey_511) },
+	{ get_inkey_512, sizeof(get_inkey_512) },
+	{ get_inkey_611, sizeof(get_inkey_611) },
+	{ get_inkey_621, sizeof(get_inkey_621) },
+	{ get_inkey_631, sizeof(get_inkey_631) },
+	{ get_inkey_641, sizeof(get_inkey_641) },
+	{ get_inkey_811, sizeof(get_inkey_811) },
+	{ get_inkey_911, sizeof(get_inkey_911) },
+	{ get_inkey_921, sizeof(get_inkey_921) },
+	{ get_inkey_931, sizeof(get_inkey_931) },
+	{ get_inkey_941, sizeof(get_inkey_941) },
+	{ get_inkey_951, sizeof(get_inkey_951) },
+	{ get_inkey_961, sizeof(get_inkey_961) },
+	{ get_inkey_971, sizeof(get_inkey_971) },
+	{ get_inkey_981, sizeof(get_inkey_981) },
+	{ get_inkey_991, sizeof(get_inkey_991) },
+	{ get_inkey_9101, sizeof(get_inkey_9101) },
+	{ get_inkey_1011, sizeof(get_inkey_1011) },
+	{ get_inkey_1021, sizeof(get_inkey_1021) },
+	{ get_inkey_1111, sizeof(get_inkey_1111) },
+	{ get_inkey_1211, sizeof(get_inkey_1211) },
+	{ get_inkey_1221, sizeof(get_inkey_1221) },
+	{ get_inkey_1311, sizeof(get_inkey_1311) },
+	{ get_input_111, sizeof(get_input_111) },
+	{ get_input_121, sizeof(get_input_121) },
+	{ get_input_131, sizeof(get_input_131) },
+	{ get_input_141, sizeof(get_input_141) },
+	{ get_input_151, sizeof(get_input_151) },
+	{ get_input_161, sizeof(get_input_161) },
+	{ get_input_171, sizeof(get_input_171) },
+	{ get_input_181, sizeof(get_input_181) },
+	{ get_input_191, sizeof(get_input_191) },
+	{ get_input_1101, sizeof(get_input_1101) },
+	{ get_input_211, sizeof(get_input_211) },
+	{ get_input_311, sizeof(get_input_311) },
+	{ get_input_321, sizeof(get_input_321) },
+	{ get_input_411, sizeof(get_input_411) },
+	{ get_input_421, sizeof(get_input_421) },
+	{ get_input_511, sizeof(get_input_511) },
+	{ get_input_521, sizeof(get_input_521) },
+	{ get_input_611, sizeof(get_input_611) },
+	{ get_input_621, sizeof(get_input_621) },
+	{ get_input_631, sizeof(get_input_631) },
+	{ get_input_641, sizeof(get_input_641) },
+	{ get_input_811, sizeof(get_input_811) },
+	{ get_input_821, sizeof(get_input_821) },
+	{ get_input_831, sizeof(get_input_831) },
+	{ get_input_841, sizeof(get_input_841) },
+	{ get_input_851, sizeof(get_input_851) },
+	{ get_input_861, sizeof(get_input_861) },
+	{ get_input_871, sizeof(get_input_871) },
+	{ get_input_881, sizeof(get_input_881) },
+	{ get_input_891, sizeof(get_input_891) },
+	{ get_input_8101, sizeof(get_input_8101) },
+	{ get_input_911, sizeof(get_input_911) },
+	{ get_input_921, sizeof(get_input_921) },
+	{ get_input_1011, sizeof(get_input_1011) },
+	{ get_input_1021, sizeof(get_input_1021) },
+	{ get_input_1111, sizeof(get_input_1111) },
+	{ get_input_1121, sizeof(get_input_1121) },
+	{ get_input_1211, sizeof(get_input_1211) },
+	{ get_input_1221, sizeof(get_input_1221) },
+	{ more_time_111, sizeof(more_time_111) },
+	{ play_tone_111, sizeof(play_tone_111) },
+	{ play_tone_112, sizeof(play_tone_112) },
+	{ play_tone_113, sizeof(play_tone_113) },
+	{ play_tone_114, sizeof(play_tone_114) },
+	{ play_tone_115, sizeof(play_tone_115) },
+	{ play_tone_116, sizeof(play_tone_116) },
+	{ play_tone_117, sizeof(play_tone_117) },
+	{ play_tone_118, sizeof(play_tone_118) },
+	{ play_tone_119, sizeof(play_tone_119) },
+	{ play_tone_1110, sizeof(play_tone_1110) },
+	{ play_tone_1111, sizeof(play_tone_1111) },
+	{ play_tone_1112, sizeof(play_tone_1112) },
+	{ play_tone_1113, sizeof(play_tone_1113) },
+	{ play_tone_1114, sizeof(play_tone_1114) },
+	{ play_tone_1115, sizeof(play_tone_1115) },
+	{ play_tone_211, sizeof(play_tone_211) },
+	{ play_tone_212, sizeof(play_tone_212) },
+	{ play_tone_213, sizeof(play_tone_213) },
+	{ play_tone_311, sizeof(play_tone_311) },
+	{ play_tone_321, sizeof(play_tone_321) },
+	{ play_tone_331, sizeof(play_tone_331) },
+	{ play_tone_341, sizeof(play_tone_341) },
+	{ play_tone_411, sizeof(play_tone_411) },
+	{ play_tone_412, sizeof(play_tone_412) },
+	{ play_tone_421, sizeof(play_tone_421) },
+	{ play_tone_422, sizeof(play_tone_422) },
+	{ play_tone_431, sizeof(play_tone_431) },
+	{ play_tone_432, sizeof(play_tone_432) },
+	{ play_tone_441, sizeof(play_tone_441) },
+	{ play_tone_442, sizeof(play_tone_442) },
+	{ play_tone_443, sizeof(play_tone_443) },
+	{ play_tone_451, sizeof(play_tone_451) },
+	{ play_tone_452, sizeof(play_tone_452) },
+	{ play_tone_453, sizeof(play_tone_453) },
+	{ play_tone_461, sizeof(play_tone_461) },
+	{ play_tone_462, sizeof(play_tone_462) },
+	{ play_tone_463, sizeof(play_tone_463) },
+	{ play_tone_471, sizeof(play_tone_471) },
+	{ play_tone_472, sizeof(play_tone_472) },
+	{ play_tone_473, sizeof(play_tone_473) },
+	{ play_tone_481, sizeof(play_tone_481) },
+	{ play_tone_482, sizeof(play_tone_482) },
+	{ play_tone_483, sizeof(play_tone_483) },
+	{ play_tone_491, sizeof(play_tone_491) },
+	{ play_tone_492, sizeof(play_tone_492) },
+	{ play_tone_493, sizeof(play_tone_493) },
+	{ play_tone_4101, sizeof(play_tone_4101) },
+	{ play_tone_4102, sizeof(play_tone_4102) },
+	{ play_tone_511, sizeof(play_tone_511) },
+	{ play_tone_512, sizeof(play_tone_512) },
+	{ play_tone_513, sizeof(play_tone_513) },
+	{ play_tone_611, sizeof(play_tone_611) },
+	{ play_tone_612, sizeof(play_tone_612) },
+	{ play_tone_613, sizeof(play_tone_613) },
+	{ poll_interval_111, sizeof(poll_interval_111) },
+};
+
+static void test_envelope_queue_priority(void)
+{
+	struct stk_envelope_queue *queue;
+	static const enum stk_envelope_class order[] = {
+		STK_ENVELOPE_CLASS_CBS,
+		STK_ENVELOPE_CLASS_TIMER,
+		STK_ENVELOPE_CLASS_CBS,
+		STK_ENVELOPE_CLASS_SMS_PP,
+		STK_ENVELOPE_CLASS_USER,
+		STK_ENVELOPE_CLASS_TIMER,
+		STK_ENVELOPE_CLASS_USER,
+	};
+	/* Indexes into order[], by class and then by arrival */
+	static const unsigned int expected[] = { 4, 6, 3, 1, 5, 0, 2 };
+	unsigned int i;
+
+	queue = stk_envelope_queue_new(NULL, NULL);
+	g_assert(stk_envelope_queue_pop(queue) == NULL);
+
+	for (i = 0; i < G_N_ELEMENTS(order); i++)
+		stk_envelope_queue_push(queue, order[i],
+						GUINT_TO_POINTER(i + 1));
+
+	g_assert(stk_envelope_queue_length(queue,
+					STK_ENVELOPE_CLASS_USER) == 2);
+	g_assert(stk_envelope_queue_length(queue,
+					STK_ENVELOPE_CLASS_CBS) == 2);
+
+	for (i = 0; i < G_N_ELEMENTS(expected); i++)
+		g_assert(stk_envelope_queue_pop(queue) ==
+					GUINT_TO_POINTER(expected[i] + 1));
+
+	g_assert(stk_envelope_queue_pop(queue) == NULL);
+
+	stk_envelope_queue_free(queue, NULL);
+}
+
+static void envelope_dropped(void *data, void *user_data)
+{
+	GSList **dropped = user_data;
+
+	*dropped = g_slist_append(*dropped, data);
+}
+
+static void test_envelope_queue_cbs_bound(void)
+{
+	struct stk_envelope_queue *queue;
+	GSList *dropped = NULL;
+	unsigned int total = STK_ENVELOPE_CBS_QUEUE_MAX + 4;
+	unsigned int i;
+
+	queue = stk_envelope_queue_new(envelope_dropped, &dropped);
+
+	stk_envelope_queue_push(queue, STK_ENVELOPE_CLASS_USER,
+						GUINT_TO_POINTER(1000));
+
+	for (i = 0; i < total; i++)
+		stk_envelope_queue_push(queue, STK_ENVELOPE_CLASS_CBS,
+						GUINT_TO_POINTER(i + 1));
+
+	/* The oldest pages are shed, other classes are never bounded */
+	g_assert(stk_envelope_queue_length(queue, STK_ENVELOPE_CLASS_CBS) ==
+						STK_ENVELOPE_CBS_QUEUE_MAX);
+	g_assert(g_slist_length(dropped) == total - STK_ENVELOPE_CBS_QUEUE_MAX);
+
+	for (i = 0; i < total - STK_ENVELOPE_CBS_QUEUE_MAX; i++)
+		g_assert(g_slist_nth_data(dropped, i) ==
+						GUINT_TO_POINTER(i + 1));
+
+	g_assert(stk_envelope_queue_pop(queue) == GUINT_TO_POINTER(1000));
+
+	for (i = total - STK_ENVELOPE_CBS_QUEUE_MAX; i < total; i++)
+		g_assert(stk_envelope_queue_pop(queue) ==
+						GUINT_TO_POINTER(i + 1));
+
+	g_assert(stk_envelope_queue_pop(queue) == NULL);
+
+	g_slist_free(dropped);
+	stk_envelope_queue_free(queue, NULL);
+}
+
+#define STK_BENCH_ROUNDS 2000
+
+static void test_parser_benchmark(void)
+{
+	unsigned int i, r;
+	double elapsed;
+
+	g_test_timer_start();
+
+	for (r = 0; r < STK_BENCH_ROUNDS; r++) {
+		for (i = 0; i < G_N_ELEMENTS(stk_bench_pdus); i++) {
+			struct stk_command *command;
+
+			command = stk_command_new_from_pdu(stk_bench_pdus[i].pdu,
+							stk_bench_pdus[i].len);
+			g_assert(command);
+			stk_command_free(command);
+		}
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "%u commands in %f s",
+				STK_BENCH_ROUNDS *
+				(unsigned int) G_N_ELEMENTS(stk_bench_pdus),
+				elapsed);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -24385,5 +24661,14 @@ int main(int argc, char **argv)
 	g_test_add_data_func("/teststk/IMG to XPM Test 6",
 				&xpm_test_6, test_img_to_xpm);
 
+	g_test_add_func("/teststk/Envelope Queue Priority",
+				test_envelope_queue_priority);
+	g_test_add_func("/teststk/Envelope Queue CBS Bound",
+				test_envelope_queue_cbs_bound);
+
+	if (g_test_perf())
+		g_test_add_func("/teststk/Parser Benchmark",
+					test_parser_benchmark);
+
 	return g_test_run();
 }
@@ -1012,6 +1012,100 @@ static void test_unicode_to_gsm(void)
 	}
 }
 
+static void test_hex_codec(void)
+{
+	unsigned char in[256];
+	unsigned char out[257];
+	char hex[513];
+	char ref[3];
+	unsigned char *decoded;
+	long written;
+	int len;
+	int i;
+
+	for (i = 0; i < 256; i++)
+		in[i] = i;
+
+	for (len = 0; len <= 256; len++) {
+		encode_hex_own_buf(in, len, 0, hex);
+		g_assert(strlen(hex) == (size_t) len * 2);
+
+		for (i = 0; i < len; i++) {
+			sprintf(ref, "%02X", in[i]);
+			g_assert(memcmp(ref, hex + i * 2, 2) == 0);
+		}
+
+		decoded = decode_hex_own_buf(hex, -1, &written, 0, out);
+		g_assert(decoded == out);
+		g_assert(written == len);
+		g_assert(memcmp(out, in, len) == 0);
+
+		/* Every single bad character must be rejected */
+		for (i = 0; i < len * 2; i++) {
+			char c = hex[i];
+
+			hex[i] = 'G';
+			g_assert(decode_hex_own_buf(hex, -1, &written, 0,
+							out) == NULL);
+			hex[i] = c;
+		}
+	}
+
+	decoded = decode_hex("0aBcDeF9", -1, &written, 0xff);
+	g_assert(decoded);
+	g_assert(written == 4);
+	g_assert(decoded[0] == 0x0a && decoded[1] == 0xbc);
+	g_assert(decoded[2] == 0xde && decoded[3] == 0xf9);
+	g_assert(decoded[4] == 0xff);
+	g_free(decoded);
+
+	/* Odd trailing digit is ignored, as before */
+	decoded = decode_hex("123", -1, &written, 0);
+	g_assert(decoded);
+	g_assert(written == 1);
+	g_assert(decoded[0] == 0x12);
+	g_free(decoded);
+
+	g_assert(decode_hex("12 4", -1, &written, 0) == NULL);
+	g_assert(decode_hex("1x", -1, &written, 0) == NULL);
+}
+
+#define HEX_BENCH_SIZE 176
+#define HEX_BENCH_ROUNDS 200000
+
+static void test_hex_benchmark(void)
+{
+	unsigned char in[HEX_BENCH_SIZE];
+	unsigned char out[HEX_BENCH_SIZE];
+	char hex[HEX_BENCH_SIZE * 2 + 1];
+	long written;
+	double elapsed;
+	int i;
+
+	for (i = 0; i < HEX_BENCH_SIZE; i++)
+		in[i] = i * 7;
+
+	g_test_timer_start();
+
+	for (i = 0; i < HEX_BENCH_ROUNDS; i++)
+		encode_hex_own_buf(in, HEX_BENCH_SIZE, 0, hex);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "encode_hex: %d x %d bytes in %f s",
+				HEX_BENCH_ROUNDS, HEX_BENCH_SIZE, elapsed);
+
+	g_test_timer_start();
+
+	for (i = 0; i < HEX_BENCH_ROUNDS; i++)
+		decode_hex_own_buf(hex, HEX_BENCH_SIZE * 2, &written, 0, out);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "decode_hex: %d x %d bytes in %f s",
+				HEX_BENCH_ROUNDS, HEX_BENCH_SIZE, elapsed);
+
+	g_assert(memcmp(in, out, HEX_BENCH_SIZE) == 0);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -1028,6 +1122,10 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/SIM conversions", test_sim);
 	g_test_add_func("/testutil/Valid Unicode to GSM Conversion",
 			test_unicode_to_gsm);
+	g_test_add_func("/testutil/Hex Encode Decode", test_hex_codec);
+
+	if (g_test_perf())
+		g_test_add_func("/testutil/Hex Benchmark", test_hex_benchmark);
 
 	return g_test_run();
 }